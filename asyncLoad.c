@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "asyncLoad.h"
+#include "loader.h"
+#include "meshCache.h"
+#include "meshNormals.h"
+#include "meshOptimize.h"
+#include "utils.h"
+
+static void push_loaded_mesh(MeshQueue *queue, LoadedMesh *loaded)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        if (queue->count < ASYNC_QUEUE_CAPACITY)
+        {
+            queue->items[(queue->head + queue->count) % ASYNC_QUEUE_CAPACITY] = loaded;
+            queue->count++;
+            pthread_mutex_unlock(&queue->lock);
+            return;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        // Full, the render thread takes one per frame at most
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+LoadedMesh *poll_async_load(AsyncLoader *loader)
+{
+    MeshQueue *queue = &loader->queue;
+    LoadedMesh *loaded = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0)
+    {
+        loaded = queue->items[queue->head];
+        queue->head = (queue->head + 1) % ASYNC_QUEUE_CAPACITY;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return loaded;
+}
+
+static void copy_mesh_arrays(const float *vertices, int vertex_count, const unsigned int *indices, int index_count, GpuMesh *mesh)
+{
+    mesh->vertex_count = vertex_count;
+    mesh->index_count = index_count;
+    mesh->vertices = malloc(((size_t)vertex_count + 1) * GPU_VERTEX_FLOATS * sizeof(float));
+    mesh->indices = malloc(((size_t)index_count + 1) * sizeof(unsigned int));
+    if (!mesh->vertices || !mesh->indices)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(mesh->vertices, vertices, (size_t)vertex_count * GPU_VERTEX_FLOATS * sizeof(float));
+    memcpy(mesh->indices, indices, (size_t)index_count * sizeof(unsigned int));
+}
+
+static void load_model(const AsyncLoader *loader, LoadedMesh *loaded)
+{
+    char objFilename[sizeof(loader->model_name) + 4], mtlFilename[sizeof(loader->model_name) + 4];
+    snprintf(objFilename, sizeof(objFilename), "%s.obj", loader->model_name);
+    snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", loader->model_name);
+
+    MeshCache cache;
+    if (load_mesh_cache(objFilename, mtlFilename, loader->cache_flags, &cache))
+    {
+        // The mapping could go straight to the sink, but the render thread
+        // would then hold it open for as long as the upload takes
+        copy_mesh_arrays(cache.vertices, cache.vertex_count, cache.indices, cache.index_count, &loaded->mesh);
+        close_mesh_cache(&cache);
+        loaded->from_cache = 1;
+        return;
+    }
+
+    Vertex *vertices = NULL;
+    TexCoord *texCoords = NULL;
+    Normal *normals = NULL;
+    Face *faces = NULL;
+    int vertex_count = 0, vertex_capacity = 0;
+    int texCoord_count = 0, texCoord_capacity = 0;
+    int normal_count = 0, normal_capacity = 0;
+    int face_count = 0, face_capacity = 0;
+
+    // The material table is this thread's own and goes away with it
+    read_mtl_file(mtlFilename);
+    if (loader->thread_count == 1)
+    {
+        read_obj_file(objFilename, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+    }
+    else
+    {
+        read_obj_file_parallel(objFilename, loader->thread_count, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+    }
+
+    repair_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, loader->thread_count, &normals, &normal_count, &normal_capacity);
+    // Sorted like the synchronous load does, so the cache serves both
+    MaterialRange *ranges = NULL;
+    int range_count = sort_faces_by_material(faces, face_count, &ranges);
+    build_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, &loaded->mesh);
+    free(vertices);
+    free(texCoords);
+    free(normals);
+    free(faces);
+
+    if (loader->cache_flags & MESH_CACHE_OPTIMIZED)
+    {
+        optimize_gpu_mesh(&loaded->mesh, ranges, range_count, NULL);
+    }
+    write_mesh_cache(objFilename, mtlFilename, loader->cache_flags | MESH_CACHE_MATERIAL_RANGES, &loaded->mesh, materials, material_count, ranges, range_count);
+    free(ranges);
+    free_materials();
+}
+
+static void *async_load_worker(void *argument)
+{
+    AsyncLoader *loader = (AsyncLoader *)argument;
+    double start = getTimeSeconds();
+
+    LoadedMesh *loaded = calloc(1, sizeof(LoadedMesh));
+    if (!loaded)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    if (loader->scene_names)
+    {
+        load_scene(loader->scene_names, loader->thread_count == 1 ? 0 : loader->thread_count, loader->cache_flags, &loaded->scene);
+        loaded->mesh = loaded->scene.mesh;
+        memset(&loaded->scene.mesh, 0, sizeof(GpuMesh));
+
+        if (loader->occluder_names && loaded->scene.model_count > 0)
+        {
+            build_occlusion_culler(&loaded->occlusion, loaded->scene.models, loaded->scene.model_count, &loaded->mesh, loader->occluder_names);
+        }
+    }
+    else
+    {
+        load_model(loader, loaded);
+    }
+
+    loaded->milliseconds = (getTimeSeconds() - start) * 1000.0;
+    push_loaded_mesh(&loader->queue, loaded);
+    return NULL;
+}
+
+int start_async_load(AsyncLoader *loader, const char *model_name, const char *scene_names, const char *occluder_names, int thread_count, uint32_t cache_flags)
+{
+    memset(loader, 0, sizeof(AsyncLoader));
+    snprintf(loader->model_name, sizeof(loader->model_name), "%s", model_name);
+    loader->scene_names = scene_names;
+    loader->occluder_names = occluder_names;
+    loader->thread_count = thread_count;
+    // Loads with anything richer are served too, see mesh_cache_flags_satisfy
+    loader->cache_flags = cache_flags & MESH_CACHE_OPTIMIZED;
+
+    pthread_mutex_init(&loader->queue.lock, NULL);
+    if (pthread_create(&loader->thread, NULL, async_load_worker, loader) != 0)
+    {
+        pthread_mutex_destroy(&loader->queue.lock);
+        return 0;
+    }
+
+    loader->running = 1;
+    return 1;
+}
+
+void finish_async_load(AsyncLoader *loader)
+{
+    if (!loader->running)
+    {
+        return;
+    }
+
+    pthread_join(loader->thread, NULL);
+    loader->running = 0;
+
+    LoadedMesh *loaded;
+    while ((loaded = poll_async_load(loader)) != NULL)
+    {
+        free_loaded_mesh(loaded);
+    }
+    pthread_mutex_destroy(&loader->queue.lock);
+}
+
+void free_loaded_mesh(LoadedMesh *loaded)
+{
+    free_gpu_mesh(&loaded->mesh);
+    free_scene(&loaded->scene);
+    free_occlusion_culler(&loaded->occlusion);
+    free(loaded);
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef ASYNC_LOAD_H
+#define ASYNC_LOAD_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "mesh.h"
+#include "occlusion.h"
+#include "scene.h"
+
+// Finished meshes waiting for the render thread
+#define ASYNC_QUEUE_CAPACITY 8
+
+// A mesh built off the render thread, ready to upload
+typedef struct
+{
+    GpuMesh mesh;
+    Scene scene; // Models and materials when a scene was loaded, its mesh moved into mesh
+    OcclusionCuller occlusion; // The scene's clusters and occluders, when asked for
+    int from_cache;
+    double milliseconds; // Parsing and building on the worker
+} LoadedMesh;
+
+// Single producer, single consumer, guarded by a mutex that is only held
+// for a pointer copy so the render thread never waits on the worker
+typedef struct
+{
+    pthread_mutex_t lock;
+    LoadedMesh *items[ASYNC_QUEUE_CAPACITY];
+    int head;
+    int count;
+} MeshQueue;
+
+typedef struct
+{
+    pthread_t thread;
+    MeshQueue queue;
+    int running;
+
+    char model_name[1024];
+    const char *scene_names;    // Must outlive the load
+    const char *occluder_names; // Same, NULL for no culler
+    int thread_count;
+    uint32_t cache_flags;
+} AsyncLoader;
+
+// Starts loading on a background thread: the scene when scene_names isn't
+// NULL, the model otherwise, through the mesh cache with cache_flags (only
+// MESH_CACHE_OPTIMIZED is applied). A scene's occlusion culler is built
+// there too when occluder_names isn't NULL, simplifying the occluders
+// would stall a frame. thread_count is passed on to the parser. Returns 0
+// if the thread can't be started.
+int start_async_load(AsyncLoader *loader, const char *model_name, const char *scene_names, const char *occluder_names, int thread_count, uint32_t cache_flags);
+
+// Next finished mesh, NULL while there is none. Never blocks; the caller
+// owns the result and frees it with free_loaded_mesh.
+LoadedMesh *poll_async_load(AsyncLoader *loader);
+
+// Waits for the worker and drops anything it queued that was never taken
+void finish_async_load(AsyncLoader *loader);
+
+void free_loaded_mesh(LoadedMesh *loaded);
+
+#endif // ASYNC_LOAD_H
\ No newline at end of file
@@ -0,0 +1,619 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "loader.h"
+#include "mesh.h"
+#include "meshNormals.h"
+#include "procedural.h"
+#include "utils.h"
+
+// Loader and mesh build benchmark, a program of its own that needs no
+// window or GL context. Every run of every model happens in a fresh child
+// process, so peak RSS and allocation counts are the run's own and the
+// material table starts empty. Results go to stdout as JSON, progress and
+// the baseline comparison to stderr.
+
+#define BENCHMARK_DEFAULT_RUNS 7
+#define BENCHMARK_MAX_RUNS 101
+#define BENCHMARK_MAX_CASES 64
+#define BENCHMARK_MAX_GRIDS 8
+#define BENCHMARK_MAX_FANS 8
+
+// A median this much slower than the baseline's fails, as a fraction
+#define BENCHMARK_DEFAULT_TOLERANCE 0.15
+
+// Stages faster than this are timer noise and never fail
+#define BENCHMARK_NOISE_FLOOR_MS 0.1
+
+// Compared against when it exists, written by --update-baseline
+#define BENCHMARK_BASELINE "benchmark_baseline.json"
+
+// generate_mesh_normals replaces every normal, with tangents, on all cores
+// after the build, so it times the stage without changing what was built
+#define BENCHMARK_STAGES 4
+static const char *stage_names[BENCHMARK_STAGES] = {"read_mtl_file", "read_obj_file", "build_gpu_mesh", "generate_mesh_normals"};
+
+// Allocation calls from the loader and mesh code, counted when linked with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (GNU ld and lld).
+// Without it the counts come out as -1.
+static long allocation_count = 0;
+
+#ifdef BENCHMARK_COUNT_ALLOCATIONS
+#define ALLOCATIONS_COUNTED 1
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *memory, size_t size)
+{
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    return __real_realloc(memory, size);
+}
+#else
+#define ALLOCATIONS_COUNTED 0
+#endif
+
+// What a child reports back through its pipe
+typedef struct
+{
+    double seconds[BENCHMARK_STAGES];
+    long allocations[BENCHMARK_STAGES];
+    long peak_rss_kb;
+    int vertex_count;
+    int face_count;
+    int gpu_vertex_count;
+    int generated_normal_count;
+} RunResult;
+
+typedef struct
+{
+    char name[256];
+    int synthetic;
+    long long obj_bytes;
+    long long mtl_bytes;
+    RunResult runs[BENCHMARK_MAX_RUNS];
+    int run_count;
+} BenchmarkCase;
+
+typedef struct
+{
+    double min;
+    double median;
+    double p90;
+    double max;
+} Percentiles;
+
+static void run_stages(const char *name, RunResult *result)
+{
+    char objFilename[1024], mtlFilename[1024];
+    snprintf(objFilename, sizeof(objFilename), "%s.obj", name);
+    snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", name);
+
+    Vertex *vertices = NULL;
+    TexCoord *texCoords = NULL;
+    Normal *normals = NULL;
+    Face *faces = NULL;
+    int vertex_count = 0, vertex_capacity = 0;
+    int texCoord_count = 0, texCoord_capacity = 0;
+    int normal_count = 0, normal_capacity = 0;
+    int face_count = 0, face_capacity = 0;
+    GpuMesh mesh;
+    Tangent *tangents = NULL;
+
+    for (int stage = 0; stage < BENCHMARK_STAGES; stage++)
+    {
+        long allocations = allocation_count;
+        double start = getTimeSeconds();
+
+        if (stage == 0)
+        {
+            read_mtl_file(mtlFilename);
+        }
+        else if (stage == 1)
+        {
+            read_obj_file(objFilename, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+        }
+        else if (stage == 2)
+        {
+            build_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, &mesh);
+        }
+        else
+        {
+            result->generated_normal_count = generate_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, MESH_NORMALS_DEFAULT_CREASE_ANGLE, 0, &normals, &tangents);
+        }
+
+        result->seconds[stage] = getTimeSeconds() - start;
+        result->allocations[stage] = ALLOCATIONS_COUNTED ? allocation_count - allocations : -1;
+    }
+
+    result->vertex_count = vertex_count;
+    result->face_count = face_count;
+    result->gpu_vertex_count = mesh.vertex_count;
+    result->peak_rss_kb = getPeakMemoryKb();
+}
+
+// Runs the stages in a child. The loader exits on errors, which shows up
+// here as a missing result.
+static int run_in_child(const char *name, RunResult *result)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        perror("Failed to create pipe");
+        return 0;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("Failed to fork");
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        // The loader's progress output would end up in the JSON
+        if (!freopen("/dev/null", "w", stdout))
+        {
+            _exit(EXIT_FAILURE);
+        }
+
+        RunResult child = {0};
+        run_stages(name, &child);
+        _exit(write(fds[1], &child, sizeof(RunResult)) == (ssize_t)sizeof(RunResult) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(RunResult));
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return got == (ssize_t)sizeof(RunResult) && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Linear between the closest ranks
+static Percentiles percentiles(double *values, int count)
+{
+    qsort(values, (size_t)count, sizeof(double), compare_doubles);
+
+    double ranks[2] = {0.5 * (count - 1), 0.9 * (count - 1)};
+    double found[2];
+    for (int i = 0; i < 2; i++)
+    {
+        int low = (int)ranks[i];
+        int high = low + 1 < count ? low + 1 : low;
+        found[i] = values[low] + (values[high] - values[low]) * (ranks[i] - low);
+    }
+
+    Percentiles result = {values[0], found[0], found[1], values[count - 1]};
+    return result;
+}
+
+static Percentiles stage_milliseconds(const BenchmarkCase *benchmark, int stage)
+{
+    double values[BENCHMARK_MAX_RUNS];
+    for (int r = 0; r < benchmark->run_count; r++)
+    {
+        values[r] = benchmark->runs[r].seconds[stage] * 1000.0;
+    }
+    return percentiles(values, benchmark->run_count);
+}
+
+static Percentiles peak_rss(const BenchmarkCase *benchmark)
+{
+    double values[BENCHMARK_MAX_RUNS];
+    for (int r = 0; r < benchmark->run_count; r++)
+    {
+        values[r] = (double)benchmark->runs[r].peak_rss_kb;
+    }
+    return percentiles(values, benchmark->run_count);
+}
+
+static void write_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const char *c = text; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fputc('\\', out);
+        }
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json(FILE *out, const BenchmarkCase *cases, int case_count, int runs)
+{
+    fprintf(out, "{\n  \"version\": 1,\n  \"runs\": %d,\n  \"allocations_counted\": %s,\n  \"cases\": [\n", runs, ALLOCATIONS_COUNTED ? "true" : "false");
+
+    for (int c = 0; c < case_count; c++)
+    {
+        const BenchmarkCase *benchmark = &cases[c];
+        const RunResult *first = &benchmark->runs[0];
+
+        fprintf(out, "    {\n      \"name\": ");
+        write_json_string(out, benchmark->name);
+        fprintf(out, ",\n      \"synthetic\": %s,\n", benchmark->synthetic ? "true" : "false");
+        fprintf(out, "      \"obj_bytes\": %lld,\n      \"mtl_bytes\": %lld,\n", benchmark->obj_bytes, benchmark->mtl_bytes);
+        fprintf(out, "      \"vertices\": %d,\n      \"faces\": %d,\n      \"gpu_vertices\": %d,\n      \"generated_normals\": %d,\n", first->vertex_count, first->face_count, first->gpu_vertex_count, first->generated_normal_count);
+
+        Percentiles rss = peak_rss(benchmark);
+        fprintf(out, "      \"peak_rss_kb\": %.0f,\n      \"stages\": {\n", rss.median);
+
+        for (int stage = 0; stage < BENCHMARK_STAGES; stage++)
+        {
+            Percentiles ms = stage_milliseconds(benchmark, stage);
+            double seconds = ms.median > 0.0 ? ms.median / 1000.0 : 1e-9;
+
+            // Throughput of what the stage reads: the MTL, the OBJ, the faces
+            long long bytes = stage == 0 ? benchmark->mtl_bytes : stage == 1 ? benchmark->obj_bytes : 0;
+            fprintf(out, "        \"%s\": {\"min_ms\": %.4f, \"median_ms\": %.4f, \"p90_ms\": %.4f, \"max_ms\": %.4f, ", stage_names[stage], ms.min, ms.median, ms.p90, ms.max);
+            fprintf(out, "\"mb_per_s\": %.2f, \"faces_per_s\": %.0f, \"allocations\": %ld}%s\n", bytes / seconds / 1e6, stage == 0 ? 0.0 : first->face_count / seconds, first->allocations[stage], stage + 1 < BENCHMARK_STAGES ? "," : "");
+        }
+
+        fprintf(out, "      }\n    }%s\n", c + 1 < case_count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
+
+// Reads a number out of a file write_json wrote: key inside the named
+// stage of the named case, or of the case itself when stage is NULL
+static int baseline_value(const char *json, const char *name, const char *stage, const char *key, double *value)
+{
+    char pattern[320];
+    snprintf(pattern, sizeof(pattern), "\"name\": \"%s\"", name);
+    const char *begin = strstr(json, pattern);
+    if (!begin)
+    {
+        return 0;
+    }
+    const char *end = strstr(begin + 1, "\"name\": ");
+    end = end ? end : json + strlen(json);
+
+    if (stage)
+    {
+        snprintf(pattern, sizeof(pattern), "\"%s\": {", stage);
+        begin = strstr(begin, pattern);
+        if (!begin || begin > end)
+        {
+            return 0;
+        }
+        end = strchr(begin, '}');
+    }
+
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *found = strstr(begin, pattern);
+    if (!found || !end || found > end)
+    {
+        return 0;
+    }
+
+    *value = strtod(found + strlen(pattern), NULL);
+    return 1;
+}
+
+static char *read_text_file(const char *filename)
+{
+    size_t size = 0;
+    const char *data = mapFile(filename, &size);
+    if (!data)
+    {
+        return NULL;
+    }
+
+    char *text = malloc(size + 1);
+    if (!text)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(text, data, size);
+    text[size] = '\0';
+    unmapFile(data, size);
+    return text;
+}
+
+// Medians slower than tolerance allows, more allocations or more memory
+// than the baseline are regressions. Returns how many were found, -1 when
+// there is no baseline to compare against.
+static int compare_with_baseline(const char *filename, const BenchmarkCase *cases, int case_count, double tolerance)
+{
+    char *json = read_text_file(filename);
+    if (!json)
+    {
+        fprintf(stderr, "No baseline at %s, write one with --update-baseline\n", filename);
+        return -1;
+    }
+
+    fprintf(stderr, "\nAgainst %s, %.0f%% tolerance:\n", filename, tolerance * 100.0);
+    int regressions = 0;
+
+    for (int c = 0; c < case_count; c++)
+    {
+        const BenchmarkCase *benchmark = &cases[c];
+        for (int stage = 0; stage < BENCHMARK_STAGES; stage++)
+        {
+            double before;
+            if (!baseline_value(json, benchmark->name, stage_names[stage], "median_ms", &before))
+            {
+                fprintf(stderr, "  %-24s %-21s not in the baseline\n", benchmark->name, stage_names[stage]);
+                continue;
+            }
+
+            double now = stage_milliseconds(benchmark, stage).median;
+            int slower = now > before * (1.0 + tolerance) && now > BENCHMARK_NOISE_FLOOR_MS;
+            regressions += slower;
+            fprintf(stderr, "  %-24s %-21s %10.3f ms -> %10.3f ms %+7.1f%%%s\n", benchmark->name, stage_names[stage], before, now, before > 0.0 ? (now / before - 1.0) * 100.0 : 0.0, slower ? "  REGRESSION" : "");
+
+            double allocations;
+            if (ALLOCATIONS_COUNTED && baseline_value(json, benchmark->name, stage_names[stage], "allocations", &allocations) && allocations >= 0.0 && benchmark->runs[0].allocations[stage] > (long)allocations)
+            {
+                fprintf(stderr, "  %-24s %-21s %ld allocations, %ld before  REGRESSION\n", benchmark->name, stage_names[stage], benchmark->runs[0].allocations[stage], (long)allocations);
+                regressions++;
+            }
+        }
+
+        double rss;
+        if (baseline_value(json, benchmark->name, NULL, "peak_rss_kb", &rss) && peak_rss(benchmark).median > rss * (1.0 + tolerance))
+        {
+            fprintf(stderr, "  %-24s peak RSS %.0f KB, %.0f KB before  REGRESSION\n", benchmark->name, peak_rss(benchmark).median, rss);
+            regressions++;
+        }
+    }
+
+    free(json);
+    return regressions;
+}
+
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t length = strlen(name), suffix_length = strlen(suffix);
+    return length > suffix_length && strcmp(name + length - suffix_length, suffix) == 0;
+}
+
+// Every NAME.obj in the working directory with a NAME.mtl next to it
+static int find_bundled_models(BenchmarkCase *cases, int case_count)
+{
+    struct dirent **entries;
+    int entry_count = scandir(".", &entries, NULL, alphasort);
+    for (int i = 0; i < entry_count; i++)
+    {
+        const char *file = entries[i]->d_name;
+        size_t length = strlen(file);
+        char name[256], mtlFilename[300];
+        long long size, mtime;
+
+        if (case_count < BENCHMARK_MAX_CASES && has_suffix(file, ".obj") && length - 4 < sizeof(name) && strncmp(file, "benchmark_grid_", 15) != 0 && strncmp(file, "benchmark_fan_", 14) != 0)
+        {
+            memcpy(name, file, length - 4);
+            name[length - 4] = '\0';
+            snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", name);
+            if (getFileInfo(mtlFilename, &size, &mtime))
+            {
+                memset(&cases[case_count], 0, sizeof(BenchmarkCase));
+                snprintf(cases[case_count].name, sizeof(cases[case_count].name), "%s", name);
+                case_count++;
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return case_count;
+}
+
+int main(int argc, char *argv[])
+{
+    // --runs N times every model is loaded, after one untimed warm up run
+    int runs = BENCHMARK_DEFAULT_RUNS;
+    // --grid CELLS adds a synthetic 2 * CELLS^2 triangle model, repeatable
+    int gridCells[BENCHMARK_MAX_GRIDS];
+    int gridCount = 0;
+    // --fan TRIANGLES adds a synthetic cone with one apex shared by every
+    // triangle, repeatable
+    int fanTriangles[BENCHMARK_MAX_FANS];
+    int fanCount = 0;
+    // --model NAME benchmarks NAME.obj and NAME.mtl instead of every
+    // bundled model, repeatable
+    const char *modelNames[BENCHMARK_MAX_CASES];
+    int modelCount = 0;
+    // --output FILE writes the JSON there instead of stdout
+    const char *outputName = NULL;
+    // --baseline FILE is compared against, --update-baseline replaces it
+    // with this run's results instead
+    const char *baselineName = BENCHMARK_BASELINE;
+    int updateBaseline = 0;
+    // --tolerance PERCENT slower medians still pass
+    double tolerance = BENCHMARK_DEFAULT_TOLERANCE;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+        {
+            runs = atoi(argv[++i]);
+            runs = runs < 1 ? 1 : runs > BENCHMARK_MAX_RUNS ? BENCHMARK_MAX_RUNS : runs;
+        }
+        else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc && gridCount < BENCHMARK_MAX_GRIDS)
+        {
+            gridCells[gridCount++] = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fan") == 0 && i + 1 < argc && fanCount < BENCHMARK_MAX_FANS)
+        {
+            fanTriangles[fanCount++] = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc && modelCount < BENCHMARK_MAX_CASES)
+        {
+            modelNames[modelCount++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baselineName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--update-baseline") == 0)
+        {
+            updateBaseline = 1;
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            tolerance = atof(argv[++i]) / 100.0;
+        }
+    }
+
+    static BenchmarkCase cases[BENCHMARK_MAX_CASES];
+    int caseCount = 0;
+
+    if (modelCount > 0)
+    {
+        for (int m = 0; m < modelCount; m++)
+        {
+            snprintf(cases[caseCount++].name, sizeof(cases[0].name), "%s", modelNames[m]);
+        }
+    }
+    else
+    {
+        caseCount = find_bundled_models(cases, caseCount);
+    }
+
+    for (int g = 0; g < gridCount && caseCount < BENCHMARK_MAX_CASES; g++)
+    {
+        BenchmarkCase *grid = &cases[caseCount];
+        snprintf(grid->name, sizeof(grid->name), "benchmark_grid_%d", gridCells[g]);
+        if (write_grid_model(grid->name, gridCells[g]))
+        {
+            grid->synthetic = 1;
+            caseCount++;
+        }
+    }
+    for (int f = 0; f < fanCount && caseCount < BENCHMARK_MAX_CASES; f++)
+    {
+        BenchmarkCase *fan = &cases[caseCount];
+        snprintf(fan->name, sizeof(fan->name), "benchmark_fan_%d", fanTriangles[f]);
+        if (write_fan_model(fan->name, fanTriangles[f]))
+        {
+            fan->synthetic = 1;
+            caseCount++;
+        }
+    }
+
+    int failed = 0;
+    for (int c = 0; c < caseCount; c++)
+    {
+        BenchmarkCase *benchmark = &cases[c];
+        char objFilename[300], mtlFilename[300];
+        long long mtime;
+        snprintf(objFilename, sizeof(objFilename), "%s.obj", benchmark->name);
+        snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", benchmark->name);
+        getFileInfo(objFilename, &benchmark->obj_bytes, &mtime);
+        getFileInfo(mtlFilename, &benchmark->mtl_bytes, &mtime);
+
+        // The warm up run leaves both files in the page cache
+        RunResult warmUp;
+        int ok = run_in_child(benchmark->name, &warmUp);
+        for (int r = 0; ok && r < runs; r++)
+        {
+            ok = run_in_child(benchmark->name, &benchmark->runs[r]);
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "%s failed to load, left out\n", benchmark->name);
+            failed = 1;
+            memmove(benchmark, benchmark + 1, (size_t)(caseCount - c - 1) * sizeof(BenchmarkCase));
+            caseCount--;
+            c--;
+            continue;
+        }
+        benchmark->run_count = runs;
+
+        fprintf(stderr, "%-24s %9d faces  mtl %8.3f ms  obj %9.3f ms  build %9.3f ms  normals %9.3f ms  (medians of %d)\n", benchmark->name, benchmark->runs[0].face_count, stage_milliseconds(benchmark, 0).median, stage_milliseconds(benchmark, 1).median, stage_milliseconds(benchmark, 2).median, stage_milliseconds(benchmark, 3).median, runs);
+    }
+
+    for (int g = 0; g < gridCount; g++)
+    {
+        char filename[300];
+        snprintf(filename, sizeof(filename), "benchmark_grid_%d.obj", gridCells[g]);
+        remove(filename);
+        snprintf(filename, sizeof(filename), "benchmark_grid_%d.mtl", gridCells[g]);
+        remove(filename);
+    }
+    for (int f = 0; f < fanCount; f++)
+    {
+        char filename[300];
+        snprintf(filename, sizeof(filename), "benchmark_fan_%d.obj", fanTriangles[f]);
+        remove(filename);
+        snprintf(filename, sizeof(filename), "benchmark_fan_%d.mtl", fanTriangles[f]);
+        remove(filename);
+    }
+
+    FILE *out = stdout;
+    if (outputName && !(out = fopen(outputName, "w")))
+    {
+        perror("Failed to open file");
+        return EXIT_FAILURE;
+    }
+    write_json(out, cases, caseCount, runs);
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+
+    if (updateBaseline)
+    {
+        FILE *baseline = fopen(baselineName, "w");
+        if (!baseline)
+        {
+            perror("Failed to open file");
+            return EXIT_FAILURE;
+        }
+        write_json(baseline, cases, caseCount, runs);
+        fclose(baseline);
+        fprintf(stderr, "Wrote baseline %s\n", baselineName);
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    // Without a baseline nothing was checked, which must not pass as clean
+    int regressions = compare_with_baseline(baselineName, cases, caseCount, tolerance);
+    if (regressions < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (regressions > 0)
+    {
+        fprintf(stderr, "\n%d REGRESSION%s against %s\n", regressions, regressions == 1 ? "" : "S", baselineName);
+        return EXIT_FAILURE;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,900 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bvh.h"
+#include "threads.h"
+#include "utils.h"
+
+// Subtrees handed to each thread once the top levels are split, so uneven
+// subtrees still balance
+#define BVH_SUBTREES_PER_THREAD 4
+
+typedef struct
+{
+    float min[3];
+    float max[3];
+    float centroid[3];
+} BuildPrimitive;
+
+// Binary node of the SAH build, collapsed into BvhNodes at the end
+typedef struct
+{
+    float min[3];
+    float max[3];
+    int left; // Left child, the right one follows it; -1 for a leaf
+    int first; // Range in the primitive order
+    int count;
+} BinaryNode;
+
+typedef struct
+{
+    BinaryNode *nodes;
+    int count;
+    int capacity;
+} BinaryNodeArray;
+
+typedef struct
+{
+    const BuildPrimitive *primitives;
+    int *order;
+
+    BinaryNodeArray *subtrees;
+    const int *subtree_roots; // Range of each subtree, as top level nodes
+    const BinaryNode *top;
+} BvhBuilder;
+
+static void *allocate_or_die(size_t size)
+{
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+static int push_binary_node(BinaryNodeArray *array)
+{
+    if (array->count == array->capacity)
+    {
+        array->capacity = array->capacity ? array->capacity * 2 : 64;
+        array->nodes = realloc(array->nodes, (size_t)array->capacity * sizeof(BinaryNode));
+        if (!array->nodes)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return array->count++;
+}
+
+static float surface_area(const float min[3], const float max[3])
+{
+    float dx = max[0] - min[0];
+    float dy = max[1] - min[1];
+    float dz = max[2] - min[2];
+    return dx < 0.0f ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static void empty_bounds(float min[3], float max[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = FLT_MAX;
+        max[i] = -FLT_MAX;
+    }
+}
+
+static void grow_bounds(float min[3], float max[3], const float other_min[3], const float other_max[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = other_min[i] < min[i] ? other_min[i] : min[i];
+        max[i] = other_max[i] > max[i] ? other_max[i] : max[i];
+    }
+}
+
+static void init_binary_node(const BvhBuilder *builder, BinaryNode *node, int first, int count)
+{
+    node->left = -1;
+    node->first = first;
+    node->count = count;
+
+    empty_bounds(node->min, node->max);
+    for (int i = first; i < first + count; i++)
+    {
+        const BuildPrimitive *primitive = &builder->primitives[builder->order[i]];
+        grow_bounds(node->min, node->max, primitive->min, primitive->max);
+    }
+}
+
+// Binned SAH over all three axes. Returns 0 to keep the node as a leaf,
+// otherwise partitions its range and fills in both children.
+static int split_binary_node(const BvhBuilder *builder, const BinaryNode *node, BinaryNode *left_child, BinaryNode *right_child)
+{
+    int first = node->first;
+    int count = node->count;
+    if (count <= 1)
+    {
+        return 0;
+    }
+
+    float centroid_min[3], centroid_max[3];
+    empty_bounds(centroid_min, centroid_max);
+    for (int i = first; i < first + count; i++)
+    {
+        const float *centroid = builder->primitives[builder->order[i]].centroid;
+        grow_bounds(centroid_min, centroid_max, centroid, centroid);
+    }
+
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_bin = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centroid_max[axis] - centroid_min[axis];
+        if (extent <= 0.0f)
+        {
+            continue;
+        }
+
+        int bin_count[BVH_BINS] = {0};
+        float bin_min[BVH_BINS][3], bin_max[BVH_BINS][3];
+        for (int b = 0; b < BVH_BINS; b++)
+        {
+            empty_bounds(bin_min[b], bin_max[b]);
+        }
+
+        float scale = BVH_BINS / extent;
+        for (int i = first; i < first + count; i++)
+        {
+            const BuildPrimitive *primitive = &builder->primitives[builder->order[i]];
+            int b = (int)((primitive->centroid[axis] - centroid_min[axis]) * scale);
+            b = b < BVH_BINS ? b : BVH_BINS - 1;
+            bin_count[b]++;
+            grow_bounds(bin_min[b], bin_max[b], primitive->min, primitive->max);
+        }
+
+        // Sweep from the right for the right side areas, then from the left
+        float right_area[BVH_BINS];
+        int right_count[BVH_BINS];
+        float right_min[BVH_BINS][3], right_max[BVH_BINS][3];
+        float sweep_min[3], sweep_max[3];
+        empty_bounds(sweep_min, sweep_max);
+        int sweep_count = 0;
+        for (int b = BVH_BINS - 1; b > 0; b--)
+        {
+            grow_bounds(sweep_min, sweep_max, bin_min[b], bin_max[b]);
+            sweep_count += bin_count[b];
+            right_area[b] = surface_area(sweep_min, sweep_max);
+            right_count[b] = sweep_count;
+            memcpy(right_min[b], sweep_min, sizeof(sweep_min));
+            memcpy(right_max[b], sweep_max, sizeof(sweep_max));
+        }
+
+        empty_bounds(sweep_min, sweep_max);
+        sweep_count = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++)
+        {
+            grow_bounds(sweep_min, sweep_max, bin_min[b], bin_max[b]);
+            sweep_count += bin_count[b];
+            if (sweep_count == 0 || right_count[b + 1] == 0)
+            {
+                continue;
+            }
+
+            float cost = surface_area(sweep_min, sweep_max) * sweep_count + right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+
+                // The bins already know the children's bounds
+                memcpy(left_child->min, sweep_min, sizeof(sweep_min));
+                memcpy(left_child->max, sweep_max, sizeof(sweep_max));
+                memcpy(right_child->min, right_min[b + 1], sizeof(sweep_min));
+                memcpy(right_child->max, right_max[b + 1], sizeof(sweep_max));
+            }
+        }
+    }
+
+    if (best_axis < 0)
+    {
+        // Every centroid in one spot, only a leaf or an arbitrary halving
+        if (count <= BVH_MAX_LEAF_TRIANGLES)
+        {
+            return 0;
+        }
+        init_binary_node(builder, left_child, first, count / 2);
+        init_binary_node(builder, right_child, first + count / 2, count - count / 2);
+        return 1;
+    }
+
+    // A traversal step costs about as much as a triangle test
+    float area = surface_area(node->min, node->max);
+    float split_cost = 1.0f + (area > 0.0f ? best_cost / area : 0.0f);
+    if (count <= BVH_MAX_LEAF_TRIANGLES && split_cost >= count)
+    {
+        return 0;
+    }
+
+    int *order = builder->order;
+    float scale = BVH_BINS / (centroid_max[best_axis] - centroid_min[best_axis]);
+    int left = first;
+    int right = first + count - 1;
+    while (left <= right)
+    {
+        int b = (int)((builder->primitives[order[left]].centroid[best_axis] - centroid_min[best_axis]) * scale);
+        b = b < BVH_BINS ? b : BVH_BINS - 1;
+        if (b <= best_bin)
+        {
+            left++;
+        }
+        else
+        {
+            int swap = order[left];
+            order[left] = order[right];
+            order[right--] = swap;
+        }
+    }
+
+    left_child->left = -1;
+    left_child->first = first;
+    left_child->count = left - first;
+    right_child->left = -1;
+    right_child->first = left;
+    right_child->count = first + count - left;
+    return 1;
+}
+
+// Splits a node and its descendants all the way down
+static void build_binary_subtree(const BvhBuilder *builder, BinaryNodeArray *array, int root)
+{
+    int capacity = 64;
+    int *stack = allocate_or_die((size_t)capacity * sizeof(int));
+    int stack_size = 0;
+    stack[stack_size++] = root;
+
+    while (stack_size > 0)
+    {
+        int index = stack[--stack_size];
+        BinaryNode children[2];
+        if (!split_binary_node(builder, &array->nodes[index], &children[0], &children[1]))
+        {
+            continue;
+        }
+
+        int left = push_binary_node(array);
+        push_binary_node(array);
+        array->nodes[left] = children[0];
+        array->nodes[left + 1] = children[1];
+        array->nodes[index].left = left;
+
+        if (stack_size + 2 > capacity)
+        {
+            capacity *= 2;
+            stack = realloc(stack, (size_t)capacity * sizeof(int));
+            if (!stack)
+            {
+                perror("Failed to allocate memory");
+                exit(EXIT_FAILURE);
+            }
+        }
+        stack[stack_size++] = left + 1;
+        stack[stack_size++] = left;
+    }
+
+    free(stack);
+}
+
+static void build_subtree_task(void *context, int taskIndex)
+{
+    const BvhBuilder *builder = (const BvhBuilder *)context;
+    BinaryNodeArray *array = &builder->subtrees[taskIndex];
+
+    push_binary_node(array);
+    array->nodes[0] = builder->top[builder->subtree_roots[taskIndex]];
+    build_binary_subtree(builder, array, 0);
+}
+
+// Splits the top levels until there are enough independent subtrees, builds
+// those in parallel and appends them to top. Returns the finished tree.
+static void build_binary_tree(BvhBuilder *builder, BinaryNodeArray *top, int triangle_count, int thread_count)
+{
+    push_binary_node(top);
+    init_binary_node(builder, &top->nodes[0], 0, triangle_count);
+
+    int target = thread_count > 1 ? thread_count * BVH_SUBTREES_PER_THREAD : 1;
+    int *pending = allocate_or_die((size_t)(target + 1) * sizeof(int));
+    int pending_count = 1;
+    pending[0] = 0;
+
+    // Always split the biggest pending range, the subtrees end up similar
+    while (pending_count > 0 && pending_count < target)
+    {
+        int biggest = 0;
+        for (int i = 1; i < pending_count; i++)
+        {
+            biggest = top->nodes[pending[i]].count > top->nodes[pending[biggest]].count ? i : biggest;
+        }
+
+        int index = pending[biggest];
+        pending[biggest] = pending[--pending_count];
+
+        BinaryNode children[2];
+        if (!split_binary_node(builder, &top->nodes[index], &children[0], &children[1]))
+        {
+            continue;
+        }
+
+        int left = push_binary_node(top);
+        push_binary_node(top);
+        top->nodes[left] = children[0];
+        top->nodes[left + 1] = children[1];
+        top->nodes[index].left = left;
+
+        pending[pending_count++] = left;
+        pending[pending_count++] = left + 1;
+    }
+
+    BinaryNodeArray *subtrees = calloc((size_t)pending_count + 1, sizeof(BinaryNodeArray));
+    if (!subtrees)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    builder->subtrees = subtrees;
+    builder->subtree_roots = pending;
+    builder->top = top->nodes;
+    runParallel(pending_count, thread_count, build_subtree_task, builder);
+
+    // Stitch: a subtree's root replaces its placeholder, the rest is
+    // appended with child indices shifted to match
+    for (int s = 0; s < pending_count; s++)
+    {
+        BinaryNodeArray *subtree = &subtrees[s];
+        int offset = top->count - 1;
+
+        for (int i = 1; i < subtree->count; i++)
+        {
+            int index = push_binary_node(top);
+            top->nodes[index] = subtree->nodes[i];
+            if (top->nodes[index].left >= 0)
+            {
+                top->nodes[index].left += offset;
+            }
+        }
+
+        top->nodes[pending[s]] = subtree->nodes[0];
+        if (subtree->nodes[0].left >= 0)
+        {
+            top->nodes[pending[s]].left += offset;
+        }
+
+        free(subtree->nodes);
+    }
+
+    free(subtrees);
+    free(pending);
+}
+
+static void set_lane(BvhNode *node, int lane, const BinaryNode *binary)
+{
+    node->min_x[lane] = binary->min[0];
+    node->min_y[lane] = binary->min[1];
+    node->min_z[lane] = binary->min[2];
+    node->max_x[lane] = binary->max[0];
+    node->max_y[lane] = binary->max[1];
+    node->max_z[lane] = binary->max[2];
+}
+
+// Pulls grandchildren up until every node has four children, always
+// opening the largest inner child first
+static void collapse_binary_tree(const BinaryNodeArray *binary, Bvh *bvh)
+{
+    bvh->nodes = allocate_or_die(((size_t)binary->count / 2 + 1) * sizeof(BvhNode));
+    bvh->node_count = 1;
+    bvh->depth = 1;
+
+    // Queue of (binary node, bvh node, depth), built front to back so
+    // children always come after their parent
+    int *queue = allocate_or_die(((size_t)binary->count + 1) * 3 * sizeof(int));
+    int head = 0;
+    int tail = 0;
+    queue[tail++] = 0;
+    queue[tail++] = 0;
+    queue[tail++] = 1;
+
+    while (head < tail)
+    {
+        int binary_index = queue[head++];
+        int node_index = queue[head++];
+        int depth = queue[head++];
+        const BinaryNode *parent = &binary->nodes[binary_index];
+
+        int children[4];
+        int child_count = 0;
+        if (parent->left < 0)
+        {
+            // Only a leaf root gets here
+            children[child_count++] = binary_index;
+        }
+        else
+        {
+            children[child_count++] = parent->left;
+            children[child_count++] = parent->left + 1;
+        }
+
+        while (child_count < 4)
+        {
+            int widest = -1;
+            float widest_area = -1.0f;
+            for (int i = 0; i < child_count; i++)
+            {
+                const BinaryNode *child = &binary->nodes[children[i]];
+                float area = surface_area(child->min, child->max);
+                if (child->left >= 0 && area > widest_area)
+                {
+                    widest = i;
+                    widest_area = area;
+                }
+            }
+            if (widest < 0)
+            {
+                break;
+            }
+
+            int opened = binary->nodes[children[widest]].left;
+            children[widest] = opened;
+            children[child_count++] = opened + 1;
+        }
+
+        BvhNode *node = &bvh->nodes[node_index];
+        memset(node, 0, sizeof(BvhNode));
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (lane >= child_count)
+            {
+                node->count[lane] = -1;
+                continue;
+            }
+
+            const BinaryNode *child = &binary->nodes[children[lane]];
+            set_lane(node, lane, child);
+
+            if (child->left < 0)
+            {
+                node->child[lane] = child->first;
+                node->count[lane] = child->count;
+            }
+            else
+            {
+                node->child[lane] = bvh->node_count++;
+                node->count[lane] = 0;
+                queue[tail++] = children[lane];
+                queue[tail++] = node->child[lane];
+                queue[tail++] = depth + 1;
+                bvh->depth = depth + 1 > bvh->depth ? depth + 1 : bvh->depth;
+            }
+        }
+    }
+
+    free(queue);
+}
+
+void build_bvh(const float *positions, int stride, const unsigned int *indices, const int *ids, int triangle_count, int thread_count, Bvh *bvh)
+{
+    memset(bvh, 0, sizeof(Bvh));
+    thread_count = thread_count > 0 ? thread_count : getCpuCount();
+
+    BuildPrimitive *primitives = allocate_or_die((size_t)triangle_count * sizeof(BuildPrimitive));
+    int *order = allocate_or_die((size_t)triangle_count * sizeof(int));
+
+    for (int t = 0; t < triangle_count; t++)
+    {
+        BuildPrimitive *primitive = &primitives[t];
+        empty_bounds(primitive->min, primitive->max);
+        for (int c = 0; c < 3; c++)
+        {
+            const float *position = &positions[(size_t)indices[t * 3 + c] * stride];
+            grow_bounds(primitive->min, primitive->max, position, position);
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            primitive->centroid[i] = (primitive->min[i] + primitive->max[i]) * 0.5f;
+        }
+        order[t] = t;
+    }
+
+    BvhBuilder builder = {primitives, order, NULL, NULL, NULL};
+    BinaryNodeArray binary = {NULL, 0, 0};
+    build_binary_tree(&builder, &binary, triangle_count, thread_count);
+    collapse_binary_tree(&binary, bvh);
+
+    // Triangles in leaf order, so a leaf is one contiguous run
+    bvh->triangles = allocate_or_die((size_t)triangle_count * sizeof(BvhTriangle));
+    bvh->triangle_count = triangle_count;
+    for (int i = 0; i < triangle_count; i++)
+    {
+        int t = order[i];
+        const float *a = &positions[(size_t)indices[t * 3] * stride];
+        const float *b = &positions[(size_t)indices[t * 3 + 1] * stride];
+        const float *c = &positions[(size_t)indices[t * 3 + 2] * stride];
+
+        BvhTriangle *triangle = &bvh->triangles[i];
+        for (int k = 0; k < 3; k++)
+        {
+            triangle->v0[k] = a[k];
+            triangle->edge1[k] = b[k] - a[k];
+            triangle->edge2[k] = c[k] - a[k];
+        }
+        triangle->id = ids ? ids[t] : t;
+    }
+
+    free(binary.nodes);
+    free(primitives);
+    free(order);
+}
+
+void build_bvh_from_faces(const Vertex *vertices, int vertex_count, const Face *faces, int face_count, int thread_count, Bvh *bvh)
+{
+    unsigned int *indices = allocate_or_die((size_t)face_count * 3 * sizeof(unsigned int));
+    int *ids = allocate_or_die((size_t)face_count * sizeof(int));
+    int triangle_count = 0;
+
+    for (int f = 0; f < face_count; f++)
+    {
+        const int *corner = faces[f].vertexIndex;
+        if (corner[0] < 1 || corner[0] > vertex_count || corner[1] < 1 || corner[1] > vertex_count || corner[2] < 1 || corner[2] > vertex_count)
+        {
+            continue;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            indices[triangle_count * 3 + c] = (unsigned int)(corner[c] - 1);
+        }
+        ids[triangle_count++] = f;
+    }
+
+    build_bvh(vertices ? &vertices[0].x : NULL, 3, indices, ids, triangle_count, thread_count, bvh);
+
+    free(indices);
+    free(ids);
+}
+
+// A ray in the form the slab test wants, splatted across the four lanes
+typedef struct
+{
+    float origin[3];
+    float direction[3];
+    BvhFloat4 inverse_x, inverse_y, inverse_z;
+    BvhFloat4 scaled_x, scaled_y, scaled_z; // origin * inverse
+} PreparedRay;
+
+static void prepare_ray(PreparedRay *ray, const float origin[3], const float direction[3])
+{
+    float inverse[3];
+    for (int i = 0; i < 3; i++)
+    {
+        // Axis parallel rays get a huge but finite slope, so 0 * inf never
+        // turns a slab into NaN
+        float d = fabsf(direction[i]) < 1e-20f ? (direction[i] < 0.0f ? -1e-20f : 1e-20f) : direction[i];
+        inverse[i] = 1.0f / d;
+        ray->origin[i] = origin[i];
+        ray->direction[i] = direction[i];
+    }
+
+    ray->inverse_x = (BvhFloat4){inverse[0], inverse[0], inverse[0], inverse[0]};
+    ray->inverse_y = (BvhFloat4){inverse[1], inverse[1], inverse[1], inverse[1]};
+    ray->inverse_z = (BvhFloat4){inverse[2], inverse[2], inverse[2], inverse[2]};
+    ray->scaled_x = ray->inverse_x * origin[0];
+    ray->scaled_y = ray->inverse_y * origin[1];
+    ray->scaled_z = ray->inverse_z * origin[2];
+}
+
+static inline BvhFloat4 min4(BvhFloat4 a, BvhFloat4 b)
+{
+    BvhInt4 mask = a < b;
+    return (BvhFloat4)((mask & (BvhInt4)a) | (~mask & (BvhInt4)b));
+}
+
+static inline BvhFloat4 max4(BvhFloat4 a, BvhFloat4 b)
+{
+    BvhInt4 mask = a > b;
+    return (BvhFloat4)((mask & (BvhInt4)a) | (~mask & (BvhInt4)b));
+}
+
+// Entry distances of the four child boxes, and which of them the ray
+// crosses within [0, max_t]
+static inline BvhInt4 intersect_children(const BvhNode *node, const PreparedRay *ray, float max_t, BvhFloat4 *entry)
+{
+    BvhFloat4 x0 = node->min_x * ray->inverse_x - ray->scaled_x;
+    BvhFloat4 x1 = node->max_x * ray->inverse_x - ray->scaled_x;
+    BvhFloat4 y0 = node->min_y * ray->inverse_y - ray->scaled_y;
+    BvhFloat4 y1 = node->max_y * ray->inverse_y - ray->scaled_y;
+    BvhFloat4 z0 = node->min_z * ray->inverse_z - ray->scaled_z;
+    BvhFloat4 z1 = node->max_z * ray->inverse_z - ray->scaled_z;
+
+    BvhFloat4 zero = {0.0f, 0.0f, 0.0f, 0.0f};
+    BvhFloat4 limit = {max_t, max_t, max_t, max_t};
+
+    BvhFloat4 enter = max4(max4(min4(x0, x1), min4(y0, y1)), max4(min4(z0, z1), zero));
+    BvhFloat4 leave = min4(min4(max4(x0, x1), max4(y0, y1)), min4(max4(z0, z1), limit));
+
+    *entry = enter;
+    return enter <= leave;
+}
+
+static int intersect_triangle(const BvhTriangle *triangle, const PreparedRay *ray, float max_t, BvhHit *hit)
+{
+    const float *d = ray->direction;
+    const float *e1 = triangle->edge1;
+    const float *e2 = triangle->edge2;
+
+    float p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+    float determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (determinant == 0.0f)
+    {
+        return 0;
+    }
+
+    // Two sided, picking should find whatever is in front
+    float inverse = 1.0f / determinant;
+    float s[3] = {ray->origin[0] - triangle->v0[0], ray->origin[1] - triangle->v0[1], ray->origin[2] - triangle->v0[2]};
+    float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+    if (u < 0.0f || u > 1.0f)
+    {
+        return 0;
+    }
+
+    float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+    float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverse;
+    if (v < 0.0f || u + v > 1.0f)
+    {
+        return 0;
+    }
+
+    float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+    if (t < 0.0f || t > max_t)
+    {
+        return 0;
+    }
+
+    hit->t = t;
+    hit->u = u;
+    hit->v = v;
+    hit->id = triangle->id;
+    return 1;
+}
+
+typedef struct
+{
+    int node;
+    float entry;
+} TraversalEntry;
+
+static int traverse(const Bvh *bvh, const float origin[3], const float direction[3], float max_t, int any_hit, BvhHit *hit)
+{
+    if (bvh->node_count == 0)
+    {
+        return 0;
+    }
+
+    PreparedRay ray;
+    prepare_ray(&ray, origin, direction);
+
+    // Each node pops one entry and pushes at most four
+    TraversalEntry stack[3 * bvh->depth + 2];
+    int stack_size = 0;
+    stack[stack_size++] = (TraversalEntry){0, 0.0f};
+
+    int found = 0;
+    BvhHit candidate;
+
+    while (stack_size > 0)
+    {
+        TraversalEntry entry = stack[--stack_size];
+        if (entry.entry > max_t)
+        {
+            continue;
+        }
+
+        const BvhNode *node = &bvh->nodes[entry.node];
+        BvhFloat4 enter;
+        BvhInt4 crossed = intersect_children(node, &ray, max_t, &enter);
+
+        // Inner children are pushed farthest first so the nearest is
+        // visited next and max_t shrinks as early as possible
+        TraversalEntry inner[4];
+        int inner_count = 0;
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (!crossed[lane] || node->count[lane] < 0)
+            {
+                continue;
+            }
+
+            if (node->count[lane] > 0)
+            {
+                const BvhTriangle *triangles = &bvh->triangles[node->child[lane]];
+                for (int i = 0; i < node->count[lane]; i++)
+                {
+                    if (intersect_triangle(&triangles[i], &ray, max_t, &candidate))
+                    {
+                        found = 1;
+                        max_t = candidate.t;
+                        if (hit)
+                        {
+                            *hit = candidate;
+                        }
+                        if (any_hit)
+                        {
+                            return 1;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            TraversalEntry child = {node->child[lane], enter[lane]};
+            int position = inner_count++;
+            while (position > 0 && inner[position - 1].entry < child.entry)
+            {
+                inner[position] = inner[position - 1];
+                position--;
+            }
+            inner[position] = child;
+        }
+
+        for (int i = 0; i < inner_count; i++)
+        {
+            stack[stack_size++] = inner[i];
+        }
+    }
+
+    return found;
+}
+
+int bvh_intersect(const Bvh *bvh, const float origin[3], const float direction[3], float max_t, BvhHit *hit)
+{
+    return traverse(bvh, origin, direction, max_t, 0, hit);
+}
+
+int bvh_occluded(const Bvh *bvh, const float origin[3], const float direction[3], float max_t)
+{
+    return traverse(bvh, origin, direction, max_t, 1, NULL);
+}
+
+static float random_unit(unsigned int *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+static void random_ray(unsigned int *state, const float center[3], const float half[3], float radius, float origin[3], float direction[3])
+{
+    // From a random point on a sphere around the mesh towards a random
+    // point inside its bounds, so most rays are worth tracing
+    float z = random_unit(state) * 2.0f - 1.0f;
+    float angle = random_unit(state) * 6.2831853f;
+    float ring = sqrtf(1.0f - z * z);
+    float around[3] = {ring * cosf(angle), ring * sinf(angle), z};
+
+    float length = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        origin[i] = center[i] + around[i] * radius * 2.0f;
+        direction[i] = center[i] + (random_unit(state) * 2.0f - 1.0f) * half[i] - origin[i];
+        length += direction[i] * direction[i];
+    }
+
+    length = sqrtf(length);
+    for (int i = 0; i < 3; i++)
+    {
+        direction[i] /= length;
+    }
+}
+
+void benchmark_bvh(const Bvh *bvh, int ray_count)
+{
+    if (bvh->node_count == 0 || ray_count <= 0)
+    {
+        return;
+    }
+
+    float min[3], max[3], center[3], half[3];
+    const BvhNode *root = &bvh->nodes[0];
+    empty_bounds(min, max);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        if (root->count[lane] >= 0)
+        {
+            float lane_min[3] = {root->min_x[lane], root->min_y[lane], root->min_z[lane]};
+            float lane_max[3] = {root->max_x[lane], root->max_y[lane], root->max_z[lane]};
+            grow_bounds(min, max, lane_min, lane_max);
+        }
+    }
+
+    float radius = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        center[i] = (min[i] + max[i]) * 0.5f;
+        half[i] = (max[i] - min[i]) * 0.5f;
+        radius += half[i] * half[i];
+    }
+    radius = sqrtf(radius);
+    float max_t = radius * 4.0f;
+
+    unsigned int state = 12345u;
+    int hits = 0;
+    double start = getTimeSeconds();
+    for (int r = 0; r < ray_count; r++)
+    {
+        float origin[3], direction[3];
+        BvhHit hit;
+        random_ray(&state, center, half, radius, origin, direction);
+        hits += bvh_intersect(bvh, origin, direction, max_t, &hit);
+    }
+    double closest_seconds = getTimeSeconds() - start;
+
+    state = 12345u;
+    int occluded = 0;
+    start = getTimeSeconds();
+    for (int r = 0; r < ray_count; r++)
+    {
+        float origin[3], direction[3];
+        random_ray(&state, center, half, radius, origin, direction);
+        occluded += bvh_occluded(bvh, origin, direction, max_t);
+    }
+    double occluded_seconds = getTimeSeconds() - start;
+
+    // Brute force over every triangle for a sample of the same rays
+    int sample_count = ray_count < 1000 ? ray_count : 1000;
+    int mismatches = 0;
+    state = 12345u;
+    start = getTimeSeconds();
+    for (int r = 0; r < sample_count; r++)
+    {
+        float origin[3], direction[3];
+        random_ray(&state, center, half, radius, origin, direction);
+
+        PreparedRay ray;
+        prepare_ray(&ray, origin, direction);
+
+        BvhHit best = {max_t, 0.0f, 0.0f, -1};
+        BvhHit candidate;
+        for (int t = 0; t < bvh->triangle_count; t++)
+        {
+            if (intersect_triangle(&bvh->triangles[t], &ray, best.t, &candidate))
+            {
+                best = candidate;
+            }
+        }
+
+        BvhHit hit;
+        int found = bvh_intersect(bvh, origin, direction, max_t, &hit);
+        if (found != (best.id >= 0) || (found && hit.t != best.t))
+        {
+            mismatches++;
+        }
+    }
+    double brute_seconds = getTimeSeconds() - start;
+
+    printf("Closest hit %.2f Mrays/s (%.2f us per ray, %.0f%% hit), occlusion %.2f Mrays/s (%.0f%% occluded)\n", ray_count / closest_seconds / 1e6, closest_seconds * 1e6 / ray_count, 100.0 * hits / ray_count, ray_count / occluded_seconds / 1e6, 100.0 * occluded / ray_count);
+    printf("Brute force %.4f Mrays/s, %d of %d sampled rays disagree with it\n", sample_count / brute_seconds / 1e6, mismatches, sample_count);
+}
+
+void free_bvh(Bvh *bvh)
+{
+    free(bvh->nodes);
+    free(bvh->triangles);
+    memset(bvh, 0, sizeof(Bvh));
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "loader.h"
+
+// Leaves hold at most this many triangles
+#define BVH_MAX_LEAF_TRIANGLES 4
+
+// Centroid bins per axis when searching for the best SAH split
+#define BVH_BINS 16
+
+// Four lanes of floats or ints, with the GCC and Clang vector extension so
+// the same code becomes SSE on x86 and NEON on ARM
+typedef float BvhFloat4 __attribute__((vector_size(16)));
+typedef int BvhInt4 __attribute__((vector_size(16)));
+
+// Four children tested against a ray at once, bounds stored per axis.
+// count > 0 is a leaf of count triangles starting at child, 0 an inner
+// node at index child, -1 an empty lane whose box can't be hit.
+typedef struct
+{
+    BvhFloat4 min_x, min_y, min_z;
+    BvhFloat4 max_x, max_y, max_z;
+    int child[4];
+    int count[4];
+} BvhNode;
+
+// Precomputed for Moller-Trumbore, in leaf order
+typedef struct
+{
+    float v0[3];
+    float edge1[3];
+    float edge2[3];
+    int id; // Triangle number, or the face index for build_bvh_from_faces
+} BvhTriangle;
+
+typedef struct
+{
+    BvhNode *nodes; // Root first, children always after their parent
+    int node_count;
+    BvhTriangle *triangles;
+    int triangle_count;
+    int depth; // Longest root to leaf path, bounds the traversal stack
+} Bvh;
+
+typedef struct
+{
+    float t; // Distance along the ray, in units of its direction
+    float u, v; // Barycentrics of the hit on the triangle
+    int id;
+} BvhHit;
+
+// Builds over indexed triangles, positions spaced stride floats apart.
+// ids names each triangle in hits, NULL numbers them in order. The upper
+// levels are split on the calling thread until there are enough subtrees
+// to keep thread_count threads busy (0 = one per core), those are then
+// built in parallel and stitched into one node array.
+void build_bvh(const float *positions, int stride, const unsigned int *indices, const int *ids, int triangle_count, int thread_count, Bvh *bvh);
+
+// Same over the loader's faces, hits report face indices. Faces with
+// positions out of range are left out.
+void build_bvh_from_faces(const Vertex *vertices, int vertex_count, const Face *faces, int face_count, int thread_count, Bvh *bvh);
+
+// Closest hit with t in [0, max_t]. Returns 0 on a miss.
+int bvh_intersect(const Bvh *bvh, const float origin[3], const float direction[3], float max_t, BvhHit *hit);
+
+// Whether anything is hit with t in [0, max_t], stops at the first one
+int bvh_occluded(const Bvh *bvh, const float origin[3], const float direction[3], float max_t);
+
+// Times ray_count random rays through the bounds of the mesh, closest hit
+// and occlusion, and checks a sample against brute force
+void benchmark_bvh(const Bvh *bvh, int ray_count);
+
+void free_bvh(Bvh *bvh);
+
+#endif // BVH_H
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "colorGrade.h"
+#include "threads.h"
+#include "utils.h"
+
+static float fract(float x)
+{
+    return x - floorf(x);
+}
+
+static void rgb_to_hsb(const float c[3], float out[3])
+{
+    // The branch free GLSL version with its steps taken as branches
+    float p[4], q[4];
+    if (c[1] >= c[2])
+    {
+        p[0] = c[1], p[1] = c[2], p[2] = 0.0f, p[3] = -1.0f / 3.0f;
+    }
+    else
+    {
+        p[0] = c[2], p[1] = c[1], p[2] = -1.0f, p[3] = 2.0f / 3.0f;
+    }
+    if (c[0] >= p[0])
+    {
+        q[0] = c[0], q[1] = p[1], q[2] = p[2], q[3] = p[0];
+    }
+    else
+    {
+        q[0] = p[0], q[1] = p[1], q[2] = p[3], q[3] = c[0];
+    }
+
+    float d = q[0] - fminf(q[3], q[1]);
+    float e = 1.0e-10f;
+    out[0] = fabsf(q[2] + (q[3] - q[1]) / (6.0f * d + e));
+    out[1] = d / (q[0] + e);
+    out[2] = q[0];
+}
+
+static void hsb_to_rgb(const float c[3], float out[3])
+{
+    static const float offsets[3] = {1.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    for (int i = 0; i < 3; i++)
+    {
+        float p = fabsf(fract(c[0] + offsets[i]) * 6.0f - 3.0f);
+        float ramp = fminf(fmaxf(p - 1.0f, 0.0f), 1.0f);
+        out[i] = c[2] * (1.0f + (ramp - 1.0f) * c[1]);
+    }
+}
+
+// The shadow and highlight colors of an already gamma corrected color,
+// times it
+static void grade_corrected(const GlobalParameters *parameters, const float corrected[3], float graded[3])
+{
+    float shadow[3], highlight[3];
+    rgb_to_hsb(corrected, shadow);
+    shadow[0] -= parameters->hueAdjust;
+    shadow[1] *= parameters->saturationAdjust;
+    shadow[2] -= parameters->brightnessAdjust;
+    hsb_to_rgb(shadow, shadow);
+
+    rgb_to_hsb(corrected, highlight);
+    highlight[0] += parameters->hHueAdjust;
+    highlight[1] *= parameters->hSaturationAdjust;
+    highlight[2] += parameters->hBrightnessAdjust;
+    hsb_to_rgb(highlight, highlight);
+
+    for (int i = 0; i < 3; i++)
+    {
+        graded[i] = (shadow[i] + highlight[i]) * corrected[i];
+    }
+}
+
+void grade_color(const GlobalParameters *parameters, const float kd[3], float corrected[3], float graded[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        corrected[i] = powf(kd[i], 1.0f / parameters->gamma);
+    }
+    grade_corrected(parameters, corrected, graded);
+}
+
+void init_color_grade_lut(ColorGradeLut *lut, int size)
+{
+    memset(lut, 0, sizeof(ColorGradeLut));
+    lut->size = size;
+
+    size_t floats = (size_t)size * size * size * 3;
+    lut->corrected = malloc(floats * sizeof(float));
+    lut->graded = malloc(floats * sizeof(float));
+    if (!lut->corrected || !lut->graded)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+int color_grade_lut_stale(const ColorGradeLut *lut, const GlobalParameters *parameters)
+{
+    const GlobalParameters *built = &lut->built;
+    return !lut->valid ||
+           built->hueAdjust != parameters->hueAdjust ||
+           built->saturationAdjust != parameters->saturationAdjust ||
+           built->brightnessAdjust != parameters->brightnessAdjust ||
+           built->hHueAdjust != parameters->hHueAdjust ||
+           built->hSaturationAdjust != parameters->hSaturationAdjust ||
+           built->hBrightnessAdjust != parameters->hBrightnessAdjust ||
+           built->gamma != parameters->gamma;
+}
+
+typedef struct
+{
+    ColorGradeLut *lut;
+    const GlobalParameters *parameters;
+    float *axis_corrected; // kd^(1 / gamma) of each index along an axis
+} LutBuild;
+
+// The kd an entry stands for, the square of its sqrt(kd) coordinate
+static float lut_entry_color(int index, int size)
+{
+    float coordinate = (float)index / (float)(size - 1);
+    return coordinate * coordinate;
+}
+
+static void build_lut_slice(void *context, int z)
+{
+    LutBuild *build = (LutBuild *)context;
+    ColorGradeLut *lut = build->lut;
+    int size = lut->size;
+
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            size_t entry = (((size_t)z * size + y) * size + x) * 3;
+            float *corrected = &lut->corrected[entry];
+            corrected[0] = build->axis_corrected[x];
+            corrected[1] = build->axis_corrected[y];
+            corrected[2] = build->axis_corrected[z];
+            grade_corrected(build->parameters, corrected, &lut->graded[entry]);
+        }
+    }
+}
+
+double build_color_grade_lut(ColorGradeLut *lut, const GlobalParameters *parameters, int thread_count)
+{
+    double start = getTimeSeconds();
+
+    // Gamma correction is per channel, so it only has size distinct values
+    float *axis_corrected = malloc((size_t)lut->size * sizeof(float));
+    if (!axis_corrected)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < lut->size; i++)
+    {
+        axis_corrected[i] = powf(lut_entry_color(i, lut->size), 1.0f / parameters->gamma);
+    }
+
+    LutBuild build = {lut, parameters, axis_corrected};
+    runParallel(lut->size, thread_count > 0 ? thread_count : getCpuCount(), build_lut_slice, &build);
+    free(axis_corrected);
+
+    lut->built = *parameters;
+    lut->valid = 1;
+    return (getTimeSeconds() - start) * 1000.0;
+}
+
+void sample_color_grade_lut(const ColorGradeLut *lut, const float kd[3], float corrected[3], float graded[3])
+{
+    int size = lut->size;
+    int base[3];
+    float weight[3];
+    for (int i = 0; i < 3; i++)
+    {
+        float position = sqrtf(fminf(fmaxf(kd[i], 0.0f), 1.0f)) * (float)(size - 1);
+        base[i] = (int)position;
+        base[i] = base[i] < size - 1 ? base[i] : size - 2;
+        weight[i] = position - (float)base[i];
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        corrected[i] = 0.0f;
+        graded[i] = 0.0f;
+    }
+    for (int corner = 0; corner < 8; corner++)
+    {
+        int dx = corner & 1, dy = (corner >> 1) & 1, dz = corner >> 2;
+        float w = (dx ? weight[0] : 1.0f - weight[0]) * (dy ? weight[1] : 1.0f - weight[1]) * (dz ? weight[2] : 1.0f - weight[2]);
+        size_t entry = (((size_t)(base[2] + dz) * size + base[1] + dy) * size + base[0] + dx) * 3;
+        for (int i = 0; i < 3; i++)
+        {
+            corrected[i] += w * lut->corrected[entry + i];
+            graded[i] += w * lut->graded[entry + i];
+        }
+    }
+}
+
+static int compare_errors(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+int verify_color_grade_lut(const ColorGradeLut *lut, const GlobalParameters *parameters, int sample_count, float p99_tolerance, float max_tolerance)
+{
+    float *errors = malloc((size_t)(sample_count > 0 ? sample_count : 1) * sizeof(float));
+    if (!errors)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    // Fixed seed so runs compare, xorshift so it doesn't touch rand's state
+    unsigned int state = 2463534242u;
+    float random[4];
+    float table_max = 0.0f, worst[3] = {0.0f, 0.0f, 0.0f};
+    double table_sum = 0.0, shaded_sum = 0.0;
+
+    for (int sample = 0; sample < sample_count; sample++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            random[i] = (float)(state >> 8) / 16777215.0f;
+        }
+        const float *kd = random;
+        // Ambient plus anything from no light to full diffuse and specular
+        float light = parameters->ambientStrength + random[3] * (1.0f + parameters->specularStrength);
+
+        float expected_corrected[3], expected_graded[3], corrected[3], graded[3];
+        grade_color(parameters, kd, expected_corrected, expected_graded);
+        sample_color_grade_lut(lut, kd, corrected, graded);
+
+        // The tables can be off by a lot where the grading saturates, so
+        // what counts is the error in the clamped color that gets written
+        float shaded_error = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            float table_error = fmaxf(fabsf(corrected[i] - expected_corrected[i]), fabsf(graded[i] - expected_graded[i]));
+            table_sum += table_error;
+            if (table_error > table_max)
+            {
+                table_max = table_error;
+                memcpy(worst, kd, sizeof(worst));
+            }
+
+            float expected = fminf(fmaxf(light * expected_corrected[i] + expected_graded[i], 0.0f), 1.0f);
+            float shaded = fminf(fmaxf(light * corrected[i] + graded[i], 0.0f), 1.0f);
+            shaded_error = fmaxf(shaded_error, fabsf(shaded - expected));
+        }
+        errors[sample] = shaded_error;
+        shaded_sum += shaded_error;
+    }
+    qsort(errors, (size_t)sample_count, sizeof(float), compare_errors);
+
+    int count = sample_count > 0 ? sample_count : 1;
+    float p99 = sample_count > 0 ? errors[(int)(0.99 * (sample_count - 1) + 0.5)] : 0.0f;
+    float shaded_max = sample_count > 0 ? errors[sample_count - 1] : 0.0f;
+    printf("Color grading LUT %d^3 against the analytic grading, %d colors\n", lut->size, sample_count);
+    printf("  tables: max error %.5f, mean %.6f (worst at %.3f %.3f %.3f)\n", table_max, table_sum / (3.0 * count), worst[0], worst[1], worst[2]);
+    printf("  shaded: max error %.5f (%.2f of 255), mean %.6f, p99 %.5f (%.2f of 255)\n", shaded_max, shaded_max * 255.0f, shaded_sum / count, p99, p99 * 255.0f);
+
+    int passed = p99 <= p99_tolerance && shaded_max <= max_tolerance;
+    printf("  %s, p99 tolerance %.5f, max tolerance %.5f\n", passed ? "passed" : "FAILED", p99_tolerance, max_tolerance);
+
+    free(errors);
+    return passed;
+}
+
+void benchmark_color_grade_lut(const GlobalParameters *parameters, int size, int rebuild_count)
+{
+    ColorGradeLut lut;
+    init_color_grade_lut(&lut, size);
+
+    int cores = getCpuCount();
+    for (int threads = 1;; threads *= 2)
+    {
+        threads = threads < cores ? threads : cores;
+
+        // Alternate the gamma so no rebuild repeats the one before it
+        GlobalParameters changed = *parameters;
+        double total = 0.0, fastest = 1e30;
+        for (int i = 0; i < rebuild_count; i++)
+        {
+            changed.gamma = parameters->gamma + (i & 1 ? 0.1f : 0.0f);
+            double milliseconds = build_color_grade_lut(&lut, &changed, threads);
+            total += milliseconds;
+            fastest = milliseconds < fastest ? milliseconds : fastest;
+        }
+        printf("LUT %d^3 rebuild on %d thread%s: %.3f ms mean, %.3f ms fastest\n", size, threads, threads == 1 ? "" : "s", total / rebuild_count, fastest);
+
+        if (threads == cores)
+        {
+            break;
+        }
+    }
+
+    free_color_grade_lut(&lut);
+}
+
+void free_color_grade_lut(ColorGradeLut *lut)
+{
+    free(lut->corrected);
+    free(lut->graded);
+    lut->corrected = NULL;
+    lut->graded = NULL;
+    lut->valid = 0;
+}
\ No newline at end of file
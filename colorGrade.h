@@ -0,0 +1,63 @@
+#ifndef COLOR_GRADE_H
+#define COLOR_GRADE_H
+
+#include "shading.h"
+
+// Entries along each axis of the lookup tables. They are indexed by
+// sqrt(kd) rather than kd: gamma correction is steep near black and close
+// to linear in that space, so trilinear filtering stays accurate. The
+// grading kinks where two channels cross and the saturation boost
+// steepens it, so the error falls about as 1 / size: 64 leaves 1% of
+// shaded colors 7.7 of 255 levels off, 128 brings that to 2.7.
+#define COLOR_GRADE_LUT_SIZE 128
+
+// What --verify-lut holds the shaded colors to at the default parameters:
+// 99% within 3 of 255 levels and none more than 24 off. 128^3 measures 2.7
+// and 22.6, the mean is well under one level.
+#define COLOR_GRADE_VERIFY_SAMPLES 200000
+#define COLOR_GRADE_VERIFY_P99_TOLERANCE (3.0f / 255.0f)
+#define COLOR_GRADE_VERIFY_MAX_TOLERANCE (24.0f / 255.0f)
+
+// fragmentShader.glsl's grading baked per diffuse color, as two RGB tables
+// of size^3 entries, red fastest. Only the gamma and the six hue,
+// saturation and brightness adjustments go in, the lighting stays per
+// fragment: color = (ambient + diffuse + specular) * corrected + graded.
+typedef struct
+{
+    int size;
+    float *corrected; // kd^(1 / gamma)
+    float *graded;    // (shadow color + highlight color) * corrected
+    GlobalParameters built;
+    int valid;
+} ColorGradeLut;
+
+// The analytic grading the tables are built from: gamma, then the shadow
+// and highlight colors through HSB, like the shader used to per fragment
+void grade_color(const GlobalParameters *parameters, const float kd[3], float corrected[3], float graded[3]);
+
+void init_color_grade_lut(ColorGradeLut *lut, int size);
+
+// Whether a parameter the tables depend on changed since they were built
+int color_grade_lut_stale(const ColorGradeLut *lut, const GlobalParameters *parameters);
+
+// One z slice per task on thread_count threads, 0 uses one per core.
+// Returns the milliseconds taken.
+double build_color_grade_lut(ColorGradeLut *lut, const GlobalParameters *parameters, int thread_count);
+
+// Trilinear, the way GL_LINEAR samples the 3D textures. kd is clamped to
+// 0..1 like the texture coordinates are.
+void sample_color_grade_lut(const ColorGradeLut *lut, const float kd[3], float corrected[3], float graded[3]);
+
+// Compares lookups against grade_color for sample_count random colors, lit
+// by random amounts, and prints the table and shaded color differences.
+// Returns 1 if 99% of the shaded colors are within p99_tolerance and all
+// of them within max_tolerance.
+int verify_color_grade_lut(const ColorGradeLut *lut, const GlobalParameters *parameters, int sample_count, float p99_tolerance, float max_tolerance);
+
+// Times rebuild_count rebuilds at size with 1, 2, 4... threads up to one
+// per core
+void benchmark_color_grade_lut(const GlobalParameters *parameters, int size, int rebuild_count);
+
+void free_color_grade_lut(ColorGradeLut *lut);
+
+#endif // COLOR_GRADE_H
\ No newline at end of file
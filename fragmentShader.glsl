@@ -1,30 +1,57 @@
 #version 330 core
 
+// Permutations from shaderManager.h, defined ahead of this source:
+// LUT_GRADING takes the grading from colorGrade.h's lookups instead of
+// converting to HSB and back per fragment
+// INSTANCED multiplies Kd and d by the instance's tint
+
 out vec4 FragColor;
 
 in vec3 color;
 in vec3 Normal;
 in vec3 FragPos;
 
+#ifdef INSTANCED
+in vec4 tint;
+#endif
+
 uniform vec3 lightColor = vec3(1.0, 1.0, 1.0);
 uniform vec3 lightPos = vec3(1.2, 1.0, -2.0);
-
-uniform float hueAdjust = 0.05;
-uniform float saturationAdjust = 1.8;
-uniform float brightnessAdjust = 0.2;
-
-uniform float hHueAdjust = 0.05;
-uniform float hSaturationAdjust = 1.8;
-uniform float hBrightnessAdjust = 0.2;
-
-// For some objects, 2.2 is a better gamma value
-uniform float gamma = 2.2;
-
-uniform float ambientStrength = 0.1;
-
-uniform float specularStrength = 0.8;
-uniform float specularExponent = 32.0;
-
+uniform vec3 viewPos; // The camera, ShaderTransforms.eye
+
+// GlobalParameters in uniformBuffers.h, std140
+layout(std140) uniform GlobalParameters {
+    float hueAdjust;
+    float saturationAdjust;
+    float brightnessAdjust;
+
+    float hHueAdjust;
+    float hSaturationAdjust;
+    float hBrightnessAdjust;
+
+    // For some objects, 2.2 is a better gamma value
+    float gamma;
+
+    float ambientStrength;
+
+    float specularStrength;
+    float specularExponent; // Used by materials without an Ns
+};
+
+// MaterialParameters in uniformBuffers.h, the drawn material's
+layout(std140) uniform MaterialParameters {
+    vec4 materialDiffuse;  // Kd, d
+    vec4 materialSpecular; // Ks, Ns
+    vec4 materialOptions;  // x: 1 takes Kd from the vertex color
+};
+
+#ifdef LUT_GRADING
+// colorGrade.h, the grading of every diffuse color baked by the CPU and
+// indexed by sqrt(kd): kd^(1 / gamma) and the shadow plus highlight colors
+// times it
+uniform sampler3D correctedLut;
+uniform sampler3D gradedLut;
+#else
 vec3 rgb2hsb(vec3 c) {
     vec4 K = vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
     vec4 p = mix(vec4(c.bg, K.wz), vec4(c.gb, K.xy), step(c.b, c.g));
@@ -39,6 +66,7 @@ vec3 hsb2rgb(vec3 c) {
     vec3 p = abs(fract(c.xxx + vec3(1.0, 2.0 / 3.0, 1.0 / 3.0)) * 6.0 - 3.0);
     return c.z * mix(vec3(1.0), clamp(p - vec3(1.0), 0.0, 1.0), c.y);
 }
+#endif
 
 void main() {
     vec3 ambient = ambientStrength * lightColor;
@@ -48,31 +76,43 @@ void main() {
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * lightColor;
 
-    vec3 viewDir = normalize(-FragPos);
+    vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), specularExponent);
-    vec3 specular = specularStrength * spec * lightColor;
-
-    float kd_corrected_r = pow(color.r, 1.0 / gamma);
-    float kd_corrected_g = pow(color.g, 1.0 / gamma);
-    float kd_corrected_b = pow(color.b, 1.0 / gamma);
-
-    vec3 kd_corrected = vec3(kd_corrected_r, kd_corrected_g, kd_corrected_b);
+    float exponent = materialSpecular.a > 0.0 ? materialSpecular.a : specularExponent;
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), exponent);
+    vec3 specular = specularStrength * spec * lightColor * materialSpecular.rgb;
+
+    vec3 kd = mix(materialDiffuse.rgb, color, materialOptions.x);
+    float alpha = materialDiffuse.a;
+#ifdef INSTANCED
+    kd *= tint.rgb;
+    alpha *= tint.a;
+#endif
+
+#ifdef LUT_GRADING
+    // Onto texel centers, so 0 and 1 land on the first and last entries
+    float lutSize = float(textureSize(correctedLut, 0).x);
+    vec3 lutCoordinate = sqrt(clamp(kd, 0.0, 1.0)) * ((lutSize - 1.0) / lutSize) + 0.5 / lutSize;
+    vec3 kd_corrected = texture(correctedLut, lutCoordinate).rgb;
+    vec3 graded = texture(gradedLut, lutCoordinate).rgb;
+#else
+    vec3 kd_corrected = pow(kd, vec3(1.0 / gamma));
 
     vec3 shadowColor = rgb2hsb(kd_corrected);
     shadowColor.r -= hueAdjust;
     shadowColor.g *= saturationAdjust;
     shadowColor.b -= brightnessAdjust;
-
     shadowColor = hsb2rgb(shadowColor);
 
-    vec3 highligthColor = rgb2hsb(kd_corrected);
-    highligthColor.r += hHueAdjust;
-    highligthColor.g *= hSaturationAdjust;
-    highligthColor.b += hBrightnessAdjust;
+    vec3 highlightColor = rgb2hsb(kd_corrected);
+    highlightColor.r += hHueAdjust;
+    highlightColor.g *= hSaturationAdjust;
+    highlightColor.b += hBrightnessAdjust;
+    highlightColor = hsb2rgb(highlightColor);
 
-    highligthColor = hsb2rgb(highligthColor);
+    vec3 graded = (shadowColor + highlightColor) * kd_corrected;
+#endif
 
-    vec3 result = (ambient + diffuse + shadowColor + specular + highligthColor) * kd_corrected;
-    FragColor = vec4(result, 1.0);
+    vec3 result = (ambient + diffuse + specular) * kd_corrected + graded;
+    FragColor = vec4(result, alpha);
 }
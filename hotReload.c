@@ -0,0 +1,493 @@
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "hotReload.h"
+#include "meshCache.h"
+#include "meshNormals.h"
+#include "meshOptimize.h"
+#include "shaderManager.h"
+#include "utils.h"
+
+// Index of each file in the watch list
+#define WATCH_OBJ 0
+#define WATCH_MTL 1
+#define WATCH_VERTEX_SOURCE 2
+#define WATCH_FRAGMENT_SOURCE 3
+#define WATCH_FILES 4
+
+typedef struct
+{
+    const char *path;
+    const char *name; // After the last slash
+    int watch;        // inotify watch of its directory, -1 when polling
+    long long size;   // Last seen, when polling
+    long long mtime;
+    double first; // When the unsettled change was first seen, 0 if none
+    double last;  // Its latest event
+} WatchedFile;
+
+static void push_hot_reload(HotReloader *reloader, HotReload *reload)
+{
+    HotReloadQueue *queue = &reloader->queue;
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        if (queue->count < HOT_RELOAD_QUEUE_CAPACITY)
+        {
+            queue->items[(queue->head + queue->count) % HOT_RELOAD_QUEUE_CAPACITY] = reload;
+            queue->count++;
+            pthread_mutex_unlock(&queue->lock);
+            return;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        // Full, the render thread takes one per frame at most. Waiting on
+        // the stop pipe so a closing window never hangs here.
+        struct pollfd stop = {reloader->stop_pipe[0], POLLIN, 0};
+        if (poll(&stop, 1, 1) > 0)
+        {
+            free_hot_reload(reload);
+            return;
+        }
+    }
+}
+
+HotReload *poll_hot_reload(HotReloader *reloader)
+{
+    HotReloadQueue *queue = &reloader->queue;
+    HotReload *reload = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0)
+    {
+        reload = queue->items[queue->head];
+        queue->head = (queue->head + 1) % HOT_RELOAD_QUEUE_CAPACITY;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return reload;
+}
+
+static HotReload *create_hot_reload(HotReloadKind kind, double saved)
+{
+    HotReload *reload = calloc(1, sizeof(HotReload));
+    if (!reload)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    reload->kind = kind;
+    reload->saved = saved;
+    return reload;
+}
+
+// This thread's material table, handed over as a copy
+static void take_material_table(HotReload *reload)
+{
+    reload->material_count = material_count;
+    reload->materials = malloc(((size_t)material_count + 1) * sizeof(Material));
+    if (!reload->materials)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(reload->materials, materials, (size_t)material_count * sizeof(Material));
+    free_materials();
+}
+
+static HotReload *reload_materials(const HotReloader *reloader, double saved)
+{
+    // A save by rename has the file missing for a moment, the next event
+    // follows once it is back
+    double start = getTimeSeconds();
+    free_materials();
+    if (!try_read_mtl_file(reloader->mtl_filename))
+    {
+        perror("Skipped reloading the MTL");
+        free_materials();
+        return NULL;
+    }
+
+    HotReload *reload = create_hot_reload(HOT_RELOAD_MATERIALS, saved);
+    take_material_table(reload);
+    reload->milliseconds = (getTimeSeconds() - start) * 1000.0;
+    return reload;
+}
+
+static HotReload *reload_mesh(const HotReloader *reloader, double saved)
+{
+    double start = getTimeSeconds();
+
+    Vertex *vertices = NULL;
+    TexCoord *texCoords = NULL;
+    Normal *normals = NULL;
+    Face *faces = NULL;
+    int vertex_count = 0, vertex_capacity = 0;
+    int texCoord_count = 0, texCoord_capacity = 0;
+    int normal_count = 0, normal_capacity = 0;
+    int face_count = 0, face_capacity = 0;
+
+    // The MTL first, so usemtl finds the names it defines. Either file can
+    // be missing for a moment during a save by rename.
+    free_materials();
+    int loaded = try_read_mtl_file(reloader->mtl_filename);
+    if (loaded && reloader->thread_count == 1)
+    {
+        loaded = try_read_obj_file(reloader->obj_filename, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+    }
+    else if (loaded)
+    {
+        loaded = try_read_obj_file_parallel(reloader->obj_filename, reloader->thread_count, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+    }
+    if (!loaded)
+    {
+        perror("Skipped reloading the mesh");
+    }
+
+    // Otherwise most likely caught halfway through a save, the next event
+    // follows
+    if (!loaded || face_count == 0)
+    {
+        free(vertices);
+        free(texCoords);
+        free(normals);
+        free(faces);
+        free_materials();
+        return NULL;
+    }
+
+    if (reloader->crease_angle >= 0.0f)
+    {
+        normal_count = generate_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, reloader->crease_angle, reloader->thread_count, &normals, NULL);
+        normal_capacity = normal_count;
+    }
+    else
+    {
+        repair_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, reloader->thread_count, &normals, &normal_count, &normal_capacity);
+    }
+
+    HotReload *reload = create_hot_reload(HOT_RELOAD_MESH, saved);
+    reload->range_count = sort_faces_by_material(faces, face_count, &reload->ranges);
+    build_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, &reload->mesh);
+    free(vertices);
+    free(texCoords);
+    free(normals);
+    free(faces);
+
+    if (reloader->cache_flags & MESH_CACHE_OPTIMIZED)
+    {
+        optimize_gpu_mesh(&reload->mesh, reload->ranges, reload->range_count, NULL);
+    }
+
+    // The next start maps the result instead of parsing again. Normals
+    // made at a crease angle aren't the OBJ's, they stay out of the cache.
+    MeshCacheWriter writer;
+    if (reloader->crease_angle < 0.0f && open_mesh_cache_writer(&writer, reloader->obj_filename, reloader->mtl_filename, reloader->cache_flags))
+    {
+        MeshSink cacheSink = mesh_cache_writer_sink(&writer);
+        stream_gpu_arrays(reload->mesh.vertices, reload->mesh.vertex_count, reload->mesh.indices, reload->mesh.index_count, &cacheSink);
+        finish_mesh_cache_writer(&writer, materials, material_count, NULL, 0, reload->ranges, reload->range_count);
+    }
+
+    take_material_table(reload);
+    reload->milliseconds = (getTimeSeconds() - start) * 1000.0;
+    return reload;
+}
+
+static HotReload *reload_shaders(double saved)
+{
+    double start = getTimeSeconds();
+    char *vertexSource = readShaderSource(SHADER_VERTEX_SOURCE);
+    char *fragmentSource = readShaderSource(SHADER_FRAGMENT_SOURCE);
+    if (!vertexSource || !fragmentSource)
+    {
+        free(vertexSource);
+        free(fragmentSource);
+        return NULL;
+    }
+
+    HotReload *reload = create_hot_reload(HOT_RELOAD_SHADERS, saved);
+    reload->vertex_source = vertexSource;
+    reload->fragment_source = fragmentSource;
+    reload->milliseconds = (getTimeSeconds() - start) * 1000.0;
+    return reload;
+}
+
+static void init_watched_file(WatchedFile *file, const char *path)
+{
+    memset(file, 0, sizeof(WatchedFile));
+    file->path = path;
+    const char *slash = strrchr(path, '/');
+    file->name = slash ? slash + 1 : path;
+    file->watch = -1;
+    getFileInfo(path, &file->size, &file->mtime);
+}
+
+static void mark_changed(WatchedFile *file, double now)
+{
+    file->first = file->first > 0.0 ? file->first : now;
+    file->last = now;
+}
+
+// When a change that has had HOT_RELOAD_SETTLE_MS of quiet was first seen,
+// 0 while there is none
+static double take_settled(WatchedFile *file, double now)
+{
+    if (file->first <= 0.0 || (now - file->last) * 1000.0 < HOT_RELOAD_SETTLE_MS)
+    {
+        return 0.0;
+    }
+    double first = file->first;
+    file->first = 0.0;
+    return first;
+}
+
+#ifdef __linux__
+// Directories rather than files, editors that save by renaming a new file
+// over the old one would leave a file watch on the deleted inode
+static int watch_directories(WatchedFile *files, int file_count)
+{
+    int inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < file_count; i++)
+    {
+        char directory[1024];
+        int length = (int)(files[i].name - files[i].path);
+        snprintf(directory, sizeof(directory), "%.*s", length > 0 ? length : 1, length > 0 ? files[i].path : ".");
+
+        // Adding a directory twice returns the same watch
+        files[i].watch = inotify_add_watch(inotify, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (files[i].watch < 0)
+        {
+            close(inotify);
+            return -1;
+        }
+    }
+    return inotify;
+}
+
+static void read_inotify_events(int inotify, WatchedFile *files, int file_count, double now)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(inotify, buffer, sizeof(buffer))) > 0)
+    {
+        for (char *at = buffer; at < buffer + length;)
+        {
+            const struct inotify_event *event = (const struct inotify_event *)at;
+            for (int i = 0; i < file_count && event->len > 0; i++)
+            {
+                if (event->wd == files[i].watch && strcmp(event->name, files[i].name) == 0)
+                {
+                    mark_changed(&files[i], now);
+                }
+            }
+            at += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+#endif
+
+static void poll_modification_times(WatchedFile *files, int file_count, double now)
+{
+    for (int i = 0; i < file_count; i++)
+    {
+        long long size = 0, mtime = 0;
+        getFileInfo(files[i].path, &size, &mtime);
+        if (size != files[i].size || mtime != files[i].mtime)
+        {
+            files[i].size = size;
+            files[i].mtime = mtime;
+            mark_changed(&files[i], now);
+        }
+    }
+}
+
+static void *hot_reload_worker(void *argument)
+{
+    HotReloader *reloader = (HotReloader *)argument;
+
+    // Shaders last, so without a model the watch list is just its tail
+    WatchedFile files[WATCH_FILES];
+    init_watched_file(&files[WATCH_OBJ], reloader->obj_filename);
+    init_watched_file(&files[WATCH_MTL], reloader->mtl_filename);
+    init_watched_file(&files[WATCH_VERTEX_SOURCE], SHADER_VERTEX_SOURCE);
+    init_watched_file(&files[WATCH_FRAGMENT_SOURCE], SHADER_FRAGMENT_SOURCE);
+    WatchedFile *watched = reloader->obj_filename[0] ? files : &files[WATCH_VERTEX_SOURCE];
+    int watched_count = reloader->obj_filename[0] ? WATCH_FILES : WATCH_FILES - WATCH_VERTEX_SOURCE;
+
+    int inotify = -1;
+#ifdef __linux__
+    inotify = watch_directories(watched, watched_count);
+#endif
+    printf("Watching %d files for changes%s\n", watched_count, inotify >= 0 ? " with inotify" : ", polling");
+
+    for (;;)
+    {
+        // Until something happens, the next poll, or the earliest pending
+        // change settles
+        int timeout = inotify >= 0 ? -1 : HOT_RELOAD_POLL_MS;
+        double now = getTimeSeconds();
+        for (int i = 0; i < watched_count; i++)
+        {
+            if (watched[i].first > 0.0)
+            {
+                int settle = (int)(HOT_RELOAD_SETTLE_MS - (now - watched[i].last) * 1000.0) + 1;
+                settle = settle > 0 ? settle : 0;
+                timeout = timeout < 0 || settle < timeout ? settle : timeout;
+            }
+        }
+
+        struct pollfd descriptors[2] = {{reloader->stop_pipe[0], POLLIN, 0}, {inotify, POLLIN, 0}};
+        poll(descriptors, inotify >= 0 ? 2 : 1, timeout);
+        if (descriptors[0].revents)
+        {
+            break;
+        }
+
+        now = getTimeSeconds();
+#ifdef __linux__
+        if (inotify >= 0)
+        {
+            read_inotify_events(inotify, watched, watched_count, now);
+        }
+#endif
+        if (inotify < 0)
+        {
+            poll_modification_times(watched, watched_count, now);
+        }
+
+        double objSaved = reloader->obj_filename[0] ? take_settled(&files[WATCH_OBJ], now) : 0.0;
+        double mtlSaved = reloader->obj_filename[0] ? take_settled(&files[WATCH_MTL], now) : 0.0;
+        double vertexSaved = take_settled(&files[WATCH_VERTEX_SOURCE], now);
+        double fragmentSaved = take_settled(&files[WATCH_FRAGMENT_SOURCE], now);
+        double shaderSaved = vertexSaved > 0.0 && (fragmentSaved <= 0.0 || vertexSaved < fragmentSaved) ? vertexSaved : fragmentSaved;
+
+        HotReload *reload = NULL;
+        if (objSaved > 0.0 && reloader->reload_mesh)
+        {
+            // The rebuild reads the MTL too
+            double saved = mtlSaved > 0.0 && mtlSaved < objSaved ? mtlSaved : objSaved;
+            if ((reload = reload_mesh(reloader, saved)) != NULL)
+            {
+                push_hot_reload(reloader, reload);
+            }
+            mtlSaved = 0.0;
+        }
+        else if (objSaved > 0.0)
+        {
+            printf("%s changed, geometry only reloads without --packed, --meshlets, --lod and --pick\n", reloader->obj_filename);
+        }
+
+        if (mtlSaved > 0.0 && (reload = reload_materials(reloader, mtlSaved)) != NULL)
+        {
+            push_hot_reload(reloader, reload);
+        }
+        if (shaderSaved > 0.0 && (reload = reload_shaders(shaderSaved)) != NULL)
+        {
+            push_hot_reload(reloader, reload);
+        }
+    }
+
+    if (inotify >= 0)
+    {
+        close(inotify);
+    }
+    free_materials();
+    return NULL;
+}
+
+int start_hot_reload(HotReloader *reloader, const char *model_name, int reload_mesh, int thread_count, uint32_t cache_flags, float crease_angle)
+{
+    memset(reloader, 0, sizeof(HotReloader));
+    if (model_name)
+    {
+        snprintf(reloader->obj_filename, sizeof(reloader->obj_filename), "%s.obj", model_name);
+        snprintf(reloader->mtl_filename, sizeof(reloader->mtl_filename), "%s.mtl", model_name);
+    }
+    reloader->reload_mesh = reload_mesh;
+    reloader->thread_count = thread_count;
+    // Meshes are only reloaded without meshlets and LODs, what is written
+    // is the plain model's cache every other path also accepts
+    reloader->cache_flags = cache_flags & (MESH_CACHE_OPTIMIZED | MESH_CACHE_MATERIAL_RANGES);
+    reloader->crease_angle = crease_angle;
+
+    if (pipe(reloader->stop_pipe) != 0)
+    {
+        return 0;
+    }
+    pthread_mutex_init(&reloader->queue.lock, NULL);
+    if (pthread_create(&reloader->thread, NULL, hot_reload_worker, reloader) != 0)
+    {
+        pthread_mutex_destroy(&reloader->queue.lock);
+        close(reloader->stop_pipe[0]);
+        close(reloader->stop_pipe[1]);
+        return 0;
+    }
+
+    reloader->running = 1;
+    return 1;
+}
+
+int merge_material_table(Material *table, int count, const Material *reloaded, int reloaded_count)
+{
+    int updated = 0;
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = 0; j < reloaded_count; j++)
+        {
+            if (strcmp(table[i].name, reloaded[j].name) == 0)
+            {
+                table[i] = reloaded[j];
+                updated++;
+                break;
+            }
+        }
+    }
+    return updated;
+}
+
+void stop_hot_reload(HotReloader *reloader)
+{
+    if (!reloader->running)
+    {
+        return;
+    }
+
+    char wake = 1;
+    if (write(reloader->stop_pipe[1], &wake, 1) != 1)
+    {
+        perror("Failed to stop the file watcher");
+    }
+    pthread_join(reloader->thread, NULL);
+    reloader->running = 0;
+
+    HotReload *reload;
+    while ((reload = poll_hot_reload(reloader)) != NULL)
+    {
+        free_hot_reload(reload);
+    }
+    pthread_mutex_destroy(&reloader->queue.lock);
+    close(reloader->stop_pipe[0]);
+    close(reloader->stop_pipe[1]);
+}
+
+void free_hot_reload(HotReload *reload)
+{
+    free(reload->materials);
+    free_gpu_mesh(&reload->mesh);
+    free(reload->ranges);
+    free(reload->vertex_source);
+    free(reload->fragment_source);
+    free(reload);
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "loader.h"
+#include "mesh.h"
+
+// Events for one file closer together than this are one save, editors
+// write, truncate and rename in several steps
+#define HOT_RELOAD_SETTLE_MS 50
+
+// How often files are checked where there is no inotify
+#define HOT_RELOAD_POLL_MS 250
+
+// Reloads waiting for the render thread
+#define HOT_RELOAD_QUEUE_CAPACITY 8
+
+typedef enum
+{
+    HOT_RELOAD_MATERIALS, // The MTL changed, only the material table
+    HOT_RELOAD_MESH,      // The OBJ changed, geometry and materials
+    HOT_RELOAD_SHADERS    // A GLSL source changed
+} HotReloadKind;
+
+// A change already parsed on the watcher's thread, for the render thread
+// to swap in
+typedef struct
+{
+    HotReloadKind kind;
+    double saved;        // getTimeSeconds when the change was seen
+    double milliseconds; // Parsing and building on the watcher's thread
+
+    // MATERIALS and MESH, the table as the MTL now reads. A MESH's faces
+    // index it, a MATERIALS table is merged by name.
+    Material *materials;
+    int material_count;
+
+    // MESH, built like the first load with faces sorted by material
+    GpuMesh mesh;
+    MaterialRange *ranges;
+    int range_count;
+
+    // SHADERS, both sources as they are now
+    char *vertex_source;
+    char *fragment_source;
+} HotReload;
+
+// Single producer, single consumer, the mutex is only held for a pointer
+// copy like MeshQueue's
+typedef struct
+{
+    pthread_mutex_t lock;
+    HotReload *items[HOT_RELOAD_QUEUE_CAPACITY];
+    int head;
+    int count;
+} HotReloadQueue;
+
+typedef struct
+{
+    pthread_t thread;
+    HotReloadQueue queue;
+    int running;
+    int stop_pipe[2]; // Written to wake the thread up for good
+
+    char obj_filename[1024]; // Empty when only shaders are watched
+    char mtl_filename[1024];
+    int reload_mesh; // 0 leaves OBJ changes to the next start
+    int thread_count;
+    uint32_t cache_flags;
+    float crease_angle; // Negative only repairs missing normals
+} HotReloader;
+
+// Watches the model's OBJ and MTL, unless model_name is NULL, and the GLSL
+// sources on a thread of its own: inotify on Linux, polling the
+// modification times elsewhere. An OBJ change is only rebuilt with
+// reload_mesh, parsed on thread_count threads and written to the mesh
+// cache with cache_flags (only MESH_CACHE_OPTIMIZED and
+// MESH_CACHE_MATERIAL_RANGES are applied). A crease_angle of 0 or more
+// regenerates every normal at it and writes no cache, like --crease-angle
+// on the first load. Returns 0 if the thread can't be started.
+int start_hot_reload(HotReloader *reloader, const char *model_name, int reload_mesh, int thread_count, uint32_t cache_flags, float crease_angle);
+
+// Next parsed change, NULL while there is none. Never blocks; the caller
+// owns the result and frees it with free_hot_reload.
+HotReload *poll_hot_reload(HotReloader *reloader);
+
+// Copies the reloaded values into table by name, so face material IDs stay
+// valid. Materials the MTL no longer has keep theirs, new ones are left
+// out as no face uses them. Returns how many were updated.
+int merge_material_table(Material *table, int count, const Material *reloaded, int reloaded_count);
+
+// Stops the thread and drops anything it queued that was never taken
+void stop_hot_reload(HotReloader *reloader);
+
+void free_hot_reload(HotReload *reload);
+
+#endif // HOT_RELOAD_H
\ No newline at end of file
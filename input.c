@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+#include "glfw3.h"
+#include "input.h"
+#include "logger.h"
+#include "utils.h"
+
+// Set on ready while the render thread hasn't taken it
+#define INPUT_SNAPSHOT_FRESH 4
+
+// What each digit key edits, by the digit
+static const struct
+{
+    const char *name;
+    size_t offset;
+} edited_parameters[10] = {
+    {"specularExponent", offsetof(GlobalParameters, specularExponent)},
+    {"hueAdjust", offsetof(GlobalParameters, hueAdjust)},
+    {"saturationAdjust", offsetof(GlobalParameters, saturationAdjust)},
+    {"brightnessAdjust", offsetof(GlobalParameters, brightnessAdjust)},
+    {"hHueAdjust", offsetof(GlobalParameters, hHueAdjust)},
+    {"hSaturationAdjust", offsetof(GlobalParameters, hSaturationAdjust)},
+    {"hBrightnessAdjust", offsetof(GlobalParameters, hBrightnessAdjust)},
+    {"gamma", offsetof(GlobalParameters, gamma)},
+    {"ambientStrength", offsetof(GlobalParameters, ambientStrength)},
+    {"specularStrength", offsetof(GlobalParameters, specularStrength)},
+};
+
+static float *edited_value(GlobalParameters *parameters, int edit)
+{
+    return (float *)((char *)parameters + edited_parameters[edit].offset);
+}
+
+// Logs the edited parameter if it moved since it was last logged, at most
+// every INPUT_LOG_INTERVAL unless forced
+static void log_edited_parameter(InputController *input, double now, int force)
+{
+    float value = *edited_value(&input->state.parameters, input->state.edit);
+    if (value == input->logged_value || (!force && now - input->logged < INPUT_LOG_INTERVAL))
+    {
+        return;
+    }
+    log_message("%s: %f\n", edited_parameters[input->state.edit].name, value);
+    input->logged = now;
+    input->logged_value = value;
+}
+
+// Returns 1 if the event changed what the next snapshot holds
+static int apply_input_event(InputController *input, const InputEvent *event, double now)
+{
+    if (event->key >= GLFW_KEY_0 && event->key <= GLFW_KEY_9)
+    {
+        int edit = event->key - GLFW_KEY_0;
+        if (event->action != GLFW_PRESS || edit == input->state.edit)
+        {
+            return 0;
+        }
+
+        // Where the previous parameter stopped, then start from the new one
+        log_edited_parameter(input, now, 1);
+        input->state.edit = edit;
+        input->logged_value = *edited_value(&input->state.parameters, edit);
+        return 1;
+    }
+
+    int *held;
+    if (event->key == GLFW_KEY_RIGHT)
+    {
+        held = &input->right;
+    }
+    else if (event->key == GLFW_KEY_LEFT)
+    {
+        held = &input->left;
+    }
+    else
+    {
+        return 0;
+    }
+
+    // Repeats only say the key is still down
+    int down = event->action != GLFW_RELEASE;
+    if (*held == down)
+    {
+        return 0;
+    }
+    *held = down;
+    if (down && input->state.input_time == 0.0)
+    {
+        input->state.input_time = event->time;
+    }
+    return 1;
+}
+
+static void publish_snapshot(InputController *input)
+{
+    InputSnapshot *snapshot = &input->snapshots[input->back];
+    *snapshot = input->state;
+
+    // A snapshot the render thread never took hands its key on, so the
+    // latency is measured to the frame that finally shows it
+    int ready = __atomic_load_n(&input->ready, __ATOMIC_ACQUIRE);
+    if (ready & INPUT_SNAPSHOT_FRESH)
+    {
+        double skipped = input->snapshots[ready & ~INPUT_SNAPSHOT_FRESH].input_time;
+        if (skipped > 0.0 && (snapshot->input_time == 0.0 || skipped < snapshot->input_time))
+        {
+            snapshot->input_time = skipped;
+        }
+    }
+
+    input->back = __atomic_exchange_n(&input->ready, input->back | INPUT_SNAPSHOT_FRESH, __ATOMIC_ACQ_REL) & ~INPUT_SNAPSHOT_FRESH;
+    input->state.input_time = 0.0;
+}
+
+static void *input_thread(void *argument)
+{
+    InputController *input = (InputController *)argument;
+    InputQueue *queue = &input->queue;
+    const double step = 1.0 / INPUT_UPDATE_HZ;
+
+    while (!__atomic_load_n(&input->stopping, __ATOMIC_ACQUIRE))
+    {
+        double now = getTimeSeconds();
+        int moving = input->right != input->left;
+        int changed = 0;
+
+        unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        while (queue->head != tail)
+        {
+            changed |= apply_input_event(input, &queue->events[queue->head & (INPUT_QUEUE_CAPACITY - 1)], now);
+            __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+        }
+
+        // A press steps at once and starts the grid of fixed steps there,
+        // a late step is caught up by the next few unless it is so late
+        // that it starts a new grid
+        int direction = input->right - input->left;
+        if (direction != 0 && !moving)
+        {
+            input->next_step = now;
+        }
+        else if (input->next_step < now - 4.0 * step)
+        {
+            input->next_step = now;
+        }
+        if (direction != 0 && now >= input->next_step)
+        {
+            *edited_value(&input->state.parameters, input->state.edit) += direction * INPUT_ADJUST_PER_SECOND * (float)step;
+            input->next_step += step;
+            changed = 1;
+        }
+        log_edited_parameter(input, now, direction == 0);
+
+        if (changed)
+        {
+            publish_snapshot(input);
+        }
+        __atomic_store_n(&input->handled, tail, __ATOMIC_RELEASE);
+
+        // Idle until a key while none is held, otherwise until the next
+        // step unless a key comes first
+        fd_set wake;
+        FD_ZERO(&wake);
+        FD_SET(input->wake_pipe[0], &wake);
+        struct timeval timeout = {0, 0};
+        if (direction != 0)
+        {
+            double wait = input->next_step - getTimeSeconds();
+            wait = wait > 0.0 ? wait : 0.0;
+            timeout.tv_sec = (time_t)wait;
+            timeout.tv_usec = (suseconds_t)((wait - (time_t)wait) * 1e6);
+        }
+        if (select(input->wake_pipe[0] + 1, &wake, NULL, NULL, direction != 0 ? &timeout : NULL) > 0)
+        {
+            char wakes[64];
+            if (read(input->wake_pipe[0], wakes, sizeof(wakes)) < 0)
+            {
+                perror("Failed to read the input wake pipe");
+            }
+        }
+    }
+    return NULL;
+}
+
+int start_input(InputController *input, const GlobalParameters *parameters)
+{
+    memset(input, 0, sizeof(InputController));
+    input->state.parameters = *parameters;
+    input->state.edit = 1;
+    input->logged_value = *edited_value(&input->state.parameters, input->state.edit);
+    for (int i = 0; i < 3; i++)
+    {
+        input->snapshots[i] = input->state;
+    }
+    input->back = 0;
+    input->ready = 1;
+    input->front = 2;
+
+    // Pushing never waits on a full pipe, the thread is awake then anyway
+    if (pipe(input->wake_pipe) != 0)
+    {
+        return 0;
+    }
+    fcntl(input->wake_pipe[1], F_SETFL, fcntl(input->wake_pipe[1], F_GETFL) | O_NONBLOCK);
+    if (pthread_create(&input->thread, NULL, input_thread, input) != 0)
+    {
+        close(input->wake_pipe[0]);
+        close(input->wake_pipe[1]);
+        return 0;
+    }
+    input->running = 1;
+    return 1;
+}
+
+static void wake_input_thread(InputController *input)
+{
+    char wake = 1;
+    if (write(input->wake_pipe[1], &wake, 1) < 0 && errno != EAGAIN)
+    {
+        perror("Failed to wake the input thread");
+    }
+}
+
+void push_input_event(InputController *input, int key, int action)
+{
+    InputQueue *queue = &input->queue;
+    unsigned int tail = queue->tail;
+    if (!input->running || tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == INPUT_QUEUE_CAPACITY)
+    {
+        queue->dropped++;
+        return;
+    }
+    queue->events[tail & (INPUT_QUEUE_CAPACITY - 1)] = (InputEvent){key, action, getTimeSeconds()};
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    wake_input_thread(input);
+}
+
+void wait_for_input(InputController *input)
+{
+    unsigned int tail = input->queue.tail;
+    if (!input->running || __atomic_load_n(&input->handled, __ATOMIC_ACQUIRE) == tail)
+    {
+        return;
+    }
+
+    double deadline = getTimeSeconds() + INPUT_HANDOFF_MS / 1000.0;
+    struct timespec pause = {0, 50000};
+    while (__atomic_load_n(&input->handled, __ATOMIC_ACQUIRE) != tail && getTimeSeconds() < deadline)
+    {
+        nanosleep(&pause, NULL);
+    }
+}
+
+const InputSnapshot *latest_input_snapshot(InputController *input)
+{
+    if (__atomic_load_n(&input->ready, __ATOMIC_ACQUIRE) & INPUT_SNAPSHOT_FRESH)
+    {
+        input->front = __atomic_exchange_n(&input->ready, input->front, __ATOMIC_ACQ_REL) & ~INPUT_SNAPSHOT_FRESH;
+    }
+    return &input->snapshots[input->front];
+}
+
+void input_frame_shown(InputController *input, const InputSnapshot *snapshot, double now)
+{
+    // A key handed on from a skipped snapshot can show up twice
+    if (snapshot->input_time <= input->shown_input_time)
+    {
+        return;
+    }
+    input->shown_input_time = snapshot->input_time;
+
+    double latency = now - snapshot->input_time;
+    input->latency_count++;
+    input->latency_total += latency;
+    input->latency_worst = latency > input->latency_worst ? latency : input->latency_worst;
+}
+
+void print_input_latency(const InputController *input)
+{
+    if (input->latency_count > 0)
+    {
+        printf("Key to swap %.2f ms on average, %.2f ms worst, over %d keys\n", input->latency_total * 1000.0 / input->latency_count, input->latency_worst * 1000.0, input->latency_count);
+    }
+    if (input->queue.dropped > 0)
+    {
+        printf("The key queue was full, dropped %d events\n", input->queue.dropped);
+    }
+}
+
+void stop_input(InputController *input)
+{
+    if (!input->running)
+    {
+        return;
+    }
+    __atomic_store_n(&input->stopping, 1, __ATOMIC_RELEASE);
+    wake_input_thread(input);
+    pthread_join(input->thread, NULL);
+    input->running = 0;
+    close(input->wake_pipe[0]);
+    close(input->wake_pipe[1]);
+}
\ No newline at end of file
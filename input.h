@@ -0,0 +1,111 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <pthread.h>
+#include "shading.h"
+
+// Key events waiting for the update thread, a power of two
+#define INPUT_QUEUE_CAPACITY 256
+
+// Parameter updates per second while an arrow key is held, whatever the
+// frame rate
+#define INPUT_UPDATE_HZ 120
+
+// Longest the render thread waits for the update thread to apply the keys
+// it just queued
+#define INPUT_HANDOFF_MS 2
+
+// What holding an arrow key adds per second, 0.01 a frame at 60 Hz as
+// when keys were polled by the render loop
+#define INPUT_ADJUST_PER_SECOND 0.6f
+
+// Seconds between logs of a parameter while its key is held, the value it
+// stops at is always logged
+#define INPUT_LOG_INTERVAL 0.1
+
+typedef struct
+{
+    int key;     // GLFW_KEY_*
+    int action;  // GLFW_PRESS, GLFW_REPEAT or GLFW_RELEASE
+    double time; // getTimeSeconds when GLFW delivered it
+} InputEvent;
+
+// Single producer, single consumer without locks: GLFW's callback on the
+// render thread writes, the update thread reads
+typedef struct
+{
+    InputEvent events[INPUT_QUEUE_CAPACITY];
+    unsigned int head; // Next read, the update thread's
+    unsigned int tail; // Next write, the render thread's
+    int dropped;
+} InputQueue;
+
+// What the render thread draws with, published whole by the update thread
+typedef struct
+{
+    GlobalParameters parameters;
+    int edit; // Parameter the arrow keys change, its digit key
+
+    // getTimeSeconds of the earliest key that changed something since the
+    // render thread last took a snapshot, 0 if none did
+    double input_time;
+} InputSnapshot;
+
+typedef struct
+{
+    pthread_t thread;
+    InputQueue queue;
+    int running;
+    int stopping;
+    int wake_pipe[2]; // Written after a push or to stop, so an idle thread sleeps
+    unsigned int handled; // Queue position published up to
+
+    // Triple buffered: the update thread fills back, swaps it with ready
+    // and the render thread swaps ready with front when it is newer.
+    // A flag on ready marks it as not yet taken.
+    InputSnapshot snapshots[3];
+    int back;
+    int ready;
+    int front;
+
+    // The update thread's own
+    InputSnapshot state;
+    int left, right; // Arrow keys held
+    double next_step;
+    double logged;   // When the edited parameter was last logged
+    float logged_value;
+
+    // The render thread's own: from a key to the swap of the first frame
+    // that showed it
+    double shown_input_time;
+    int latency_count;
+    double latency_total;
+    double latency_worst;
+} InputController;
+
+// Starts the update thread from parameters with parameter 1 being edited.
+// Returns 0 if the thread can't be started.
+int start_input(InputController *input, const GlobalParameters *parameters);
+
+// For GLFW's key callback, on the thread that polls events. Never blocks; a
+// full queue drops the event.
+void push_input_event(InputController *input, int key, int action);
+
+// After polling events: waits until the update thread published what the
+// keys pushed so far changed, at most INPUT_HANDOFF_MS, so they show in the
+// next frame. Returns at once when none were pushed.
+void wait_for_input(InputController *input);
+
+// The newest snapshot, valid until the next call
+const InputSnapshot *latest_input_snapshot(InputController *input);
+
+// After the swap of a frame drawn with snapshot, counts its key's latency
+// the first time it shows
+void input_frame_shown(InputController *input, const InputSnapshot *snapshot, double now);
+
+// Average and worst milliseconds from a key to the swap that showed it
+void print_input_latency(const InputController *input);
+
+void stop_input(InputController *input);
+
+#endif // INPUT_H
\ No newline at end of file
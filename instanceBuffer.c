@@ -0,0 +1,187 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <string.h>
+#include "instanceBuffer.h"
+#include "shading.h"
+#include "uniformBuffers.h"
+#include "upload.h"
+#include "utils.h"
+
+void initInstanceBuffer(InstanceBuffer *instances, int capacity)
+{
+    memset(instances, 0, sizeof(InstanceBuffer));
+    instances->capacity = capacity;
+    instances->regionBytes = (GLsizeiptr)capacity * INSTANCE_FLOATS * sizeof(GLfloat);
+
+    glGenBuffers(1, &instances->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+    glBufferData(GL_ARRAY_BUFFER, instances->regionBytes * INSTANCE_BUFFER_FRAMES, NULL, GL_STREAM_DRAW);
+}
+
+float *mapInstanceFrame(InstanceBuffer *instances, int count)
+{
+    GLsync *fence = &instances->fences[instances->region];
+    if (*fence)
+    {
+        // Polled first so a region that is free costs no flush
+        if (glClientWaitSync(*fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            instances->stalls++;
+            while (glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+        }
+        glDeleteSync(*fence);
+        *fence = 0;
+    }
+
+    GLsizeiptr bytes = (GLsizeiptr)(count < instances->capacity ? count : instances->capacity) * INSTANCE_FLOATS * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+    return glMapBufferRange(GL_ARRAY_BUFFER, instances->region * instances->regionBytes, bytes > 0 ? bytes : 1, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void unmapInstanceFrame(InstanceBuffer *instances)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    // GL 3.3 has no base instance, so the attributes are moved to the
+    // region instead
+    GLsizei stride = INSTANCE_FLOATS * sizeof(GLfloat);
+    for (int i = 0; i < 4; i++)
+    {
+        GLuint location = INSTANCE_ATTRIBUTE_LOCATION + i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid *)(instances->region * instances->regionBytes + i * 4 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+void fenceInstanceFrame(InstanceBuffer *instances)
+{
+    instances->fences[instances->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    instances->region = (instances->region + 1) % INSTANCE_BUFFER_FRAMES;
+}
+
+void freeInstanceBuffer(InstanceBuffer *instances)
+{
+    for (int i = 0; i < INSTANCE_BUFFER_FRAMES; i++)
+    {
+        if (instances->fences[i])
+        {
+            glDeleteSync(instances->fences[i]);
+        }
+    }
+    glDeleteBuffers(1, &instances->buffer);
+    memset(instances, 0, sizeof(InstanceBuffer));
+}
+
+// The program's camera uniforms for the frame the benchmark draws
+static void setBenchmarkCamera(GLuint program, const ShaderTransforms *transforms, const VertexPacker *packer)
+{
+    if (packer)
+    {
+        setPackedVertexUniforms(program, packer);
+    }
+    bindUniformBlocks(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, (const GLfloat *)transforms->model.columns);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewProjection"), 1, GL_FALSE, (const GLfloat *)transforms->view_projection.columns);
+    glUniformMatrix3fv(glGetUniformLocation(program, "normalMatrix"), 1, GL_FALSE, transforms->normal_matrix);
+    glUniform3f(glGetUniformLocation(program, "viewPos"), transforms->eye[0], transforms->eye[1], transforms->eye[2]);
+}
+
+void benchmarkInstancedDraws(ShaderManager *manager, unsigned int permutation, const VertexPacker *packer, GLuint vertexArray, GLsizei indexCount, GLenum indexType, const float boundsMin[3], const float boundsMax[3], int threadCount)
+{
+    GLuint instancedProgram = getShaderProgram(manager, permutation | SHADER_INSTANCED);
+    GLuint singleProgram = getShaderProgram(manager, permutation & ~SHADER_INSTANCED);
+    if (!instancedProgram || !singleProgram)
+    {
+        fprintf(stderr, "Shaders for the instancing benchmark failed to build\n");
+        return;
+    }
+
+    ShaderTransforms transforms;
+    shader_transforms(0.0f, 1.0f, &transforms);
+    setBenchmarkCamera(singleProgram, &transforms, packer);
+    GLint modelLocation = glGetUniformLocation(singleProgram, "model");
+    GLint normalMatrixLocation = glGetUniformLocation(singleProgram, "normalMatrix");
+    setBenchmarkCamera(instancedProgram, &transforms, packer);
+
+    InstanceBuffer buffer;
+    initInstanceBuffer(&buffer, INSTANCE_BENCHMARK_MAX);
+    glBindVertexArray(vertexArray);
+
+    const double frameBudget = 1000.0 / 60.0;
+    int instancedFits = 0, singleFits = 0;
+    double singleMilliseconds = 0.0;
+
+    printf("Instanced draws against a draw per instance, %d triangles each, ms per frame\n", indexCount / 3);
+    printf("  %9s %10s %10s\n", "instances", "instanced", "per draw");
+    for (int count = 256; count <= INSTANCE_BENCHMARK_MAX; count *= 2)
+    {
+        InstanceSet set;
+        init_instance_grid(&set, count, boundsMin, boundsMax);
+
+        glUseProgram(instancedProgram);
+        glFinish();
+        double start = getTimeSeconds();
+        for (int frame = 0; frame < INSTANCE_BENCHMARK_FRAMES; frame++)
+        {
+            float *data = mapInstanceFrame(&buffer, count);
+            update_instances(&set, frame / 60.0f, threadCount, data);
+            unmapInstanceFrame(&buffer);
+            glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, count);
+            fenceInstanceFrame(&buffer);
+        }
+        glFinish();
+        double instancedMilliseconds = (getTimeSeconds() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        instancedFits = instancedMilliseconds <= frameBudget ? count : instancedFits;
+
+        // Stops once it is well past the budget, the larger counts would
+        // only take long to say the same
+        int timeSingle = singleMilliseconds <= 4.0 * frameBudget;
+        if (timeSingle)
+        {
+            glUseProgram(singleProgram);
+            glFinish();
+            start = getTimeSeconds();
+            for (int frame = 0; frame < INSTANCE_BENCHMARK_FRAMES; frame++)
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    Mat4 instance = instance_matrix(&set, i, frame / 60.0f);
+                    Mat4 model = mat4_multiply(&transforms.model, &instance);
+                    GLfloat normalMatrix[9];
+                    mat4_normal_matrix(&model, normalMatrix);
+                    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, (const GLfloat *)model.columns);
+                    glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, normalMatrix);
+                    glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+                }
+            }
+            glFinish();
+            singleMilliseconds = (getTimeSeconds() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+            singleFits = singleMilliseconds <= frameBudget ? count : singleFits;
+            printf("  %9d %10.2f %10.2f\n", count, instancedMilliseconds, singleMilliseconds);
+        }
+        else
+        {
+            printf("  %9d %10.2f %10s\n", count, instancedMilliseconds, "-");
+        }
+
+        free_instances(&set);
+        if (instancedMilliseconds > 4.0 * frameBudget && !timeSingle)
+        {
+            break;
+        }
+    }
+
+    printf("At 60 Hz: %d instances instanced, %d with a draw each, %d waits on the instance buffer\n", instancedFits, singleFits, buffer.stalls);
+
+    for (int i = 0; i < 4; i++)
+    {
+        glDisableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION + i);
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+    freeInstanceBuffer(&buffer);
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <GL/glew.h>
+#include "instances.h"
+#include "shaderManager.h"
+#include "vertexPack.h"
+
+// Frames the instance attributes are spread over: the CPU fills one region
+// while the GPU may still be reading the two before it
+#define INSTANCE_BUFFER_FRAMES 3
+
+// Location of instanceRow0 in vertexShader.glsl, the other three follow
+#define INSTANCE_ATTRIBUTE_LOCATION 3
+
+// benchmarkInstancedDraws doubles the count up to this many and times
+// this many frames of each
+#define INSTANCE_BENCHMARK_MAX 262144
+#define INSTANCE_BENCHMARK_FRAMES 20
+
+// One buffer of INSTANCE_BUFFER_FRAMES regions, each fenced after the
+// frame that draws from it, so filling one never waits on a draw in flight
+typedef struct
+{
+    GLuint buffer;
+    GLsizeiptr regionBytes;
+    GLsync fences[INSTANCE_BUFFER_FRAMES];
+    int region; // Filled this frame
+    int capacity;
+    int stalls; // Frames that had to wait for their region
+} InstanceBuffer;
+
+void initInstanceBuffer(InstanceBuffer *instances, int capacity);
+
+// This frame's region mapped for count instances, unsynchronized, so the
+// driver never copies or waits on its own. Waits for the region's fence
+// first, which only blocks when the GPU is INSTANCE_BUFFER_FRAMES behind.
+float *mapInstanceFrame(InstanceBuffer *instances, int count);
+
+// Unmaps the region and points the instance attributes of the bound vertex
+// array at it
+void unmapInstanceFrame(InstanceBuffer *instances);
+
+// After the frame's instanced draws: fences the region and moves on
+void fenceInstanceFrame(InstanceBuffer *instances);
+
+void freeInstanceBuffer(InstanceBuffer *instances);
+
+// Times instances per frame drawn with one glDrawElementsInstanced from an
+// InstanceBuffer against a glDrawElements per instance with its matrices
+// set as uniforms, doubling the count until both are past a 60 Hz frame,
+// and prints how many instances each fits in one. permutation is the
+// shader without SHADER_INSTANCED; packer is NULL unless it has
+// SHADER_PACKED_VERTICES. Unbinds the vertex array and leaves no program
+// in use.
+void benchmarkInstancedDraws(ShaderManager *manager, unsigned int permutation, const VertexPacker *packer, GLuint vertexArray, GLsizei indexCount, GLenum indexType, const float boundsMin[3], const float boundsMax[3], int threadCount);
+
+#endif // INSTANCE_BUFFER_H
\ No newline at end of file
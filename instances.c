@@ -0,0 +1,264 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "instances.h"
+#include "scene.h"
+#include "threads.h"
+#include "utils.h"
+
+typedef struct
+{
+    const InstanceSet *set;
+    float time;
+    float *out;
+} InstanceUpdate;
+
+static float *allocate_lanes(int padded)
+{
+    size_t size = (size_t)(padded > 0 ? padded : 4) * sizeof(float);
+    float *lanes = aligned_alloc(16, size);
+    if (!lanes)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(lanes, 0, size);
+    return lanes;
+}
+
+// Fixed seed so runs place the same crowd, xorshift so it doesn't touch
+// rand's state
+static float next_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+void init_instance_grid(InstanceSet *set, int count, const float bounds_min[3], const float bounds_max[3])
+{
+    memset(set, 0, sizeof(InstanceSet));
+    set->count = count;
+
+    int padded = (count + 3) & ~3;
+    set->x = allocate_lanes(padded);
+    set->y = allocate_lanes(padded);
+    set->z = allocate_lanes(padded);
+    set->scale = allocate_lanes(padded);
+    set->phase = allocate_lanes(padded);
+    set->speed = allocate_lanes(padded);
+    for (int c = 0; c < 4; c++)
+    {
+        set->tint[c] = allocate_lanes(padded);
+    }
+
+    float extent = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        set->center[i] = 0.5f * (bounds_min[i] + bounds_max[i]);
+        extent = fmaxf(extent, bounds_max[i] - bounds_min[i]);
+    }
+
+    int side = 1;
+    while ((long long)side * side * side < count)
+    {
+        side++;
+    }
+    float cell_size = 2.0f * SCENE_HALF_EXTENT / side;
+    float fit = extent > 0.0f ? cell_size * INSTANCE_CELL_FILL / extent : 1.0f;
+
+    uint32_t state = 2463534242u;
+    for (int i = 0; i < count; i++)
+    {
+        set->x[i] = -SCENE_HALF_EXTENT + cell_size * (i % side + 0.5f);
+        set->y[i] = SCENE_HALF_EXTENT - cell_size * (i / side % side + 0.5f);
+        set->z[i] = -SCENE_HALF_EXTENT + cell_size * (i / side / side + 0.5f);
+        set->scale[i] = fit * (0.8f + 0.2f * next_random(&state));
+        set->phase[i] = 6.2831853f * next_random(&state);
+        set->speed[i] = 2.0f * next_random(&state) - 1.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            set->tint[c][i] = 0.6f + 0.4f * next_random(&state);
+        }
+        set->tint[3][i] = 1.0f;
+    }
+}
+
+// Sine and cosine of four angles: reduced by quarter turns to [-pi/4,
+// pi/4] with pi/2 in three parts, then the Cephes single precision
+// polynomials, a few ulps from sinf and cosf
+static void sin_cos4(VecFloat4 angle, VecFloat4 *sine, VecFloat4 *cosine)
+{
+    // Rounded to the nearest quarter turn by pushing the fraction out of
+    // the mantissa
+    VecFloat4 rounded = (angle * 0.63661977f + 12582912.0f) - 12582912.0f;
+    VecInt4 quadrant = __builtin_convertvector(rounded, VecInt4);
+
+    VecFloat4 r = angle - rounded * 1.5703125f;
+    r = r - rounded * 4.837512969970703125e-4f;
+    r = r - rounded * 7.54978995489188216e-8f;
+    VecFloat4 r2 = r * r;
+
+    VecFloat4 s = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    VecFloat4 c = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+    // Odd quadrants swap the two, the sign follows the quadrant
+    VecInt4 swap = (quadrant & 1) != 0;
+    VecInt4 sine_bits = ((VecInt4)c & swap) | ((VecInt4)s & ~swap);
+    VecInt4 cosine_bits = ((VecInt4)s & swap) | ((VecInt4)c & ~swap);
+    const VecInt4 sign = {INT_MIN, INT_MIN, INT_MIN, INT_MIN};
+    sine_bits ^= sign & ((quadrant & 2) != 0);
+    cosine_bits ^= sign & (((quadrant + 1) & 2) != 0);
+
+    *sine = (VecFloat4)sine_bits;
+    *cosine = (VecFloat4)cosine_bits;
+}
+
+static void update_instances_task(void *context, int chunk)
+{
+    const InstanceUpdate *update = (const InstanceUpdate *)context;
+    const InstanceSet *set = update->set;
+    int begin = chunk * INSTANCE_CHUNK;
+    int end = begin + INSTANCE_CHUNK < set->count ? begin + INSTANCE_CHUNK : set->count;
+
+    for (int i = begin; i < end; i += 4)
+    {
+        // The arrays are padded, the lanes past the end are read and
+        // never written
+        VecFloat4 scale = *(const VecFloat4 *)&set->scale[i];
+        VecFloat4 sine, cosine;
+        sin_cos4(*(const VecFloat4 *)&set->phase[i] + *(const VecFloat4 *)&set->speed[i] * update->time, &sine, &cosine);
+
+        // Rotation about Y times scale, spinning about the mesh's center
+        VecFloat4 a = cosine * scale;
+        VecFloat4 b = sine * scale;
+        VecFloat4 x = *(const VecFloat4 *)&set->x[i] - (a * set->center[0] + b * set->center[2]);
+        VecFloat4 y = *(const VecFloat4 *)&set->y[i] - scale * set->center[1];
+        VecFloat4 z = *(const VecFloat4 *)&set->z[i] - (a * set->center[2] - b * set->center[0]);
+
+        int lanes = end - i < 4 ? end - i : 4;
+        for (int l = 0; l < lanes; l++)
+        {
+            float *row = &update->out[(size_t)(i + l) * INSTANCE_FLOATS];
+            row[0] = a[l], row[1] = 0.0f, row[2] = b[l], row[3] = x[l];
+            row[4] = 0.0f, row[5] = scale[l], row[6] = 0.0f, row[7] = y[l];
+            row[8] = -b[l], row[9] = 0.0f, row[10] = a[l], row[11] = z[l];
+            for (int c = 0; c < 4; c++)
+            {
+                row[12 + c] = set->tint[c][i + l];
+            }
+        }
+    }
+}
+
+void update_instances(const InstanceSet *set, float time, int thread_count, float *out)
+{
+    InstanceUpdate update = {set, time, out};
+    int chunks = (set->count + INSTANCE_CHUNK - 1) / INSTANCE_CHUNK;
+    runParallel(chunks, thread_count > 0 ? thread_count : getCpuCount(), update_instances_task, &update);
+}
+
+Mat4 instance_matrix(const InstanceSet *set, int instance, float time)
+{
+    float scale = set->scale[instance];
+    Vec3 center = vec3(set->center[0], set->center[1], set->center[2]) * scale;
+    Mat4 rotation = mat4_rotation(vec3(0.0f, 1.0f, 0.0f), set->phase[instance] + set->speed[instance] * time);
+    Vec4 offset = mat4_transform(&rotation, vec4(center[0], center[1], center[2], 0.0f));
+    Mat4 translation = mat4_translation(vec3(set->x[instance] - offset[0], set->y[instance] - offset[1], set->z[instance] - offset[2]));
+    Mat4 scaling = mat4_scale(vec3(scale, scale, scale));
+
+    Mat4 rotated = mat4_multiply(&rotation, &scaling);
+    return mat4_multiply(&translation, &rotated);
+}
+
+// What update_instances replaces: one instance at a time with libm
+static void update_instances_scalar(const InstanceSet *set, float time, float *out)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        float angle = set->phase[i] + set->speed[i] * time;
+        float a = cosf(angle) * set->scale[i];
+        float b = sinf(angle) * set->scale[i];
+
+        float *row = &out[(size_t)i * INSTANCE_FLOATS];
+        row[0] = a, row[1] = 0.0f, row[2] = b, row[3] = set->x[i] - (a * set->center[0] + b * set->center[2]);
+        row[4] = 0.0f, row[5] = set->scale[i], row[6] = 0.0f, row[7] = set->y[i] - set->scale[i] * set->center[1];
+        row[8] = -b, row[9] = 0.0f, row[10] = a, row[11] = set->z[i] - (a * set->center[2] - b * set->center[0]);
+        for (int c = 0; c < 4; c++)
+        {
+            row[12 + c] = set->tint[c][i];
+        }
+    }
+}
+
+void benchmark_instance_updates(int count, int frames)
+{
+    const float bounds_min[3] = {-1.0f, -1.0f, -1.0f};
+    const float bounds_max[3] = {1.0f, 1.0f, 1.0f};
+    InstanceSet set;
+    init_instance_grid(&set, count, bounds_min, bounds_max);
+
+    float *scalar = malloc((size_t)count * INSTANCE_FLOATS * sizeof(float) + 1);
+    float *vector = malloc((size_t)count * INSTANCE_FLOATS * sizeof(float) + 1);
+    if (!scalar || !vector)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = getTimeSeconds();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        update_instances_scalar(&set, frame / 60.0f, scalar);
+    }
+    double scalar_seconds = getTimeSeconds() - start;
+
+    start = getTimeSeconds();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        update_instances(&set, frame / 60.0f, 1, vector);
+    }
+    double vector_seconds = getTimeSeconds() - start;
+
+    start = getTimeSeconds();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        update_instances(&set, frame / 60.0f, 0, vector);
+    }
+    double parallel_seconds = getTimeSeconds() - start;
+
+    // Both wrote the last frame, they should agree to a few ulps
+    float largest = 0.0f;
+    for (size_t i = 0; i < (size_t)count * INSTANCE_FLOATS; i++)
+    {
+        largest = fmaxf(largest, fabsf(scalar[i] - vector[i]));
+    }
+
+    double per_instance = 1e9 / ((double)count * (frames > 0 ? frames : 1));
+    printf("Instance updates, %d instances over %d frames, largest difference %.2g\n", count, frames, largest);
+    printf("  scalar:  %8.2f ns per instance\n", scalar_seconds * per_instance);
+    printf("  SIMD:    %8.2f ns per instance\n", vector_seconds * per_instance);
+    printf("  SIMD x%d: %8.2f ns per instance\n", getCpuCount(), parallel_seconds * per_instance);
+
+    free(scalar);
+    free(vector);
+    free_instances(&set);
+}
+
+void free_instances(InstanceSet *set)
+{
+    free(set->x);
+    free(set->y);
+    free(set->z);
+    free(set->scale);
+    free(set->phase);
+    free(set->speed);
+    for (int c = 0; c < 4; c++)
+    {
+        free(set->tint[c]);
+    }
+    memset(set, 0, sizeof(InstanceSet));
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef INSTANCES_H
+#define INSTANCES_H
+
+#include "vecMath.h"
+
+// Instances updated per task
+#define INSTANCE_CHUNK 4096
+
+// Floats per instance in the attribute buffer: the first three rows of its
+// affine transform, then its tint. vertexShader.glsl reads them as
+// instanceRow0..2 and instanceTint.
+#define INSTANCE_FLOATS 16
+
+// Fraction of its grid cell an instance fills at scale 1
+#define INSTANCE_CELL_FILL 0.8f
+
+// Copies of one mesh, one entry per instance in each array so an update
+// reads four instances per SIMD load. Arrays are 16 byte aligned and padded
+// to a multiple of 4.
+typedef struct
+{
+    int count;
+    float center[3];  // Of the mesh bounds, what instances spin about
+    float *x, *y, *z; // Where the center goes
+    float *scale;
+    float *phase; // Spin about the instance's own Y, phase + speed * time
+    float *speed; // Radians per second
+    float *tint[4]; // Multiplies Kd and d, the material override
+} InstanceSet;
+
+// Spreads count instances of a mesh with the given bounds over a cubic grid
+// as wide as a scene, each spinning at its own speed with its own tint
+void init_instance_grid(InstanceSet *set, int count, const float bounds_min[3], const float bounds_max[3]);
+
+// Writes every instance's INSTANCE_FLOATS at time into out, four instances
+// at a time with vecMath's vectors, INSTANCE_CHUNK instances per task on
+// thread_count threads (0 = one per core)
+void update_instances(const InstanceSet *set, float time, int thread_count, float *out);
+
+// One instance's transform, the way a draw per instance needs it
+Mat4 instance_matrix(const InstanceSet *set, int instance, float time);
+
+// Times update_instances over count instances against a scalar loop with
+// libm's sinf and cosf, on one thread and on every core. Prints
+// nanoseconds per instance.
+void benchmark_instance_updates(int count, int frames);
+
+void free_instances(InstanceSet *set);
+
+#endif // INSTANCES_H
\ No newline at end of file
@@ -0,0 +1,897 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "loader.h"
+#include "profiler.h"
+#include "utils.h"
+#include "threads.h"
+
+_Thread_local Material *materials = NULL;
+_Thread_local int material_count = 0;
+static _Thread_local int material_capacity = 0;
+
+// Open addressing index from material name to ID, -1 marks an empty slot.
+// Kept at most half full.
+static _Thread_local int *material_index = NULL;
+static _Thread_local unsigned int material_index_size = 0;
+
+// Largest mantissa a float holds exactly, and the powers of ten that are
+// exact as floats. A mantissa and exponent inside both bounds converts
+// with a single correctly rounded multiply or divide, which is the same
+// result strtof (and so sscanf) gives.
+#define FAST_FLOAT_MAX_MANTISSA (1ull << 24)
+#define FAST_FLOAT_MAX_EXPONENT 10
+
+// Parallel loads cut the file into a few chunks per thread, each at least
+// this many bytes
+#define OBJ_CHUNKS_PER_THREAD 4
+#define OBJ_MIN_CHUNK_SIZE (64 * 1024)
+
+static const float exact_powers_of_ten[FAST_FLOAT_MAX_EXPONENT + 1] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static const char *skip_spaces(const char *p, const char *end)
+{
+    while (p < end && is_space(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char *parse_int(const char *p, const char *end, int *value, int *ok)
+{
+    p = skip_spaces(p, end);
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (p >= end || !is_digit(*p))
+    {
+        *ok = 0;
+        return p;
+    }
+
+    int result = 0;
+    while (p < end && is_digit(*p))
+    {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+
+    *value = negative ? -result : result;
+    *ok = 1;
+    return p;
+}
+
+static const char *parse_float(const char *p, const char *end, float *value)
+{
+    p = skip_spaces(p, end);
+    const char *start = p;
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    int truncated = 0;
+
+    while (p < end && is_digit(*p))
+    {
+        if (mantissa < 100000000000000000ull)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+        else
+        {
+            truncated |= *p != '0';
+            exponent++;
+        }
+        digits++;
+        p++;
+    }
+
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && is_digit(*p))
+        {
+            if (mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            else
+            {
+                truncated |= *p != '0';
+            }
+            digits++;
+            p++;
+        }
+    }
+
+    if (digits > 0 && p < end && (*p == 'e' || *p == 'E'))
+    {
+        // A dangling "e" or "e+" is swallowed without digits, like sscanf does
+        p++;
+        int exponentNegative = 0;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            exponentNegative = *p == '-';
+            p++;
+        }
+        int e = 0;
+        while (p < end && is_digit(*p))
+        {
+            if (e < 10000)
+            {
+                e = e * 10 + (*p - '0');
+            }
+            p++;
+        }
+        exponent += exponentNegative ? -e : e;
+    }
+
+    if (digits > 0 && !truncated)
+    {
+        while (mantissa > FAST_FLOAT_MAX_MANTISSA && mantissa % 10 == 0)
+        {
+            mantissa /= 10;
+            exponent++;
+        }
+
+        if (mantissa <= FAST_FLOAT_MAX_MANTISSA && exponent >= -FAST_FLOAT_MAX_EXPONENT && exponent <= FAST_FLOAT_MAX_EXPONENT)
+        {
+            float result = (float)mantissa;
+            if (exponent < 0)
+            {
+                result /= exact_powers_of_ten[-exponent];
+            }
+            else
+            {
+                result *= exact_powers_of_ten[exponent];
+            }
+            *value = negative ? -result : result;
+            return p;
+        }
+    }
+
+    // Rare long or odd tokens (nan, inf, 20 digit mantissas) go through
+    // strtof on a terminated copy, the mapping itself has no NUL to stop at
+    const char *tokenEnd = start;
+    while (tokenEnd < end && !is_space(*tokenEnd) && *tokenEnd != '\n' && *tokenEnd != '/')
+    {
+        tokenEnd++;
+    }
+
+    char token[64];
+    size_t length = (size_t)(tokenEnd - start);
+    if (length >= sizeof(token))
+    {
+        length = sizeof(token) - 1;
+    }
+    memcpy(token, start, length);
+    token[length] = '\0';
+
+    char *parsedEnd;
+    *value = strtof(token, &parsedEnd);
+    return start + (parsedEnd - token);
+}
+
+static void grow_array(void **array, int *capacity, size_t elementSize)
+{
+    PROFILE_SCOPE(obj_grow);
+    *capacity *= 2; // Double the capacity
+    *array = realloc(*array, *capacity * elementSize);
+    if (!*array)
+    {
+        perror("Failed to reallocate memory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// One newline-aligned slice of an OBJ file and everything parsed out of it.
+// The serial loader parses the whole file as a single chunk.
+typedef struct
+{
+    const char *begin;
+    const char *end;
+
+    Vertex *vertices;
+    int vertex_count;
+    int vertex_capacity;
+
+    TexCoord *texCoords;
+    int texCoord_count;
+    int texCoord_capacity;
+
+    Normal *normals;
+    int normal_count;
+    int normal_capacity;
+
+    Face *faces;
+    int face_count;
+    int face_capacity;
+
+    // usemtl names seen in this chunk, pointing into the mapping. While
+    // parsing, faces store an index into this list; they are turned into
+    // interned material IDs in file order once every chunk is done, so IDs
+    // never depend on thread timing.
+    const char **material_names;
+    int *material_name_lengths;
+    int *material_ids;
+    int material_name_count;
+    int material_name_capacity;
+
+    // usemtl state crossing chunk boundaries: faces ahead of the first
+    // usemtl in a chunk belong to whatever material the chunks before it
+    // left active
+    int has_usemtl;
+    int faces_before_usemtl;
+    int inherited_material;
+
+    // Where this chunk lands in the stitched arrays
+    int vertex_offset;
+    int texCoord_offset;
+    int normal_offset;
+    int face_offset;
+} ObjChunk;
+
+static void init_obj_chunk(ObjChunk *chunk, int initial_capacity)
+{
+    // Initialize counts and capacities, can be adjusted as needed
+    chunk->vertex_count = 0;
+    chunk->vertex_capacity = initial_capacity;
+    chunk->vertices = malloc(chunk->vertex_capacity * sizeof(Vertex));
+
+    chunk->texCoord_count = 0;
+    chunk->texCoord_capacity = initial_capacity;
+    chunk->texCoords = malloc(chunk->texCoord_capacity * sizeof(TexCoord));
+
+    chunk->normal_count = 0;
+    chunk->normal_capacity = initial_capacity;
+    chunk->normals = malloc(chunk->normal_capacity * sizeof(Normal));
+
+    chunk->face_count = 0;
+    chunk->face_capacity = initial_capacity;
+    chunk->faces = malloc(chunk->face_capacity * sizeof(Face));
+
+    if (!chunk->vertices || !chunk->texCoords || !chunk->normals || !chunk->faces)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    chunk->material_names = NULL;
+    chunk->material_name_lengths = NULL;
+    chunk->material_ids = NULL;
+    chunk->material_name_count = 0;
+    chunk->material_name_capacity = 0;
+
+    chunk->has_usemtl = 0;
+    chunk->faces_before_usemtl = 0;
+    chunk->inherited_material = -1;
+}
+
+static void free_obj_chunk_materials(ObjChunk *chunk)
+{
+    free(chunk->material_names);
+    free(chunk->material_name_lengths);
+    free(chunk->material_ids);
+}
+
+static void parse_obj_chunk(ObjChunk *chunk)
+{
+    int current_material = -1;
+
+    const char *end = chunk->end;
+    const char *p = chunk->begin;
+
+    // Records come in long runs of one type, each run is one span. Lines
+    // of other types count toward the run before them.
+    PROFILE_RUN(records);
+
+    while (p < end)
+    {
+        // Every record is parsed straight out of the mapping, bounded by
+        // its own line so long lines are never truncated
+        const char *lineEnd = memchr(p, '\n', (size_t)(end - p));
+        if (!lineEnd)
+        {
+            lineEnd = end;
+        }
+
+        if (p[0] == 'v' && lineEnd - p > 1 && is_space(p[1]))
+        {
+            PROFILE_RUN_STEP(records, obj_v);
+            Vertex vertex = {0};
+            const char *q = parse_float(p + 2, lineEnd, &vertex.x);
+            q = parse_float(q, lineEnd, &vertex.y);
+            parse_float(q, lineEnd, &vertex.z);
+
+            if (chunk->vertex_count >= chunk->vertex_capacity)
+            {
+                grow_array((void **)&chunk->vertices, &chunk->vertex_capacity, sizeof(Vertex));
+            }
+
+            chunk->vertices[chunk->vertex_count++] = vertex;
+        }
+        else if (p[0] == 'v' && lineEnd - p > 2 && p[1] == 't' && is_space(p[2]))
+        {
+            PROFILE_RUN_STEP(records, obj_vt);
+            TexCoord texCoord = {0};
+            const char *q = parse_float(p + 3, lineEnd, &texCoord.u);
+            parse_float(q, lineEnd, &texCoord.v);
+
+            if (chunk->texCoord_count >= chunk->texCoord_capacity)
+            {
+                grow_array((void **)&chunk->texCoords, &chunk->texCoord_capacity, sizeof(TexCoord));
+            }
+
+            chunk->texCoords[chunk->texCoord_count++] = texCoord;
+        }
+        else if (p[0] == 'v' && lineEnd - p > 2 && p[1] == 'n' && is_space(p[2]))
+        {
+            PROFILE_RUN_STEP(records, obj_vn);
+            Normal normal = {0};
+            const char *q = parse_float(p + 3, lineEnd, &normal.x);
+            q = parse_float(q, lineEnd, &normal.y);
+            parse_float(q, lineEnd, &normal.z);
+
+            if (chunk->normal_count >= chunk->normal_capacity)
+            {
+                grow_array((void **)&chunk->normals, &chunk->normal_capacity, sizeof(Normal));
+            }
+
+            chunk->normals[chunk->normal_count++] = normal;
+        }
+        else if (lineEnd - p > 7 && strncmp(p, "usemtl", 6) == 0 && is_space(p[6]))
+        {
+            PROFILE_RUN_STEP(records, obj_usemtl);
+            const char *name = skip_spaces(p + 7, lineEnd);
+            int length = 0;
+            while (name + length < lineEnd && !is_space(name[length]))
+            {
+                length++;
+            }
+
+            if (chunk->material_name_count >= chunk->material_name_capacity)
+            {
+                chunk->material_name_capacity = chunk->material_name_capacity ? chunk->material_name_capacity * 2 : 8;
+                chunk->material_names = realloc(chunk->material_names, chunk->material_name_capacity * sizeof(const char *));
+                chunk->material_name_lengths = realloc(chunk->material_name_lengths, chunk->material_name_capacity * sizeof(int));
+                if (!chunk->material_names || !chunk->material_name_lengths)
+                {
+                    perror("Failed to reallocate memory");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            current_material = chunk->material_name_count++;
+            chunk->material_names[current_material] = name;
+            chunk->material_name_lengths[current_material] = length;
+            chunk->has_usemtl = 1;
+        }
+        else if (p[0] == 'f' && lineEnd - p > 1 && is_space(p[1]))
+        {
+            PROFILE_RUN_STEP(records, obj_f);
+            // v, v/vt, v//vn and v/vt/vn corners, whatever a corner leaves
+            // out stays 0, which no OBJ index is
+            Face face = {0};
+            int corners = 0;
+            int ok = 1;
+            const char *q = p + 2;
+
+            for (int i = 0; i < 3 && ok; i++)
+            {
+                q = parse_int(q, lineEnd, &face.vertexIndex[i], &ok);
+                if (ok && q < lineEnd && *q == '/')
+                {
+                    q++;
+                    if (q < lineEnd && *q != '/')
+                    {
+                        q = parse_int(q, lineEnd, &face.texCoordIndex[i], &ok);
+                    }
+                    if (ok && q < lineEnd && *q == '/')
+                    {
+                        q = parse_int(q + 1, lineEnd, &face.normalIndex[i], &ok);
+                    }
+                }
+                corners += ok;
+            }
+
+            if (corners == 3)
+            {
+                face.materialId = current_material;
+
+                if (chunk->face_count >= chunk->face_capacity)
+                {
+                    grow_array((void **)&chunk->faces, &chunk->face_capacity, sizeof(Face));
+                }
+
+                chunk->faces[chunk->face_count++] = face;
+                if (!chunk->has_usemtl)
+                {
+                    chunk->faces_before_usemtl++;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Error: Expected 3 face corners, got %d\n", corners);
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+
+    PROFILE_RUN_END(records);
+}
+
+// Interns this chunk's usemtl names in file order. active is the material
+// left active by the chunks before it and comes back updated.
+static void intern_obj_chunk_materials(ObjChunk *chunk, int *active)
+{
+    chunk->inherited_material = *active;
+
+    chunk->material_ids = malloc((chunk->material_name_count + 1) * sizeof(int));
+    if (!chunk->material_ids)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < chunk->material_name_count; i++)
+    {
+        chunk->material_ids[i] = intern_material(chunk->material_names[i], chunk->material_name_lengths[i]);
+    }
+
+    if (chunk->has_usemtl)
+    {
+        *active = chunk->material_ids[chunk->material_name_count - 1];
+    }
+}
+
+// Swaps the chunk-local usemtl indices in faces for interned IDs. Faces
+// ahead of the chunk's first usemtl take whatever the previous chunks left
+// active.
+static void resolve_obj_chunk_faces(const ObjChunk *chunk, Face *faces)
+{
+    for (int i = 0; i < chunk->faces_before_usemtl; i++)
+    {
+        faces[i].materialId = chunk->inherited_material;
+    }
+    for (int i = chunk->faces_before_usemtl; i < chunk->face_count; i++)
+    {
+        faces[i].materialId = chunk->material_ids[faces[i].materialId];
+    }
+}
+
+int try_read_obj_file(const char *filename, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity)
+{
+    PROFILE_BEGIN(obj_open);
+    size_t size = 0;
+    const char *data = mapFile(filename, &size);
+    PROFILE_END(obj_open);
+    if (!data)
+    {
+        return 0;
+    }
+
+    ObjChunk chunk;
+    init_obj_chunk(&chunk, 10); // Initial capacity, can be adjusted as needed
+    chunk.begin = data;
+    chunk.end = data + size;
+
+    parse_obj_chunk(&chunk);
+
+    int active = -1;
+    intern_obj_chunk_materials(&chunk, &active);
+    resolve_obj_chunk_faces(&chunk, chunk.faces);
+    free_obj_chunk_materials(&chunk);
+
+    unmapFile(data, size);
+
+    *vertices = chunk.vertices;
+    *vertex_count = chunk.vertex_count;
+    *vertex_capacity = chunk.vertex_capacity;
+
+    *texCoords = chunk.texCoords;
+    *textCoord_count = chunk.texCoord_count;
+    *texCoord_capacity = chunk.texCoord_capacity;
+
+    *normals = chunk.normals;
+    *normal_count = chunk.normal_count;
+    *normal_capacity = chunk.normal_capacity;
+
+    *faces = chunk.faces;
+    *face_count = chunk.face_count;
+    *face_capacity = chunk.face_capacity;
+    return 1;
+}
+
+void read_obj_file(const char *filename, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity)
+{
+    if (!try_read_obj_file(filename, vertices, vertex_count, vertex_capacity, texCoords, textCoord_count, texCoord_capacity, normals, normal_count, normal_capacity, faces, face_count, face_capacity))
+    {
+        perror("Failed to open file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+typedef struct
+{
+    ObjChunk *chunks;
+    Vertex *vertices;
+    TexCoord *texCoords;
+    Normal *normals;
+    Face *faces;
+} ObjStitch;
+
+static void parse_obj_chunk_task(void *context, int taskIndex)
+{
+    parse_obj_chunk(&((ObjChunk *)context)[taskIndex]);
+}
+
+static void stitch_obj_chunk_task(void *context, int taskIndex)
+{
+    ObjStitch *stitch = (ObjStitch *)context;
+    ObjChunk *chunk = &stitch->chunks[taskIndex];
+
+    memcpy(stitch->vertices + chunk->vertex_offset, chunk->vertices, chunk->vertex_count * sizeof(Vertex));
+    memcpy(stitch->texCoords + chunk->texCoord_offset, chunk->texCoords, chunk->texCoord_count * sizeof(TexCoord));
+    memcpy(stitch->normals + chunk->normal_offset, chunk->normals, chunk->normal_count * sizeof(Normal));
+
+    Face *faces = stitch->faces + chunk->face_offset;
+    memcpy(faces, chunk->faces, chunk->face_count * sizeof(Face));
+    resolve_obj_chunk_faces(chunk, faces);
+
+    free_obj_chunk_materials(chunk);
+    free(chunk->vertices);
+    free(chunk->texCoords);
+    free(chunk->normals);
+    free(chunk->faces);
+}
+
+int try_read_obj_file_parallel(const char *filename, int thread_count, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity)
+{
+    if (thread_count <= 0)
+    {
+        thread_count = getCpuCount();
+    }
+
+    PROFILE_BEGIN(obj_open);
+    size_t size = 0;
+    const char *data = mapFile(filename, &size);
+    PROFILE_END(obj_open);
+    if (!data)
+    {
+        return 0;
+    }
+
+    // A few chunks per thread so uneven record mixes still balance, but
+    // never so small that per-chunk setup dominates
+    size_t chunk_count = thread_count == 1 ? 1 : (size_t)thread_count * OBJ_CHUNKS_PER_THREAD;
+    if (size / chunk_count < OBJ_MIN_CHUNK_SIZE)
+    {
+        chunk_count = size / OBJ_MIN_CHUNK_SIZE + 1;
+    }
+
+    ObjChunk *chunks = malloc(chunk_count * sizeof(ObjChunk));
+    if (!chunks)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *end = data + size;
+    const char *begin = data;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        // Cut at the first line start at or after the even split point
+        const char *split = i + 1 == chunk_count ? end : data + size * (i + 1) / chunk_count;
+        if (split < begin)
+        {
+            split = begin;
+        }
+        if (split < end && split > data && split[-1] != '\n')
+        {
+            const char *newline = memchr(split, '\n', (size_t)(end - split));
+            split = newline ? newline + 1 : end;
+        }
+
+        init_obj_chunk(&chunks[i], 1024);
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        begin = split;
+    }
+
+    runParallel((int)chunk_count, thread_count, parse_obj_chunk_task, chunks);
+
+    // Prefix sums give every chunk its slot in the final arrays, and carry
+    // the active material forward across chunk boundaries
+    ObjChunk totals = {0};
+    int active = -1;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        ObjChunk *chunk = &chunks[i];
+        chunk->vertex_offset = totals.vertex_count;
+        chunk->texCoord_offset = totals.texCoord_count;
+        chunk->normal_offset = totals.normal_count;
+        chunk->face_offset = totals.face_count;
+
+        totals.vertex_count += chunk->vertex_count;
+        totals.texCoord_count += chunk->texCoord_count;
+        totals.normal_count += chunk->normal_count;
+        totals.face_count += chunk->face_count;
+
+        intern_obj_chunk_materials(chunk, &active);
+    }
+
+    // usemtl names point into the mapping, which is only needed until here
+    unmapFile(data, size);
+
+    // Exact sized, the stitched arrays never grow again
+    ObjStitch stitch;
+    stitch.chunks = chunks;
+    stitch.vertices = malloc((totals.vertex_count + 1) * sizeof(Vertex));
+    stitch.texCoords = malloc((totals.texCoord_count + 1) * sizeof(TexCoord));
+    stitch.normals = malloc((totals.normal_count + 1) * sizeof(Normal));
+    stitch.faces = malloc((totals.face_count + 1) * sizeof(Face));
+
+    if (!stitch.vertices || !stitch.texCoords || !stitch.normals || !stitch.faces)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    PROFILE_BEGIN(obj_stitch);
+    runParallel((int)chunk_count, thread_count, stitch_obj_chunk_task, &stitch);
+    free(chunks);
+    PROFILE_END(obj_stitch);
+
+    *vertices = stitch.vertices;
+    *vertex_count = totals.vertex_count;
+    *vertex_capacity = totals.vertex_count;
+
+    *texCoords = stitch.texCoords;
+    *textCoord_count = totals.texCoord_count;
+    *texCoord_capacity = totals.texCoord_count;
+
+    *normals = stitch.normals;
+    *normal_count = totals.normal_count;
+    *normal_capacity = totals.normal_count;
+
+    *faces = stitch.faces;
+    *face_count = totals.face_count;
+    *face_capacity = totals.face_count;
+    return 1;
+}
+
+void read_obj_file_parallel(const char *filename, int thread_count, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity)
+{
+    if (!try_read_obj_file_parallel(filename, thread_count, vertices, vertex_count, vertex_capacity, texCoords, textCoord_count, texCoord_capacity, normals, normal_count, normal_capacity, faces, face_count, face_capacity))
+    {
+        perror("Failed to open file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static unsigned int hash_material_name(const char *name, int length)
+{
+    return (unsigned int)hashBytes(name, (size_t)length, HASH_SEED);
+}
+
+static void rebuild_material_index()
+{
+    free(material_index);
+    material_index = malloc(material_index_size * sizeof(int));
+    if (!material_index)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned int i = 0; i < material_index_size; i++)
+    {
+        material_index[i] = -1;
+    }
+
+    for (int id = 0; id < material_count; id++)
+    {
+        unsigned int slot = hash_material_name(materials[id].name, (int)strlen(materials[id].name)) & (material_index_size - 1);
+        while (material_index[slot] >= 0)
+        {
+            slot = (slot + 1) & (material_index_size - 1);
+        }
+        material_index[slot] = id;
+    }
+}
+
+static int lookup_material(const char *name, int length, unsigned int *slot)
+{
+    if (material_index_size == 0)
+    {
+        return -1;
+    }
+
+    *slot = hash_material_name(name, length) & (material_index_size - 1);
+    while (material_index[*slot] >= 0)
+    {
+        const char *candidate = materials[material_index[*slot]].name;
+        if (strncmp(candidate, name, length) == 0 && candidate[length] == '\0')
+        {
+            return material_index[*slot];
+        }
+        *slot = (*slot + 1) & (material_index_size - 1);
+    }
+    return -1;
+}
+
+int find_material(const char *name)
+{
+    unsigned int slot;
+    int length = (int)strlen(name);
+    if (length >= MATERIAL_NAME_LENGTH)
+    {
+        length = MATERIAL_NAME_LENGTH - 1;
+    }
+    return lookup_material(name, length, &slot);
+}
+
+int intern_material(const char *name, int length)
+{
+    if (length >= MATERIAL_NAME_LENGTH)
+    {
+        length = MATERIAL_NAME_LENGTH - 1;
+    }
+
+    unsigned int slot = 0;
+    int id = lookup_material(name, length, &slot);
+    if (id >= 0)
+    {
+        return id;
+    }
+
+    if (material_count >= material_capacity)
+    {
+        material_capacity = material_capacity ? material_capacity * 2 : 16;
+        materials = realloc(materials, material_capacity * sizeof(Material));
+        if (!materials)
+        {
+            perror("Failed to reallocate memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    id = material_count++;
+    memset(&materials[id], 0, sizeof(Material));
+    memcpy(materials[id].name, name, length);
+    materials[id].d = 1.0f; // Opaque unless the MTL says otherwise
+
+    if ((unsigned int)material_count * 2 > material_index_size)
+    {
+        material_index_size = material_index_size ? material_index_size * 2 : 32;
+        rebuild_material_index();
+    }
+    else
+    {
+        material_index[slot] = id;
+    }
+
+    return id;
+}
+
+void load_material_table(const Material *source, int count)
+{
+    free_materials();
+    for (int i = 0; i < count; i++)
+    {
+        int id = intern_material(source[i].name, (int)strlen(source[i].name));
+        materials[id] = source[i];
+    }
+}
+
+void free_materials()
+{
+    free(materials);
+    free(material_index);
+    materials = NULL;
+    material_index = NULL;
+    material_count = 0;
+    material_capacity = 0;
+    material_index_size = 0;
+}
+
+int try_read_mtl_file(const char *filename)
+{
+    PROFILE_SCOPE(read_mtl_file);
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    char line[128];
+    Material *current_material = NULL;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "newmtl ", 7) == 0)
+        {
+            char name[sizeof(current_material->name)];
+            if (sscanf(line, "newmtl %49s", name) == 1)
+            {
+                // A material an OBJ already referenced gets filled in here.
+                // Interning may move the table, so index it afterwards.
+                int id = intern_material(name, (int)strlen(name));
+                current_material = &materials[id];
+            }
+        }
+        else if (current_material)
+        {
+            if (strncmp(line, "Ka ", 3) == 0)
+            {
+                sscanf(line, "Ka %f %f %f", &current_material->Ka[0], &current_material->Ka[1], &current_material->Ka[2]);
+            }
+            else if (strncmp(line, "Kd ", 3) == 0)
+            {
+                sscanf(line, "Kd %f %f %f", &current_material->Kd[0], &current_material->Kd[1], &current_material->Kd[2]);
+            }
+            else if (strncmp(line, "Ks ", 3) == 0)
+            {
+                sscanf(line, "Ks %f %f %f", &current_material->Ks[0], &current_material->Ks[1], &current_material->Ks[2]);
+            }
+            else if (strncmp(line, "Ns ", 3) == 0)
+            {
+                sscanf(line, "Ns %f", &current_material->Ns);
+            }
+            else if (strncmp(line, "Ni ", 3) == 0)
+            {
+                sscanf(line, "Ni %f", &current_material->Ni);
+            }
+            else if (strncmp(line, "d ", 2) == 0)
+            {
+                sscanf(line, "d %f", &current_material->d);
+            }
+            else if (strncmp(line, "illum ", 6) == 0)
+            {
+                sscanf(line, "illum %d", &current_material->illum);
+            }
+            else if (strncmp(line, "map_Kd ", 7) == 0)
+            {
+                sscanf(line, "map_Kd %49s", current_material->map_Kd);
+            }
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+void read_mtl_file(const char *filename)
+{
+    if (!try_read_mtl_file(filename))
+    {
+        perror("Failed to open file");
+        exit(EXIT_FAILURE);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+typedef struct
+{
+    float x, y, z;
+} Vertex;
+
+typedef struct
+{
+    float u, v;
+} TexCoord;
+
+typedef struct
+{
+    float x, y, z;
+} Normal;
+
+typedef struct
+{
+    int vertexIndex[3];
+    int texCoordIndex[3];
+    int normalIndex[3];
+    int materialId; // Index into materials, -1 before any usemtl
+} Face;
+
+#define MATERIAL_NAME_LENGTH 50
+
+typedef struct
+{
+    char name[MATERIAL_NAME_LENGTH];
+    float Ka[3];     // Ambient color
+    float Kd[3];     // Diffuse color
+    float Ks[3];     // Specular color
+    float Ns;        // Specular exponent
+    float Ni;        // Optical density (refraction index)
+    float d;         // Dissolve (transparency)
+    int illum;       // Illumination model
+    char map_Kd[50]; // Diffuse texture map
+} Material;
+
+// Every material named by an MTL newmtl or an OBJ usemtl, indexed by the
+// IDs faces store. Grows as names are interned, so don't hold pointers into
+// it across loads. Each thread has its own table, so models loaded on
+// different threads get separate material namespaces; loads and builds of
+// one model must stay on one thread (the parallel OBJ parse interns on the
+// calling thread).
+extern _Thread_local Material *materials;
+extern _Thread_local int material_count;
+
+// ID for a material name, or -1 if it was never interned
+int find_material(const char *name);
+
+// ID for a material name, adding a zeroed entry the first time it is seen.
+// Names are not NUL terminated, length bytes are used (at most 49).
+int intern_material(const char *name, int length);
+
+// Replaces the whole table, used when materials come out of a cache
+void load_material_table(const Material *source, int count);
+
+void free_materials();
+
+// Parses an OBJ file in place from a memory mapping of it. Arrays are
+// allocated by the loader and grown by doubling, the caller frees them.
+void read_obj_file(const char *filename, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity);
+
+// Same output as read_obj_file, bit for bit, but the file is cut into
+// newline-aligned chunks parsed on thread_count threads (0 = one per core)
+// and stitched back together. Capacities come back equal to the counts.
+void read_obj_file_parallel(const char *filename, int thread_count, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity);
+
+void read_mtl_file(const char *filename);
+
+// The same loads, returning 0 with errno set instead of exiting when the
+// file can't be opened or mapped. For files that may be caught halfway
+// through a save, like hot reloads of a model that is being edited.
+int try_read_obj_file(const char *filename, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity);
+int try_read_obj_file_parallel(const char *filename, int thread_count, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity);
+int try_read_mtl_file(const char *filename);
+
+#endif // LOADER_H
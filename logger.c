@@ -0,0 +1,146 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include "logger.h"
+
+// A slot is free for the writer whose position equals its sequence and
+// holds a message for the reader once it is position + 1
+typedef struct
+{
+    size_t sequence;
+    char text[LOG_MESSAGE_BYTES];
+} LogSlot;
+
+typedef struct
+{
+    LogSlot slots[LOG_QUEUE_CAPACITY];
+    size_t tail; // Next position a writer claims
+    size_t head; // Next position the logging thread reads, its own
+    FILE *out;
+    pthread_t thread;
+    int running;
+    int stopping;
+    int dropped;
+} Logger;
+
+static Logger logger;
+
+// Writes every finished message in order, stops at the first one still
+// being formatted. Returns how many were written.
+static int drain_log()
+{
+    int written = 0;
+    for (;;)
+    {
+        LogSlot *slot = &logger.slots[logger.head & (LOG_QUEUE_CAPACITY - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != logger.head + 1)
+        {
+            return written;
+        }
+        fputs(slot->text, logger.out);
+        __atomic_store_n(&slot->sequence, logger.head + LOG_QUEUE_CAPACITY, __ATOMIC_RELEASE);
+        logger.head++;
+        written++;
+    }
+}
+
+static void *logger_thread(void *argument)
+{
+    (void)argument;
+    struct timespec pause = {0, LOG_FLUSH_MS * 1000000L};
+    while (!__atomic_load_n(&logger.stopping, __ATOMIC_ACQUIRE))
+    {
+        // One flush for everything since the last, the only place that
+        // waits on the terminal
+        if (drain_log() > 0)
+        {
+            fflush(logger.out);
+        }
+        nanosleep(&pause, NULL);
+    }
+    drain_log();
+    fflush(logger.out);
+    return NULL;
+}
+
+int start_logger(FILE *out)
+{
+    logger.out = out;
+    logger.tail = 0;
+    logger.head = 0;
+    logger.stopping = 0;
+    logger.dropped = 0;
+    for (size_t i = 0; i < LOG_QUEUE_CAPACITY; i++)
+    {
+        logger.slots[i].sequence = i;
+    }
+
+    // Whatever was printed before goes out ahead of the queued lines
+    fflush(out);
+    if (pthread_create(&logger.thread, NULL, logger_thread, NULL) != 0)
+    {
+        return 0;
+    }
+    __atomic_store_n(&logger.running, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void log_message(const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    if (!__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE))
+    {
+        vprintf(format, arguments);
+        va_end(arguments);
+        return;
+    }
+
+    // Claims the tail slot once the reader is done with its last lap
+    size_t position = __atomic_load_n(&logger.tail, __ATOMIC_RELAXED);
+    LogSlot *slot;
+    for (;;)
+    {
+        slot = &logger.slots[position & (LOG_QUEUE_CAPACITY - 1)];
+        intptr_t lag = (intptr_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+        if (lag == 0)
+        {
+            if (__atomic_compare_exchange_n(&logger.tail, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (lag < 0)
+        {
+            __atomic_fetch_add(&logger.dropped, 1, __ATOMIC_RELAXED);
+            va_end(arguments);
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n(&logger.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    vsnprintf(slot->text, LOG_MESSAGE_BYTES, format, arguments);
+    va_end(arguments);
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+void stop_logger()
+{
+    if (!__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    __atomic_store_n(&logger.stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(logger.thread, NULL);
+    __atomic_store_n(&logger.running, 0, __ATOMIC_RELEASE);
+
+    if (logger.dropped > 0)
+    {
+        printf("The log queue was full, dropped %d messages\n", logger.dropped);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+
+// Messages waiting for the logging thread, a power of two. A full queue
+// drops the message instead of making its thread wait.
+#define LOG_QUEUE_CAPACITY 1024
+
+// Longer messages are cut, the newline included
+#define LOG_MESSAGE_BYTES 256
+
+// How long the logging thread sleeps between writes
+#define LOG_FLUSH_MS 10
+
+// Starts the thread that writes log_message's lines to out. Returns 0 if it
+// can't be started, log_message then keeps writing directly.
+int start_logger(FILE *out);
+
+// printf for threads that can't wait on a terminal: formats into a slot of
+// a lock-free queue and returns, any number of threads at once. Writes
+// directly while no logger runs.
+void log_message(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Writes what is still queued and stops the thread, then says how many
+// messages were dropped, if any. Only once no other thread logs anymore.
+void stop_logger();
+
+#endif // LOGGER_H
\ No newline at end of file
@@ -4,350 +4,568 @@
 #include <stdlib.h>
 #include <string.h>
 #include "shaders.h"
+#include "shaderManager.h"
+#include "hotReload.h"
+#include "loader.h"
+#include "utils.h"
+#include "mesh.h"
+#include "meshCache.h"
+#include "meshNormals.h"
+#include "upload.h"
+#include "meshOptimize.h"
+#include "meshlet.h"
+#include "meshLod.h"
+#include "bvh.h"
+#include "procedural.h"
+#include "scene.h"
+#include "occlusion.h"
+#include "instances.h"
+#include "instanceBuffer.h"
+#include "asyncLoad.h"
+#include "uniformBuffers.h"
+#include "profiler.h"
+#include "softRaster.h"
+#include "vecMath.h"
+#include "colorGrade.h"
+#include "input.h"
+#include "logger.h"
 #include <math.h>
 
-typedef struct
-{
-    float x, y, z;
-} Vertex;
+// Written when no window can be opened and --software didn't name a file
+#define SOFTWARE_FALLBACK_IMAGE "frame.ppm"
 
-typedef struct
-{
-    float u, v;
-} TexCoord;
+// Frames per thread count in the --software benchmark
+#define SOFTWARE_BENCHMARK_FRAMES 10
 
-typedef struct
-{
-    float x, y, z;
-} Normal;
+// Calls per operation and vertices in the --math-benchmark
+#define MATH_BENCHMARK_ITERATIONS 1000000
+#define MATH_BENCHMARK_VERTICES 1000000
+
+// Rebuilds per thread count in the --verify-lut timing
+#define COLOR_GRADE_BENCHMARK_REBUILDS 10
 
-typedef struct
+// Runs inside glfwPollEvents, so it only queues the key
+static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
-    int vertexIndex[3];
-    int texCoordIndex[3];
-    int normalIndex[3];
-    char materialName[50];
-} Face;
+    (void)scancode;
+    (void)mods;
+    push_input_event((InputController *)glfwGetWindowUserPointer(window), key, action);
+}
 
-typedef struct
+int main(int argc, char *argv[])
 {
-    char name[50];
-    float Ka[3];     // Ambient color
-    float Kd[3];     // Diffuse color
-    float Ks[3];     // Specular color
-    float Ns;        // Specular exponent
-    float Ni;        // Optical density (refraction index)
-    float d;         // Dissolve (transparency)
-    int illum;       // Illumination model
-    char map_Kd[50]; // Diffuse texture map
-} Material;
+    double programStart = getTimeSeconds();
+
+    // --threads N parses the OBJ on N threads, 0 uses one per core
+    int loadThreads = 1;
+    // --model NAME loads NAME.obj and NAME.mtl
+    const char *modelName = "sword";
+    // --optimize reorders triangles and vertices for the GPU caches before
+    // upload, a cache built without it is rebuilt rather than reused
+    int optimize = 0;
+    // --packed uploads 12 byte quantized vertices and 16 bit indices
+    // instead of 36 byte float vertices and 32 bit indices
+    int packVertices = 0;
+    // --meshlets cuts the mesh into clusters that are culled on the CPU
+    // every frame and drawn with one multi-draw
+    int useMeshlets = 0;
+    // --pick builds a BVH over the triangles, left click reports the
+    // triangle under the cursor
+    int picking = 0;
+    // --lod adds simplified levels of detail and draws the coarsest one
+    // whose error stays under --lod-error pixels on screen
+    int useLods = 0;
+    float lodPixelError = 1.0f;
+    // --scene NAME,NAME,... loads several models at once into one buffer
+    // and draws them all with one multi-draw
+    const char *sceneNames = NULL;
+    // --occluders NAME,NAME,... draws simplified versions of those scene
+    // models into a small CPU depth buffer every frame and skips the
+    // scene's clusters hidden behind them or outside the view
+    const char *occluderNames = NULL;
+    // --async opens the window right away and loads on a background
+    // thread, uploading at most --upload-budget milliseconds per frame
+    int asyncLoading = 0;
+    double uploadBudgetMs = 2.0;
+    // --software FILE renders a frame on the CPU into FILE (binary PPM) and
+    // benchmarks the rasterizer, without opening a window. Also what
+    // happens when there is no OpenGL context to be had.
+    const char *softwareOutput = NULL;
+    // --profile NAME writes NAME.json, a Chrome trace of the load and every
+    // frame, and NAME.csv with per phase percentiles on exit. Needs a build
+    // with -DPROFILER.
+    const char *profileName = NULL;
+    // --analytic-grading converts to HSB and back per fragment instead of
+    // reading the baked color grading lookups
+    int analyticGrading = 0;
+    // --precompile-shaders makes every shader permutation up front so the
+    // program cache holds them all, --shader-benchmark times making them
+    // with the cache cleared against with the cache filled
+    int precompileShaders = 0;
+    int shaderBenchmark = 0;
+    // --watch reloads the MTL, the OBJ and the shaders when they are saved,
+    // parsed and compiled without holding up a frame
+    int watchFiles = 0;
+    // --instances N draws N copies of the model with one instanced draw,
+    // each placed, spun and tinted on the CPU every frame.
+    // --instance-benchmark times instanced draws against a draw per copy.
+    int instanceCount = 0;
+    int instanceBenchmark = 0;
+    // --crease-angle DEGREES regenerates every normal, keeping hard edges
+    // where faces meet at more than DEGREES, and bypasses the mesh cache.
+    // Without it normals are only generated when the OBJ lacks usable ones.
+    float creaseAngle = -1.0f;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            loadThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc)
+        {
+            modelName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--optimize") == 0)
+        {
+            optimize = 1;
+        }
+        else if (strcmp(argv[i], "--packed") == 0)
+        {
+            packVertices = 1;
+        }
+        else if (strcmp(argv[i], "--meshlets") == 0)
+        {
+            useMeshlets = 1;
+        }
+        else if (strcmp(argv[i], "--pick") == 0)
+        {
+            picking = 1;
+        }
+        else if (strcmp(argv[i], "--lod") == 0)
+        {
+            useLods = 1;
+        }
+        else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc)
+        {
+            lodPixelError = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+        {
+            sceneNames = argv[++i];
+        }
+        else if (strcmp(argv[i], "--occluders") == 0 && i + 1 < argc)
+        {
+            occluderNames = argv[++i];
+        }
+        else if (strcmp(argv[i], "--async") == 0)
+        {
+            asyncLoading = 1;
+        }
+        else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc)
+        {
+            uploadBudgetMs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--software") == 0 && i + 1 < argc)
+        {
+            softwareOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profileName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--analytic-grading") == 0)
+        {
+            analyticGrading = 1;
+        }
+        else if (strcmp(argv[i], "--precompile-shaders") == 0)
+        {
+            precompileShaders = 1;
+        }
+        else if (strcmp(argv[i], "--shader-benchmark") == 0)
+        {
+            shaderBenchmark = 1;
+        }
+        else if (strcmp(argv[i], "--watch") == 0)
+        {
+            watchFiles = 1;
+        }
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+        {
+            instanceCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--instance-benchmark") == 0)
+        {
+            instanceBenchmark = 1;
+        }
+        else if (strcmp(argv[i], "--crease-angle") == 0 && i + 1 < argc)
+        {
+            creaseAngle = (float)atof(argv[++i]);
+            creaseAngle = creaseAngle < 0.0f ? 0.0f : creaseAngle;
+        }
+        else if (strcmp(argv[i], "--generate-grid") == 0 && i + 2 < argc)
+        {
+            // --generate-grid CELLS NAME writes a 2 * CELLS^2 triangle stress
+            // model, load it afterwards with --model NAME
+            int cells = atoi(argv[i + 1]);
+            if (!write_grid_model(argv[i + 2], cells))
+            {
+                return -1;
+            }
+            printf("Wrote %s.obj with %lld triangles\n", argv[i + 2], 2LL * cells * cells);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--math-benchmark") == 0)
+        {
+            // --math-benchmark times the SIMD matrix code against scalar
+            // loops, and the vertex stage with per vertex matrices against
+            // per frame ones
+            benchmark_vec_math(MATH_BENCHMARK_ITERATIONS, MATH_BENCHMARK_VERTICES);
+            return 0;
+        }
+        else if (strcmp(argv[i], "--verify-lut") == 0)
+        {
+            // --verify-lut checks the color grading lookups against the
+            // analytic grading at the default parameters and times rebuilds
+            GlobalParameters gradeParameters;
+            default_global_parameters(&gradeParameters);
+            ColorGradeLut lut;
+            init_color_grade_lut(&lut, COLOR_GRADE_LUT_SIZE);
+            build_color_grade_lut(&lut, &gradeParameters, 0);
+            int passed = verify_color_grade_lut(&lut, &gradeParameters, COLOR_GRADE_VERIFY_SAMPLES, COLOR_GRADE_VERIFY_P99_TOLERANCE, COLOR_GRADE_VERIFY_MAX_TOLERANCE);
+            free_color_grade_lut(&lut);
+            benchmark_color_grade_lut(&gradeParameters, COLOR_GRADE_LUT_SIZE, COLOR_GRADE_BENCHMARK_REBUILDS);
+            return passed ? 0 : 1;
+        }
+    }
 
-// #define MAX_VERTICES 100000
+    if (creaseAngle >= 0.0f && (sceneNames || asyncLoading))
+    {
+        printf("--crease-angle regenerates the normals of a single model loaded up front, ignoring it with --scene and --async\n");
+        creaseAngle = -1.0f;
+    }
 
-// Vertex vertices[MAX_VERTICES];
-// int vertex_count = 0;
+    if (occluderNames && !sceneNames)
+    {
+        printf("--occluders culls the models of a --scene, ignoring it for a single model\n");
+        occluderNames = NULL;
+    }
+
+    if ((instanceCount > 0 || instanceBenchmark) && (sceneNames || asyncLoading))
+    {
+        printf("--instances and --instance-benchmark copy a single model loaded up front, ignoring them with --scene and --async\n");
+        instanceCount = 0;
+        instanceBenchmark = 0;
+    }
 
-// #define MAX_TEXCOORDS 100000
+    if (instanceCount > 0 && (useMeshlets || useLods || picking))
+    {
+        printf("--meshlets, --lod and --pick work on a single copy, ignoring them for --instances\n");
+        useMeshlets = 0;
+        useLods = 0;
+        picking = 0;
+    }
 
-// TexCoord texCoords[MAX_TEXCOORDS];
-// int texCoord_count = 0;
+    if (sceneNames && (useMeshlets || useLods || picking))
+    {
+        printf("--meshlets, --lod and --pick work on a single model, ignoring them for the scene\n");
+        useMeshlets = 0;
+        useLods = 0;
+        picking = 0;
+    }
 
-// #define MAX_NORMALS 100000
+    if (softwareOutput && (asyncLoading || packVertices || useMeshlets || useLods || picking))
+    {
+        printf("--async, --packed, --meshlets, --lod and --pick are GPU options, ignoring them with --software\n");
+        asyncLoading = 0;
+        packVertices = 0;
+        useMeshlets = 0;
+        useLods = 0;
+        picking = 0;
+    }
 
-// Normal normals[MAX_NORMALS];
-// int normal_count = 0;
+    if (asyncLoading && (packVertices || useMeshlets || useLods || picking))
+    {
+        printf("--packed, --meshlets, --lod and --pick need the mesh before the first frame, ignoring them with --async\n");
+        packVertices = 0;
+        useMeshlets = 0;
+        useLods = 0;
+        picking = 0;
+    }
 
-// #define MAX_FACES 1000000
+    printf("\nReading OBJ file...\n\n");
 
-// Face faces[MAX_FACES];
-// int face_count = 0;
+    char objFilename[1024], mtlFilename[1024];
+    snprintf(objFilename, sizeof(objFilename), "%s.obj", modelName);
+    snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", modelName);
 
-#define MAX_MATERIALS 100
+    double loadStart = getTimeSeconds();
 
-Material materials[MAX_MATERIALS];
-int material_count = 0;
+    // Without a valid cache the parsed OBJ is kept until it has been built
+    // straight into GPU buffers
+    MeshCache cache = {0};
 
-void read_obj_file(const char *filename, Vertex **vertices, int *vertex_count, int *vertex_capacity, TexCoord **texCoords, int *textCoord_count, int *texCoord_capacity, Normal **normals, int *normal_count, int *normal_capacity, Face **faces, int *face_count, int *face_capacity)
-{
-    FILE *file = fopen(filename, "r");
-    if (!file)
-    {
-        perror("Failed to open file");
-        exit(EXIT_FAILURE);
-    }
+    Vertex *vertices = NULL;
+    int vertex_count = 0;
+    int vertex_capacity = 0;
 
-    char line[128];
-    char current_material[50] = "";
+    TexCoord *texCoords = NULL;
+    int texCoord_count = 0;
+    int texCoord_capacity = 0;
 
-    // Initialize vertex count and capacity
-    *vertex_count = 0;
-    *vertex_capacity = 10; // Initial capacity, can be adjusted as needed
-    *vertices = malloc(*vertex_capacity * sizeof(Vertex));
+    Normal *normals = NULL;
+    int normal_count = 0;
+    int normal_capacity = 0;
 
-    // Initialize texture coordinate count and capacity
-    *textCoord_count = 0;
-    *texCoord_capacity = 10; // Initial capacity, can be adjusted as needed
-    *texCoords = malloc(*texCoord_capacity * sizeof(TexCoord));
+    Face *faces = NULL;
+    int face_count = 0;
+    int face_capacity = 0;
 
-    // Initialize normal count and capacity
-    *normal_count = 0;
-    *normal_capacity = 10; // Initial capacity, can be adjusted as needed
-    *normals = malloc(*normal_capacity * sizeof(Normal));
+    // Every model of a scene loads on a thread of its own, with its own
+    // material table and mesh cache
+    Scene scene = {0};
 
-    // Initialize face count and capacity
-    *face_count = 0;
-    *face_capacity = 10; // Initial capacity, can be adjusted as needed
-    *faces = malloc(*face_capacity * sizeof(Face));
+    // Or everything happens on a worker while the render loop already runs
+    AsyncLoader asyncLoader = {0};
 
-    if (!*vertices)
+    uint32_t cacheFlags = (optimize ? MESH_CACHE_OPTIMIZED : 0) | (useMeshlets ? MESH_CACHE_MESHLETS : 0) | (useLods ? MESH_CACHE_LODS : 0) | MESH_CACHE_MATERIAL_RANGES;
+    if (asyncLoading)
     {
-        perror("Failed to allocate memory");
-        fclose(file);
-        exit(EXIT_FAILURE);
+        if (!start_async_load(&asyncLoader, modelName, sceneNames, occluderNames, loadThreads, cacheFlags))
+        {
+            fprintf(stderr, "Failed to start the loading thread\n");
+            return -1;
+        }
+        printf("Loading %s in the background\n", sceneNames ? sceneNames : objFilename);
     }
-
-    while (fgets(line, sizeof(line), file))
+    else if (sceneNames)
     {
-        if (strncmp(line, "v ", 2) == 0)
-        {
-            Vertex vertex;
-            sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-
-            if (*vertex_count >= *vertex_capacity)
-            {
-                *vertex_capacity *= 2; // Double the capacity
-                *vertices = realloc(*vertices, *vertex_capacity * sizeof(Vertex));
-                if (!*vertices)
-                {
-                    perror("Failed to reallocate memory");
-                    fclose(file);
-                    exit(EXIT_FAILURE);
-                }
-            }
+        load_scene(sceneNames, loadThreads == 1 ? 0 : loadThreads, cacheFlags, &scene);
 
-            (*vertices)[(*vertex_count)++] = vertex;
-        }
-        else if (strncmp(line, "vt ", 3) == 0)
+        for (int m = 0; m < scene.model_count; m++)
         {
-            TexCoord texCoord;
-            sscanf(line, "vt %f %f", &texCoord.u, &texCoord.v);
-
-            if (*textCoord_count >= *texCoord_capacity)
-            {
-                *texCoord_capacity *= 2; // Double the capacity
-                *texCoords = realloc(*texCoords, *texCoord_capacity * sizeof(TexCoord));
-                if (!*texCoords)
-                {
-                    perror("Failed to reallocate memory");
-                    fclose(file);
-                    exit(EXIT_FAILURE);
-                }
-            }
+            const SceneModel *model = &scene.models[m];
+            printf("%s: %d vertices, %d triangles, %d materials, %.2f ms%s\n", model->name, model->vertex_count, model->index_count / 3, model->material_count, model->milliseconds, model->from_cache ? " from cache" : "");
+        }
+        printf("Scene of %d models loaded in %.2f ms\n", scene.model_count, (getTimeSeconds() - loadStart) * 1000.0);
+    }
+    else if (creaseAngle < 0.0f && load_mesh_cache(objFilename, mtlFilename, cacheFlags, &cache))
+    {
+        load_material_table(cache.materials, cache.material_count);
 
-            (*texCoords)[(*textCoord_count)++] = texCoord;
+        printf("Mesh cache hit, %d vertices and %d indices mapped in %.2f ms\n", cache.vertex_count, cache.index_count, (getTimeSeconds() - loadStart) * 1000.0);
+    }
+    else
+    {
+        read_mtl_file(mtlFilename);
+        if (loadThreads == 1)
+        {
+            read_obj_file(objFilename, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
         }
-        else if (strncmp(line, "vn ", 3) == 0)
+        else
         {
-            Normal normal;
-            sscanf(line, "vn %f %f %f", &normal.x, &normal.y, &normal.z);
+            read_obj_file_parallel(objFilename, loadThreads, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+        }
 
-            if (*normal_count >= *normal_capacity)
-            {
-                *normal_capacity *= 2; // Double the capacity
-                *normals = realloc(*normals, *normal_capacity * sizeof(Normal));
-                if (!*normals)
-                {
-                    perror("Failed to reallocate memory");
-                    fclose(file);
-                    exit(EXIT_FAILURE);
-                }
-            }
+        printf("Parsed %d vertices and %d faces in %.2f ms\n", vertex_count, face_count, (getTimeSeconds() - loadStart) * 1000.0);
 
-            (*normals)[(*normal_count)++] = normal;
-        }
-        else if (strncmp(line, "usemtl ", 7) == 0)
+        double normalsStart = getTimeSeconds();
+        if (creaseAngle >= 0.0f)
         {
-            sscanf(line, "usemtl %s", current_material);
+            normal_count = generate_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, creaseAngle, loadThreads == 1 ? 0 : loadThreads, &normals, NULL);
+            normal_capacity = normal_count;
+            printf("Generated %d normals at a %.1f degree crease angle in %.2f ms\n", normal_count, creaseAngle, (getTimeSeconds() - normalsStart) * 1000.0);
         }
-        else if (strncmp(line, "f ", 2) == 0)
+        else if (repair_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, loadThreads == 1 ? 0 : loadThreads, &normals, &normal_count, &normal_capacity))
         {
-            Face face;
-            int matches = sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                                 &face.vertexIndex[0], &face.texCoordIndex[0], &face.normalIndex[0],
-                                 &face.vertexIndex[1], &face.texCoordIndex[1], &face.normalIndex[1],
-                                 &face.vertexIndex[2], &face.texCoordIndex[2], &face.normalIndex[2]);
-
-            if (matches == 9)
-            {
-                strcpy(face.materialName, current_material);
-
-                if (*face_count >= *face_capacity)
-                {
-                    *face_capacity *= 2; // Double the capacity
-                    *faces = realloc(*faces, *face_capacity * sizeof(Face));
-                    if (!*faces)
-                    {
-                        perror("Failed to reallocate memory");
-                        fclose(file);
-                        exit(EXIT_FAILURE);
-                    }
-                }
-
-                (*faces)[(*face_count)++] = face;
-            }
-            else
-            {
-                fprintf(stderr, "Error: Expected 9 values for face, got %d\n", matches);
-            }
+            printf("Missing or broken normals, generated %d in %.2f ms\n", normal_count, (getTimeSeconds() - normalsStart) * 1000.0);
         }
-    }
 
-    fclose(file);
-}
+        // printf("Materials:\n");
+        // for (int i = 0; i < material_count; i++)
+        // {
+        //     printf("Material %d: %s\n", i + 1, materials[i].name);
+        //     printf("  Ka: %f %f %f\n", materials[i].Ka[0], materials[i].Ka[1], materials[i].Ka[2]);
+        //     printf("  Kd: %f %f %f\n", materials[i].Kd[0], materials[i].Kd[1], materials[i].Kd[2]);
+        //     printf("  Ks: %f %f %f\n", materials[i].Ks[0], materials[i].Ks[1], materials[i].Ks[2]);
+        //     printf("  Ns: %f\n", materials[i].Ns);
+        //     printf("  Ni: %f\n", materials[i].Ni);
+        //     printf("  d: %f\n", materials[i].d);
+        //     printf("  illum: %d\n", materials[i].illum);
+        //     printf("  map_Kd: %s\n", materials[i].map_Kd);
+        // }
+
+        // for (int i = 0; i < vertex_count; i++)
+        // {
+        //     printf("Vertex %d: x=%f, y=%f, z=%f\n", i + 1, vertices[i].x, vertices[i].y, vertices[i].z);
+        // }
+
+        // printf("Texture Coordinates:\n");
+        // for (int i = 0; i < texCoord_count; i++)
+        // {
+        //     printf("TexCoord %d: u=%f, v=%f\n", i + 1, texCoords[i].u, texCoords[i].v);
+        // }
+
+        // printf("Normals:\n");
+        // for (int i = 0; i < normal_count; i++)
+        // {
+        //     printf("Normal %d: x=%f, y=%f, z=%f\n", i + 1, normals[i].x, normals[i].y, normals[i].z);
+        // }
+
+        // printf("Faces:\n");
+        // for (int i = 0; i < face_count; i++)
+        // {
+        //     printf("Face %d: ", i + 1);
+        //     for (int j = 0; j < 3; j++)
+        //     {
+        //         printf("%d/%d/%d ", faces[i].vertexIndex[j], faces[i].texCoordIndex[j], faces[i].normalIndex[j]);
+        //     }
+        //     printf("\n");
+        // }
+
+        // Print how many vertices, texCoords, normals, and faces were read
+        printf("\nObj Amounts of memory allocated:\n\n");
+        printf("Vertices: %d\n", vertex_capacity);
+        printf("TexCoords: %d\n", texCoord_capacity);
+        printf("Normals: %d\n", normal_capacity);
+        printf("Faces: %d\n", face_capacity);
 
-void read_mtl_file(const char *filename)
-{
-    FILE *file = fopen(filename, "r");
-    if (!file)
-    {
-        perror("Failed to open file");
-        exit(EXIT_FAILURE);
     }
 
-    char line[128];
-    Material *current_material = NULL;
+    // The color adjustments, changed with the keys while rendering
+    GlobalParameters parameters;
+    default_global_parameters(&parameters);
 
-    while (fgets(line, sizeof(line), file))
+    GLFWwindow *window = NULL;
+    if (!softwareOutput)
     {
-        if (strncmp(line, "newmtl ", 7) == 0)
+        // Initialize GLFW
+        if (!glfwInit())
         {
-            current_material = &materials[material_count++];
-            sscanf(line, "newmtl %s", current_material->name);
+            fprintf(stderr, "Failed to initialize GLFW\n");
         }
-        else if (current_material)
+        else
         {
-            if (strncmp(line, "Ka ", 3) == 0)
-            {
-                sscanf(line, "Ka %f %f %f", &current_material->Ka[0], &current_material->Ka[1], &current_material->Ka[2]);
-            }
-            else if (strncmp(line, "Kd ", 3) == 0)
+            // Set GLFW window hints for OpenGL version (adjust to your needs)
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+            // Create a windowed mode window and its OpenGL context
+            window = glfwCreateWindow(1024, 1024, "OpenGL Triangle", NULL, NULL);
+            if (!window)
             {
-                sscanf(line, "Kd %f %f %f", &current_material->Kd[0], &current_material->Kd[1], &current_material->Kd[2]);
+                fprintf(stderr, "Failed to create GLFW window\n");
+                glfwTerminate();
             }
-            else if (strncmp(line, "Ks ", 3) == 0)
-            {
-                sscanf(line, "Ks %f %f %f", &current_material->Ks[0], &current_material->Ks[1], &current_material->Ks[2]);
-            }
-            else if (strncmp(line, "Ns ", 3) == 0)
-            {
-                sscanf(line, "Ns %f", &current_material->Ns);
-            }
-            else if (strncmp(line, "Ni ", 3) == 0)
-            {
-                sscanf(line, "Ni %f", &current_material->Ni);
-            }
-            else if (strncmp(line, "d ", 2) == 0)
-            {
-                sscanf(line, "d %f", &current_material->d);
-            }
-            else if (strncmp(line, "illum ", 6) == 0)
+        }
+
+        // A background load would have to be waited for, it just fails
+        if (!window && asyncLoading)
+        {
+            finish_async_load(&asyncLoader);
+            return -1;
+        }
+        if (!window)
+        {
+            softwareOutput = SOFTWARE_FALLBACK_IMAGE;
+            printf("No OpenGL context, rendering %s on the CPU instead\n", softwareOutput);
+        }
+    }
+
+    if (softwareOutput)
+    {
+        // Same vertices, indices and material ranges as the GPU would get
+        GpuMesh softwareMesh = {0};
+        MaterialRange *softwareRanges = NULL;
+        int softwareRangeCount = 0;
+
+        if (sceneNames)
+        {
+            // Model indices are relative to their base vertex, which the
+            // multi-draw adds on the GPU
+            softwareMesh.vertices = scene.mesh.vertices;
+            softwareMesh.vertex_count = scene.mesh.vertex_count;
+            softwareMesh.index_count = scene.mesh.index_count;
+            softwareMesh.indices = malloc(((size_t)scene.mesh.index_count + 1) * sizeof(unsigned int));
+            if (!softwareMesh.indices)
             {
-                sscanf(line, "illum %d", &current_material->illum);
+                perror("Failed to allocate memory");
+                exit(EXIT_FAILURE);
             }
-            else if (strncmp(line, "map_Kd ", 7) == 0)
+            for (int m = 0; m < scene.model_count; m++)
             {
-                sscanf(line, "map_Kd %s", current_material->map_Kd);
+                const SceneModel *model = &scene.models[m];
+                for (int i = model->first_index; i < model->first_index + model->index_count; i++)
+                {
+                    softwareMesh.indices[i] = scene.mesh.indices[i] + (unsigned int)model->base_vertex;
+                }
             }
         }
-    }
-
-    fclose(file);
-}
-
-int main()
-{
-    printf("\nReading OBJ file...\n\n");
-
-    Vertex *vertices = NULL;
-    int vertex_count = 0;
-    int vertex_capacity = 0;
+        else if (cache.data)
+        {
+            softwareMesh.vertices = (float *)cache.vertices;
+            softwareMesh.vertex_count = cache.vertex_count;
+            softwareMesh.indices = (unsigned int *)cache.indices;
+            softwareMesh.index_count = cache.index_count;
+            softwareRangeCount = cache.material_range_count;
+        }
+        else
+        {
+            softwareRangeCount = sort_faces_by_material(faces, face_count, &softwareRanges);
+            build_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, &softwareMesh);
+        }
 
-    TexCoord *texCoords = NULL;
-    int texCoord_count = 0;
-    int texCoord_capacity = 0;
+        MaterialParameters *softwareMaterials = malloc(((size_t)material_count + 1) * sizeof(MaterialParameters));
+        if (!softwareMaterials)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < material_count; i++)
+        {
+            material_parameters(&materials[i], &softwareMaterials[i]);
+        }
 
-    Normal *normals = NULL;
-    int normal_count = 0;
-    int normal_capacity = 0;
+        SoftMesh softMesh = {
+            softwareMesh.vertices, softwareMesh.vertex_count,
+            softwareMesh.indices, softwareMesh.index_count,
+            cache.data ? cache.material_ranges : softwareRanges, softwareRangeCount,
+            softwareMaterials, material_count};
 
-    Face *faces = NULL;
-    int face_count = 0;
-    int face_capacity = 0;
+        SoftRasterizer rasterizer;
+        init_soft_rasterizer(&rasterizer, 1024, 1024, loadThreads == 1 ? 0 : loadThreads);
+        double drawStart = getTimeSeconds();
+        soft_draw(&rasterizer, &softMesh, &parameters, 0.0f);
+        printf("Drew %d triangles on %d threads in %.2f ms\n", softMesh.index_count / 3, rasterizer.thread_count, (getTimeSeconds() - drawStart) * 1000.0);
 
-    read_mtl_file("sword.mtl");
-    read_obj_file("sword.obj", &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
-
-    // printf("Materials:\n");
-    // for (int i = 0; i < material_count; i++)
-    // {
-    //     printf("Material %d: %s\n", i + 1, materials[i].name);
-    //     printf("  Ka: %f %f %f\n", materials[i].Ka[0], materials[i].Ka[1], materials[i].Ka[2]);
-    //     printf("  Kd: %f %f %f\n", materials[i].Kd[0], materials[i].Kd[1], materials[i].Kd[2]);
-    //     printf("  Ks: %f %f %f\n", materials[i].Ks[0], materials[i].Ks[1], materials[i].Ks[2]);
-    //     printf("  Ns: %f\n", materials[i].Ns);
-    //     printf("  Ni: %f\n", materials[i].Ni);
-    //     printf("  d: %f\n", materials[i].d);
-    //     printf("  illum: %d\n", materials[i].illum);
-    //     printf("  map_Kd: %s\n", materials[i].map_Kd);
-    // }
-
-    // for (int i = 0; i < vertex_count; i++)
-    // {
-    //     printf("Vertex %d: x=%f, y=%f, z=%f\n", i + 1, vertices[i].x, vertices[i].y, vertices[i].z);
-    // }
-
-    // printf("Texture Coordinates:\n");
-    // for (int i = 0; i < texCoord_count; i++)
-    // {
-    //     printf("TexCoord %d: u=%f, v=%f\n", i + 1, texCoords[i].u, texCoords[i].v);
-    // }
-
-    // printf("Normals:\n");
-    // for (int i = 0; i < normal_count; i++)
-    // {
-    //     printf("Normal %d: x=%f, y=%f, z=%f\n", i + 1, normals[i].x, normals[i].y, normals[i].z);
-    // }
-
-    // printf("Faces:\n");
-    // for (int i = 0; i < face_count; i++)
-    // {
-    //     printf("Face %d: ", i + 1);
-    //     for (int j = 0; j < 3; j++)
-    //     {
-    //         printf("%d/%d/%d ", faces[i].vertexIndex[j], faces[i].texCoordIndex[j], faces[i].normalIndex[j]);
-    //     }
-    //     printf("\n");
-    // }
-
-    // Initialize GLFW
-    if (!glfwInit())
-    {
-        fprintf(stderr, "Failed to initialize GLFW\n");
-        return -1;
-    }
+        int written = write_soft_framebuffer(&rasterizer, softwareOutput);
+        if (written)
+        {
+            printf("Wrote %s\n", softwareOutput);
+        }
+        free_soft_rasterizer(&rasterizer);
 
-    // Set GLFW window hints for OpenGL version (adjust to your needs)
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        benchmark_soft_raster(&softMesh, &parameters, 1024, 1024, SOFTWARE_BENCHMARK_FRAMES);
 
-    // Create a windowed mode window and its OpenGL context
-    GLFWwindow *window = glfwCreateWindow(1024, 1024, "OpenGL Triangle", NULL, NULL);
-    if (!window)
-    {
-        fprintf(stderr, "Failed to create GLFW window\n");
-        glfwTerminate();
-        return -1;
+        if (sceneNames)
+        {
+            free(softwareMesh.indices);
+        }
+        else if (!cache.data)
+        {
+            free_gpu_mesh(&softwareMesh);
+        }
+        free(softwareRanges);
+        free(softwareMaterials);
+        close_mesh_cache(&cache);
+        free(vertices);
+        free(texCoords);
+        free(normals);
+        free(faces);
+        free_scene(&scene);
+        free_materials();
+        return written ? 0 : -1;
     }
 
     // Make the window's context current
@@ -386,101 +604,381 @@ int main()
     printf("Max Fragment Uniforms: %d\n", maxFragmentUniforms);
     printf("Max Geometry Uniforms: %d\n", maxGeometryUniforms);
 
-    // Print how many vertices, texCoords, normals, and faces were read
-    printf("\nObj Amounts of memory allocated:\n\n");
-    printf("Vertices: %d\n", vertex_capacity);
-    printf("TexCoords: %d\n", texCoord_capacity);
-    printf("Normals: %d\n", normal_capacity);
-    printf("Faces: %d\n", face_capacity);
-
     printf("\nPassing data to GPU...\n");
 
-    GLfloat verticesToGPU[face_count * 9];
+    GLuint VAO, VBO, EBO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+
+    // Both paths stream into buffer storage allocated once at its final
+    // size, a staging block at a time
+    GpuUpload upload = {VBO, EBO, 0, 0};
+    MeshSink uploadSink = gpuUploadSink(&upload);
+    double uploadStart = getTimeSeconds();
+
+    // Packing quantizes positions to the bounds, instances are spread out
+    // by them
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f}, boundsMax[3] = {0.0f, 0.0f, 0.0f};
+    if (packVertices || instanceCount > 0 || instanceBenchmark)
+    {
+        if (sceneNames)
+        {
+            compute_position_bounds(scene.mesh.vertices, scene.mesh.vertex_count, GPU_VERTEX_FLOATS, boundsMin, boundsMax);
+        }
+        else if (cache.data)
+        {
+            compute_position_bounds(cache.vertices, cache.vertex_count, GPU_VERTEX_FLOATS, boundsMin, boundsMax);
+        }
+        else
+        {
+            compute_position_bounds(vertices ? &vertices[0].x : NULL, vertex_count, 3, boundsMin, boundsMax);
+        }
+    }
 
-    for (int i = 0; i < vertex_count; i++)
+    // Packing happens on the way to the GPU, the cache keeps the float
+    // layout so either mode can use it
+    VertexPacker packer;
+    GpuPackedUpload packedUpload = {VBO, EBO, 0, 0, GL_UNSIGNED_INT, &packer};
+    if (packVertices)
     {
-        verticesToGPU[i * 9] = vertices[i].x;
-        verticesToGPU[i * 9 + 1] = vertices[i].y;
-        verticesToGPU[i * 9 + 2] = vertices[i].z;
+        const Material *packMaterials = sceneNames ? scene.materials : materials;
+        int packMaterialCount = sceneNames ? scene.material_count : material_count;
+        if (init_vertex_packer(&packer, boundsMin, boundsMax, packMaterials, packMaterialCount))
+        {
+            uploadSink = gpuPackedUploadSink(&packedUpload);
+        }
+        else
+        {
+            printf("More than %d material colors, keeping the float vertex layout\n", PACKED_MAX_COLORS);
+            packVertices = 0;
+        }
+    }
+
+    // Reordering, meshlets and LODs need the finished buffers on the CPU,
+    // from the cache mapping or from a mesh built in memory
+    GpuMesh mesh = {0};
+    Meshlet *meshlets = NULL;
+    int meshletCount = 0;
 
-        Face *face = NULL;
+    // Level 0 is the whole index buffer unless coarser levels follow it
+    MeshLod lods[MAX_MESH_LODS];
+    int lodCount = 0;
 
-        for (int j = 0; j < face_count; j++)
+    // Draws of the full level, one per material, none when the triangles
+    // aren't sorted by material and the vertex colors are drawn instead
+    MaterialRange *materialRanges = NULL;
+    int materialRangeCount = 0;
+
+    if (sceneNames)
+    {
+        stream_gpu_arrays(scene.mesh.vertices, scene.mesh.vertex_count, scene.mesh.indices, scene.mesh.index_count, &uploadSink);
+    }
+    else if (cache.data)
+    {
+        stream_gpu_arrays(cache.vertices, cache.vertex_count, cache.indices, cache.index_count, &uploadSink);
+
+        lodCount = cache.lod_count < MAX_MESH_LODS ? cache.lod_count : MAX_MESH_LODS;
+        memcpy(lods, cache.lods, (size_t)lodCount * sizeof(MeshLod));
+        if (lodCount > 0)
         {
-            for (int k = 0; k < 3; k++)
-            {
-                if (faces[j].vertexIndex[k] == i + 1)
-                {
-                    face = &faces[j];
-                    break;
-                }
-            }
+            print_mesh_lods(lods, lodCount, -1.0);
+        }
+
+        materialRangeCount = cache.material_range_count;
+        materialRanges = malloc(((size_t)materialRangeCount + 1) * sizeof(MaterialRange));
+        if (!materialRanges)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
         }
+        memcpy(materialRanges, cache.material_ranges, (size_t)materialRangeCount * sizeof(MaterialRange));
+    }
+    else if (!asyncLoading)
+    {
+        // The cache file is written from the same blocks as they go by
+        MeshCacheWriter writer;
+        int caching = creaseAngle < 0.0f && open_mesh_cache_writer(&writer, objFilename, mtlFilename, cacheFlags);
+        MeshSink cacheSink = mesh_cache_writer_sink(&writer);
+        MeshSinkPair pair = {&uploadSink, &cacheSink};
+        MeshSink bothSinks = tee_mesh_sinks(&pair);
+
+        materialRangeCount = sort_faces_by_material(faces, face_count, &materialRanges);
+        printf("Sorted faces into %d material ranges\n", materialRangeCount);
 
-        if (face)
+        if (optimize || useMeshlets || useLods)
         {
-            // printf("Face %d: %s\n", i + 1, face->materialName);
-            for (int j = 0; j < material_count; j++)
+            // Reordering needs the whole mesh at once, so it is built in
+            // memory first and streamed from there
+            build_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, &mesh);
+
+            if (optimize)
             {
-                if (strcmp(materials[j].name, face->materialName) == 0)
-                {
-                    verticesToGPU[i * 9 + 3] = materials[j].Kd[0];
-                    verticesToGPU[i * 9 + 4] = materials[j].Kd[1];
-                    verticesToGPU[i * 9 + 5] = materials[j].Kd[2];
-                }
+                MeshOptimizeStats stats;
+                optimize_gpu_mesh(&mesh, materialRanges, materialRangeCount, &stats);
+
+                printf("Optimized in %.2f ms, %d clusters, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", stats.milliseconds, stats.cluster_count, stats.acmr_before, stats.acmr_after, stats.atvr_before, stats.atvr_after);
+            }
+
+            if (useMeshlets)
+            {
+                // Meshlets are ordered across materials, so they are drawn
+                // with the vertex colors
+                order_meshlet_triangles(mesh.vertices, mesh.vertex_count, GPU_VERTEX_FLOATS, mesh.indices, mesh.index_count);
+                materialRangeCount = 0;
             }
 
-            verticesToGPU[i * 9 + 6] = normals[face->normalIndex[0] - 1].x;
-            verticesToGPU[i * 9 + 7] = normals[face->normalIndex[1] - 1].y;
-            verticesToGPU[i * 9 + 8] = normals[face->normalIndex[2] - 1].z;
+            // Simplified from the final order, the full level stays as it is
+            if (useLods)
+            {
+                double lodMilliseconds;
+                lodCount = build_gpu_mesh_lods(&mesh, optimize, lods, &lodMilliseconds);
+                print_mesh_lods(lods, lodCount, lodMilliseconds);
+            }
+
+            stream_gpu_arrays(mesh.vertices, mesh.vertex_count, mesh.indices, mesh.index_count, caching ? &bothSinks : &uploadSink);
+        }
+        else
+        {
+            stream_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, caching ? &bothSinks : &uploadSink);
+        }
+
+        if (caching && finish_mesh_cache_writer(&writer, materials, material_count, lods, lodCount, materialRanges, materialRangeCount))
+        {
+            printf("Wrote mesh cache for %s\n", objFilename);
         }
     }
 
-    GLint indices[face_count * 3];
+    int vertexCount = packVertices ? packedUpload.vertexCount : upload.vertexCount;
+    int indexCount = packVertices ? packedUpload.indexCount : upload.indexCount;
+    GLenum indexType = packVertices ? packedUpload.indexType : GL_UNSIGNED_INT;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    if (lodCount == 0)
+    {
+        lods[0] = (MeshLod){0, indexCount, 0.0f};
+        lodCount = 1;
+    }
 
-    for (int i = 0; i < face_count; i++)
+    if (useMeshlets)
     {
-        for (int j = 0; j < 3; j++)
+        const float *meshVertices = cache.data ? cache.vertices : mesh.vertices;
+        const unsigned int *meshIndices = cache.data ? cache.indices : mesh.indices;
+
+        double meshletStart = getTimeSeconds();
+        meshletCount = build_meshlets(meshVertices, vertexCount, GPU_VERTEX_FLOATS, meshIndices, lods[0].index_count, &meshlets);
+
+        printf("Built %d meshlets of up to %d vertices and %d triangles in %.2f ms\n", meshletCount, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, (getTimeSeconds() - meshletStart) * 1000.0);
+        benchmark_meshlet_culling(meshlets, meshletCount, lods[0].index_count, 360);
+    }
+
+    // One draw per surviving run of meshlets, filled every frame
+    GLsizei *drawCounts = malloc(((size_t)meshletCount + 1) * sizeof(GLsizei));
+    const void **drawOffsets = malloc(((size_t)meshletCount + 1) * sizeof(void *));
+    if (!drawCounts || !drawOffsets)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    free_gpu_mesh(&mesh);
+
+    // Per model base vertices keep each model's indices as they were built
+    int sceneDrawCount = scene.model_count;
+    GLsizei *sceneCounts = malloc(((size_t)sceneDrawCount + 1) * sizeof(GLsizei));
+    const void **sceneOffsets = malloc(((size_t)sceneDrawCount + 1) * sizeof(void *));
+    GLint *sceneBaseVertices = malloc(((size_t)sceneDrawCount + 1) * sizeof(GLint));
+    if (!sceneCounts || !sceneOffsets || !sceneBaseVertices)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    scene_draws(&scene, indexSize, sceneCounts, sceneOffsets, sceneBaseVertices);
+
+    // Clusters of the models take the place of their draws, culled every
+    // frame. A background load builds it on the worker.
+    OcclusionCuller occlusion = {0};
+    if (occluderNames && scene.model_count > 0)
+    {
+        build_occlusion_culler(&occlusion, scene.models, scene.model_count, &scene.mesh, occluderNames);
+        benchmark_occlusion_culling(&occlusion, 360);
+
+        sceneCounts = realloc(sceneCounts, ((size_t)occlusion.cluster_count + 1) * sizeof(GLsizei));
+        sceneOffsets = realloc(sceneOffsets, ((size_t)occlusion.cluster_count + 1) * sizeof(void *));
+        sceneBaseVertices = realloc(sceneBaseVertices, ((size_t)occlusion.cluster_count + 1) * sizeof(GLint));
+        if (!sceneCounts || !sceneOffsets || !sceneBaseVertices)
         {
-            indices[i * 3 + j] = faces[i].vertexIndex[j] - 1;
+            perror("Failed to reallocate memory");
+            exit(EXIT_FAILURE);
         }
     }
+    free_scene(&scene);
 
-    GLint VAO, VBO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
+    if (!cache.data && !sceneNames && !asyncLoading)
+    {
+        printf("Welded %d corners into %d vertices (%.1f%%)\n", lods[0].index_count, vertexCount, 100.0 * vertexCount / (lods[0].index_count ? lods[0].index_count : 1));
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verticesToGPU), verticesToGPU, GL_DYNAMIC_DRAW);
+    if (!asyncLoading)
+    {
+        printf("Uploaded %d vertices and %d indices in %.2f ms, peak memory %ld KB\n", vertexCount, indexCount, (getTimeSeconds() - uploadStart) * 1000.0, getPeakMemoryKb());
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_DYNAMIC_DRAW);
+    if (packVertices)
+    {
+        long long floatBytes = (long long)vertexCount * GPU_VERTEX_FLOATS * sizeof(GLfloat) + (long long)indexCount * sizeof(GLuint);
+        long long packedBytes = (long long)vertexCount * sizeof(PackedVertex) + (long long)indexCount * indexSize;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(0);
+        printf("Packed buffers %lld KB instead of %lld KB (%.1f%%), %s indices\n", packedBytes / 1024, floatBytes / 1024, 100.0 * packedBytes / (floatBytes ? floatBytes : 1), indexType == GL_UNSIGNED_SHORT ? "16 bit" : "32 bit");
+        print_packing_error(&packer);
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), (GLvoid *)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
+        setPackedVertexAttributes();
+    }
+    else
+    {
+        // A background load hasn't touched the buffer yet
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        setVertexAttributes();
+    }
 
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(GLfloat), (GLvoid *)(6 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(2);
+    // Drawn until a background load is on the GPU
+    GLuint placeholderVAO = 0, placeholderBuffers[2] = {0, 0};
+    if (asyncLoading)
+    {
+        GpuMesh placeholder;
+        build_placeholder_mesh(2.0f, &placeholder);
+
+        glGenVertexArrays(1, &placeholderVAO);
+        glGenBuffers(2, placeholderBuffers);
+        glBindVertexArray(placeholderVAO);
+
+        GpuUpload placeholderUpload = {placeholderBuffers[0], placeholderBuffers[1], 0, 0};
+        MeshSink placeholderSink = gpuUploadSink(&placeholderUpload);
+        stream_gpu_arrays(placeholder.vertices, placeholder.vertex_count, placeholder.indices, placeholder.index_count, &placeholderSink);
+        setVertexAttributes();
+        free_gpu_mesh(&placeholder);
+    }
 
     glBindVertexArray(0);
 
-    GLuint shaders[2];
-    shaders[0] = genShader("vertexShader.glsl", GL_VERTEX_SHADER);
-    shaders[1] = genShader("fragmentShader.glsl", GL_FRAGMENT_SHADER);
+    if (shaderBenchmark)
+    {
+        benchmarkShaderStartup();
+    }
+
+    // Linked programs come from the program cache after the first start
+    double shaderStart = getTimeSeconds();
+    ShaderManager shaderManager;
+    initShaderManager(&shaderManager);
+    if (precompileShaders && !precompileShaderPermutations(&shaderManager))
+    {
+        fprintf(stderr, "Not every shader permutation could be built\n");
+    }
+    unsigned int permutation = (packVertices ? SHADER_PACKED_VERTICES : 0) | (analyticGrading ? 0 : SHADER_LUT_GRADING) | (instanceCount > 0 ? SHADER_INSTANCED : 0);
+    GLuint shaderProgram = getShaderProgram(&shaderManager, permutation);
+    printf("Shaders ready in %.2f ms, %d from the program cache, %d compiled\n", (getTimeSeconds() - shaderStart) * 1000.0, shaderManager.cacheHits, shaderManager.cacheMisses);
+
+    if (packVertices)
+    {
+        setPackedVertexUniforms(shaderProgram, &packer);
+    }
+
+    // Blocks are filled once and only uploaded again when they change
+    bindUniformBlocks(shaderProgram);
+    GlobalUniforms globalUniforms;
+    MaterialUniforms materialUniforms;
+    initGlobalUniforms(&globalUniforms);
+    initMaterialUniforms(&materialUniforms);
+    setMaterialUniforms(&materialUniforms, materials, material_count);
+    ColorGradeTextures colorGrade;
+    initColorGradeTextures(&colorGrade);
+
+    if (instanceBenchmark)
+    {
+        benchmark_instance_updates(100000, 60);
+
+        updateGlobalUniforms(&globalUniforms, &parameters);
+        updateColorGradeTextures(&colorGrade, &parameters);
+        updateMaterialUniforms(&materialUniforms);
+        bindMaterialUniforms(&materialUniforms, -1);
+        benchmarkInstancedDraws(&shaderManager, permutation & ~SHADER_INSTANCED, packVertices ? &packer : NULL, VAO, indexCount, indexType, boundsMin, boundsMax, 0);
+    }
+
+    // Every copy's transform and tint, written each frame into the next
+    // region of the instance buffer
+    InstanceSet instances = {0};
+    InstanceBuffer instanceBuffer = {0};
+    if (instanceCount > 0)
+    {
+        init_instance_grid(&instances, instanceCount, boundsMin, boundsMax);
+        initInstanceBuffer(&instanceBuffer, instanceCount);
+    }
 
-    GLuint shaderProgram = genShaderProgram(shaders, 2);
+    // Matrices are made on the CPU once a frame, see shader_transforms
+    GLint modelLocation = glGetUniformLocation(shaderProgram, "model");
+    GLint viewProjectionLocation = glGetUniformLocation(shaderProgram, "viewProjection");
+    GLint normalMatrixLocation = glGetUniformLocation(shaderProgram, "normalMatrix");
+    GLint viewPosLocation = glGetUniformLocation(shaderProgram, "viewPos");
+
+    // Only a plain float mesh can be swapped for a rebuilt one, the other
+    // paths derive too much from it before the first frame. A scene only
+    // watches the shaders.
+    HotReloader hotReloader = {0};
+    if (watchFiles)
+    {
+        int reloadMesh = !packVertices && !useMeshlets && !useLods && !picking;
+        if (!reloadMesh && !sceneNames)
+        {
+            printf("--packed, --meshlets, --lod and --pick keep the mesh, OBJ changes apply on the next start\n");
+        }
+        if (!start_hot_reload(&hotReloader, sceneNames ? NULL : modelName, reloadMesh, loadThreads, cacheFlags, creaseAngle))
+        {
+            fprintf(stderr, "Failed to start watching for changes\n");
+        }
+    }
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
+    // Meshlet culling drops clusters whose faces all point away, so the
+    // GPU has to drop the same back faces or open geometry loses its back
+    // sides only where a cluster was culled. OBJ faces wind
+    // counterclockwise.
+    if (useMeshlets)
+    {
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        glFrontFace(GL_CCW);
+    }
+
+    // Materials with d < 1 are sorted last and blend over the rest
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Built from the OBJ faces when they were parsed, so picks name faces
+    // (numbered in material order), otherwise from the cached buffers, so
+    // picks name index buffer triangles
+    Bvh bvh = {0};
+    if (picking)
+    {
+        double bvhStart = getTimeSeconds();
+        if (cache.data)
+        {
+            build_bvh(cache.vertices, GPU_VERTEX_FLOATS, cache.indices, NULL, lods[0].index_count / 3, loadThreads, &bvh);
+        }
+        else
+        {
+            build_bvh_from_faces(vertices, vertex_count, faces, face_count, loadThreads, &bvh);
+        }
+
+        printf("Built BVH over %d triangles in %.2f ms, %d nodes, depth %d\n", bvh.triangle_count, (getTimeSeconds() - bvhStart) * 1000.0, bvh.node_count, bvh.depth);
+        benchmark_bvh(&bvh, 100000);
+    }
+
     printf("\nFreeing memory...\n");
 
+    close_mesh_cache(&cache);
     free(vertices);
     free(texCoords);
     free(normals);
@@ -488,268 +986,508 @@ int main()
 
     printf("\nRendering...\n");
 
-    // This works for esposito.obj
+    // Parameters are changed on a thread of their own at a fixed step,
+    // whatever the frame rate
+    InputController input;
+    if (!start_input(&input, &parameters))
+    {
+        fprintf(stderr, "Failed to start the input thread\n");
+    }
+    glfwSetWindowUserPointer(window, &input);
+    glfwSetKeyCallback(window, keyCallback);
 
-    float hueAdjust = 0.05; //1
-    float saturationAdjust = 3.459998; //2
-    float brightnessAdjust = 0.2; //3
-    float hHueAdjust = 0.05; //4
-    float hSaturationAdjust = 0.880001;//5
-    float hBrightnessAdjust = 0.2;//6
-    float gamma = 2.2;//7
-    float ambientStrength = -0.109999;//8
-    float specularStrength = 0.8;//9
-    float specularExponent = 32.0;//0
+    // Nothing in the loop waits on the terminal
+    if (!start_logger(stdout))
+    {
+        fprintf(stderr, "Failed to start the logging thread\n");
+    }
 
-    int currentEdit = 1;
+    int wasClicking = 0;
+    int currentLod = 0;
+
+    // Background load progress, and the frame times it is judged by
+    LoadedMesh *loadedMesh = NULL;
+    MeshStream meshStream;
+    int meshReady = !asyncLoading;
+    int uploadFrames = 0;
+    double uploadBegin = 0.0;
+    double lastFrame = 0.0;
+    double worstLoadingFrame = 0.0;
+    int framesDrawn = 0;
+
+    // Swap to swap after the first frame, for the jitter
+    int frameTimeCount = 0;
+    double frameTimeTotal = 0.0;
+    double frameTimeSquares = 0.0;
+    double worstFrameTime = 0.0;
+
+    // A reload being swapped in: a mesh streaming into buffers of its own
+    // or a program the driver is still building. Both keep drawing the old
+    // one until they are done.
+    HotReload *hotReload = NULL;
+    GLuint reloadVAO = 0, reloadBuffers[2] = {0, 0};
+    GpuUpload reloadUpload;
+    MeshSink reloadSink;
+    MeshStream reloadStream;
+    ShaderRebuild shaderRebuild = {0};
+    double reloadSaved = 0.0;
+    double reloadMilliseconds = 0.0;
 
     // Render loop
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_BEGIN(frame);
 
-        // Set the clear color
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        // Take the mesh off the queue once the worker is done, then feed it
+        // to the buffers a few staging blocks per frame within the budget,
+        // so no frame waits for the whole upload
+        PROFILE_BEGIN(upload);
+        if (!meshReady)
+        {
+            if (!loadedMesh && (loadedMesh = poll_async_load(&asyncLoader)) != NULL)
+            {
+                log_message("Loaded %d vertices and %d indices in the background in %.2f ms%s\n", loadedMesh->mesh.vertex_count, loadedMesh->mesh.index_count, loadedMesh->milliseconds, loadedMesh->from_cache ? " from cache" : "");
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+                glBindVertexArray(VAO);
+                begin_mesh_stream(&meshStream, loadedMesh->mesh.vertices, loadedMesh->mesh.vertex_count, loadedMesh->mesh.indices, loadedMesh->mesh.index_count, &uploadSink);
+                uploadBegin = getTimeSeconds();
+            }
 
-        glUseProgram(shaderProgram);
+            if (loadedMesh)
+            {
+                glBindVertexArray(VAO);
+                uploadFrames++;
+                if (continue_mesh_stream(&meshStream, getTimeSeconds() + uploadBudgetMs / 1000.0))
+                {
+                    indexCount = loadedMesh->mesh.index_count;
+                    lods[0] = (MeshLod){0, indexCount, 0.0f};
+
+                    const Scene *loadedScene = &loadedMesh->scene;
+                    occlusion = loadedMesh->occlusion;
+                    memset(&loadedMesh->occlusion, 0, sizeof(OcclusionCuller));
+
+                    sceneDrawCount = loadedScene->model_count;
+                    int drawCapacity = occlusion.cluster_count > sceneDrawCount ? occlusion.cluster_count : sceneDrawCount;
+                    sceneCounts = realloc(sceneCounts, ((size_t)drawCapacity + 1) * sizeof(GLsizei));
+                    sceneOffsets = realloc(sceneOffsets, ((size_t)drawCapacity + 1) * sizeof(void *));
+                    sceneBaseVertices = realloc(sceneBaseVertices, ((size_t)drawCapacity + 1) * sizeof(GLint));
+                    if (!sceneCounts || !sceneOffsets || !sceneBaseVertices)
+                    {
+                        perror("Failed to reallocate memory");
+                        exit(EXIT_FAILURE);
+                    }
+                    scene_draws(loadedScene, indexSize, sceneCounts, sceneOffsets, sceneBaseVertices);
 
-        // if we're pressing 1
-        if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
-        {
-            currentEdit = 1;
-        }
-        // if we're pressing 2
-        if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
-        {
-            currentEdit = 2;
-        }
-        // if we're pressing 3
-        if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
-        {
-            currentEdit = 3;
-        }
-        // if we're pressing 4
-        if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
-        {
-            currentEdit = 4;
-        }
-        // if we're pressing 5
-        if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
-        {
-            currentEdit = 5;
-        }
-        // if we're pressing 6
-        if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS)
-        {
-            currentEdit = 6;
-        }
-        // if we're pressing 7
-        if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
-        {
-            currentEdit = 7;
-        }
-        // if we're pressing 8
-        if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
-        {
-            currentEdit = 8;
-        }
-        // if we're pressing 9
-        if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS)
-        {
-            currentEdit = 9;
-        }
-        // if we're pressing 0
-        if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS)
-        {
-            currentEdit = 0;
+                    log_message("Uploaded over %d frames in %.2f ms, ready %.2f ms after start\n", uploadFrames, (getTimeSeconds() - uploadBegin) * 1000.0, (getTimeSeconds() - programStart) * 1000.0);
+                    free_loaded_mesh(loadedMesh);
+                    loadedMesh = NULL;
+                    meshReady = 1;
+                }
+            }
         }
 
-        // if is 1 and were pressing right
-        if (currentEdit == 1 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-        {
-            hueAdjust += 0.01;
-            printf("hueAdjust: %f\n", hueAdjust);
-        }
-        // if is 1 and were pressing left
-        if (currentEdit == 1 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-        {
-            hueAdjust -= 0.01;
-            printf("hueAdjust: %f\n", hueAdjust);
-        }
-        // if is 2 and were pressing right
-        if (currentEdit == 2 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-        {
-            saturationAdjust += 0.01;
-            printf("saturationAdjust: %f\n", saturationAdjust);
-        }
-        // if is 2 and were pressing left
-        if (currentEdit == 2 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        PROFILE_END(upload);
+
+        // One reload at a time, taken once the first load is on the GPU
+        PROFILE_BEGIN(hot_reload);
+        if (!hotReload && meshReady && (hotReload = poll_hot_reload(&hotReloader)) != NULL)
         {
-            saturationAdjust -= 0.01;
-            printf("saturationAdjust: %f\n", saturationAdjust);
+            if (hotReload->kind == HOT_RELOAD_MESH)
+            {
+                glGenVertexArrays(1, &reloadVAO);
+                glGenBuffers(2, reloadBuffers);
+                glBindVertexArray(reloadVAO);
+                reloadUpload = (GpuUpload){reloadBuffers[0], reloadBuffers[1], 0, 0};
+                reloadSink = gpuUploadSink(&reloadUpload);
+                begin_mesh_stream(&reloadStream, hotReload->mesh.vertices, hotReload->mesh.vertex_count, hotReload->mesh.indices, hotReload->mesh.index_count, &reloadSink);
+            }
+            else if (hotReload->kind == HOT_RELOAD_SHADERS)
+            {
+                startShaderRebuild(&shaderManager, permutation, hotReload->vertex_source, hotReload->fragment_source, &shaderRebuild);
+            }
         }
-        // if is 3 and were pressing right
-        if (currentEdit == 3 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+
+        if (hotReload)
         {
-            brightnessAdjust += 0.01;
-            printf("brightnessAdjust: %f\n", brightnessAdjust);
+            int applied = 0;
+            if (hotReload->kind == HOT_RELOAD_MATERIALS)
+            {
+                // Only the full level drawn per material reads the table,
+                // every other draw has Kd baked into its vertex colors
+                if (sceneNames || useMeshlets || materialRangeCount == 0)
+                {
+                    log_message("The MTL changed, but this mesh draws the vertex colors it was loaded with, materials apply on the next start\n");
+                }
+                else
+                {
+                    int updated = merge_material_table(materials, material_count, hotReload->materials, hotReload->material_count);
+                    setMaterialUniforms(&materialUniforms, materials, material_count);
+                    log_message("Reloaded %d of %d materials%s\n", updated, material_count, lodCount > 1 ? ", coarser LODs keep their vertex colors" : "");
+                }
+                applied = 1;
+            }
+            else if (hotReload->kind == HOT_RELOAD_MESH)
+            {
+                glBindVertexArray(reloadVAO);
+                if (continue_mesh_stream(&reloadStream, getTimeSeconds() + uploadBudgetMs / 1000.0))
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, reloadBuffers[0]);
+                    setVertexAttributes();
+
+                    glDeleteVertexArrays(1, &VAO);
+                    glDeleteBuffers(1, &VBO);
+                    glDeleteBuffers(1, &EBO);
+                    VAO = reloadVAO;
+                    VBO = reloadBuffers[0];
+                    EBO = reloadBuffers[1];
+                    reloadVAO = 0;
+
+                    indexCount = reloadUpload.indexCount;
+                    lods[0] = (MeshLod){0, indexCount, 0.0f};
+                    lodCount = 1;
+
+                    // The faces index the reloaded table, not the old one
+                    free(materialRanges);
+                    materialRanges = hotReload->ranges;
+                    materialRangeCount = hotReload->range_count;
+                    hotReload->ranges = NULL;
+                    load_material_table(hotReload->materials, hotReload->material_count);
+                    setMaterialUniforms(&materialUniforms, materials, material_count);
+
+                    log_message("Reloaded %d vertices and %d indices\n", reloadUpload.vertexCount, indexCount);
+                    applied = 1;
+                }
+            }
+            else
+            {
+                GLuint rebuilt;
+                if (finishShaderRebuild(&shaderManager, &shaderRebuild, &rebuilt))
+                {
+                    if (rebuilt)
+                    {
+                        shaderProgram = rebuilt;
+                        if (packVertices)
+                        {
+                            setPackedVertexUniforms(shaderProgram, &packer);
+                        }
+                        bindUniformBlocks(shaderProgram);
+                        modelLocation = glGetUniformLocation(shaderProgram, "model");
+                        viewProjectionLocation = glGetUniformLocation(shaderProgram, "viewProjection");
+                        normalMatrixLocation = glGetUniformLocation(shaderProgram, "normalMatrix");
+                        viewPosLocation = glGetUniformLocation(shaderProgram, "viewPos");
+                        log_message("Reloaded the shaders\n");
+                        applied = 1;
+                    }
+                    else
+                    {
+                        log_message("The shaders didn't build, keeping the previous ones\n");
+                        free_hot_reload(hotReload);
+                        hotReload = NULL;
+                    }
+                }
+            }
+
+            // Latency is reported once the frame it shows up in is swapped
+            if (applied)
+            {
+                reloadSaved = hotReload->saved;
+                reloadMilliseconds = hotReload->milliseconds;
+                free_hot_reload(hotReload);
+                hotReload = NULL;
+            }
         }
-        // if is 3 and were pressing left
-        if (currentEdit == 3 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        PROFILE_END(hot_reload);
+
+        // Set the clear color
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+
+        glUseProgram(shaderProgram);
+
+        // Keys arrive through keyCallback, the update thread turns them into
+        // parameters and hands them over whole
+        PROFILE_BEGIN(input);
+        const InputSnapshot *snapshot = latest_input_snapshot(&input);
+        PROFILE_END(input);
+
+        // No GL calls unless a key changed a parameter
+        PROFILE_BEGIN(uniforms);
+        updateGlobalUniforms(&globalUniforms, &snapshot->parameters);
+        updateMaterialUniforms(&materialUniforms);
+        double lutMilliseconds = analyticGrading ? 0.0 : updateColorGradeTextures(&colorGrade, &snapshot->parameters);
+        if (lutMilliseconds > 0.0)
         {
-            brightnessAdjust -= 0.01;
-            printf("brightnessAdjust: %f\n", brightnessAdjust);
+            log_message("Rebuilt the color grading LUT in %.2f ms\n", lutMilliseconds);
         }
-        // if is 4 and were pressing right
-        if (currentEdit == 4 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
+        float aspect = framebufferHeight > 0 ? (float)framebufferWidth / framebufferHeight : 1.0f;
+
+        GLfloat time = (GLfloat)glfwGetTime();
+        ShaderTransforms transforms;
+        shader_transforms(time, aspect, &transforms);
+        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, (const GLfloat *)transforms.model.columns);
+        glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, (const GLfloat *)transforms.view_projection.columns);
+        glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, transforms.normal_matrix);
+        glUniform3f(viewPosLocation, transforms.eye[0], transforms.eye[1], transforms.eye[2]);
+        PROFILE_END(uniforms);
+
+        // On every core, the GPU still reads the regions of the two frames
+        // before this one
+        if (instanceCount > 0)
         {
-            hHueAdjust += 0.01;
-            printf("hHueAdjust: %f\n", hHueAdjust);
+            PROFILE_BEGIN(instances);
+            float *instanceData = mapInstanceFrame(&instanceBuffer, instanceCount);
+            if (instanceData)
+            {
+                update_instances(&instances, time, 0, instanceData);
+                glBindVertexArray(VAO);
+                unmapInstanceFrame(&instanceBuffer);
+            }
+            PROFILE_END(instances);
         }
-        // if is 4 and were pressing left
-        if (currentEdit == 4 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+
+        // The level follows the framebuffer size, the camera doesn't move
+        PROFILE_BEGIN(draw);
+        int lod = select_mesh_lod(lods, lodCount, shader_pixels_per_unit(framebufferHeight), lodPixelError);
+        if (lod != currentLod)
         {
-            hHueAdjust -= 0.01;
-            printf("hHueAdjust: %f\n", hHueAdjust);
+            log_message("Drawing LOD %d, %d triangles\n", lod, lods[lod].index_count / 3);
+            currentLod = lod;
         }
-        // if is 5 and were pressing right
-        if (currentEdit == 5 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+
+        // Everything but the sorted full level shades with vertex colors
+        bindMaterialUniforms(&materialUniforms, -1);
+
+        if (!meshReady)
         {
-            hSaturationAdjust += 0.01;
-            printf("hSaturationAdjust: %f\n", hSaturationAdjust);
+            glBindVertexArray(placeholderVAO);
+            glDrawElements(GL_TRIANGLES, 24, GL_UNSIGNED_INT, 0);
         }
-        // if is 5 and were pressing left
-        if (currentEdit == 5 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        else if (sceneNames)
         {
-            hSaturationAdjust -= 0.01;
-            printf("hSaturationAdjust: %f\n", hSaturationAdjust);
+            int drawCount = sceneDrawCount;
+            if (occlusion.cluster_count > 0)
+            {
+                PROFILE_BEGIN(occlusion);
+                drawCount = cull_occluded_clusters(&occlusion, &transforms.model_view_projection, indexSize, sceneCounts, sceneOffsets, sceneBaseVertices);
+                PROFILE_END(occlusion);
+            }
+            glBindVertexArray(VAO);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, sceneCounts, indexType, sceneOffsets, drawCount, sceneBaseVertices);
         }
-        // if is 6 and were pressing right
-        if (currentEdit == 6 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        else if (instanceCount > 0)
         {
-            hBrightnessAdjust += 0.01;
-            printf("hBrightnessAdjust: %f\n", hBrightnessAdjust);
+            glBindVertexArray(VAO);
+            if (materialRangeCount > 0)
+            {
+                for (int r = 0; r < materialRangeCount; r++)
+                {
+                    bindMaterialUniforms(&materialUniforms, materialRanges[r].material);
+                    glDrawElementsInstanced(GL_TRIANGLES, materialRanges[r].index_count, indexType, (const void *)(materialRanges[r].first_index * indexSize), instanceCount);
+                }
+            }
+            else
+            {
+                glDrawElementsInstanced(GL_TRIANGLES, lods[0].index_count, indexType, 0, instanceCount);
+            }
+            fenceInstanceFrame(&instanceBuffer);
         }
-        // if is 6 and were pressing left
-        if (currentEdit == 6 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        else if (lod > 0)
         {
-            hBrightnessAdjust -= 0.01;
-            printf("hBrightnessAdjust: %f\n", hBrightnessAdjust);
+            // Meshlets only cover the full level
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, lods[lod].index_count, indexType, (const void *)(lods[lod].first_index * indexSize));
         }
-        // if is 7 and were pressing right
-        if (currentEdit == 7 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        else if (useMeshlets)
         {
-            gamma += 0.01;
-            printf("gamma: %f\n", gamma);
+            // Cull against the same time the shader rotates by
+            MeshletView view;
+            shader_meshlet_view(time, aspect, &view);
+
+            int visibleIndices = 0;
+            glBindVertexArray(VAO);
+            int drawCount = cull_meshlets(meshlets, meshletCount, &view, indexSize, drawCounts, drawOffsets, &visibleIndices);
+            glMultiDrawElements(GL_TRIANGLES, drawCounts, indexType, drawOffsets, drawCount);
         }
-        // if is 7 and were pressing left
-        if (currentEdit == 7 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        else if (materialRangeCount > 0)
         {
-            gamma -= 0.01;
-            printf("gamma: %f\n", gamma);
+            glBindVertexArray(VAO);
+            for (int r = 0; r < materialRangeCount; r++)
+            {
+                bindMaterialUniforms(&materialUniforms, materialRanges[r].material);
+                glDrawElements(GL_TRIANGLES, materialRanges[r].index_count, indexType, (const void *)(materialRanges[r].first_index * indexSize));
+            }
         }
-        // if is 8 and were pressing right
-        if (currentEdit == 8 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        else
         {
-            ambientStrength += 0.01;
-            printf("ambientStrength: %f\n", ambientStrength);
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, lods[0].index_count, indexType, 0);
         }
-        // if is 8 and were pressing left
-        if (currentEdit == 8 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+
+        PROFILE_END(draw);
+
+        int clicking = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (picking && clicking && !wasClicking)
         {
-            ambientStrength -= 0.01;
-            printf("ambientStrength: %f\n", ambientStrength);
+            double cursorX, cursorY;
+            int windowWidth, windowHeight;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+
+            // Back through this frame's matrices: from the eye through the
+            // cursor on the far plane, into model space where the BVH is
+            float ndcX = (float)(2.0 * cursorX / windowWidth - 1.0);
+            float ndcY = (float)(1.0 - 2.0 * cursorY / windowHeight);
+            Mat4 inverseViewProjection = mat4_inverse(&transforms.view_projection);
+            Mat4 inverseModel = mat4_inverse(&transforms.model);
+            Vec4 farPoint = mat4_transform(&inverseViewProjection, vec4(ndcX, ndcY, 1.0f, 1.0f));
+            Vec4 eye = mat4_transform(&inverseModel, vec4(transforms.eye[0], transforms.eye[1], transforms.eye[2], 1.0f));
+            Vec4 target = mat4_transform(&inverseModel, farPoint / farPoint[3]);
+            Vec3 toward = vec3_normalize(target - eye);
+            float origin[3] = {eye[0], eye[1], eye[2]};
+            float direction[3] = {toward[0], toward[1], toward[2]};
+
+            BvhHit hit;
+            double pickStart = getTimeSeconds();
+            if (bvh_intersect(&bvh, origin, direction, SHADER_FAR_PLANE, &hit))
+            {
+                log_message("Picked triangle %d at distance %.3f in %.2f us\n", hit.id, hit.t, (getTimeSeconds() - pickStart) * 1e6);
+            }
+            else
+            {
+                log_message("Nothing under the cursor\n");
+            }
         }
-        // if is 9 and were pressing right
-        if (currentEdit == 9 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        wasClicking = clicking;
+
+        PROFILE_BEGIN(swap);
+        glfwSwapBuffers(window);
+        PROFILE_END(swap);
+
+        double now = getTimeSeconds();
+        input_frame_shown(&input, snapshot, now);
+        if (framesDrawn > 0)
         {
-            specularStrength += 0.01;
-            printf("specularStrength: %f\n", specularStrength);
+            double frameTime = now - lastFrame;
+            frameTimeCount++;
+            frameTimeTotal += frameTime;
+            frameTimeSquares += frameTime * frameTime;
+            worstFrameTime = frameTime > worstFrameTime ? frameTime : worstFrameTime;
         }
-        // if is 9 and were pressing left
-        if (currentEdit == 9 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        if (framesDrawn++ == 0)
         {
-            specularStrength -= 0.01;
-            printf("specularStrength: %f\n", specularStrength);
+            log_message("First frame %.2f ms after start\n", (now - programStart) * 1000.0);
         }
-        // if is 0 and were pressing right
-        if (currentEdit == 0 && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+        else if (asyncLoading && (!meshReady || uploadFrames > 0))
         {
-            specularExponent += 0.01;
-            printf("specularExponent: %f\n", specularExponent);
+            worstLoadingFrame = now - lastFrame > worstLoadingFrame ? now - lastFrame : worstLoadingFrame;
+            if (meshReady)
+            {
+                log_message("Worst frame while loading %.2f ms\n", worstLoadingFrame * 1000.0);
+                uploadFrames = 0;
+            }
         }
-        // if is 0 and were pressing left
-        if (currentEdit == 0 && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+        lastFrame = now;
+
+        if (reloadSaved > 0.0)
         {
-            specularExponent -= 0.01;
-            printf("specularExponent: %f\n", specularExponent);
+            log_message("Reload on screen %.2f ms after the save, %.2f ms of it parsing\n", (now - reloadSaved) * 1000.0, reloadMilliseconds);
+            reloadSaved = 0.0;
         }
 
-        // Uniform for hueAdjust
-        GLint hueAdjustLocation = glGetUniformLocation(shaderProgram, "hueAdjust");
-        glUniform1f(hueAdjustLocation, hueAdjust);
-
-        // Uniform for saturationAdjust
-        GLint saturationAdjustLocation = glGetUniformLocation(shaderProgram, "saturationAdjust");
-        glUniform1f(saturationAdjustLocation, saturationAdjust);
-
-        // Uniform for brightnessAdjust
-        GLint brightnessAdjustLocation = glGetUniformLocation(shaderProgram, "brightnessAdjust");
-        glUniform1f(brightnessAdjustLocation, brightnessAdjust);
-
-        // Uniform for hHueAdjust
-        GLint hHueAdjustLocation = glGetUniformLocation(shaderProgram, "hHueAdjust");
-        glUniform1f(hHueAdjustLocation, hHueAdjust);
-
-        // Uniform for hSaturationAdjust
-        GLint hSaturationAdjustLocation = glGetUniformLocation(shaderProgram, "hSaturationAdjust");
-        glUniform1f(hSaturationAdjustLocation, hSaturationAdjust);
-
-        // Uniform for hBrightnessAdjust
-        GLint hBrightnessAdjustLocation = glGetUniformLocation(shaderProgram, "hBrightnessAdjust");
-        glUniform1f(hBrightnessAdjustLocation, hBrightnessAdjust);
-
-        // Uniform for gamma
-        GLint gammaLocation = glGetUniformLocation(shaderProgram, "gamma");
-        glUniform1f(gammaLocation, gamma);
+        PROFILE_BEGIN(poll_events);
+        glfwPollEvents();
+        wait_for_input(&input);
+        PROFILE_END(poll_events);
 
-        // Uniform for ambientStrength
-        GLint ambientStrengthLocation = glGetUniformLocation(shaderProgram, "ambientStrength");
-        glUniform1f(ambientStrengthLocation, ambientStrength);
+        PROFILE_END(frame);
+    }
 
-        // Uniform for specularStrength
-        GLint specularStrengthLocation = glGetUniformLocation(shaderProgram, "specularStrength");
-        glUniform1f(specularStrengthLocation, specularStrength);
+    stop_input(&input);
+    stop_logger();
 
-        // Uniform for specularExponent
-        GLint specularExponentLocation = glGetUniformLocation(shaderProgram, "specularExponent");
-        glUniform1f(specularExponentLocation, specularExponent);
-        
-        // Uniform for time
-        GLint timeLocation = glGetUniformLocation(shaderProgram, "time");
-        glUniform1f(timeLocation, (GLfloat)glfwGetTime());
+    printf("\nExiting...\n");
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, face_count * 3, GL_UNSIGNED_INT, 0);
+    print_input_latency(&input);
+    if (frameTimeCount > 0)
+    {
+        double meanFrameTime = frameTimeTotal / frameTimeCount;
+        double variance = frameTimeSquares / frameTimeCount - meanFrameTime * meanFrameTime;
+        printf("Frame time %.2f ms on average, %.2f ms standard deviation, %.2f ms worst\n", meanFrameTime * 1000.0, sqrt(variance > 0.0 ? variance : 0.0) * 1000.0, worstFrameTime * 1000.0);
+    }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    if (occlusion.stats.frames > 0)
+    {
+        print_occlusion_stats(&occlusion.stats, "while rendering");
+    }
+    if (instanceCount > 0)
+    {
+        printf("Drew %d instances a frame, %d frames waited for the instance buffer\n", instanceCount, instanceBuffer.stalls);
     }
 
-    printf("\nExiting...\n");
+    // A reload still on its way is dropped
+    stop_hot_reload(&hotReloader);
+    if (hotReload)
+    {
+        glDeleteVertexArrays(1, &reloadVAO);
+        glDeleteBuffers(2, reloadBuffers);
+        glDeleteProgram(shaderRebuild.program);
+        free_hot_reload(hotReload);
+    }
 
     // Clean up
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &placeholderVAO);
+    glDeleteBuffers(2, placeholderBuffers);
+
+    freeShaderManager(&shaderManager);
+    freeGlobalUniforms(&globalUniforms);
+    freeMaterialUniforms(&materialUniforms);
+    freeColorGradeTextures(&colorGrade);
+
+    free(meshlets);
+    free(materialRanges);
+    free_bvh(&bvh);
+    free_occlusion_culler(&occlusion);
+    free_instances(&instances);
+    freeInstanceBuffer(&instanceBuffer);
+    free(drawCounts);
+    free(drawOffsets);
+    free(sceneCounts);
+    free(sceneOffsets);
+    free(sceneBaseVertices);
+    free_materials();
+
+    // A window closed mid-load still waits for the worker to finish
+    if (loadedMesh)
+    {
+        free_loaded_mesh(loadedMesh);
+    }
+    finish_async_load(&asyncLoader);
 
-    glDeleteProgram(shaderProgram);
-
-    for (int i = 0; i < 2; i++)
+    // Last, once the input, reload and loading threads have all been
+    // joined and nothing records anymore
+    if (profileName)
     {
-        glDeleteShader(shaders[i]);
+#ifdef PROFILER
+        char traceFilename[1024], percentileFilename[1024];
+        snprintf(traceFilename, sizeof(traceFilename), "%s.json", profileName);
+        snprintf(percentileFilename, sizeof(percentileFilename), "%s.csv", profileName);
+        if (write_chrome_trace(traceFilename) && write_profile_percentiles(percentileFilename))
+        {
+            printf("Wrote %s and %s\n", traceFilename, percentileFilename);
+        }
+        free_profiler();
+#else
+        printf("Built without -DPROFILER, nothing to write for --profile\n");
+#endif
     }
 
     // Terminate GLFW
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh.h"
+#include "profiler.h"
+#include "utils.h"
+
+// One face corner as the GPU sees it. Corners with equal keys share a vertex.
+typedef struct
+{
+    int vertexIndex;
+    int texCoordIndex;
+    int normalIndex;
+    int materialIndex;
+} VertexKey;
+
+// Open addressing table from VertexKey to the welded vertex index
+typedef struct
+{
+    VertexKey *keys;
+    int *values;
+    unsigned int mask;
+} WeldTable;
+
+static unsigned int hash_vertex_key(const VertexKey *key)
+{
+    // Multiplicative mix, OBJ indices are small and highly correlated
+    unsigned int hash = (unsigned int)key->vertexIndex * 0x9E3779B1u;
+    hash ^= (unsigned int)key->texCoordIndex * 0x85EBCA77u;
+    hash ^= (unsigned int)key->normalIndex * 0xC2B2AE3Du;
+    hash ^= (unsigned int)key->materialIndex * 0x27D4EB2Fu;
+    return hash ^ (hash >> 15);
+}
+
+static void init_weld_table(WeldTable *table, int expected_count)
+{
+    // Kept at most half full
+    unsigned int table_size = 16;
+    while (table_size < (unsigned int)expected_count * 2)
+    {
+        table_size *= 2;
+    }
+
+    table->mask = table_size - 1;
+    table->keys = malloc(table_size * sizeof(VertexKey));
+    table->values = malloc(table_size * sizeof(int));
+
+    if (!table->keys || !table->values)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        table->values[i] = -1;
+    }
+}
+
+// Slot holding key, or the empty slot where it belongs
+static unsigned int find_weld_slot(const WeldTable *table, const VertexKey *key)
+{
+    unsigned int slot = hash_vertex_key(key) & table->mask;
+    while (table->values[slot] >= 0 && memcmp(&table->keys[slot], key, sizeof(VertexKey)) != 0)
+    {
+        slot = (slot + 1) & table->mask;
+    }
+    return slot;
+}
+
+static void grow_weld_table(WeldTable *table)
+{
+    WeldTable old = *table;
+    init_weld_table(table, (int)(old.mask + 1));
+
+    for (unsigned int i = 0; i <= old.mask; i++)
+    {
+        if (old.values[i] >= 0)
+        {
+            unsigned int slot = find_weld_slot(table, &old.keys[i]);
+            table->keys[slot] = old.keys[i];
+            table->values[slot] = old.values[i];
+        }
+    }
+
+    free(old.keys);
+    free(old.values);
+}
+
+static VertexKey face_corner_key(const Face *face, int corner)
+{
+    VertexKey key = {face->vertexIndex[corner], face->texCoordIndex[corner], face->normalIndex[corner], face->materialId};
+    return key;
+}
+
+static void write_gpu_vertex(float *out, const VertexKey *key, const Vertex *vertices, int vertex_count, const Normal *normals, int normal_count)
+{
+    memset(out, 0, GPU_VERTEX_FLOATS * sizeof(float));
+
+    if (key->vertexIndex >= 1 && key->vertexIndex <= vertex_count)
+    {
+        const Vertex *position = &vertices[key->vertexIndex - 1];
+        out[0] = position->x;
+        out[1] = position->y;
+        out[2] = position->z;
+    }
+
+    if (key->materialIndex >= 0)
+    {
+        out[3] = materials[key->materialIndex].Kd[0];
+        out[4] = materials[key->materialIndex].Kd[1];
+        out[5] = materials[key->materialIndex].Kd[2];
+    }
+
+    if (key->normalIndex >= 1 && key->normalIndex <= normal_count)
+    {
+        const Normal *normal = &normals[key->normalIndex - 1];
+        out[6] = normal->x;
+        out[7] = normal->y;
+        out[8] = normal->z;
+    }
+}
+
+void stream_gpu_mesh(const Vertex *vertices, int vertex_count, const Normal *normals, int normal_count, const Face *faces, int face_count, const MeshSink *sink)
+{
+    PROFILE_SCOPE(stream_gpu_mesh);
+
+    int corner_count = face_count * 3;
+
+    // Sized for the common case of about one vertex per position or normal
+    // and grown on demand, rather than for every corner being unique
+    WeldTable table;
+    init_weld_table(&table, vertex_count > normal_count ? vertex_count : normal_count);
+
+    // First pass numbers the unique corners, so the sink learns the exact
+    // sizes before any data and can allocate its storage once
+    int unique_count = 0;
+    for (int i = 0; i < face_count; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            VertexKey key = face_corner_key(&faces[i], j);
+            unsigned int slot = find_weld_slot(&table, &key);
+
+            if (table.values[slot] < 0)
+            {
+                table.keys[slot] = key;
+                table.values[slot] = unique_count++;
+
+                if ((unsigned int)unique_count * 2 > table.mask + 1)
+                {
+                    grow_weld_table(&table);
+                }
+            }
+        }
+    }
+
+    sink->begin(sink->context, unique_count, corner_count);
+
+    // Second pass walks the same corners in the same order. A corner whose
+    // number is the next one due is a first appearance and emits its
+    // vertex, so both streams come out in order through fixed blocks.
+    float *vertexBlock = malloc(STAGING_BLOCK_VERTICES * GPU_VERTEX_FLOATS * sizeof(float));
+    unsigned int *indexBlock = malloc(STAGING_BLOCK_INDICES * sizeof(unsigned int));
+
+    if (!vertexBlock || !indexBlock)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    int vertices_emitted = 0;
+    int vertices_staged = 0;
+    int indices_emitted = 0;
+    int indices_staged = 0;
+
+    for (int i = 0; i < face_count; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            VertexKey key = face_corner_key(&faces[i], j);
+            int index = table.values[find_weld_slot(&table, &key)];
+
+            if (index == vertices_emitted + vertices_staged)
+            {
+                write_gpu_vertex(&vertexBlock[vertices_staged * GPU_VERTEX_FLOATS], &key, vertices, vertex_count, normals, normal_count);
+
+                if (++vertices_staged == STAGING_BLOCK_VERTICES)
+                {
+                    sink->write_vertices(sink->context, vertexBlock, vertices_emitted, vertices_staged);
+                    vertices_emitted += vertices_staged;
+                    vertices_staged = 0;
+                }
+            }
+
+            indexBlock[indices_staged] = (unsigned int)index;
+
+            if (++indices_staged == STAGING_BLOCK_INDICES)
+            {
+                sink->write_indices(sink->context, indexBlock, indices_emitted, indices_staged);
+                indices_emitted += indices_staged;
+                indices_staged = 0;
+            }
+        }
+    }
+
+    if (vertices_staged > 0)
+    {
+        sink->write_vertices(sink->context, vertexBlock, vertices_emitted, vertices_staged);
+    }
+    if (indices_staged > 0)
+    {
+        sink->write_indices(sink->context, indexBlock, indices_emitted, indices_staged);
+    }
+
+    free(vertexBlock);
+    free(indexBlock);
+    free(table.keys);
+    free(table.values);
+}
+
+void stream_gpu_arrays(const float *vertices, int vertex_count, const unsigned int *indices, int index_count, const MeshSink *sink)
+{
+    sink->begin(sink->context, vertex_count, index_count);
+
+    for (int first = 0; first < vertex_count; first += STAGING_BLOCK_VERTICES)
+    {
+        int count = vertex_count - first < STAGING_BLOCK_VERTICES ? vertex_count - first : STAGING_BLOCK_VERTICES;
+        sink->write_vertices(sink->context, &vertices[(size_t)first * GPU_VERTEX_FLOATS], first, count);
+    }
+
+    for (int first = 0; first < index_count; first += STAGING_BLOCK_INDICES)
+    {
+        int count = index_count - first < STAGING_BLOCK_INDICES ? index_count - first : STAGING_BLOCK_INDICES;
+        sink->write_indices(sink->context, &indices[first], first, count);
+    }
+}
+
+void begin_mesh_stream(MeshStream *stream, const float *vertices, int vertex_count, const unsigned int *indices, int index_count, const MeshSink *sink)
+{
+    MeshStream start = {vertices, vertex_count, indices, index_count, sink, 0, 0};
+    *stream = start;
+    sink->begin(sink->context, vertex_count, index_count);
+}
+
+int continue_mesh_stream(MeshStream *stream, double deadline)
+{
+    const MeshSink *sink = stream->sink;
+    do
+    {
+        if (stream->vertices_written < stream->vertex_count)
+        {
+            int first = stream->vertices_written;
+            int count = stream->vertex_count - first < STAGING_BLOCK_VERTICES ? stream->vertex_count - first : STAGING_BLOCK_VERTICES;
+            sink->write_vertices(sink->context, &stream->vertices[(size_t)first * GPU_VERTEX_FLOATS], first, count);
+            stream->vertices_written += count;
+        }
+        else if (stream->indices_written < stream->index_count)
+        {
+            int first = stream->indices_written;
+            int count = stream->index_count - first < STAGING_BLOCK_INDICES ? stream->index_count - first : STAGING_BLOCK_INDICES;
+            sink->write_indices(sink->context, &stream->indices[first], first, count);
+            stream->indices_written += count;
+        }
+    } while ((stream->vertices_written < stream->vertex_count || stream->indices_written < stream->index_count) && getTimeSeconds() < deadline);
+
+    return stream->vertices_written == stream->vertex_count && stream->indices_written == stream->index_count;
+}
+
+static void begin_gpu_mesh_arrays(void *context, int vertex_count, int index_count)
+{
+    GpuMesh *mesh = (GpuMesh *)context;
+
+    mesh->vertex_count = vertex_count;
+    mesh->vertices = malloc(((size_t)vertex_count + 1) * GPU_VERTEX_FLOATS * sizeof(float));
+    mesh->index_count = index_count;
+    mesh->indices = malloc(((size_t)index_count + 1) * sizeof(unsigned int));
+
+    if (!mesh->vertices || !mesh->indices)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void write_gpu_mesh_vertices(void *context, const float *vertices, int first, int count)
+{
+    GpuMesh *mesh = (GpuMesh *)context;
+    memcpy(&mesh->vertices[(size_t)first * GPU_VERTEX_FLOATS], vertices, (size_t)count * GPU_VERTEX_FLOATS * sizeof(float));
+}
+
+static void write_gpu_mesh_indices(void *context, const unsigned int *indices, int first, int count)
+{
+    GpuMesh *mesh = (GpuMesh *)context;
+    memcpy(&mesh->indices[first], indices, (size_t)count * sizeof(unsigned int));
+}
+
+void build_gpu_mesh(const Vertex *vertices, int vertex_count, const Normal *normals, int normal_count, const Face *faces, int face_count, GpuMesh *mesh)
+{
+    MeshSink sink = {begin_gpu_mesh_arrays, write_gpu_mesh_vertices, write_gpu_mesh_indices, mesh};
+    stream_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, &sink);
+}
+
+int sort_faces_by_material(Face *faces, int face_count, MaterialRange **ranges)
+{
+    // Bucket 0 is for faces without a material, material m is bucket m + 1
+    int bucket_count = material_count + 1;
+    int *rank = malloc((size_t)bucket_count * sizeof(int));
+    int *first = calloc((size_t)bucket_count + 1, sizeof(int));
+    Face *sorted = malloc(((size_t)face_count + 1) * sizeof(Face));
+    *ranges = malloc((size_t)bucket_count * sizeof(MaterialRange));
+
+    if (!rank || !first || !sorted || !*ranges)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    int ranked = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int b = 0; b < bucket_count; b++)
+        {
+            int blended = b > 0 && materials[b - 1].d < 1.0f;
+            if (blended == pass)
+            {
+                rank[b] = ranked++;
+            }
+        }
+    }
+
+    for (int i = 0; i < face_count; i++)
+    {
+        first[rank[faces[i].materialId + 1] + 1]++;
+    }
+    for (int r = 0; r < bucket_count; r++)
+    {
+        first[r + 1] += first[r];
+    }
+
+    int range_count = 0;
+    for (int b = 0; b < bucket_count; b++)
+    {
+        int r = rank[b];
+        if (first[r + 1] > first[r])
+        {
+            MaterialRange range = {b - 1, first[r] * 3, (first[r + 1] - first[r]) * 3};
+            (*ranges)[range_count++] = range;
+        }
+    }
+
+    // Ranges in draw order, then the faces scattered into place
+    for (int i = 1; i < range_count; i++)
+    {
+        MaterialRange range = (*ranges)[i];
+        int j = i;
+        for (; j > 0 && (*ranges)[j - 1].first_index > range.first_index; j--)
+        {
+            (*ranges)[j] = (*ranges)[j - 1];
+        }
+        (*ranges)[j] = range;
+    }
+
+    for (int i = 0; i < face_count; i++)
+    {
+        sorted[first[rank[faces[i].materialId + 1]]++] = faces[i];
+    }
+    memcpy(faces, sorted, (size_t)face_count * sizeof(Face));
+
+    free(rank);
+    free(first);
+    free(sorted);
+    return range_count;
+}
+
+static void begin_both_sinks(void *context, int vertex_count, int index_count)
+{
+    const MeshSinkPair *pair = (const MeshSinkPair *)context;
+    pair->first->begin(pair->first->context, vertex_count, index_count);
+    pair->second->begin(pair->second->context, vertex_count, index_count);
+}
+
+static void write_both_sinks_vertices(void *context, const float *vertices, int first, int count)
+{
+    const MeshSinkPair *pair = (const MeshSinkPair *)context;
+    pair->first->write_vertices(pair->first->context, vertices, first, count);
+    pair->second->write_vertices(pair->second->context, vertices, first, count);
+}
+
+static void write_both_sinks_indices(void *context, const unsigned int *indices, int first, int count)
+{
+    const MeshSinkPair *pair = (const MeshSinkPair *)context;
+    pair->first->write_indices(pair->first->context, indices, first, count);
+    pair->second->write_indices(pair->second->context, indices, first, count);
+}
+
+MeshSink tee_mesh_sinks(MeshSinkPair *pair)
+{
+    MeshSink sink = {begin_both_sinks, write_both_sinks_vertices, write_both_sinks_indices, pair};
+    return sink;
+}
+
+int *weld_vertex_positions(const float *vertices, int vertex_count, int stride)
+{
+    unsigned int table_size = 16;
+    while (table_size < (unsigned int)vertex_count * 2)
+    {
+        table_size *= 2;
+    }
+
+    int *table = malloc((size_t)table_size * sizeof(int));
+    int *position_of = malloc(((size_t)vertex_count + 1) * sizeof(int));
+    if (!table || !position_of)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(table, -1, (size_t)table_size * sizeof(int));
+
+    for (int v = 0; v < vertex_count; v++)
+    {
+        const float *position = &vertices[(size_t)v * stride];
+        unsigned int slot = (unsigned int)hashBytes(position, 3 * sizeof(float), HASH_SEED) & (table_size - 1);
+
+        while (table[slot] >= 0 && memcmp(&vertices[(size_t)table[slot] * stride], position, 3 * sizeof(float)) != 0)
+        {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] < 0)
+        {
+            table[slot] = v;
+        }
+        position_of[v] = table[slot];
+    }
+
+    free(table);
+    return position_of;
+}
+
+void free_gpu_mesh(GpuMesh *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->indices);
+    mesh->vertices = NULL;
+    mesh->indices = NULL;
+    mesh->vertex_count = 0;
+    mesh->index_count = 0;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "loader.h"
+
+// Floats per interleaved vertex: position, material Kd color, normal
+#define GPU_VERTEX_FLOATS 9
+
+// Streaming builds hand data over in blocks of at most this many elements,
+// so their working memory doesn't grow with the mesh
+#define STAGING_BLOCK_VERTICES 8192
+#define STAGING_BLOCK_INDICES 32768
+
+// Vertex and index data in the exact layout the VAO reads
+typedef struct
+{
+    float *vertices;
+    int vertex_count;
+    unsigned int *indices;
+    int index_count;
+} GpuMesh;
+
+// A level of detail, a range of the index buffer drawing the whole mesh
+// with the same vertices and fewer triangles. error is the largest
+// distance the surface moved, in model units, 0 for the full mesh.
+typedef struct
+{
+    int first_index;
+    int index_count;
+    float error;
+} MeshLod;
+
+// The triangles of one material, a range of the index buffer drawn with
+// that material's uniform block bound. material is -1 for faces before any
+// usemtl.
+typedef struct
+{
+    int material;
+    int first_index;
+    int index_count;
+} MaterialRange;
+
+// Receives a mesh as it is built. begin gets the exact vertex and index
+// counts before any data, so storage is allocated once. Vertices and
+// indices then arrive in order, a staging block at a time, at first.
+typedef struct
+{
+    void (*begin)(void *context, int vertex_count, int index_count);
+    void (*write_vertices)(void *context, const float *vertices, int first, int count);
+    void (*write_indices)(void *context, const unsigned int *indices, int first, int count);
+    void *context;
+} MeshSink;
+
+typedef struct
+{
+    const MeshSink *first;
+    const MeshSink *second;
+} MeshSinkPair;
+
+// Welds face corners into unique (position, texcoord, normal, material)
+// vertices through a hash table and streams the vertex and index buffers
+// into sink through two reusable staging blocks
+void stream_gpu_mesh(const Vertex *vertices, int vertex_count, const Normal *normals, int normal_count, const Face *faces, int face_count, const MeshSink *sink);
+
+// Feeds finished buffers (a mapped cache, a built GpuMesh) to sink in the
+// same staging-block sized pieces, without copying them
+void stream_gpu_arrays(const float *vertices, int vertex_count, const unsigned int *indices, int index_count, const MeshSink *sink);
+
+// Progress of finished buffers going to a sink over several calls
+typedef struct
+{
+    const float *vertices;
+    int vertex_count;
+    const unsigned int *indices;
+    int index_count;
+    const MeshSink *sink;
+    int vertices_written;
+    int indices_written;
+} MeshStream;
+
+// stream_gpu_arrays spread over time: begin hands sink the counts, each
+// continue writes staging blocks, vertices first, until getTimeSeconds
+// passes deadline, at least one block per call. continue returns 1 once
+// everything has been written. The arrays and sink must outlive it.
+void begin_mesh_stream(MeshStream *stream, const float *vertices, int vertex_count, const unsigned int *indices, int index_count, const MeshSink *sink);
+int continue_mesh_stream(MeshStream *stream, double deadline);
+
+// Same as stream_gpu_mesh, collected into heap arrays
+void build_gpu_mesh(const Vertex *vertices, int vertex_count, const Normal *normals, int normal_count, const Face *faces, int face_count, GpuMesh *mesh);
+
+// Stable sort of faces by material, opaque materials before blended ones
+// (d < 1) so those draw last, then by ID. Fills the index ranges the faces
+// turn into once built, three indices per face in face order. Returns the
+// number of ranges; the caller frees them.
+int sort_faces_by_material(Face *faces, int face_count, MaterialRange **ranges);
+
+// Sink forwarding everything to both sinks of pair, which must outlive it
+MeshSink tee_mesh_sinks(MeshSinkPair *pair);
+
+// Maps every vertex to the first vertex with the same position, so meshes
+// split by normals or materials still have adjacency. Flat shaded meshes
+// share no vertex indices at all. The caller frees the array.
+int *weld_vertex_positions(const float *vertices, int vertex_count, int stride);
+
+void free_gpu_mesh(GpuMesh *mesh);
+
+#endif // MESH_H
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshCache.h"
+#include "utils.h"
+
+#define MESH_CACHE_MAGIC "MSHC"
+
+static size_t align_section(size_t offset)
+{
+    return (offset + 15) & ~(size_t)15;
+}
+
+static int hash_file(const char *filename, uint64_t *hash)
+{
+    size_t size = 0;
+    const char *data = mapFile(filename, &size);
+    if (!data)
+    {
+        return 0;
+    }
+    *hash = hashBytes(data, size, HASH_SEED);
+    unmapFile(data, size);
+    return 1;
+}
+
+static int stamp_source(const char *filename, SourceStamp *stamp)
+{
+    long long size, mtime;
+    if (!getFileInfo(filename, &size, &mtime) || !hash_file(filename, &stamp->hash))
+    {
+        return 0;
+    }
+    stamp->size = size;
+    stamp->mtime = mtime;
+    return 1;
+}
+
+static int source_matches(const char *filename, const SourceStamp *stamp)
+{
+    long long size, mtime;
+    if (!getFileInfo(filename, &size, &mtime) || size != stamp->size)
+    {
+        return 0;
+    }
+    if (mtime == stamp->mtime)
+    {
+        return 1;
+    }
+
+    uint64_t hash;
+    return hash_file(filename, &hash) && hash == stamp->hash;
+}
+
+void mesh_cache_path(const char *objFilename, char *path, size_t pathSize)
+{
+    snprintf(path, pathSize, "%s.meshcache", objFilename);
+}
+
+int mesh_cache_flags_satisfy(uint32_t cached, uint32_t wanted)
+{
+    // Meshlet order replaces the material order, neither serves the other
+    if ((cached & MESH_CACHE_MESHLETS) != (wanted & MESH_CACHE_MESHLETS))
+    {
+        return 0;
+    }
+    return (cached & wanted) == wanted;
+}
+
+int load_mesh_cache(const char *objFilename, const char *mtlFilename, uint32_t flags, MeshCache *cache)
+{
+    memset(cache, 0, sizeof(MeshCache));
+
+    char path[1024];
+    mesh_cache_path(objFilename, path, sizeof(path));
+
+    size_t size = 0;
+    const char *data = mapFile(path, &size);
+    if (!data)
+    {
+        return 0;
+    }
+
+    const MeshCacheHeader *header = (const MeshCacheHeader *)data;
+    int valid = size >= sizeof(MeshCacheHeader) &&
+                memcmp(header->magic, MESH_CACHE_MAGIC, 4) == 0 &&
+                header->version == MESH_CACHE_VERSION &&
+                header->vertex_floats == GPU_VERTEX_FLOATS &&
+                header->material_size == sizeof(Material) &&
+                header->vertex_offset + (uint64_t)header->vertex_count * GPU_VERTEX_FLOATS * sizeof(float) <= size &&
+                header->index_offset + (uint64_t)header->index_count * sizeof(unsigned int) <= size &&
+                header->material_offset + (uint64_t)header->material_count * sizeof(Material) <= size &&
+                header->lod_size == sizeof(MeshLod) &&
+                header->lod_offset + (uint64_t)header->lod_count * sizeof(MeshLod) <= size &&
+                header->material_range_size == sizeof(MaterialRange) &&
+                header->material_range_offset + (uint64_t)header->material_range_count * sizeof(MaterialRange) <= size;
+
+    if (!valid)
+    {
+        fprintf(stderr, "Ignoring unreadable or outdated mesh cache %s\n", path);
+        unmapFile(data, size);
+        return 0;
+    }
+
+    if (!mesh_cache_flags_satisfy(header->flags, flags))
+    {
+        unmapFile(data, size);
+        return 0;
+    }
+
+    if (!source_matches(objFilename, &header->obj) || !source_matches(mtlFilename, &header->mtl))
+    {
+        unmapFile(data, size);
+        return 0;
+    }
+
+    cache->data = data;
+    cache->size = size;
+    cache->vertices = (const float *)(data + header->vertex_offset);
+    cache->vertex_count = (int)header->vertex_count;
+    cache->indices = (const unsigned int *)(data + header->index_offset);
+    cache->index_count = (int)header->index_count;
+    cache->materials = (const Material *)(data + header->material_offset);
+    cache->material_count = (int)header->material_count;
+    cache->lods = (const MeshLod *)(data + header->lod_offset);
+    cache->lod_count = (int)header->lod_count;
+    cache->material_ranges = (const MaterialRange *)(data + header->material_range_offset);
+    cache->material_range_count = (int)header->material_range_count;
+
+    // Coarser levels nobody asked for stay out of sight behind the full one
+    if ((header->flags & MESH_CACHE_LODS) && !(flags & MESH_CACHE_LODS) && cache->lod_count > 0)
+    {
+        cache->index_count = cache->lods[0].index_count;
+        cache->lod_count = 0;
+    }
+    return 1;
+}
+
+void close_mesh_cache(MeshCache *cache)
+{
+    unmapFile(cache->data, cache->size);
+    memset(cache, 0, sizeof(MeshCache));
+}
+
+static void write_at(MeshCacheWriter *writer, uint64_t offset, const void *data, size_t size)
+{
+    if (writer->ok && (fseek(writer->file, (long)offset, SEEK_SET) != 0 || fwrite(data, 1, size, writer->file) != size))
+    {
+        writer->ok = 0;
+    }
+}
+
+int open_mesh_cache_writer(MeshCacheWriter *writer, const char *objFilename, const char *mtlFilename, uint32_t flags)
+{
+    memset(writer, 0, sizeof(MeshCacheWriter));
+    memcpy(writer->header.magic, MESH_CACHE_MAGIC, 4);
+    writer->header.version = MESH_CACHE_VERSION;
+    writer->header.flags = flags;
+
+    if (!stamp_source(objFilename, &writer->header.obj) || !stamp_source(mtlFilename, &writer->header.mtl))
+    {
+        return 0;
+    }
+
+    // Written under a temporary name and renamed into place, so a crash or a
+    // concurrent run never sees half a cache
+    mesh_cache_path(objFilename, writer->path, sizeof(writer->path));
+    snprintf(writer->temp_path, sizeof(writer->temp_path), "%s.tmp", writer->path);
+
+    writer->file = fopen(writer->temp_path, "wb");
+    if (!writer->file)
+    {
+        fprintf(stderr, "Failed to write mesh cache %s\n", writer->temp_path);
+        return 0;
+    }
+
+    writer->ok = 1;
+    return 1;
+}
+
+static void begin_mesh_cache(void *context, int vertex_count, int index_count)
+{
+    MeshCacheWriter *writer = (MeshCacheWriter *)context;
+    MeshCacheHeader *header = &writer->header;
+
+    // Sizes are known up front, so every section has its final place and
+    // blocks are written straight to it
+    header->vertex_floats = GPU_VERTEX_FLOATS;
+    header->vertex_count = (uint32_t)vertex_count;
+    header->index_count = (uint32_t)index_count;
+    header->material_size = sizeof(Material);
+    header->lod_size = sizeof(MeshLod);
+    header->material_range_size = sizeof(MaterialRange);
+    header->vertex_offset = align_section(sizeof(MeshCacheHeader));
+    header->index_offset = align_section(header->vertex_offset + (uint64_t)vertex_count * GPU_VERTEX_FLOATS * sizeof(float));
+    header->material_offset = align_section(header->index_offset + (uint64_t)index_count * sizeof(unsigned int));
+}
+
+static void write_mesh_cache_vertices(void *context, const float *vertices, int first, int count)
+{
+    MeshCacheWriter *writer = (MeshCacheWriter *)context;
+    write_at(writer, writer->header.vertex_offset + (uint64_t)first * GPU_VERTEX_FLOATS * sizeof(float), vertices, (size_t)count * GPU_VERTEX_FLOATS * sizeof(float));
+}
+
+static void write_mesh_cache_indices(void *context, const unsigned int *indices, int first, int count)
+{
+    MeshCacheWriter *writer = (MeshCacheWriter *)context;
+    write_at(writer, writer->header.index_offset + (uint64_t)first * sizeof(unsigned int), indices, (size_t)count * sizeof(unsigned int));
+}
+
+MeshSink mesh_cache_writer_sink(MeshCacheWriter *writer)
+{
+    MeshSink sink = {begin_mesh_cache, write_mesh_cache_vertices, write_mesh_cache_indices, writer};
+    return sink;
+}
+
+int finish_mesh_cache_writer(MeshCacheWriter *writer, const Material *materials, int material_count, const MeshLod *lods, int lod_count, const MaterialRange *ranges, int range_count)
+{
+    MeshCacheHeader *header = &writer->header;
+    header->material_count = (uint32_t)material_count;
+    header->lod_count = (uint32_t)lod_count;
+    header->material_range_count = (uint32_t)range_count;
+
+    // An empty table has no section, and no padding before it
+    uint64_t end = header->material_offset + (uint64_t)material_count * sizeof(Material);
+    header->lod_offset = lod_count > 0 ? align_section(end) : 0;
+    end = lod_count > 0 ? header->lod_offset + (uint64_t)lod_count * sizeof(MeshLod) : end;
+    header->material_range_offset = range_count > 0 ? align_section(end) : 0;
+
+    // The header goes last, a cache cut short never carries a valid one
+    write_at(writer, writer->header.material_offset, materials, (size_t)material_count * sizeof(Material));
+    write_at(writer, writer->header.lod_offset, lods, (size_t)lod_count * sizeof(MeshLod));
+    write_at(writer, writer->header.material_range_offset, ranges, (size_t)range_count * sizeof(MaterialRange));
+    write_at(writer, 0, &writer->header, sizeof(MeshCacheHeader));
+
+    if (fclose(writer->file) != 0 || !writer->ok || rename(writer->temp_path, writer->path) != 0)
+    {
+        fprintf(stderr, "Failed to write mesh cache %s\n", writer->path);
+        remove(writer->temp_path);
+        return 0;
+    }
+
+    return 1;
+}
+
+int write_mesh_cache(const char *objFilename, const char *mtlFilename, uint32_t flags, const GpuMesh *mesh, const Material *materials, int material_count, const MaterialRange *ranges, int range_count)
+{
+    MeshCacheWriter writer;
+    if (!open_mesh_cache_writer(&writer, objFilename, mtlFilename, flags))
+    {
+        return 0;
+    }
+
+    MeshSink sink = mesh_cache_writer_sink(&writer);
+    stream_gpu_arrays(mesh->vertices, mesh->vertex_count, mesh->indices, mesh->index_count, &sink);
+
+    return finish_mesh_cache_writer(&writer, materials, material_count, NULL, 0, ranges, range_count);
+}
\ No newline at end of file
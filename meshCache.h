@@ -0,0 +1,119 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "loader.h"
+#include "mesh.h"
+
+// Bump whenever the header, the vertex layout or Material changes so old
+// cache files are rebuilt instead of misread
+#define MESH_CACHE_VERSION 4
+
+// Header flags. A cache satisfies a load asking for a subset of its flags,
+// so every path shares one file: extra optimization, sorted material
+// ranges or LODs do no harm to a load that doesn't use them. Meshlet
+// order has to match either way.
+#define MESH_CACHE_OPTIMIZED 1 // Triangles and vertices reordered by meshOptimize
+#define MESH_CACHE_MESHLETS 2  // Triangles in order_meshlet_triangles order
+#define MESH_CACHE_LODS 4      // Coarser levels from meshLod after the full index range
+#define MESH_CACHE_MATERIAL_RANGES 8 // Faces sorted by sort_faces_by_material, ranges kept
+
+// Everything the cache was built from. Size and mtime are the cheap check;
+// if only the mtime moved (touch, fresh checkout) the content hash decides.
+typedef struct
+{
+    int64_t size;
+    int64_t mtime;
+    uint64_t hash;
+} SourceStamp;
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+
+    SourceStamp obj;
+    SourceStamp mtl;
+
+    uint32_t vertex_floats;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t material_count;
+    uint32_t material_size;
+    uint32_t flags;
+    uint32_t lod_count;
+    uint32_t lod_size;
+    uint32_t material_range_count;
+    uint32_t material_range_size;
+
+    // Byte offsets from the start of the file, each section 16 byte aligned
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t material_offset;
+    uint64_t lod_offset;
+    uint64_t material_range_offset;
+} MeshCacheHeader;
+
+// A cache being written while the mesh streams through it
+typedef struct
+{
+    FILE *file;
+    int ok;
+    MeshCacheHeader header;
+    char path[1024];
+    char temp_path[1040];
+} MeshCacheWriter;
+
+// A cache file mapped read-only. The pointers point into the mapping and
+// stay valid until close_mesh_cache.
+typedef struct
+{
+    const char *data;
+    size_t size;
+
+    const float *vertices;
+    int vertex_count;
+    const unsigned int *indices;
+    int index_count;
+    const Material *materials;
+    int material_count;
+    const MeshLod *lods; // Index ranges into indices, none without MESH_CACHE_LODS
+    int lod_count;
+    const MaterialRange *material_ranges; // Ranges of the full level, none without MESH_CACHE_MATERIAL_RANGES
+    int material_range_count;
+} MeshCache;
+
+// Cache file that sits next to the OBJ, "<obj>.meshcache"
+void mesh_cache_path(const char *objFilename, char *path, size_t pathSize);
+
+// 1 if a cache written with the cached flags can serve a load asking for
+// the wanted ones
+int mesh_cache_flags_satisfy(uint32_t cached, uint32_t wanted);
+
+// Maps the cache for this OBJ/MTL pair. Returns 0 when there is no cache,
+// when either source changed since it was written or when its flags don't
+// satisfy flags. Without MESH_CACHE_LODS in flags any coarser levels are
+// left out, index_count covering only the full mesh.
+int load_mesh_cache(const char *objFilename, const char *mtlFilename, uint32_t flags, MeshCache *cache);
+
+void close_mesh_cache(MeshCache *cache);
+
+// Starts a cache for the pair under a temporary name. Feed the mesh through
+// mesh_cache_writer_sink, then finish. Returns 0 if the file can't be
+// created, in which case the next run simply parses again.
+int open_mesh_cache_writer(MeshCacheWriter *writer, const char *objFilename, const char *mtlFilename, uint32_t flags);
+
+MeshSink mesh_cache_writer_sink(MeshCacheWriter *writer);
+
+// Appends the material, LOD and material range tables and renames the
+// cache into place. Returns 0 if anything along the way failed; the
+// partial file is removed.
+int finish_mesh_cache_writer(MeshCacheWriter *writer, const Material *materials, int material_count, const MeshLod *lods, int lod_count, const MaterialRange *ranges, int range_count);
+
+// Writes a fresh cache for an already built mesh in one go, ranges as
+// sort_faces_by_material made them (none without MESH_CACHE_MATERIAL_RANGES)
+int write_mesh_cache(const char *objFilename, const char *mtlFilename, uint32_t flags, const GpuMesh *mesh, const Material *materials, int material_count, const MaterialRange *ranges, int range_count);
+
+#endif // MESH_CACHE_H
\ No newline at end of file
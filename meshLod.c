@@ -0,0 +1,630 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshLod.h"
+#include "meshOptimize.h"
+#include "shading.h"
+#include "utils.h"
+
+// Symmetric 4x4 error matrix of a set of planes: xx xy xz xw yy yz yw zz zw
+// ww. weight is the face area behind it, dividing by it turns the summed
+// error into a mean squared distance.
+typedef struct
+{
+    double q[10];
+    double weight;
+} Quadric;
+
+typedef struct
+{
+    int from; // Welded position that moves
+    int to;
+    float cost;
+} Collapse;
+
+typedef struct
+{
+    uint64_t key; // Smaller welded position in the high half, UINT64_MAX when empty
+    int face;     // First face seen on the edge
+    int count;
+    int mixed;    // Faces of different materials meet on it
+} LodEdge;
+
+typedef struct
+{
+    const float *vertices;
+    int vertex_count;
+    int stride;
+
+    int *position_of; // Welded position of every vertex, see weld_vertex_positions
+    int *group_offsets; // Vertices of each welded position
+    int *group_vertices;
+    int *collapsed_to; // Position a welded position was moved onto, itself while it stays
+    Quadric *quadrics;
+
+    unsigned int *corners; // Surviving triangles, by the vertices they started with
+    int triangle_count;
+    float error; // Largest collapse so far
+} LodBuilder;
+
+static void *allocate_or_die(size_t size)
+{
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+static void add_plane(Quadric *quadric, double a, double b, double c, double d, double weight)
+{
+    double *q = quadric->q;
+    q[0] += a * a * weight;
+    q[1] += a * b * weight;
+    q[2] += a * c * weight;
+    q[3] += a * d * weight;
+    q[4] += b * b * weight;
+    q[5] += b * c * weight;
+    q[6] += b * d * weight;
+    q[7] += c * c * weight;
+    q[8] += c * d * weight;
+    q[9] += d * d * weight;
+}
+
+static double quadric_error(const Quadric *quadric, const float *position)
+{
+    const double *q = quadric->q;
+    double x = position[0], y = position[1], z = position[2];
+    double error = q[0] * x * x + q[4] * y * y + q[7] * z * z +
+                   2.0 * (q[1] * x * y + q[2] * x * z + q[5] * y * z + q[3] * x + q[6] * y + q[8] * z) +
+                   q[9];
+    return error > 0.0 ? error : 0.0;
+}
+
+static const float *position_at(const LodBuilder *builder, int vertex)
+{
+    return &builder->vertices[(size_t)vertex * builder->stride];
+}
+
+static int find_position(LodBuilder *builder, int position)
+{
+    int root = position;
+    while (builder->collapsed_to[root] != root)
+    {
+        root = builder->collapsed_to[root];
+    }
+
+    // Point the whole chain at the result so later lookups are one step
+    while (builder->collapsed_to[position] != root)
+    {
+        int next = builder->collapsed_to[position];
+        builder->collapsed_to[position] = root;
+        position = next;
+    }
+    return root;
+}
+
+// Unit normal of the triangle, returns twice its area, 0 when degenerate
+static double triangle_normal(const float *a, const float *b, const float *c, double normal[3])
+{
+    double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+
+    double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length == 0.0)
+    {
+        return 0.0;
+    }
+    normal[0] /= length;
+    normal[1] /= length;
+    normal[2] /= length;
+    return length;
+}
+
+static uint64_t edge_key(int a, int b)
+{
+    return a < b ? ((uint64_t)a << 32) | (uint32_t)b : ((uint64_t)b << 32) | (uint32_t)a;
+}
+
+static LodEdge *find_edge(LodEdge *table, unsigned int mask, uint64_t key)
+{
+    unsigned int slot = (unsigned int)hashBytes(&key, sizeof(key), HASH_SEED) & mask;
+    while (table[slot].key != UINT64_MAX && table[slot].key != key)
+    {
+        slot = (slot + 1) & mask;
+    }
+    return &table[slot];
+}
+
+static int same_material(const LodBuilder *builder, int a, int b)
+{
+    return memcmp(&position_at(builder, a)[3], &position_at(builder, b)[3], 3 * sizeof(float)) == 0;
+}
+
+static void init_quadrics(LodBuilder *builder)
+{
+    int triangle_count = builder->triangle_count;
+    builder->quadrics = calloc((size_t)builder->vertex_count + 1, sizeof(Quadric));
+    if (!builder->quadrics)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    // Count the faces on every welded edge, and whether their materials
+    // differ, to find open borders and material boundaries
+    unsigned int table_size = 16;
+    while (table_size < (unsigned int)triangle_count * 6)
+    {
+        table_size *= 2;
+    }
+    LodEdge *edges = allocate_or_die((size_t)table_size * sizeof(LodEdge));
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        edges[i].key = UINT64_MAX;
+    }
+
+    for (int t = 0; t < triangle_count; t++)
+    {
+        const unsigned int *corners = &builder->corners[(size_t)t * 3];
+        const float *a = position_at(builder, corners[0]);
+        double normal[3];
+        double area = 0.5 * triangle_normal(a, position_at(builder, corners[1]), position_at(builder, corners[2]), normal);
+
+        // Every corner gets the plane of the face, weighted by its area
+        if (area > 0.0)
+        {
+            double d = -(normal[0] * a[0] + normal[1] * a[1] + normal[2] * a[2]);
+            for (int i = 0; i < 3; i++)
+            {
+                Quadric *quadric = &builder->quadrics[builder->position_of[corners[i]]];
+                add_plane(quadric, normal[0], normal[1], normal[2], d, area);
+                quadric->weight += area;
+            }
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            uint64_t key = edge_key(builder->position_of[corners[i]], builder->position_of[corners[(i + 1) % 3]]);
+            LodEdge *edge = find_edge(edges, table_size - 1, key);
+            if (edge->key == UINT64_MAX)
+            {
+                *edge = (LodEdge){key, t, 0, 0};
+            }
+            else if (!same_material(builder, builder->corners[(size_t)edge->face * 3], corners[0]))
+            {
+                edge->mixed = 1;
+            }
+            edge->count++;
+        }
+    }
+
+    // Borders and boundaries also get a plane through the edge, upright on
+    // the face, so collapses across them cost more than collapses along them
+    for (int t = 0; t < triangle_count; t++)
+    {
+        const unsigned int *corners = &builder->corners[(size_t)t * 3];
+        double normal[3];
+        if (triangle_normal(position_at(builder, corners[0]), position_at(builder, corners[1]), position_at(builder, corners[2]), normal) == 0.0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            int a = builder->position_of[corners[i]];
+            int b = builder->position_of[corners[(i + 1) % 3]];
+            LodEdge *edge = find_edge(edges, table_size - 1, edge_key(a, b));
+            if (edge->count != 1 && !edge->mixed)
+            {
+                continue;
+            }
+
+            const float *pa = position_at(builder, a);
+            const float *pb = position_at(builder, b);
+            double direction[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+            double length_squared = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+            double plane[3] = {
+                direction[1] * normal[2] - direction[2] * normal[1],
+                direction[2] * normal[0] - direction[0] * normal[2],
+                direction[0] * normal[1] - direction[1] * normal[0]};
+            double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length == 0.0)
+            {
+                continue;
+            }
+
+            plane[0] /= length;
+            plane[1] /= length;
+            plane[2] /= length;
+            double d = -(plane[0] * pa[0] + plane[1] * pa[1] + plane[2] * pa[2]);
+            add_plane(&builder->quadrics[a], plane[0], plane[1], plane[2], d, length_squared * LOD_BOUNDARY_WEIGHT);
+            add_plane(&builder->quadrics[b], plane[0], plane[1], plane[2], d, length_squared * LOD_BOUNDARY_WEIGHT);
+        }
+    }
+
+    free(edges);
+}
+
+static float collapse_cost(const LodBuilder *builder, int from, int to)
+{
+    const Quadric *a = &builder->quadrics[from];
+    const Quadric *b = &builder->quadrics[to];
+    const float *position = position_at(builder, to);
+
+    double weight = a->weight + b->weight;
+    double error = quadric_error(a, position) + quadric_error(b, position);
+    return (float)sqrt(weight > 0.0 ? error / weight : error);
+}
+
+static float normal_cosine(const float *a, const float *b)
+{
+    float lengths = sqrtf((a[0] * a[0] + a[1] * a[1] + a[2] * a[2]) * (b[0] * b[0] + b[1] * b[1] + b[2] * b[2]));
+    return lengths > 0.0f ? (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / lengths : 1.0f;
+}
+
+// Vertex at position that stands in best for vertex once its own position
+// is gone: the same material and the closest normal
+static int matching_vertex(const LodBuilder *builder, int vertex, int position, float *cosine)
+{
+    const float *normal = &position_at(builder, vertex)[6];
+    int best = -1;
+    float best_cosine = -2.0f;
+
+    for (int i = builder->group_offsets[position]; i < builder->group_offsets[position + 1]; i++)
+    {
+        int candidate = builder->group_vertices[i];
+        float candidate_cosine = normal_cosine(normal, &position_at(builder, candidate)[6]);
+        if (same_material(builder, vertex, candidate) && candidate_cosine > best_cosine)
+        {
+            best = candidate;
+            best_cosine = candidate_cosine;
+        }
+    }
+
+    *cosine = best_cosine;
+    return best;
+}
+
+static int keeps_seams(const LodBuilder *builder, int from, int to)
+{
+    for (int i = builder->group_offsets[from]; i < builder->group_offsets[from + 1]; i++)
+    {
+        float cosine;
+        if (matching_vertex(builder, builder->group_vertices[i], to, &cosine) < 0 || cosine < LOD_SEAM_COSINE)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int compare_collapses(const void *a, const void *b)
+{
+    float costA = ((const Collapse *)a)->cost;
+    float costB = ((const Collapse *)b)->cost;
+    return (costA > costB) - (costA < costB);
+}
+
+// Whether moving from onto to keeps every remaining face around from facing
+// the way it did
+static int keeps_orientation(LodBuilder *builder, const int *offsets, const int *adjacency, int from, int to)
+{
+    for (int i = offsets[from]; i < offsets[from + 1]; i++)
+    {
+        const unsigned int *corners = &builder->corners[(size_t)adjacency[i] * 3];
+        int positions[3];
+        int moved[3];
+        int touches = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            positions[c] = find_position(builder, builder->position_of[corners[c]]);
+            touches |= positions[c] == to;
+            moved[c] = positions[c] == from ? to : positions[c];
+        }
+        if (touches)
+        {
+            continue; // Collapses to nothing
+        }
+
+        double before[3], after[3];
+        double area = triangle_normal(position_at(builder, positions[0]), position_at(builder, positions[1]), position_at(builder, positions[2]), before);
+        if (area > 0.0 && (triangle_normal(position_at(builder, moved[0]), position_at(builder, moved[1]), position_at(builder, moved[2]), after) == 0.0 ||
+                      before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Drops the triangles whose positions merged
+static void remove_degenerate_triangles(LodBuilder *builder)
+{
+    int kept = 0;
+    for (int t = 0; t < builder->triangle_count; t++)
+    {
+        const unsigned int *corners = &builder->corners[(size_t)t * 3];
+        int a = find_position(builder, builder->position_of[corners[0]]);
+        int b = find_position(builder, builder->position_of[corners[1]]);
+        int c = find_position(builder, builder->position_of[corners[2]]);
+        if (a != b && b != c && a != c)
+        {
+            memmove(&builder->corners[(size_t)kept * 3], corners, 3 * sizeof(unsigned int));
+            kept++;
+        }
+    }
+    builder->triangle_count = kept;
+}
+
+// One round of collapses, cheapest first, none sharing a position, until
+// about target triangles are left. Returns the number of collapses.
+static int collapse_edges(LodBuilder *builder, int target)
+{
+    int vertex_count = builder->vertex_count;
+    int triangle_count = builder->triangle_count;
+
+    int *offsets = calloc((size_t)vertex_count + 1, sizeof(int));
+    int *adjacency = allocate_or_die((size_t)triangle_count * 3 * sizeof(int));
+    int *fill = allocate_or_die((size_t)vertex_count * sizeof(int));
+    Collapse *collapses = allocate_or_die((size_t)triangle_count * 6 * sizeof(Collapse));
+    char *locked = calloc((size_t)vertex_count + 1, 1);
+    if (!offsets || !locked)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    int collapse_count = 0;
+    for (int t = 0; t < triangle_count; t++)
+    {
+        int positions[3];
+        for (int c = 0; c < 3; c++)
+        {
+            positions[c] = find_position(builder, builder->position_of[builder->corners[(size_t)t * 3 + c]]);
+            offsets[positions[c] + 1]++;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            int a = positions[c];
+            int b = positions[(c + 1) % 3];
+            collapses[collapse_count++] = (Collapse){a, b, collapse_cost(builder, a, b)};
+            collapses[collapse_count++] = (Collapse){b, a, collapse_cost(builder, b, a)};
+        }
+    }
+
+    for (int v = 0; v < vertex_count; v++)
+    {
+        offsets[v + 1] += offsets[v];
+        fill[v] = offsets[v];
+    }
+    for (int t = 0; t < triangle_count; t++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            int position = find_position(builder, builder->position_of[builder->corners[(size_t)t * 3 + c]]);
+            adjacency[fill[position]++] = t;
+        }
+    }
+
+    qsort(collapses, (size_t)collapse_count, sizeof(Collapse), compare_collapses);
+
+    // A collapse removes about two triangles
+    int budget = (triangle_count - target) / 2 + 1;
+    int applied = 0;
+    for (int i = 0; i < collapse_count && applied < budget; i++)
+    {
+        const Collapse *collapse = &collapses[i];
+        if (locked[collapse->from] || locked[collapse->to] ||
+            !keeps_seams(builder, collapse->from, collapse->to) ||
+            !keeps_orientation(builder, offsets, adjacency, collapse->from, collapse->to))
+        {
+            continue;
+        }
+
+        Quadric *from = &builder->quadrics[collapse->from];
+        Quadric *to = &builder->quadrics[collapse->to];
+        for (int q = 0; q < 10; q++)
+        {
+            to->q[q] += from->q[q];
+        }
+        to->weight += from->weight;
+
+        builder->collapsed_to[collapse->from] = collapse->to;
+        builder->error = collapse->cost > builder->error ? collapse->cost : builder->error;
+        locked[collapse->from] = 1;
+        locked[collapse->to] = 1;
+        applied++;
+    }
+
+    free(offsets);
+    free(adjacency);
+    free(fill);
+    free(collapses);
+    free(locked);
+
+    remove_degenerate_triangles(builder);
+    return applied;
+}
+
+// Appends the surviving triangles, every corner whose position moved
+// swapped for the best matching vertex at the new one
+static void emit_level(LodBuilder *builder, unsigned int **indices, int *index_count, int *capacity)
+{
+    int needed = *index_count + builder->triangle_count * 3;
+    if (needed > *capacity)
+    {
+        *capacity = needed * 2;
+        *indices = realloc(*indices, (size_t)*capacity * sizeof(unsigned int));
+        if (!*indices)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < builder->triangle_count * 3; i++)
+    {
+        int vertex = (int)builder->corners[i];
+        int position = find_position(builder, builder->position_of[vertex]);
+        if (position != builder->position_of[vertex])
+        {
+            float cosine;
+            int match = matching_vertex(builder, vertex, position, &cosine);
+            vertex = match >= 0 ? match : builder->group_vertices[builder->group_offsets[position]];
+        }
+        (*indices)[(*index_count)++] = (unsigned int)vertex;
+    }
+}
+
+int build_gpu_mesh_lods(GpuMesh *mesh, int optimize, MeshLod lods[MAX_MESH_LODS], double *milliseconds)
+{
+    double start = getTimeSeconds();
+    int vertex_count = mesh->vertex_count;
+
+    lods[0] = (MeshLod){0, mesh->index_count, 0.0f};
+    int lod_count = 1;
+
+    LodBuilder builder = {0};
+    builder.vertices = mesh->vertices;
+    builder.vertex_count = vertex_count;
+    builder.stride = GPU_VERTEX_FLOATS;
+    builder.position_of = weld_vertex_positions(mesh->vertices, vertex_count, GPU_VERTEX_FLOATS);
+    builder.group_offsets = calloc((size_t)vertex_count + 1, sizeof(int));
+    builder.group_vertices = allocate_or_die((size_t)vertex_count * sizeof(int));
+    builder.collapsed_to = allocate_or_die((size_t)vertex_count * sizeof(int));
+    builder.triangle_count = mesh->index_count / 3;
+    builder.corners = allocate_or_die((size_t)builder.triangle_count * 3 * sizeof(unsigned int));
+    int *fill = allocate_or_die((size_t)vertex_count * sizeof(int));
+    if (!builder.group_offsets)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(builder.corners, mesh->indices, (size_t)builder.triangle_count * 3 * sizeof(unsigned int));
+    for (int v = 0; v < vertex_count; v++)
+    {
+        builder.collapsed_to[v] = v;
+        builder.group_offsets[builder.position_of[v] + 1]++;
+    }
+    for (int v = 0; v < vertex_count; v++)
+    {
+        builder.group_offsets[v + 1] += builder.group_offsets[v];
+        fill[v] = builder.group_offsets[v];
+    }
+    for (int v = 0; v < vertex_count; v++)
+    {
+        builder.group_vertices[fill[builder.position_of[v]]++] = v;
+    }
+    free(fill);
+
+    init_quadrics(&builder);
+
+    // One simplification runs through all levels, each one is saved as the
+    // triangle count passes its target, so errors keep accumulating in the
+    // quadrics instead of starting over from a previous level
+    unsigned int *indices = NULL;
+    int index_count = 0, capacity = 0;
+    int emitted = builder.triangle_count;
+    while (lod_count < MAX_MESH_LODS)
+    {
+        int target = (int)(emitted * LOD_TRIANGLE_RATIO);
+        if (target < LOD_MIN_TRIANGLES)
+        {
+            break;
+        }
+
+        int stalled = 0;
+        while (builder.triangle_count > target && !stalled)
+        {
+            stalled = collapse_edges(&builder, target) == 0;
+        }
+
+        // A level that barely shrank before getting stuck isn't worth a range
+        if (builder.triangle_count > emitted * (1.0f + LOD_TRIANGLE_RATIO) / 2.0f || builder.triangle_count == 0)
+        {
+            break;
+        }
+
+        lods[lod_count] = (MeshLod){mesh->index_count + index_count, builder.triangle_count * 3, builder.error};
+        emit_level(&builder, &indices, &index_count, &capacity);
+        emitted = builder.triangle_count;
+        lod_count++;
+
+        if (stalled)
+        {
+            break;
+        }
+    }
+
+    if (index_count > 0)
+    {
+        mesh->indices = realloc(mesh->indices, ((size_t)mesh->index_count + index_count) * sizeof(unsigned int));
+        if (!mesh->indices)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&mesh->indices[mesh->index_count], indices, (size_t)index_count * sizeof(unsigned int));
+        mesh->index_count += index_count;
+    }
+
+    if (optimize)
+    {
+        for (int i = 1; i < lod_count; i++)
+        {
+            optimize_vertex_cache(&mesh->indices[lods[i].first_index], lods[i].index_count, mesh->vertices, vertex_count, GPU_VERTEX_FLOATS);
+        }
+    }
+
+    free(indices);
+    free(builder.position_of);
+    free(builder.group_offsets);
+    free(builder.group_vertices);
+    free(builder.collapsed_to);
+    free(builder.quadrics);
+    free(builder.corners);
+
+    *milliseconds = (getTimeSeconds() - start) * 1000.0;
+    return lod_count;
+}
+
+void print_mesh_lods(const MeshLod *lods, int lod_count, double milliseconds)
+{
+    int full = lods[0].index_count > 0 ? lods[0].index_count : 1;
+    for (int i = 0; i < lod_count; i++)
+    {
+        printf("LOD %d: %d triangles (%.1f%%), error %.3g\n", i, lods[i].index_count / 3, 100.0 * lods[i].index_count / full, lods[i].error);
+    }
+    if (milliseconds >= 0.0)
+    {
+        printf("Generated %d LODs in %.1f ms\n", lod_count - 1, milliseconds);
+    }
+}
+
+float shader_pixels_per_unit(int height)
+{
+    // Half the height covers tan(fov / 2) units per unit of distance
+    return height * 0.5f / (SHADER_CAMERA_DISTANCE * tanf(SHADER_FIELD_OF_VIEW * 0.5f));
+}
+
+int select_mesh_lod(const MeshLod *lods, int lod_count, float pixels_per_unit, float max_pixel_error)
+{
+    int level = 0;
+    for (int i = 1; i < lod_count; i++)
+    {
+        if (lods[i].error * pixels_per_unit <= max_pixel_error)
+        {
+            level = i;
+        }
+    }
+    return level;
+}
\ No newline at end of file
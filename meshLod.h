@@ -0,0 +1,43 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include "mesh.h"
+
+// Levels per mesh, the full mesh included
+#define MAX_MESH_LODS 6
+
+// Each level aims for this fraction of the triangles of the one before
+#define LOD_TRIANGLE_RATIO 0.5f
+
+// No level is made with fewer triangles than this
+#define LOD_MIN_TRIANGLES 32
+
+// A vertex only moves onto one that has, for each of its own normals, a
+// normal at least this close (about 45 degrees) with the same material, so
+// hard edges and material boundaries stay where they are
+#define LOD_SEAM_COSINE 0.7f
+
+// Weight of the planes holding open borders and material boundaries in
+// place, against the planes of the faces
+#define LOD_BOUNDARY_WEIGHT 10.0f
+
+// Simplifies the mesh with quadric error edge collapses into up to
+// MAX_MESH_LODS levels. Vertices never move or change, a collapse moves one
+// welded position onto a neighbour and the faces keep the closest matching
+// vertex there, so coarser levels are only extra index ranges appended to
+// mesh->indices. lods[0] is the original range. With optimize each new
+// range is reordered for the vertex cache. Returns the level count and the
+// time taken in milliseconds.
+int build_gpu_mesh_lods(GpuMesh *mesh, int optimize, MeshLod lods[MAX_MESH_LODS], double *milliseconds);
+
+void print_mesh_lods(const MeshLod *lods, int lod_count, double milliseconds);
+
+// Pixels per model unit on a framebuffer height pixels tall as
+// vertexShader.glsl draws it, at the model's center distance from the
+// camera in shading.h
+float shader_pixels_per_unit(int height);
+
+// Coarsest level whose error covers at most max_pixel_error pixels
+int select_mesh_lod(const MeshLod *lods, int lod_count, float pixels_per_unit, float max_pixel_error);
+
+#endif // MESH_LOD_H
\ No newline at end of file
@@ -0,0 +1,668 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshNormals.h"
+#include "profiler.h"
+#include "threads.h"
+#include "vecMath.h"
+
+// Everything the passes share. Corners are numbered face * 3 + corner.
+typedef struct
+{
+    const Vertex *vertices;
+    int vertex_count;
+    const TexCoord *texCoords;
+    int texCoord_count;
+    Face *faces;
+    int face_count;
+    float crease_cosine;
+    int with_tangents;
+
+    // Per face, unit normal and unit directions of increasing u and v,
+    // zero for degenerate faces and faces without texture coordinates
+    VecFloat4 *face_normals;
+    VecFloat4 *face_tangents;
+    VecFloat4 *face_bitangents;
+    // Per corner, the angle between the face's two edges there
+    float *corner_angles;
+
+    // Corners around every position, in corner order so sums come out the
+    // same on any thread count: position_corners[corner_start[v]] up to
+    // position_corners[corner_start[v + 1]]
+    int *corner_start;
+    int *position_corners;
+
+    // Per position, its distinct sums at its own corner_start slots, and
+    // per corner which of them it took. normal_start[v + 1] first counts
+    // the sums, then becomes a prefix sum giving every position its first
+    // output normal.
+    VecFloat4 *normal_sums;
+    VecFloat4 *tangent_sums;
+    VecFloat4 *bitangent_sums;
+    int *corner_normal;
+    int *normal_start;
+
+    Normal *normals;
+    Tangent *tangents;
+} NormalBuild;
+
+// Corners around one position a smoothing task keeps at hand before it
+// has to grow its buffers. Up to this many are compared pairwise, more
+// are grouped by face normal first.
+#define MESH_NORMALS_LOCAL_CORNERS 32
+
+// Distinct face normals around one position compared pairwise at most.
+// Past it they are binned on an octahedral grid of this many cells a side,
+// which caps the crease tests at bins^4 per position and holds the crease
+// to within a cell there, a few degrees.
+#define MESH_NORMALS_MAX_GROUPS 4096
+#define MESH_NORMALS_NORMAL_BINS 64
+
+// One corner around a position: its face's normal, and the face's normal,
+// tangent and bitangent weighted by the corner's angle
+typedef struct
+{
+    VecFloat4 face_normal;
+    VecFloat4 normal;
+    VecFloat4 tangent;
+    VecFloat4 bitangent;
+} CornerTerms;
+
+// Corners around a busy position facing one way. They smooth alike, so
+// the crease test runs once per group rather than once per corner.
+typedef struct
+{
+    VecFloat4 face_normal; // Or its bin's center
+    VecFloat4 normal;      // Its corners' terms summed in corner order
+    VecFloat4 tangent;
+    VecFloat4 bitangent;
+    int output; // Which of the position's distinct sums it took
+} NormalGroup;
+
+typedef struct
+{
+    VecFloat4 key; // The face normal or its bin's center
+    int corner;    // Index into the position's terms
+} GroupedCorner;
+
+// A smoothing task's buffers, grown to the busiest position it has seen
+typedef struct
+{
+    int capacity;
+    CornerTerms *terms;
+    GroupedCorner *sorted;
+    NormalGroup *groups;
+    int *corner_group;
+} SmoothScratch;
+
+static void *allocate_or_die(size_t size)
+{
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+static int chunk_count(int count, int chunk)
+{
+    return (count + chunk - 1) / chunk;
+}
+
+static Vec3 position_of(const NormalBuild *build, int index)
+{
+    const Vertex *vertex = &build->vertices[index - 1];
+    return vec3(vertex->x, vertex->y, vertex->z);
+}
+
+// Angle between two edges leaving a corner, 0 if either has no length
+static float corner_angle(Vec3 a, Vec3 b)
+{
+    float lengths = vec3_dot(a, a) * vec3_dot(b, b);
+    if (lengths <= 0.0f)
+    {
+        return 0.0f;
+    }
+    float cosine = vec3_dot(a, b) / sqrtf(lengths);
+    return acosf(cosine < -1.0f ? -1.0f : cosine > 1.0f ? 1.0f : cosine);
+}
+
+static int valid_face(const NormalBuild *build, const Face *face)
+{
+    for (int j = 0; j < 3; j++)
+    {
+        if (face->vertexIndex[j] < 1 || face->vertexIndex[j] > build->vertex_count)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void face_attributes_task(void *context, int chunk)
+{
+    NormalBuild *build = (NormalBuild *)context;
+    int first = chunk * MESH_NORMALS_FACE_CHUNK;
+    int last = first + MESH_NORMALS_FACE_CHUNK < build->face_count ? first + MESH_NORMALS_FACE_CHUNK : build->face_count;
+    Vec3 zero = vec3(0.0f, 0.0f, 0.0f);
+
+    for (int f = first; f < last; f++)
+    {
+        const Face *face = &build->faces[f];
+        build->face_normals[f] = zero;
+        build->corner_angles[f * 3] = build->corner_angles[f * 3 + 1] = build->corner_angles[f * 3 + 2] = 0.0f;
+        if (build->with_tangents)
+        {
+            build->face_tangents[f] = zero;
+            build->face_bitangents[f] = zero;
+        }
+
+        if (!valid_face(build, face))
+        {
+            continue;
+        }
+
+        Vec3 p0 = position_of(build, face->vertexIndex[0]);
+        Vec3 edge1 = position_of(build, face->vertexIndex[1]) - p0;
+        Vec3 edge2 = position_of(build, face->vertexIndex[2]) - p0;
+        Vec3 edge12 = edge2 - edge1;
+
+        Vec3 normal = vec3_normalize(vec3_cross(edge1, edge2));
+        if (vec3_dot(normal, normal) == 0.0f)
+        {
+            // No area, no direction to add anywhere
+            continue;
+        }
+        build->face_normals[f] = normal;
+        build->corner_angles[f * 3] = corner_angle(edge1, edge2);
+        build->corner_angles[f * 3 + 1] = corner_angle(-edge1, edge12);
+        build->corner_angles[f * 3 + 2] = corner_angle(-edge2, -edge12);
+
+        if (!build->with_tangents)
+        {
+            continue;
+        }
+
+        int uv[3];
+        int has_uv = 1;
+        for (int j = 0; j < 3; j++)
+        {
+            uv[j] = face->texCoordIndex[j];
+            has_uv = has_uv && uv[j] >= 1 && uv[j] <= build->texCoord_count;
+        }
+        if (!has_uv)
+        {
+            continue;
+        }
+
+        const TexCoord *t0 = &build->texCoords[uv[0] - 1];
+        float du1 = build->texCoords[uv[1] - 1].u - t0->u, dv1 = build->texCoords[uv[1] - 1].v - t0->v;
+        float du2 = build->texCoords[uv[2] - 1].u - t0->u, dv2 = build->texCoords[uv[2] - 1].v - t0->v;
+        float determinant = du1 * dv2 - du2 * dv1;
+        if (fabsf(determinant) > 1e-12f)
+        {
+            // Only the directions matter, every face weighs in by its angles
+            build->face_tangents[f] = vec3_normalize((edge1 * dv2 - edge2 * dv1) / determinant);
+            build->face_bitangents[f] = vec3_normalize((edge2 * du1 - edge1 * du2) / determinant);
+        }
+    }
+}
+
+static int same_vector(VecFloat4 a, VecFloat4 b)
+{
+    return memcmp(&a, &b, sizeof(VecFloat4)) == 0;
+}
+
+// Position v's sum at index u equals sum (with tangents), by bits
+static int same_sums(const NormalBuild *build, int begin, int u, VecFloat4 normal, VecFloat4 tangent, VecFloat4 bitangent)
+{
+    return same_vector(build->normal_sums[begin + u], normal) && (!build->with_tangents || (same_vector(build->tangent_sums[begin + u], tangent) && same_vector(build->bitangent_sums[begin + u], bitangent)));
+}
+
+// Index of the sum among the position's unique ones, added if it is new
+static int find_or_add_sums(NormalBuild *build, int begin, int *unique, VecFloat4 normal, VecFloat4 tangent, VecFloat4 bitangent)
+{
+    int u = 0;
+    while (u < *unique && !same_sums(build, begin, u, normal, tangent, bitangent))
+    {
+        u++;
+    }
+    if (u == *unique)
+    {
+        build->normal_sums[begin + u] = normal;
+        if (build->with_tangents)
+        {
+            build->tangent_sums[begin + u] = tangent;
+            build->bitangent_sums[begin + u] = bitangent;
+        }
+        (*unique)++;
+    }
+    return u;
+}
+
+// Center of the octahedral cell a unit normal falls in, zero stays zero
+static VecFloat4 normal_bin(VecFloat4 normal)
+{
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (length == 0.0f)
+    {
+        return normal;
+    }
+    float x = normal[0] / length, y = normal[1] / length;
+    if (normal[2] < 0.0f)
+    {
+        float folded_x = (1.0f - fabsf(y)) * (x < 0.0f ? -1.0f : 1.0f);
+        y = (1.0f - fabsf(x)) * (y < 0.0f ? -1.0f : 1.0f);
+        x = folded_x;
+    }
+
+    float center[2];
+    float coordinates[2] = {x, y};
+    for (int i = 0; i < 2; i++)
+    {
+        int cell = (int)((coordinates[i] * 0.5f + 0.5f) * MESH_NORMALS_NORMAL_BINS);
+        cell = cell < MESH_NORMALS_NORMAL_BINS - 1 ? cell : MESH_NORMALS_NORMAL_BINS - 1;
+        center[i] = ((float)cell + 0.5f) / MESH_NORMALS_NORMAL_BINS * 2.0f - 1.0f;
+    }
+
+    float z = 1.0f - fabsf(center[0]) - fabsf(center[1]);
+    if (z < 0.0f)
+    {
+        float unfolded_x = (1.0f - fabsf(center[1])) * (center[0] < 0.0f ? -1.0f : 1.0f);
+        center[1] = (1.0f - fabsf(center[0])) * (center[1] < 0.0f ? -1.0f : 1.0f);
+        center[0] = unfolded_x;
+    }
+    return vec3_normalize(vec3(center[0], center[1], z));
+}
+
+static int compare_grouped_corners(const void *a, const void *b)
+{
+    const GroupedCorner *x = (const GroupedCorner *)a, *y = (const GroupedCorner *)b;
+    int order = memcmp(&x->key, &y->key, sizeof(VecFloat4));
+    return order != 0 ? order : x->corner - y->corner;
+}
+
+// Sorts the corners by key and sums each run of equal keys into a group,
+// in corner order within it. Returns the group count.
+static int group_corners(const NormalBuild *build, SmoothScratch *scratch, int count, int binned)
+{
+    for (int i = 0; i < count; i++)
+    {
+        scratch->sorted[i].key = binned ? normal_bin(scratch->terms[i].face_normal) : scratch->terms[i].face_normal;
+        scratch->sorted[i].corner = i;
+    }
+    qsort(scratch->sorted, (size_t)count, sizeof(GroupedCorner), compare_grouped_corners);
+
+    int group_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const GroupedCorner *sorted = &scratch->sorted[i];
+        const CornerTerms *terms = &scratch->terms[sorted->corner];
+        if (i == 0 || !same_vector(sorted->key, scratch->sorted[i - 1].key))
+        {
+            NormalGroup *group = &scratch->groups[group_count++];
+            group->face_normal = sorted->key;
+            group->normal = group->tangent = group->bitangent = vec3(0.0f, 0.0f, 0.0f);
+        }
+
+        NormalGroup *group = &scratch->groups[group_count - 1];
+        group->normal += terms->normal;
+        if (build->with_tangents)
+        {
+            group->tangent += terms->tangent;
+            group->bitangent += terms->bitangent;
+        }
+        scratch->corner_group[sorted->corner] = group_count - 1;
+    }
+    return group_count;
+}
+
+// smooth_positions_task for a position with more corners than are worth
+// comparing pairwise. Same sums up to rounding, the groups add up in a
+// different order than the corners would.
+static int smooth_grouped_position(NormalBuild *build, SmoothScratch *scratch, int begin, int count)
+{
+    int group_count = group_corners(build, scratch, count, 0);
+    if (group_count > MESH_NORMALS_MAX_GROUPS)
+    {
+        group_count = group_corners(build, scratch, count, 1);
+    }
+
+    int unique = 0;
+    for (int g = 0; g < group_count; g++)
+    {
+        Vec3 own = scratch->groups[g].face_normal;
+        int take_all = vec3_dot(own, own) == 0.0f;
+
+        Vec3 normal = vec3(0.0f, 0.0f, 0.0f);
+        Vec3 tangent = normal;
+        Vec3 bitangent = normal;
+        for (int h = 0; h < group_count; h++)
+        {
+            const NormalGroup *other = &scratch->groups[h];
+            if (take_all || vec3_dot(own, other->face_normal) >= build->crease_cosine)
+            {
+                normal += other->normal;
+                if (build->with_tangents)
+                {
+                    tangent += other->tangent;
+                    bitangent += other->bitangent;
+                }
+            }
+        }
+        scratch->groups[g].output = find_or_add_sums(build, begin, &unique, normal, tangent, bitangent);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        build->corner_normal[build->position_corners[begin + i]] = scratch->groups[scratch->corner_group[i]].output;
+    }
+    return unique;
+}
+
+static void grow_smooth_scratch(SmoothScratch *scratch, int count)
+{
+    if (count <= scratch->capacity)
+    {
+        return;
+    }
+    free(scratch->terms);
+    free(scratch->sorted);
+    free(scratch->groups);
+    free(scratch->corner_group);
+    scratch->capacity = count;
+    scratch->terms = allocate_or_die((size_t)count * sizeof(CornerTerms));
+    scratch->sorted = allocate_or_die((size_t)count * sizeof(GroupedCorner));
+    scratch->groups = allocate_or_die((size_t)count * sizeof(NormalGroup));
+    scratch->corner_group = allocate_or_die((size_t)count * sizeof(int));
+}
+
+static void smooth_positions_task(void *context, int chunk)
+{
+    NormalBuild *build = (NormalBuild *)context;
+    int first = chunk * MESH_NORMALS_VERTEX_CHUNK;
+    int last = first + MESH_NORMALS_VERTEX_CHUNK < build->vertex_count ? first + MESH_NORMALS_VERTEX_CHUNK : build->vertex_count;
+    int smooth_all = build->crease_cosine <= -1.0f;
+
+    SmoothScratch scratch = {0};
+    grow_smooth_scratch(&scratch, MESH_NORMALS_LOCAL_CORNERS);
+
+    for (int v = first; v < last; v++)
+    {
+        int begin = build->corner_start[v];
+        int count = build->corner_start[v + 1] - begin;
+        int unique = 0;
+        grow_smooth_scratch(&scratch, count);
+        CornerTerms *terms = scratch.terms;
+
+        // Gathered once, the loops below only read these
+        for (int i = 0; i < count; i++)
+        {
+            int corner = build->position_corners[begin + i];
+            float weight = build->corner_angles[corner];
+            terms[i].face_normal = build->face_normals[corner / 3];
+            terms[i].normal = terms[i].face_normal * weight;
+            if (build->with_tangents)
+            {
+                terms[i].tangent = build->face_tangents[corner / 3] * weight;
+                terms[i].bitangent = build->face_bitangents[corner / 3] * weight;
+            }
+        }
+
+        if (count > MESH_NORMALS_LOCAL_CORNERS && !smooth_all)
+        {
+            build->normal_start[v + 1] = smooth_grouped_position(build, &scratch, begin, count);
+            continue;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            Vec3 own = terms[i].face_normal;
+            // A corner of a degenerate face has no side of the crease and
+            // takes everything around it
+            int take_all = smooth_all || vec3_dot(own, own) == 0.0f;
+
+            // Every smoothing group is a sum of whole faces in corner
+            // order, so corners seeing the same faces sum to the same bits
+            Vec3 normal = vec3(0.0f, 0.0f, 0.0f);
+            Vec3 tangent = normal;
+            Vec3 bitangent = normal;
+            for (int j = 0; j < count; j++)
+            {
+                if (take_all || vec3_dot(own, terms[j].face_normal) >= build->crease_cosine)
+                {
+                    normal += terms[j].normal;
+                    if (build->with_tangents)
+                    {
+                        tangent += terms[j].tangent;
+                        bitangent += terms[j].bitangent;
+                    }
+                }
+            }
+            build->corner_normal[build->position_corners[begin + i]] = find_or_add_sums(build, begin, &unique, normal, tangent, bitangent);
+
+            if (smooth_all)
+            {
+                // One group takes in every face, the other corners join it
+                for (int j = i + 1; j < count; j++)
+                {
+                    build->corner_normal[build->position_corners[begin + j]] = 0;
+                }
+                break;
+            }
+        }
+
+        build->normal_start[v + 1] = unique;
+    }
+
+    free(scratch.terms);
+    free(scratch.sorted);
+    free(scratch.groups);
+    free(scratch.corner_group);
+}
+
+static void write_normals_task(void *context, int chunk)
+{
+    NormalBuild *build = (NormalBuild *)context;
+    int first = chunk * MESH_NORMALS_VERTEX_CHUNK;
+    int last = first + MESH_NORMALS_VERTEX_CHUNK < build->vertex_count ? first + MESH_NORMALS_VERTEX_CHUNK : build->vertex_count;
+
+    for (int v = first; v < last; v++)
+    {
+        int begin = build->corner_start[v];
+        int out = build->normal_start[v];
+        int count = build->normal_start[v + 1] - out;
+
+        for (int u = 0; u < count; u++, out++)
+        {
+            Vec3 normal = vec3_normalize(build->normal_sums[begin + u]);
+            build->normals[out].x = normal[0];
+            build->normals[out].y = normal[1];
+            build->normals[out].z = normal[2];
+
+            if (build->with_tangents)
+            {
+                // Gram-Schmidt against the smoothed normal
+                Vec3 sum = build->tangent_sums[begin + u];
+                Vec3 tangent = vec3_normalize(sum - normal * vec3_dot(normal, sum));
+                float handedness = vec3_dot(vec3_cross(normal, tangent), build->bitangent_sums[begin + u]) < 0.0f ? -1.0f : 1.0f;
+                build->tangents[out].x = tangent[0];
+                build->tangents[out].y = tangent[1];
+                build->tangents[out].z = tangent[2];
+                build->tangents[out].w = handedness;
+            }
+        }
+    }
+}
+
+static void assign_normals_task(void *context, int chunk)
+{
+    NormalBuild *build = (NormalBuild *)context;
+    int first = chunk * MESH_NORMALS_FACE_CHUNK;
+    int last = first + MESH_NORMALS_FACE_CHUNK < build->face_count ? first + MESH_NORMALS_FACE_CHUNK : build->face_count;
+
+    for (int f = first; f < last; f++)
+    {
+        // A face with a bad index was left out of the adjacency, none of
+        // its corners got a normal
+        Face *face = &build->faces[f];
+        int valid = valid_face(build, face);
+        for (int j = 0; j < 3; j++)
+        {
+            face->normalIndex[j] = valid ? build->normal_start[face->vertexIndex[j] - 1] + build->corner_normal[f * 3 + j] + 1 : 0;
+        }
+    }
+}
+
+int mesh_normals_missing(const Normal *normals, int normal_count, const Face *faces, int face_count)
+{
+    for (int f = 0; f < face_count; f++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            int index = faces[f].normalIndex[j];
+            if (index < 1 || index > normal_count)
+            {
+                return 1;
+            }
+            const Normal *normal = &normals[index - 1];
+            if (normal->x * normal->x + normal->y * normal->y + normal->z * normal->z < 1e-12f)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int generate_mesh_normals(const Vertex *vertices, int vertex_count, const TexCoord *texCoords, int texCoord_count, Face *faces, int face_count, float crease_angle, int thread_count, Normal **normals, Tangent **tangents)
+{
+    PROFILE_SCOPE(generate_mesh_normals);
+
+    if (thread_count <= 0)
+    {
+        thread_count = getCpuCount();
+    }
+
+    NormalBuild build = {0};
+    build.vertices = vertices;
+    build.vertex_count = vertex_count;
+    build.texCoords = texCoords;
+    build.texCoord_count = texCoord_count;
+    build.faces = faces;
+    build.face_count = face_count;
+    build.crease_cosine = crease_angle >= 180.0f ? -1.0f : cosf(crease_angle * (float)M_PI / 180.0f);
+    build.with_tangents = tangents != NULL;
+
+    size_t corner_count = (size_t)face_count * 3;
+    build.face_normals = allocate_or_die((size_t)face_count * sizeof(VecFloat4));
+    build.corner_angles = allocate_or_die(corner_count * sizeof(float));
+    if (build.with_tangents)
+    {
+        build.face_tangents = allocate_or_die((size_t)face_count * sizeof(VecFloat4));
+        build.face_bitangents = allocate_or_die((size_t)face_count * sizeof(VecFloat4));
+    }
+
+    int face_chunks = chunk_count(face_count, MESH_NORMALS_FACE_CHUNK);
+    int vertex_chunks = chunk_count(vertex_count, MESH_NORMALS_VERTEX_CHUNK);
+    runParallel(face_chunks, thread_count, face_attributes_task, &build);
+
+    // Corners of faces with a bad index are left out and get no normal
+    PROFILE_BEGIN(mesh_normals_adjacency);
+    build.corner_start = calloc((size_t)vertex_count + 1, sizeof(int));
+    build.normal_start = calloc((size_t)vertex_count + 1, sizeof(int));
+    if (!build.corner_start || !build.normal_start)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    for (int f = 0; f < face_count; f++)
+    {
+        if (valid_face(&build, &faces[f]))
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                build.corner_start[faces[f].vertexIndex[j]]++;
+            }
+        }
+    }
+    for (int v = 0; v < vertex_count; v++)
+    {
+        build.corner_start[v + 1] += build.corner_start[v];
+    }
+
+    int used_corners = build.corner_start[vertex_count];
+    build.position_corners = allocate_or_die((size_t)used_corners * sizeof(int));
+    build.corner_normal = allocate_or_die(corner_count * sizeof(int));
+    int *cursor = allocate_or_die((size_t)vertex_count * sizeof(int));
+    memcpy(cursor, build.corner_start, (size_t)vertex_count * sizeof(int));
+    for (int f = 0; f < face_count; f++)
+    {
+        if (valid_face(&build, &faces[f]))
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                build.position_corners[cursor[faces[f].vertexIndex[j] - 1]++] = f * 3 + j;
+            }
+        }
+    }
+    free(cursor);
+    PROFILE_END(mesh_normals_adjacency);
+
+    build.normal_sums = allocate_or_die((size_t)used_corners * sizeof(VecFloat4));
+    if (build.with_tangents)
+    {
+        build.tangent_sums = allocate_or_die((size_t)used_corners * sizeof(VecFloat4));
+        build.bitangent_sums = allocate_or_die((size_t)used_corners * sizeof(VecFloat4));
+    }
+    runParallel(vertex_chunks, thread_count, smooth_positions_task, &build);
+
+    for (int v = 0; v < vertex_count; v++)
+    {
+        build.normal_start[v + 1] += build.normal_start[v];
+    }
+
+    int normal_count = build.normal_start[vertex_count];
+    build.normals = allocate_or_die((size_t)(normal_count + 1) * sizeof(Normal));
+    if (build.with_tangents)
+    {
+        build.tangents = allocate_or_die((size_t)(normal_count + 1) * sizeof(Tangent));
+    }
+    runParallel(vertex_chunks, thread_count, write_normals_task, &build);
+    runParallel(face_chunks, thread_count, assign_normals_task, &build);
+
+    free(build.face_normals);
+    free(build.face_tangents);
+    free(build.face_bitangents);
+    free(build.corner_angles);
+    free(build.corner_start);
+    free(build.position_corners);
+    free(build.normal_sums);
+    free(build.tangent_sums);
+    free(build.bitangent_sums);
+    free(build.corner_normal);
+    free(build.normal_start);
+
+    free(*normals);
+    *normals = build.normals;
+    if (tangents)
+    {
+        *tangents = build.tangents;
+    }
+    return normal_count;
+}
+
+int repair_mesh_normals(const Vertex *vertices, int vertex_count, const TexCoord *texCoords, int texCoord_count, Face *faces, int face_count, int thread_count, Normal **normals, int *normal_count, int *normal_capacity)
+{
+    if (!mesh_normals_missing(*normals, *normal_count, faces, face_count))
+    {
+        return 0;
+    }
+
+    *normal_count = generate_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, MESH_NORMALS_DEFAULT_CREASE_ANGLE, thread_count, normals, NULL);
+    *normal_capacity = *normal_count;
+    return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef MESH_NORMALS_H
+#define MESH_NORMALS_H
+
+#include "loader.h"
+
+// Faces meeting at more than this many degrees keep a hard edge when
+// normals are generated for a mesh that came without usable ones
+#define MESH_NORMALS_DEFAULT_CREASE_ANGLE 60.0f
+
+// Faces and positions handed to a thread at a time
+#define MESH_NORMALS_FACE_CHUNK 16384
+#define MESH_NORMALS_VERTEX_CHUNK 8192
+
+// Unit tangent along increasing u, w is the bitangent's handedness, 1 or
+// -1, so bitangent = w * cross(normal, tangent)
+typedef struct
+{
+    float x, y, z, w;
+} Tangent;
+
+// 1 if any face corner has no normal, points past normals or at a zero
+// length one. read_obj_file fills missing indices with 0.
+int mesh_normals_missing(const Normal *normals, int normal_count, const Face *faces, int face_count);
+
+// Replaces *normals with angle weighted smooth normals and points every
+// face corner at them. Around each position, a corner averages the faces
+// whose normals are within crease_angle degrees of its own face's, and
+// corners averaging the same faces share a normal. With tangents, *tangents
+// gets one tangent frame per normal from the texture coordinates, zero
+// where a smoothing group has none; UV seams inside a group share it.
+// Faces and positions are split over thread_count threads (0 = one per
+// core). Both arrays are allocated here, the old normals freed. Returns
+// the new normal count.
+int generate_mesh_normals(const Vertex *vertices, int vertex_count, const TexCoord *texCoords, int texCoord_count, Face *faces, int face_count, float crease_angle, int thread_count, Normal **normals, Tangent **tangents);
+
+// generate_mesh_normals at the default crease angle, only when
+// mesh_normals_missing. Keeps the loader's count and capacity in step.
+// Returns 1 if the normals were replaced.
+int repair_mesh_normals(const Vertex *vertices, int vertex_count, const TexCoord *texCoords, int texCoord_count, Face *faces, int face_count, int thread_count, Normal **normals, int *normal_count, int *normal_capacity);
+
+#endif // MESH_NORMALS_H
\ No newline at end of file
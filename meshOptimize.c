@@ -0,0 +1,392 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshOptimize.h"
+#include "utils.h"
+
+// Clusters shorter than this are merged with the next one before sorting,
+// tiny clusters cost cache misses at every seam and barely affect overdraw
+#define MIN_CLUSTER_TRIANGLES 64
+
+typedef struct
+{
+    int start;    // First triangle
+    int count;    // Triangles
+    float metric; // Larger draws earlier
+} TriangleCluster;
+
+static void *allocate_or_die(size_t size)
+{
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+int count_cache_misses(const unsigned int *indices, int index_count, int vertex_count, int cache_size)
+{
+    // FIFO by insertion time: a vertex is still cached while fewer than
+    // cache_size other vertices were inserted after it
+    int *inserted = allocate_or_die((size_t)vertex_count * sizeof(int));
+    for (int i = 0; i < vertex_count; i++)
+    {
+        inserted[i] = -cache_size - 1;
+    }
+
+    int misses = 0;
+    for (int i = 0; i < index_count; i++)
+    {
+        unsigned int vertex = indices[i];
+        if (misses - inserted[vertex] > cache_size - 1)
+        {
+            inserted[vertex] = misses++;
+        }
+    }
+
+    free(inserted);
+    return misses;
+}
+
+static int compare_clusters(const void *a, const void *b)
+{
+    float metricA = ((const TriangleCluster *)a)->metric;
+    float metricB = ((const TriangleCluster *)b)->metric;
+    return (metricA < metricB) - (metricA > metricB);
+}
+
+// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality
+// and Reduced Overdraw", 2007. Fans around the vertex most likely to still
+// be cached, so triangles come out in tight, cache-sized neighbourhoods.
+// cluster_starts receives the triangle at which each non-local jump
+// happened.
+static int tipsify(const unsigned int *indices, int index_count, int vertex_count, int cache_size, unsigned int *output, int *cluster_starts)
+{
+    int triangle_count = index_count / 3;
+
+    // Vertex to triangle adjacency, as offsets into one flat array
+    int *offsets = allocate_or_die(((size_t)vertex_count + 1) * sizeof(int));
+    int *live = allocate_or_die((size_t)vertex_count * sizeof(int));
+    int *adjacency = allocate_or_die((size_t)index_count * sizeof(int));
+    memset(live, 0, (size_t)vertex_count * sizeof(int));
+
+    for (int i = 0; i < index_count; i++)
+    {
+        live[indices[i]]++;
+    }
+
+    offsets[0] = 0;
+    int max_valence = 0;
+    for (int v = 0; v < vertex_count; v++)
+    {
+        offsets[v + 1] = offsets[v] + live[v];
+        max_valence = live[v] > max_valence ? live[v] : max_valence;
+    }
+
+    int *fill = allocate_or_die((size_t)vertex_count * sizeof(int));
+    memcpy(fill, offsets, (size_t)vertex_count * sizeof(int));
+    for (int t = 0; t < triangle_count; t++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            adjacency[fill[indices[t * 3 + c]]++] = t;
+        }
+    }
+    free(fill);
+
+    int *cache_time = allocate_or_die((size_t)vertex_count * sizeof(int));
+    memset(cache_time, 0, (size_t)vertex_count * sizeof(int));
+    char *emitted = allocate_or_die((size_t)triangle_count);
+    memset(emitted, 0, (size_t)triangle_count);
+    int *dead_end = allocate_or_die((size_t)index_count * sizeof(int));
+    int *candidates = allocate_or_die((size_t)max_valence * 3 * sizeof(int));
+
+    int dead_end_top = 0;
+    int output_count = 0;
+    int cluster_count = 0;
+    int time = cache_size + 1;
+    int cursor = 0;
+    int fanning = triangle_count > 0 ? (int)indices[0] : -1;
+    int jumped = 1;
+
+    while (fanning >= 0)
+    {
+        if (jumped)
+        {
+            cluster_starts[cluster_count++] = output_count / 3;
+        }
+
+        int candidate_count = 0;
+        for (int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+        {
+            int t = adjacency[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+
+            for (int c = 0; c < 3; c++)
+            {
+                int v = (int)indices[t * 3 + c];
+                output[output_count++] = (unsigned int)v;
+                dead_end[dead_end_top++] = v;
+                candidates[candidate_count++] = v;
+                live[v]--;
+
+                if (time - cache_time[v] > cache_size)
+                {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        // Next fan: the candidate that will still be in the cache after its
+        // remaining triangles are emitted, oldest first
+        int next = -1;
+        int best_priority = -1;
+        for (int i = 0; i < candidate_count; i++)
+        {
+            int v = candidates[i];
+            if (live[v] > 0)
+            {
+                int priority = 0;
+                if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                {
+                    priority = time - cache_time[v];
+                }
+                if (priority > best_priority)
+                {
+                    best_priority = priority;
+                    next = v;
+                }
+            }
+        }
+
+        jumped = 0;
+        if (next < 0)
+        {
+            // Dead end, back up to a recently used vertex with work left
+            while (dead_end_top > 0 && next < 0)
+            {
+                int v = dead_end[--dead_end_top];
+                if (live[v] > 0)
+                {
+                    next = v;
+                }
+            }
+        }
+        if (next < 0)
+        {
+            // Nothing local left, continue at the next unfinished vertex
+            while (cursor < vertex_count && live[cursor] == 0)
+            {
+                cursor++;
+            }
+            next = cursor < vertex_count ? cursor : -1;
+            jumped = 1;
+        }
+
+        fanning = next;
+    }
+
+    free(offsets);
+    free(live);
+    free(adjacency);
+    free(cache_time);
+    free(emitted);
+    free(dead_end);
+    free(candidates);
+
+    return cluster_count;
+}
+
+static void triangle_geometry(const unsigned int *triangle, const float *vertices, int stride, float centroid[3], float normal[3])
+{
+    const float *a = &vertices[(size_t)triangle[0] * stride];
+    const float *b = &vertices[(size_t)triangle[1] * stride];
+    const float *c = &vertices[(size_t)triangle[2] * stride];
+
+    float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+    // Unnormalized, so summing weighs triangles by area
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+
+    for (int i = 0; i < 3; i++)
+    {
+        centroid[i] = (a[i] + b[i] + c[i]) / 3.0f;
+    }
+}
+
+int optimize_vertex_cache(unsigned int *indices, int index_count, const float *vertices, int vertex_count, int stride)
+{
+    int triangle_count = index_count / 3;
+    if (triangle_count == 0)
+    {
+        return 0;
+    }
+
+    unsigned int *ordered = allocate_or_die((size_t)index_count * sizeof(unsigned int));
+    int *cluster_starts = allocate_or_die(((size_t)triangle_count + 1) * sizeof(int));
+
+    int raw_cluster_count = tipsify(indices, index_count, vertex_count, VERTEX_CACHE_SIZE, ordered, cluster_starts);
+    cluster_starts[raw_cluster_count] = triangle_count;
+
+    // Merge runs of short clusters so every cluster is worth moving
+    TriangleCluster *clusters = allocate_or_die((size_t)raw_cluster_count * sizeof(TriangleCluster));
+    int cluster_count = 0;
+    for (int i = 0; i < raw_cluster_count; i++)
+    {
+        int start = cluster_starts[i];
+        int count = cluster_starts[i + 1] - start;
+
+        if (cluster_count > 0 && clusters[cluster_count - 1].count < MIN_CLUSTER_TRIANGLES)
+        {
+            clusters[cluster_count - 1].count += count;
+        }
+        else
+        {
+            clusters[cluster_count].start = start;
+            clusters[cluster_count].count = count;
+            cluster_count++;
+        }
+    }
+
+    // View independent overdraw order: clusters that face away from the
+    // mesh centre sit on the outside and tend to occlude the rest, so they
+    // go first
+    float mesh_centroid[3] = {0.0f, 0.0f, 0.0f};
+    for (int t = 0; t < triangle_count; t++)
+    {
+        float centroid[3], normal[3];
+        triangle_geometry(&ordered[t * 3], vertices, stride, centroid, normal);
+        for (int i = 0; i < 3; i++)
+        {
+            mesh_centroid[i] += centroid[i] / triangle_count;
+        }
+    }
+
+    for (int k = 0; k < cluster_count; k++)
+    {
+        float cluster_centroid[3] = {0.0f, 0.0f, 0.0f};
+        float cluster_normal[3] = {0.0f, 0.0f, 0.0f};
+
+        for (int t = clusters[k].start; t < clusters[k].start + clusters[k].count; t++)
+        {
+            float centroid[3], normal[3];
+            triangle_geometry(&ordered[t * 3], vertices, stride, centroid, normal);
+            for (int i = 0; i < 3; i++)
+            {
+                cluster_centroid[i] += centroid[i] / clusters[k].count;
+                cluster_normal[i] += normal[i];
+            }
+        }
+
+        float length = sqrtf(cluster_normal[0] * cluster_normal[0] + cluster_normal[1] * cluster_normal[1] + cluster_normal[2] * cluster_normal[2]);
+        float metric = 0.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            metric += (cluster_centroid[i] - mesh_centroid[i]) * cluster_normal[i];
+        }
+        clusters[k].metric = length > 0.0f ? metric / length : 0.0f;
+    }
+
+    qsort(clusters, (size_t)cluster_count, sizeof(TriangleCluster), compare_clusters);
+
+    for (int k = 0, t = 0; k < cluster_count; k++)
+    {
+        memcpy(&indices[t * 3], &ordered[clusters[k].start * 3], (size_t)clusters[k].count * 3 * sizeof(unsigned int));
+        t += clusters[k].count;
+    }
+
+    // Keep the plain cache order if sorting for overdraw costs too much
+    int cache_misses = count_cache_misses(ordered, index_count, vertex_count, VERTEX_CACHE_SIZE);
+    int sorted_misses = count_cache_misses(indices, index_count, vertex_count, VERTEX_CACHE_SIZE);
+    if (sorted_misses > cache_misses * OVERDRAW_ACMR_THRESHOLD)
+    {
+        memcpy(indices, ordered, (size_t)index_count * sizeof(unsigned int));
+        cluster_count = 1;
+    }
+
+    free(ordered);
+    free(cluster_starts);
+    free(clusters);
+
+    return cluster_count;
+}
+
+void optimize_vertex_fetch(float *vertices, int vertex_count, int stride, unsigned int *indices, int index_count)
+{
+    int *remap = allocate_or_die((size_t)vertex_count * sizeof(int));
+    for (int i = 0; i < vertex_count; i++)
+    {
+        remap[i] = -1;
+    }
+
+    int next = 0;
+    for (int i = 0; i < index_count; i++)
+    {
+        if (remap[indices[i]] < 0)
+        {
+            remap[indices[i]] = next++;
+        }
+        indices[i] = (unsigned int)remap[indices[i]];
+    }
+
+    // Unreferenced vertices keep their relative order at the end
+    for (int i = 0; i < vertex_count; i++)
+    {
+        if (remap[i] < 0)
+        {
+            remap[i] = next++;
+        }
+    }
+
+    float *reordered = allocate_or_die((size_t)vertex_count * stride * sizeof(float));
+    for (int i = 0; i < vertex_count; i++)
+    {
+        memcpy(&reordered[(size_t)remap[i] * stride], &vertices[(size_t)i * stride], (size_t)stride * sizeof(float));
+    }
+    memcpy(vertices, reordered, (size_t)vertex_count * stride * sizeof(float));
+
+    free(reordered);
+    free(remap);
+}
+
+void optimize_gpu_mesh(GpuMesh *mesh, const MaterialRange *ranges, int range_count, MeshOptimizeStats *stats)
+{
+    double start = getTimeSeconds();
+    int triangle_count = mesh->index_count / 3;
+    int misses_before = count_cache_misses(mesh->indices, mesh->index_count, mesh->vertex_count, VERTEX_CACHE_SIZE);
+
+    int cluster_count = 0;
+    if (range_count == 0)
+    {
+        cluster_count = optimize_vertex_cache(mesh->indices, mesh->index_count, mesh->vertices, mesh->vertex_count, GPU_VERTEX_FLOATS);
+    }
+    for (int r = 0; r < range_count; r++)
+    {
+        cluster_count += optimize_vertex_cache(&mesh->indices[ranges[r].first_index], ranges[r].index_count, mesh->vertices, mesh->vertex_count, GPU_VERTEX_FLOATS);
+    }
+    optimize_vertex_fetch(mesh->vertices, mesh->vertex_count, GPU_VERTEX_FLOATS, mesh->indices, mesh->index_count);
+
+    if (stats)
+    {
+        int misses_after = count_cache_misses(mesh->indices, mesh->index_count, mesh->vertex_count, VERTEX_CACHE_SIZE);
+        float triangles = triangle_count > 0 ? (float)triangle_count : 1.0f;
+        float vertices = mesh->vertex_count > 0 ? (float)mesh->vertex_count : 1.0f;
+
+        stats->acmr_before = misses_before / triangles;
+        stats->acmr_after = misses_after / triangles;
+        stats->atvr_before = misses_before / vertices;
+        stats->atvr_after = misses_after / vertices;
+        stats->cluster_count = cluster_count;
+        stats->milliseconds = (getTimeSeconds() - start) * 1000.0;
+    }
+}
\ No newline at end of file
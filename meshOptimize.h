@@ -0,0 +1,44 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include "mesh.h"
+
+// Post-transform cache size the triangle order is tuned for and measured
+// against. 16 to 32 entries covers every desktop GPU of the last decade.
+#define VERTEX_CACHE_SIZE 16
+
+// Clusters are only reordered for overdraw while the cache miss ratio
+// stays within this factor of the cache-optimized order
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+typedef struct
+{
+    float acmr_before; // Average cache miss ratio, transformed vertices per triangle
+    float acmr_after;
+    float atvr_before; // Average transform to vertex ratio, 1.0 is ideal
+    float atvr_after;
+    int cluster_count; // Triangle clusters sorted for overdraw
+    double milliseconds;
+} MeshOptimizeStats;
+
+// Simulates a FIFO post-transform cache of cache_size entries over the
+// index buffer and returns the number of vertex shader invocations
+int count_cache_misses(const unsigned int *indices, int index_count, int vertex_count, int cache_size);
+
+// Reorders triangles with Tipsify for vertex cache locality, then sorts the
+// resulting clusters front to back by a view independent overdraw metric
+// as long as the cache miss ratio stays within OVERDRAW_ACMR_THRESHOLD.
+// positions are read from the interleaved vertices, stride in floats.
+// Returns the number of clusters.
+int optimize_vertex_cache(unsigned int *indices, int index_count, const float *vertices, int vertex_count, int stride);
+
+// Renumbers vertices in order of first use by the index buffer so fetches
+// walk memory forwards, and remaps the indices to match
+void optimize_vertex_fetch(float *vertices, int vertex_count, int stride, unsigned int *indices, int index_count);
+
+// Both passes on a built mesh, filling stats if it isn't NULL. Triangles
+// are only reordered within each of the range_count ranges, so faces sorted
+// by material stay that way; without ranges the whole mesh is one.
+void optimize_gpu_mesh(GpuMesh *mesh, const MaterialRange *ranges, int range_count, MeshOptimizeStats *stats);
+
+#endif // MESH_OPTIMIZE_H
\ No newline at end of file
@@ -0,0 +1,489 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh.h"
+#include "meshlet.h"
+#include "shading.h"
+#include "utils.h"
+
+#define MESHLET_CONE_EPSILON 1e-3f
+
+// How much a triangle bending away from the cluster's average normal
+// costs, in new vertices, when growing a cluster
+#define MESHLET_CONE_WEIGHT 4.0f
+
+static void normalize3(float v[3])
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f)
+    {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+static void compute_meshlet_bounds(Meshlet *meshlet, const float *vertices, int stride, const unsigned int *indices, const unsigned int *unique, int unique_count)
+{
+    // Sphere around the box centre, not minimal but tight for the compact
+    // patches meshlets are
+    float min[3], max[3];
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = max[i] = vertices[(size_t)unique[0] * stride + i];
+    }
+    for (int v = 1; v < unique_count; v++)
+    {
+        const float *position = &vertices[(size_t)unique[v] * stride];
+        for (int i = 0; i < 3; i++)
+        {
+            min[i] = position[i] < min[i] ? position[i] : min[i];
+            max[i] = position[i] > max[i] ? position[i] : max[i];
+        }
+    }
+
+    float radius_squared = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        meshlet->center[i] = (min[i] + max[i]) * 0.5f;
+    }
+    for (int v = 0; v < unique_count; v++)
+    {
+        const float *position = &vertices[(size_t)unique[v] * stride];
+        float dx = position[0] - meshlet->center[0];
+        float dy = position[1] - meshlet->center[1];
+        float dz = position[2] - meshlet->center[2];
+        float distance_squared = dx * dx + dy * dy + dz * dz;
+        radius_squared = distance_squared > radius_squared ? distance_squared : radius_squared;
+    }
+    meshlet->radius = sqrtf(radius_squared);
+
+    // Cone of the geometric face normals
+    float normals[MESHLET_MAX_TRIANGLES][3];
+    int normal_count = 0;
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+
+    for (int t = meshlet->first_index; t < meshlet->first_index + meshlet->index_count; t += 3)
+    {
+        const float *a = &vertices[(size_t)indices[t] * stride];
+        const float *b = &vertices[(size_t)indices[t + 1] * stride];
+        const float *c = &vertices[(size_t)indices[t + 2] * stride];
+
+        float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float *normal = normals[normal_count];
+        normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+        normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+        normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+
+        // Degenerate triangles are never visible, they don't widen the cone
+        if (normal[0] == 0.0f && normal[1] == 0.0f && normal[2] == 0.0f)
+        {
+            continue;
+        }
+
+        normalize3(normal);
+        axis[0] += normal[0];
+        axis[1] += normal[1];
+        axis[2] += normal[2];
+        normal_count++;
+    }
+
+    normalize3(axis);
+    float min_dot = 1.0f;
+    for (int n = 0; n < normal_count; n++)
+    {
+        float dot = normals[n][0] * axis[0] + normals[n][1] * axis[1] + normals[n][2] * axis[2];
+        min_dot = dot < min_dot ? dot : min_dot;
+    }
+
+    // Widened slightly so rounding never culls a triangle seen edge on
+    min_dot -= MESHLET_CONE_EPSILON;
+
+    memcpy(meshlet->cone_axis, axis, sizeof(axis));
+    meshlet->cone_cutoff = normal_count > 0 && min_dot > 0.0f ? sqrtf(1.0f - min_dot * min_dot) : 1.0f;
+}
+
+static void face_normal(const float *vertices, int stride, const unsigned int *triangle, float normal[3])
+{
+    const float *a = &vertices[(size_t)triangle[0] * stride];
+    const float *b = &vertices[(size_t)triangle[1] * stride];
+    const float *c = &vertices[(size_t)triangle[2] * stride];
+
+    float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+    normalize3(normal);
+}
+
+void order_meshlet_triangles(const float *vertices, int vertex_count, int stride, unsigned int *indices, int index_count)
+{
+    int triangle_count = index_count / 3;
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    // Position to triangle adjacency, as offsets into one flat array
+    int *offsets = malloc(((size_t)vertex_count + 1) * sizeof(int));
+    int *adjacency = malloc((size_t)index_count * sizeof(int));
+    int *fill = malloc((size_t)vertex_count * sizeof(int));
+    int *last_meshlet = malloc((size_t)vertex_count * sizeof(int));
+    int *position_meshlet = malloc((size_t)vertex_count * sizeof(int));
+    int *position_of = weld_vertex_positions(vertices, vertex_count, stride);
+    float *normals = malloc((size_t)triangle_count * 3 * sizeof(float));
+    char *emitted = calloc((size_t)triangle_count, 1);
+    unsigned int *ordered = malloc((size_t)index_count * sizeof(unsigned int));
+
+    if (!offsets || !adjacency || !fill || !last_meshlet || !position_meshlet || !normals || !emitted || !ordered)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(offsets, 0, ((size_t)vertex_count + 1) * sizeof(int));
+    for (int i = 0; i < index_count; i++)
+    {
+        offsets[position_of[indices[i]] + 1]++;
+    }
+    for (int v = 0; v < vertex_count; v++)
+    {
+        offsets[v + 1] += offsets[v];
+        fill[v] = offsets[v];
+        last_meshlet[v] = -1;
+        position_meshlet[v] = -1;
+    }
+    for (int t = 0; t < triangle_count; t++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            adjacency[fill[position_of[indices[t * 3 + c]]]++] = t;
+        }
+        face_normal(vertices, stride, &indices[t * 3], &normals[t * 3]);
+    }
+
+    // Grow one cluster at a time from the triangle that didn't fit into the
+    // last one, always taking the neighbour that adds the fewest vertices
+    // and keeps the normals closest together. Neighbours share a position.
+    // A cluster closes exactly when the chosen triangle would break a
+    // limit, so build_meshlets cutting the result in order finds the same
+    // clusters again.
+    int cluster[MESHLET_MAX_VERTICES];
+    int cluster_positions = 0;
+    int cluster_vertices = 0;
+    int cluster_triangles = 0;
+    int meshlet = 0;
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    int cursor = 0;
+    int next = 0;
+
+    for (int emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+    {
+        const unsigned int *triangle = &indices[next * 3];
+        int fresh = 0;
+        for (int c = 0; c < 3; c++)
+        {
+            fresh += last_meshlet[triangle[c]] != meshlet && (c < 1 || triangle[c] != triangle[0]) && (c < 2 || triangle[c] != triangle[1]);
+        }
+
+        if (cluster_vertices + fresh > MESHLET_MAX_VERTICES || cluster_triangles == MESHLET_MAX_TRIANGLES)
+        {
+            meshlet++;
+            cluster_positions = 0;
+            cluster_vertices = 0;
+            cluster_triangles = 0;
+            axis[0] = axis[1] = axis[2] = 0.0f;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            if (last_meshlet[triangle[c]] != meshlet)
+            {
+                last_meshlet[triangle[c]] = meshlet;
+                cluster_vertices++;
+            }
+
+            int position = position_of[triangle[c]];
+            if (position_meshlet[position] != meshlet)
+            {
+                position_meshlet[position] = meshlet;
+                cluster[cluster_positions++] = position;
+            }
+        }
+
+        memcpy(&ordered[emitted_count * 3], triangle, 3 * sizeof(unsigned int));
+        emitted[next] = 1;
+        cluster_triangles++;
+        axis[0] += normals[next * 3];
+        axis[1] += normals[next * 3 + 1];
+        axis[2] += normals[next * 3 + 2];
+
+        float direction[3] = {axis[0], axis[1], axis[2]};
+        normalize3(direction);
+
+        // Best unemitted neighbour of the cluster
+        next = -1;
+        float best_score = 0.0f;
+        for (int i = 0; i < cluster_positions; i++)
+        {
+            int position = cluster[i];
+            for (int a = offsets[position]; a < offsets[position + 1]; a++)
+            {
+                int t = adjacency[a];
+                if (emitted[t])
+                {
+                    continue;
+                }
+
+                const unsigned int *candidate = &indices[t * 3];
+                int extra = (last_meshlet[candidate[0]] != meshlet) + (last_meshlet[candidate[1]] != meshlet) + (last_meshlet[candidate[2]] != meshlet);
+                const float *normal = &normals[t * 3];
+                float spread = 1.0f - (normal[0] * direction[0] + normal[1] * direction[1] + normal[2] * direction[2]);
+                float score = extra + MESHLET_CONE_WEIGHT * spread;
+
+                if (next < 0 || score < best_score)
+                {
+                    best_score = score;
+                    next = t;
+                }
+            }
+        }
+
+        if (next < 0)
+        {
+            // Island finished, carry on with the next triangle in input order
+            while (cursor < triangle_count && emitted[cursor])
+            {
+                cursor++;
+            }
+            next = cursor;
+        }
+    }
+
+    memcpy(indices, ordered, (size_t)index_count * sizeof(unsigned int));
+
+    free(offsets);
+    free(adjacency);
+    free(fill);
+    free(last_meshlet);
+    free(position_meshlet);
+    free(position_of);
+    free(normals);
+    free(emitted);
+    free(ordered);
+}
+
+int build_meshlets(const float *vertices, int vertex_count, int stride, const unsigned int *indices, int index_count, Meshlet **meshlets)
+{
+    // Worst case every meshlet is cut short by the vertex limit
+    int capacity = index_count / 3 / (MESHLET_MAX_VERTICES / 3) + 1;
+    Meshlet *out = malloc((size_t)capacity * sizeof(Meshlet));
+
+    // Which meshlet last used each vertex, so uniqueness is checked in O(1)
+    int *last_meshlet = malloc(((size_t)vertex_count + 1) * sizeof(int));
+
+    if (!out || !last_meshlet)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int v = 0; v < vertex_count; v++)
+    {
+        last_meshlet[v] = -1;
+    }
+
+    unsigned int unique[MESHLET_MAX_VERTICES];
+    int unique_count = 0;
+    int count = 0;
+    int first_index = 0;
+
+    for (int t = 0; t <= index_count; t += 3)
+    {
+        int fresh = 0;
+        if (t < index_count)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v = indices[t + c];
+                fresh += last_meshlet[v] != count && (c < 1 || v != indices[t]) && (c < 2 || v != indices[t + 1]);
+            }
+        }
+
+        int full = unique_count + fresh > MESHLET_MAX_VERTICES || (t - first_index) / 3 == MESHLET_MAX_TRIANGLES;
+        if (t > first_index && (t == index_count || full))
+        {
+            Meshlet *meshlet = &out[count];
+            meshlet->first_index = first_index;
+            meshlet->index_count = t - first_index;
+            compute_meshlet_bounds(meshlet, vertices, stride, indices, unique, unique_count);
+
+            count++;
+            first_index = t;
+            unique_count = 0;
+        }
+
+        if (t == index_count)
+        {
+            break;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned int v = indices[t + c];
+            if (last_meshlet[v] != count)
+            {
+                last_meshlet[v] = count;
+                unique[unique_count++] = v;
+            }
+        }
+    }
+
+    free(last_meshlet);
+
+    *meshlets = out;
+    return count;
+}
+
+void meshlet_view_from_matrix(const float modelViewProjection[16], const float eye[4], MeshletView *view)
+{
+    // Gribb and Hartmann: each clip plane is the last row plus or minus
+    // another row of the matrix
+    const float *m = modelViewProjection;
+    for (int i = 0; i < 3; i++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            float *plane = view->planes[i * 2 + side];
+
+            for (int column = 0; column < 4; column++)
+            {
+                plane[column] = m[column * 4 + 3] + sign * m[column * 4 + i];
+            }
+
+            float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            for (int column = 0; column < 4; column++)
+            {
+                plane[column] /= length > 0.0f ? length : 1.0f;
+            }
+        }
+    }
+
+    memcpy(view->eye, eye, 4 * sizeof(float));
+}
+
+void shader_meshlet_view(float time, float aspect, MeshletView *view)
+{
+    ShaderTransforms transforms;
+    shader_transforms(time, aspect, &transforms);
+
+    // Meshlet bounds are in model space, so is the eye they're tested from
+    Mat4 inverseModel = mat4_inverse(&transforms.model);
+    Vec4 eye = mat4_transform(&inverseModel, vec4(transforms.eye[0], transforms.eye[1], transforms.eye[2], 1.0f));
+    const float eyePoint[4] = {eye[0], eye[1], eye[2], 1.0f};
+    meshlet_view_from_matrix((const float *)transforms.model_view_projection.columns, eyePoint, view);
+}
+
+static int meshlet_visible(const Meshlet *meshlet, const MeshletView *view)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const float *plane = view->planes[p];
+        float distance = plane[0] * meshlet->center[0] + plane[1] * meshlet->center[1] + plane[2] * meshlet->center[2] + plane[3];
+        if (distance < -meshlet->radius)
+        {
+            return 0;
+        }
+    }
+
+    // Back facing when every normal points away from the eye, checked
+    // conservatively for the whole sphere
+    if (meshlet->cone_cutoff >= 1.0f)
+    {
+        return 1;
+    }
+
+    const float *eye = view->eye;
+    float toward[3] = {
+        meshlet->center[0] * eye[3] - eye[0],
+        meshlet->center[1] * eye[3] - eye[1],
+        meshlet->center[2] * eye[3] - eye[2]};
+
+    float length = sqrtf(toward[0] * toward[0] + toward[1] * toward[1] + toward[2] * toward[2]);
+    float dot = toward[0] * meshlet->cone_axis[0] + toward[1] * meshlet->cone_axis[1] + toward[2] * meshlet->cone_axis[2];
+
+    return dot < meshlet->cone_cutoff * length + meshlet->radius * eye[3];
+}
+
+int cull_meshlets(const Meshlet *meshlets, int meshlet_count, const MeshletView *view, size_t index_size, int *counts, const void **offsets, int *visible_indices)
+{
+    int draw_count = 0;
+    int next_index = -1;
+    int visible = 0;
+
+    for (int i = 0; i < meshlet_count; i++)
+    {
+        const Meshlet *meshlet = &meshlets[i];
+        if (!meshlet_visible(meshlet, view))
+        {
+            continue;
+        }
+
+        if (meshlet->first_index == next_index)
+        {
+            counts[draw_count - 1] += meshlet->index_count;
+        }
+        else
+        {
+            counts[draw_count] = meshlet->index_count;
+            offsets[draw_count] = (const void *)((size_t)meshlet->first_index * index_size);
+            draw_count++;
+        }
+
+        next_index = meshlet->first_index + meshlet->index_count;
+        visible += meshlet->index_count;
+    }
+
+    *visible_indices = visible;
+    return draw_count;
+}
+
+void benchmark_meshlet_culling(const Meshlet *meshlets, int meshlet_count, int index_count, int steps)
+{
+    int *counts = malloc(((size_t)meshlet_count + 1) * sizeof(int));
+    const void **offsets = malloc(((size_t)meshlet_count + 1) * sizeof(void *));
+
+    if (!counts || !offsets)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    long long submitted = 0;
+    long long draws = 0;
+    double start = getTimeSeconds();
+
+    for (int step = 0; step < steps; step++)
+    {
+        MeshletView view;
+        shader_meshlet_view(6.2831853f * step / steps, 1.0f, &view);
+
+        int visible = 0;
+        draws += cull_meshlets(meshlets, meshlet_count, &view, sizeof(unsigned int), counts, offsets, &visible);
+        submitted += visible;
+    }
+
+    double seconds = getTimeSeconds() - start;
+    double frames = steps > 0 ? steps : 1;
+    double average = submitted / frames / 3.0;
+    double everything = index_count / 3.0;
+
+    printf("Meshlet culling over %d views: %.0f of %.0f triangles submitted (%.1f%%), %.1f draws, %.2f us per frame\n", steps, average, everything, 100.0 * average / (everything > 0.0 ? everything : 1.0), draws / frames, seconds * 1e6 / frames);
+
+    free(counts);
+    free(offsets);
+}
\ No newline at end of file
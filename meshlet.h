@@ -0,0 +1,65 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <stddef.h>
+
+// Cluster limits, the usual sizes for 8 bit local indices
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// A run of consecutive triangles in the index buffer touching at most
+// MESHLET_MAX_VERTICES vertices, with the bounds needed to reject it
+typedef struct
+{
+    int first_index;
+    int index_count;
+
+    float center[3]; // Bounding sphere
+    float radius;
+
+    // Every triangle normal lies within the cone around axis. cone_cutoff is
+    // the sine of its half angle, 1 when the cone is too wide to ever cull.
+    float cone_axis[3];
+    float cone_cutoff;
+} Meshlet;
+
+// What culling needs to know about the camera, in model space
+typedef struct
+{
+    float planes[6][4]; // Frustum planes pointing inwards, normalized
+
+    // Camera position with w = 1, or with w = 0 the direction towards an
+    // orthographic camera
+    float eye[4];
+} MeshletView;
+
+// Reorders triangles so consecutive runs form compact clusters with narrow
+// normal cones, grown over shared vertices. Run it before build_meshlets
+// when the index buffer can still change, ideally after the vertex cache
+// pass.
+void order_meshlet_triangles(const float *vertices, int vertex_count, int stride, unsigned int *indices, int index_count);
+
+// Cuts the triangle list into meshlets in index buffer order, so each one
+// is a single range for the existing buffer. Positions are read from the
+// interleaved vertices, stride in floats. Returns the meshlet count and
+// the array, which the caller frees.
+int build_meshlets(const float *vertices, int vertex_count, int stride, const unsigned int *indices, int index_count, Meshlet **meshlets);
+
+// Frustum planes of a column-major model view projection matrix
+void meshlet_view_from_matrix(const float modelViewProjection[16], const float eye[4], MeshletView *view);
+
+// The view vertexShader.glsl renders with at a given time and aspect
+// (width over height), in model space: shader_transforms' camera
+void shader_meshlet_view(float time, float aspect, MeshletView *view);
+
+// Writes one draw per run of surviving meshlets, adjacent survivors merged,
+// as glMultiDrawElements counts and byte offsets. The arrays need room for
+// meshlet_count draws. Returns the number of draws, visible_indices gets
+// the indices they cover.
+int cull_meshlets(const Meshlet *meshlets, int meshlet_count, const MeshletView *view, size_t index_size, int *counts, const void **offsets, int *visible_indices);
+
+// Culls against the shader view at steps times through a full turn and
+// prints triangles submitted against drawing everything
+void benchmark_meshlet_culling(const Meshlet *meshlets, int meshlet_count, int index_count, int steps);
+
+#endif // MESHLET_H
\ No newline at end of file
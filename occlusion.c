@@ -0,0 +1,473 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "meshLod.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "shading.h"
+#include "utils.h"
+
+static void *allocate_or_die(size_t size)
+{
+    void *memory = malloc(size ? size : 1);
+    if (!memory)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+// Whether name is one of the comma separated names
+static int name_listed(const char *names, const char *name)
+{
+    size_t length = strlen(name);
+    for (const char *begin = names; *begin;)
+    {
+        const char *end = strchr(begin, ',');
+        size_t token = end ? (size_t)(end - begin) : strlen(begin);
+        if (token == length && strncmp(begin, name, length) == 0)
+        {
+            return 1;
+        }
+        if (!end)
+        {
+            break;
+        }
+        begin = end + 1;
+    }
+    return 0;
+}
+
+static void grow_box(const float *position, float min[3], float max[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = fminf(min[i], position[i]);
+        max[i] = fmaxf(max[i], position[i]);
+    }
+}
+
+// The model's coarsest level within OCCLUSION_OCCLUDER_ERROR of its size,
+// compacted to the positions it uses. Returns the level's error.
+static float build_occluder(const SceneModel *model, const GpuMesh *mesh, Occluder *occluder)
+{
+    // The LOD builder appends levels to the mesh, so it gets a copy
+    GpuMesh copy;
+    copy.vertex_count = model->vertex_count;
+    copy.index_count = model->index_count;
+    copy.vertices = allocate_or_die((size_t)copy.vertex_count * GPU_VERTEX_FLOATS * sizeof(float));
+    copy.indices = allocate_or_die((size_t)copy.index_count * sizeof(unsigned int));
+    memcpy(copy.vertices, &mesh->vertices[(size_t)model->base_vertex * GPU_VERTEX_FLOATS], (size_t)copy.vertex_count * GPU_VERTEX_FLOATS * sizeof(float));
+    memcpy(copy.indices, &mesh->indices[model->first_index], (size_t)copy.index_count * sizeof(unsigned int));
+
+    float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int v = 0; v < copy.vertex_count; v++)
+    {
+        grow_box(&copy.vertices[(size_t)v * GPU_VERTEX_FLOATS], min, max);
+    }
+    float diagonal = sqrtf((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) + (max[2] - min[2]) * (max[2] - min[2]));
+
+    MeshLod lods[MAX_MESH_LODS];
+    double milliseconds;
+    int lod_count = build_gpu_mesh_lods(&copy, 0, lods, &milliseconds);
+    int level = 0;
+    while (level + 1 < lod_count && lods[level + 1].error <= OCCLUSION_OCCLUDER_ERROR * diagonal)
+    {
+        level++;
+    }
+
+    // Levels share the vertices, only the ones this level uses are kept
+    int *remap = allocate_or_die((size_t)copy.vertex_count * sizeof(int));
+    memset(remap, 0xff, (size_t)copy.vertex_count * sizeof(int));
+    occluder->index_count = lods[level].index_count;
+    occluder->indices = allocate_or_die((size_t)occluder->index_count * sizeof(unsigned int));
+    occluder->positions = allocate_or_die((size_t)copy.vertex_count * 3 * sizeof(float));
+    occluder->vertex_count = 0;
+    for (int i = 0; i < occluder->index_count; i++)
+    {
+        unsigned int vertex = copy.indices[lods[level].first_index + i];
+        if (remap[vertex] < 0)
+        {
+            remap[vertex] = occluder->vertex_count++;
+            memcpy(&occluder->positions[(size_t)remap[vertex] * 3], &copy.vertices[(size_t)vertex * GPU_VERTEX_FLOATS], 3 * sizeof(float));
+        }
+        occluder->indices[i] = (unsigned int)remap[vertex];
+    }
+
+    printf("Occluder %s: %d of %d triangles, error %.4f, simplified in %.2f ms\n", model->name, occluder->index_count / 3, model->index_count / 3, lods[level].error, milliseconds);
+
+    free(remap);
+    free_gpu_mesh(&copy);
+    return lods[level].error;
+}
+
+int build_occlusion_culler(OcclusionCuller *culler, const SceneModel *models, int model_count, const GpuMesh *mesh, const char *occluder_names)
+{
+    memset(culler, 0, sizeof(OcclusionCuller));
+
+    int cluster_capacity = 0;
+    for (int m = 0; m < model_count; m++)
+    {
+        int triangles = models[m].index_count / 3;
+        cluster_capacity += (triangles + OCCLUSION_CLUSTER_TRIANGLES - 1) / OCCLUSION_CLUSTER_TRIANGLES;
+    }
+    culler->clusters = allocate_or_die((size_t)cluster_capacity * sizeof(OcclusionCluster));
+    culler->occluders = allocate_or_die((size_t)model_count * sizeof(Occluder));
+
+    int most_occluder_vertices = 0;
+    for (int m = 0; m < model_count; m++)
+    {
+        const SceneModel *model = &models[m];
+        const unsigned int *indices = &mesh->indices[model->first_index];
+        const float *vertices = &mesh->vertices[(size_t)model->base_vertex * GPU_VERTEX_FLOATS];
+
+        for (int first = 0; first < model->index_count; first += OCCLUSION_CLUSTER_TRIANGLES * 3)
+        {
+            OcclusionCluster *cluster = &culler->clusters[culler->cluster_count++];
+            cluster->first_index = model->first_index + first;
+            cluster->index_count = model->index_count - first < OCCLUSION_CLUSTER_TRIANGLES * 3 ? model->index_count - first : OCCLUSION_CLUSTER_TRIANGLES * 3;
+            cluster->base_vertex = model->base_vertex;
+            for (int i = 0; i < 3; i++)
+            {
+                cluster->min[i] = FLT_MAX;
+                cluster->max[i] = -FLT_MAX;
+            }
+            for (int i = first; i < first + cluster->index_count; i++)
+            {
+                grow_box(&vertices[(size_t)indices[i] * GPU_VERTEX_FLOATS], cluster->min, cluster->max);
+            }
+        }
+
+        if (occluder_names && name_listed(occluder_names, model->name) && model->index_count > 0)
+        {
+            Occluder *occluder = &culler->occluders[culler->occluder_count++];
+            float error = build_occluder(model, mesh, occluder);
+            culler->occluder_triangles += occluder->index_count / 3;
+            culler->depth_bias = fmaxf(culler->depth_bias, error);
+            most_occluder_vertices = occluder->vertex_count > most_occluder_vertices ? occluder->vertex_count : most_occluder_vertices;
+        }
+    }
+
+    if (occluder_names && culler->occluder_count == 0)
+    {
+        printf("No scene model is named in %s, culling to the view only\n", occluder_names);
+    }
+
+    for (int level = 0; level < OCCLUSION_LEVELS; level++)
+    {
+        int size = OCCLUSION_SIZE >> level;
+        culler->levels[level] = allocate_or_die((size_t)size * size * sizeof(float));
+    }
+    culler->screen = allocate_or_die((size_t)most_occluder_vertices * 3 * sizeof(float));
+
+    return culler->occluder_count;
+}
+
+// Keeps the nearest occluder per pixel center, both windings, so closed
+// meshes need no culling of their own. Shared edges may be drawn twice,
+// which costs nothing for depth alone.
+static void raster_occluder_triangle(float *depth, const float *p0, const float *p1, const float *p2)
+{
+    float x[3] = {p0[0], p1[0], p2[0]};
+    float y[3] = {p0[1], p1[1], p2[1]};
+    float z[3] = {p0[2], p1[2], p2[2]};
+
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0.0f)
+    {
+        return;
+    }
+
+    // Edge i faces vertex i, positive inside either way round
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    float a[3], b[3], c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        a[i] = sign * (y[j] - y[k]);
+        b[i] = sign * (x[k] - x[j]);
+        c[i] = sign * (x[j] * y[k] - x[k] * y[j]);
+    }
+
+    // 1 / w is linear in screen space, unlike w
+    float plane_x = (a[0] * z[0] + a[1] * z[1] + a[2] * z[2]) * sign / area;
+    float plane_y = (b[0] * z[0] + b[1] * z[1] + b[2] * z[2]) * sign / area;
+    float plane_c = (c[0] * z[0] + c[1] * z[1] + c[2] * z[2]) * sign / area;
+
+    int x0 = (int)fmaxf(ceilf(fminf(x[0], fminf(x[1], x[2])) - 0.5f), 0.0f);
+    int x1 = (int)fminf(floorf(fmaxf(x[0], fmaxf(x[1], x[2])) - 0.5f), OCCLUSION_SIZE - 1.0f);
+    int y0 = (int)fmaxf(ceilf(fminf(y[0], fminf(y[1], y[2])) - 0.5f), 0.0f);
+    int y1 = (int)fminf(floorf(fmaxf(y[0], fmaxf(y[1], y[2])) - 0.5f), OCCLUSION_SIZE - 1.0f);
+
+    const VecFloat4 lane_offsets = {0.5f, 1.5f, 2.5f, 3.5f};
+    const VecInt4 lane_index = {0, 1, 2, 3};
+
+    for (int py = y0; py <= y1; py++)
+    {
+        float center_y = py + 0.5f;
+        float *row = &depth[py * OCCLUSION_SIZE];
+
+        for (int px = x0 & ~3; px <= x1; px += 4)
+        {
+            VecFloat4 center_x = (float)px + lane_offsets;
+            VecInt4 lane = px + lane_index;
+
+            VecInt4 covered = (lane >= x0) & (lane <= x1);
+            for (int i = 0; i < 3; i++)
+            {
+                covered &= a[i] * center_x + (b[i] * center_y + c[i]) >= 0.0f;
+            }
+
+            VecFloat4 inverse_w = plane_x * center_x + (plane_y * center_y + plane_c);
+            VecFloat4 stored;
+            memcpy(&stored, &row[px], sizeof(VecFloat4));
+            covered &= inverse_w > stored;
+
+            VecInt4 bits = ((VecInt4)inverse_w & covered) | ((VecInt4)stored & ~covered);
+            memcpy(&row[px], &bits, sizeof(VecFloat4));
+        }
+    }
+}
+
+static void draw_occluders(OcclusionCuller *culler, const Mat4 *model_view_projection)
+{
+    float *depth = culler->levels[0];
+    memset(depth, 0, (size_t)OCCLUSION_SIZE * OCCLUSION_SIZE * sizeof(float));
+
+    for (int o = 0; o < culler->occluder_count; o++)
+    {
+        const Occluder *occluder = &culler->occluders[o];
+        for (int v = 0; v < occluder->vertex_count; v++)
+        {
+            const float *position = &occluder->positions[(size_t)v * 3];
+            Vec4 clip = mat4_transform(model_view_projection, vec4(position[0], position[1], position[2], 1.0f));
+            float *screen = &culler->screen[(size_t)v * 3];
+
+            // Marked for the triangles to skip, leaving out part of an
+            // occluder only ever hides less
+            if (clip[3] < SHADER_NEAR_PLANE)
+            {
+                screen[2] = -1.0f;
+                continue;
+            }
+            float inverse_w = 1.0f / clip[3];
+            screen[0] = (clip[0] * inverse_w * 0.5f + 0.5f) * OCCLUSION_SIZE;
+            screen[1] = (clip[1] * inverse_w * 0.5f + 0.5f) * OCCLUSION_SIZE;
+            screen[2] = inverse_w;
+        }
+
+        for (int i = 0; i < occluder->index_count; i += 3)
+        {
+            const float *p0 = &culler->screen[(size_t)occluder->indices[i] * 3];
+            const float *p1 = &culler->screen[(size_t)occluder->indices[i + 1] * 3];
+            const float *p2 = &culler->screen[(size_t)occluder->indices[i + 2] * 3];
+            if (p0[2] > 0.0f && p1[2] > 0.0f && p2[2] > 0.0f)
+            {
+                raster_occluder_triangle(depth, p0, p1, p2);
+            }
+        }
+    }
+
+    for (int level = 1; level < OCCLUSION_LEVELS; level++)
+    {
+        const float *finer = culler->levels[level - 1];
+        float *coarser = culler->levels[level];
+        int size = OCCLUSION_SIZE >> level;
+        for (int y = 0; y < size; y++)
+        {
+            const float *top = &finer[(size_t)y * 2 * size * 2];
+            const float *bottom = top + size * 2;
+            for (int x = 0; x < size; x++)
+            {
+                coarser[y * size + x] = fminf(fminf(top[x * 2], top[x * 2 + 1]), fminf(bottom[x * 2], bottom[x * 2 + 1]));
+            }
+        }
+    }
+}
+
+// Every plane's most inward corner outside means the whole box is
+static int box_outside_frustum(const OcclusionCluster *cluster, const float planes[6][4])
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const float *plane = planes[p];
+        float distance = plane[3];
+        for (int i = 0; i < 3; i++)
+        {
+            distance += plane[i] * (plane[i] >= 0.0f ? cluster->max[i] : cluster->min[i]);
+        }
+        if (distance < 0.0f)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int box_occluded(const OcclusionCuller *culler, const OcclusionCluster *cluster, const Mat4 *model_view_projection)
+{
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+    float nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        Vec4 position = vec4(corner & 1 ? cluster->max[0] : cluster->min[0], corner & 2 ? cluster->max[1] : cluster->min[1], corner & 4 ? cluster->max[2] : cluster->min[2], 1.0f);
+        Vec4 clip = mat4_transform(model_view_projection, position);
+
+        // Crossing the near plane, too close to say
+        if (clip[3] < SHADER_NEAR_PLANE)
+        {
+            return 0;
+        }
+        float x = (clip[0] / clip[3] * 0.5f + 0.5f) * OCCLUSION_SIZE;
+        float y = (clip[1] / clip[3] * 0.5f + 0.5f) * OCCLUSION_SIZE;
+        min_x = fminf(min_x, x);
+        max_x = fmaxf(max_x, x);
+        min_y = fminf(min_y, y);
+        max_y = fmaxf(max_y, y);
+        nearest = fminf(nearest, clip[3]);
+    }
+
+    // Every pixel the box touches, not just the centers it covers, so a
+    // gap in the occluders under the box's edge keeps it visible
+    int x0 = (int)fmaxf(floorf(min_x), 0.0f);
+    int x1 = (int)fminf(floorf(max_x), OCCLUSION_SIZE - 1.0f);
+    int y0 = (int)fmaxf(floorf(min_y), 0.0f);
+    int y1 = (int)fminf(floorf(max_y), OCCLUSION_SIZE - 1.0f);
+    if (x0 > x1 || y0 > y1)
+    {
+        // Off the buffer, it has nothing to say about the box
+        return 0;
+    }
+
+    // The finest level where the rectangle spans at most 2 x 2 texels
+    int level = 0;
+    while (level + 1 < OCCLUSION_LEVELS && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+    {
+        level++;
+    }
+
+    const float *texels = culler->levels[level];
+    int size = OCCLUSION_SIZE >> level;
+    float farthest = FLT_MAX;
+    for (int y = y0 >> level; y <= y1 >> level; y++)
+    {
+        for (int x = x0 >> level; x <= x1 >> level; x++)
+        {
+            farthest = fminf(farthest, texels[y * size + x]);
+        }
+    }
+
+    // 0 is a pixel no occluder covers
+    return farthest > 0.0f && nearest > 1.0f / farthest + culler->depth_bias;
+}
+
+int cull_occluded_clusters(OcclusionCuller *culler, const Mat4 *model_view_projection, size_t index_size, int *counts, const void **offsets, int *base_vertices)
+{
+    double start = getTimeSeconds();
+
+    if (culler->occluder_count > 0)
+    {
+        draw_occluders(culler, model_view_projection);
+    }
+
+    MeshletView view;
+    const float eye[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    meshlet_view_from_matrix((const float *)model_view_projection->columns, eye, &view);
+
+    OcclusionStats *stats = &culler->stats;
+    int draw_count = 0;
+    int last_end = -1;
+    for (int c = 0; c < culler->cluster_count; c++)
+    {
+        const OcclusionCluster *cluster = &culler->clusters[c];
+        stats->triangles += cluster->index_count / 3;
+
+        if (box_outside_frustum(cluster, view.planes))
+        {
+            stats->frustum_culled += cluster->index_count / 3;
+            continue;
+        }
+        if (culler->occluder_count > 0 && box_occluded(culler, cluster, model_view_projection))
+        {
+            stats->occlusion_culled += cluster->index_count / 3;
+            continue;
+        }
+
+        // Runs of the same model continue the previous draw
+        if (draw_count > 0 && cluster->first_index == last_end && cluster->base_vertex == base_vertices[draw_count - 1])
+        {
+            counts[draw_count - 1] += cluster->index_count;
+        }
+        else
+        {
+            counts[draw_count] = cluster->index_count;
+            offsets[draw_count] = (const void *)((size_t)cluster->first_index * index_size);
+            base_vertices[draw_count] = cluster->base_vertex;
+            draw_count++;
+        }
+        last_end = cluster->first_index + cluster->index_count;
+    }
+
+    double milliseconds = (getTimeSeconds() - start) * 1000.0;
+    stats->frames++;
+    stats->milliseconds += milliseconds;
+    stats->worst_milliseconds = fmax(stats->worst_milliseconds, milliseconds);
+    stats->draws += draw_count;
+    return draw_count;
+}
+
+void print_occlusion_stats(const OcclusionStats *stats, const char *label)
+{
+    double frames = stats->frames > 0 ? stats->frames : 1;
+    double triangles = stats->triangles > 0 ? (double)stats->triangles : 1.0;
+    double culled = (double)(stats->frustum_culled + stats->occlusion_culled);
+
+    printf("Occlusion culling %s: %.3f ms per frame (worst %.3f), %.0f of %.0f triangles culled (%.1f%%: %.1f%% frustum, %.1f%% occlusion), %.1f draws\n", label, stats->milliseconds / frames, stats->worst_milliseconds, culled / frames, stats->triangles / frames, 100.0 * culled / triangles, 100.0 * stats->frustum_culled / triangles, 100.0 * stats->occlusion_culled / triangles, stats->draws / frames);
+}
+
+void benchmark_occlusion_culling(OcclusionCuller *culler, int steps)
+{
+    int *counts = allocate_or_die((size_t)culler->cluster_count * sizeof(int));
+    const void **offsets = allocate_or_die((size_t)culler->cluster_count * sizeof(void *));
+    int *base_vertices = allocate_or_die((size_t)culler->cluster_count * sizeof(int));
+
+    OcclusionStats saved = culler->stats;
+    memset(&culler->stats, 0, sizeof(OcclusionStats));
+
+    for (int step = 0; step < steps; step++)
+    {
+        ShaderTransforms transforms;
+        shader_transforms(6.2831853f * step / steps, 1.0f, &transforms);
+        cull_occluded_clusters(culler, &transforms.model_view_projection, sizeof(unsigned int), counts, offsets, base_vertices);
+    }
+
+    char label[128];
+    snprintf(label, sizeof(label), "over %d views, %d clusters, %d occluder triangles", steps, culler->cluster_count, culler->occluder_triangles);
+    print_occlusion_stats(&culler->stats, label);
+
+    culler->stats = saved;
+    free(counts);
+    free(offsets);
+    free(base_vertices);
+}
+
+void free_occlusion_culler(OcclusionCuller *culler)
+{
+    for (int o = 0; o < culler->occluder_count; o++)
+    {
+        free(culler->occluders[o].positions);
+        free(culler->occluders[o].indices);
+    }
+    free(culler->occluders);
+    free(culler->clusters);
+    for (int level = 0; level < OCCLUSION_LEVELS; level++)
+    {
+        free(culler->levels[level]);
+    }
+    free(culler->screen);
+    memset(culler, 0, sizeof(OcclusionCuller));
+}
\ No newline at end of file
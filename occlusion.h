@@ -0,0 +1,95 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <stddef.h>
+#include "mesh.h"
+#include "scene.h"
+#include "vecMath.h"
+
+// Occluders are drawn into a square depth buffer this size whatever the
+// window size, NDC stretched over it. A multiple of 4 for the SIMD rows and
+// a power of two for the pyramid.
+#define OCCLUSION_SIZE 256
+#define OCCLUSION_LEVELS 9 // 256 x 256 down to 1 x 1
+
+// Scene models are tested in runs of this many triangles in index buffer
+// order, each with its own box
+#define OCCLUSION_CLUSTER_TRIANGLES 256
+
+// Occluders are drawn with the coarsest LOD whose error is at most this
+// fraction of the model's box diagonal
+#define OCCLUSION_OCCLUDER_ERROR 0.03f
+
+// A run of one scene model's triangles, drawn with glMultiDrawElementsBaseVertex
+typedef struct
+{
+    int first_index;
+    int index_count;
+    int base_vertex;
+    float min[3]; // Model space box
+    float max[3];
+} OcclusionCluster;
+
+// A simplified scene model, positions only
+typedef struct
+{
+    float *positions; // xyz per vertex
+    int vertex_count;
+    unsigned int *indices;
+    int index_count;
+} Occluder;
+
+// Running totals over every cull
+typedef struct
+{
+    int frames;
+    double milliseconds;
+    double worst_milliseconds;
+    long long triangles;        // What drawing everything submits
+    long long frustum_culled;   // Triangles outside the view
+    long long occlusion_culled; // Triangles in view, behind an occluder
+    long long draws;
+} OcclusionStats;
+
+typedef struct
+{
+    OcclusionCluster *clusters;
+    int cluster_count;
+    Occluder *occluders;
+    int occluder_count;
+    int occluder_triangles;
+
+    // Occluders are drawn up to this much closer than the models they
+    // simplify, so a box has to be this much further back to be hidden
+    float depth_bias;
+
+    // Inverse view distance, 0 where no occluder was drawn. Level 0 is the
+    // buffer, every level after it keeps the farthest (smallest) of 2 x 2.
+    float *levels[OCCLUSION_LEVELS];
+    float *screen; // Per occluder vertex x, y in pixels and 1 / w, reused
+
+    OcclusionStats stats;
+} OcclusionCuller;
+
+// Clusters every model of a scene and simplifies the models named in the
+// comma separated occluder_names into occluders. Indices are the models'
+// own, as in Scene. Returns the number of occluders.
+int build_occlusion_culler(OcclusionCuller *culler, const SceneModel *models, int model_count, const GpuMesh *mesh, const char *occluder_names);
+
+// Draws the occluders with the model view projection matrix vertexShader.glsl
+// uses, then writes one draw per run of clusters that are inside the
+// frustum and not hidden behind the occluders, adjacent survivors of a
+// model merged. The arrays need room for cluster_count draws. Returns the
+// number of draws and adds the frame to culler->stats.
+int cull_occluded_clusters(OcclusionCuller *culler, const Mat4 *model_view_projection, size_t index_size, int *counts, const void **offsets, int *base_vertices);
+
+// Average and worst milliseconds per cull and the triangles culled
+void print_occlusion_stats(const OcclusionStats *stats, const char *label);
+
+// Culls against the shader view at steps times through a full turn and
+// prints the cost and the triangles culled, culler->stats left as they were
+void benchmark_occlusion_culling(OcclusionCuller *culler, int steps);
+
+void free_occlusion_culler(OcclusionCuller *culler);
+
+#endif // OCCLUSION_H
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "procedural.h"
+
+static float grid_height(float x, float z)
+{
+    return 0.1f * sinf(x * 6.0f) * cosf(z * 6.0f);
+}
+
+int write_grid_model(const char *name, int cells)
+{
+    char objFilename[1024], mtlFilename[1024];
+    snprintf(objFilename, sizeof(objFilename), "%s.obj", name);
+    snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", name);
+
+    FILE *mtl = fopen(mtlFilename, "w");
+    if (!mtl)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+    fprintf(mtl, "newmtl GridA\nKd 0.800000 0.300000 0.200000\nKs 0.500000 0.500000 0.500000\nNs 250.000000\nd 1.000000\n\n");
+    fprintf(mtl, "newmtl GridB\nKd 0.200000 0.400000 0.800000\nKs 0.500000 0.500000 0.500000\nNs 250.000000\nd 1.000000\n");
+    fclose(mtl);
+
+    FILE *obj = fopen(objFilename, "w");
+    if (!obj)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+
+    fprintf(obj, "# Procedural %dx%d grid\nmtllib %s.mtl\no Grid\n", cells, cells, name);
+
+    int side = cells + 1;
+    float step = 2.0f / cells;
+
+    for (int row = 0; row < side; row++)
+    {
+        for (int column = 0; column < side; column++)
+        {
+            float x = -1.0f + column * step;
+            float z = -1.0f + row * step;
+            fprintf(obj, "v %f %f %f\n", x, grid_height(x, z), z);
+        }
+    }
+
+    for (int row = 0; row < side; row++)
+    {
+        for (int column = 0; column < side; column++)
+        {
+            fprintf(obj, "vt %f %f\n", (float)column / cells, (float)row / cells);
+        }
+    }
+
+    for (int row = 0; row < side; row++)
+    {
+        for (int column = 0; column < side; column++)
+        {
+            // Normal of the height field from central differences
+            float x = -1.0f + column * step;
+            float z = -1.0f + row * step;
+            float dx = (grid_height(x + step, z) - grid_height(x - step, z)) / (2.0f * step);
+            float dz = (grid_height(x, z + step) - grid_height(x, z - step)) / (2.0f * step);
+            float length = sqrtf(dx * dx + 1.0f + dz * dz);
+            fprintf(obj, "vn %f %f %f\n", -dx / length, 1.0f / length, -dz / length);
+        }
+    }
+
+    for (int row = 0; row < cells; row++)
+    {
+        if (row == 0 || row == cells / 2)
+        {
+            fprintf(obj, "usemtl %s\n", row == 0 ? "GridA" : "GridB");
+        }
+
+        for (int column = 0; column < cells; column++)
+        {
+            // OBJ indices are 1-based, position, texcoord and normal share them
+            int a = row * side + column + 1;
+            int b = a + 1;
+            int c = a + side;
+            int d = c + 1;
+            fprintf(obj, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+            fprintf(obj, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+        }
+    }
+
+    if (fclose(obj) != 0)
+    {
+        perror("Failed to write file");
+        return 0;
+    }
+
+    return 1;
+}
+
+int write_fan_model(const char *name, int triangles)
+{
+    char objFilename[1024], mtlFilename[1024];
+    snprintf(objFilename, sizeof(objFilename), "%s.obj", name);
+    snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", name);
+
+    FILE *mtl = fopen(mtlFilename, "w");
+    if (!mtl)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+    fprintf(mtl, "newmtl Fan\nKd 0.600000 0.600000 0.600000\nKs 0.500000 0.500000 0.500000\nNs 250.000000\nd 1.000000\n");
+    fclose(mtl);
+
+    FILE *obj = fopen(objFilename, "w");
+    if (!obj)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+
+    fprintf(obj, "# Procedural %d triangle fan\nmtllib %s.mtl\no Fan\n", triangles, name);
+
+    // The apex first, then the rim, so the apex is vertex 1
+    fprintf(obj, "v 0.000000 1.000000 0.000000\n");
+    for (int i = 0; i < triangles; i++)
+    {
+        float angle = 2.0f * (float)M_PI * (float)i / (float)triangles;
+        fprintf(obj, "v %f 0.000000 %f\n", cosf(angle), sinf(angle));
+    }
+
+    fprintf(obj, "usemtl Fan\n");
+    for (int i = 0; i < triangles; i++)
+    {
+        fprintf(obj, "f 1 %d %d\n", (i + 1) % triangles + 2, i + 2);
+    }
+
+    if (fclose(obj) != 0)
+    {
+        perror("Failed to write file");
+        return 0;
+    }
+
+    return 1;
+}
+
+void build_placeholder_mesh(float radius, GpuMesh *mesh)
+{
+    mesh->vertex_count = 24;
+    mesh->index_count = 24;
+    mesh->vertices = malloc((size_t)mesh->vertex_count * GPU_VERTEX_FLOATS * sizeof(float));
+    mesh->indices = malloc((size_t)mesh->index_count * sizeof(unsigned int));
+    if (!mesh->vertices || !mesh->indices)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    // One face per octant, its own three vertices so the normals stay flat
+    float inverseSqrt3 = 1.0f / sqrtf(3.0f);
+    for (int face = 0; face < 8; face++)
+    {
+        float sign[3] = {face & 1 ? -1.0f : 1.0f, face & 2 ? -1.0f : 1.0f, face & 4 ? -1.0f : 1.0f};
+        for (int corner = 0; corner < 3; corner++)
+        {
+            int vertex = face * 3 + corner;
+            float *out = &mesh->vertices[(size_t)vertex * GPU_VERTEX_FLOATS];
+            for (int i = 0; i < 3; i++)
+            {
+                out[i] = i == corner ? sign[i] * radius : 0.0f;
+                out[3 + i] = PLACEHOLDER_GRAY;
+                out[6 + i] = sign[i] * inverseSqrt3;
+            }
+            mesh->indices[vertex] = (unsigned int)vertex;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef PROCEDURAL_H
+#define PROCEDURAL_H
+
+#include "mesh.h"
+
+// Gray of the placeholder shown while the real mesh is still loading
+#define PLACEHOLDER_GRAY 0.6f
+
+// Writes <name>.obj and <name>.mtl: a cells x cells height field with
+// 2 * cells * cells triangles, smooth normals, texture coordinates and two
+// materials split down the middle. For stress testing the loader and the
+// upload path at sizes none of the bundled models reach.
+int write_grid_model(const char *name, int cells);
+
+// Writes <name>.obj and <name>.mtl: a cone of triangles faces all sharing
+// the apex, without normals. For the cost of positions with thousands of
+// corners, which generate_mesh_normals has to smooth.
+int write_fan_model(const char *name, int triangles);
+
+// Flat shaded octahedron with its corners radius from the origin, in the
+// GPU vertex layout, for drawing something before any model is ready.
+// Free with free_gpu_mesh.
+void build_placeholder_mesh(float radius, GpuMesh *mesh);
+
+#endif // PROCEDURAL_H
\ No newline at end of file
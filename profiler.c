@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "profiler.h"
+
+typedef struct ProfileRing
+{
+    struct ProfileRing *next;
+    int thread; // In order of first record
+    uint64_t written; // Events ever recorded, published with release stores
+    ProfileEvent events[PROFILER_RING_EVENTS];
+} ProfileRing;
+
+// Every thread's ring, pushed with a compare and swap
+static ProfileRing *rings = NULL;
+static int ring_count = 0;
+
+static _Thread_local ProfileRing *thread_ring = NULL;
+
+uint64_t profiler_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static ProfileRing *create_thread_ring()
+{
+    ProfileRing *ring = malloc(sizeof(ProfileRing));
+    if (!ring)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    ring->thread = __atomic_fetch_add(&ring_count, 1, __ATOMIC_RELAXED);
+    ring->written = 0;
+
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+    }
+
+    thread_ring = ring;
+    return ring;
+}
+
+void profiler_record(const char *name, uint64_t begin, uint64_t end)
+{
+    ProfileRing *ring = thread_ring ? thread_ring : create_thread_ring();
+
+    // Only this thread writes the ring, readers see up to written
+    uint64_t slot = ring->written;
+    ProfileEvent *event = &ring->events[slot % PROFILER_RING_EVENTS];
+    event->name = name;
+    event->begin = begin;
+    event->end = end;
+    __atomic_store_n(&ring->written, slot + 1, __ATOMIC_RELEASE);
+}
+
+// First kept event and event count of a ring
+static uint64_t ring_events(const ProfileRing *ring, uint64_t *first)
+{
+    uint64_t written = __atomic_load_n(&ring->written, __ATOMIC_ACQUIRE);
+    *first = written > PROFILER_RING_EVENTS ? written - PROFILER_RING_EVENTS : 0;
+    return written - *first;
+}
+
+static ProfileRing *first_ring()
+{
+    return __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+}
+
+int write_chrome_trace(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+
+    // Timestamps from the earliest kept event, in microseconds
+    uint64_t origin = UINT64_MAX;
+    for (ProfileRing *ring = first_ring(); ring; ring = ring->next)
+    {
+        uint64_t first;
+        uint64_t count = ring_events(ring, &first);
+        for (uint64_t i = first; i < first + count; i++)
+        {
+            uint64_t begin = ring->events[i % PROFILER_RING_EVENTS].begin;
+            origin = begin < origin ? begin : origin;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char *separator = "";
+    for (ProfileRing *ring = first_ring(); ring; ring = ring->next)
+    {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}", separator, ring->thread, ring->thread == 0 ? "main" : "thread", ring->thread);
+        separator = ",\n";
+
+        uint64_t first;
+        uint64_t count = ring_events(ring, &first);
+        for (uint64_t i = first; i < first + count; i++)
+        {
+            const ProfileEvent *event = &ring->events[i % PROFILER_RING_EVENTS];
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", event->name, ring->thread, (event->begin - origin) / 1000.0, (event->end - event->begin) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    fclose(file);
+    return 1;
+}
+
+static int compare_events(const void *a, const void *b)
+{
+    const ProfileEvent *x = (const ProfileEvent *)a;
+    const ProfileEvent *y = (const ProfileEvent *)b;
+    int byName = strcmp(x->name, y->name);
+    if (byName != 0)
+    {
+        return byName;
+    }
+    uint64_t durationX = x->end - x->begin, durationY = y->end - y->begin;
+    return (durationX > durationY) - (durationX < durationY);
+}
+
+// Nearest rank, sorted by duration
+static double percentile_ms(const ProfileEvent *events, uint64_t count, double p)
+{
+    uint64_t rank = (uint64_t)(p * (double)(count - 1) + 0.5);
+    return (events[rank].end - events[rank].begin) / 1e6;
+}
+
+int write_profile_percentiles(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+
+    uint64_t total = 0;
+    for (ProfileRing *ring = first_ring(); ring; ring = ring->next)
+    {
+        uint64_t first;
+        total += ring_events(ring, &first);
+    }
+
+    // Every thread's spans together, grouped by name and sorted by length
+    ProfileEvent *events = malloc((total + 1) * sizeof(ProfileEvent));
+    if (!events)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t gathered = 0;
+    for (ProfileRing *ring = first_ring(); ring; ring = ring->next)
+    {
+        uint64_t first;
+        uint64_t count = ring_events(ring, &first);
+        for (uint64_t i = first; i < first + count && gathered < total; i++)
+        {
+            events[gathered++] = ring->events[i % PROFILER_RING_EVENTS];
+        }
+    }
+    qsort(events, (size_t)gathered, sizeof(ProfileEvent), compare_events);
+
+    fprintf(file, "phase,count,total_ms,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+    for (uint64_t begin = 0, end; begin < gathered; begin = end)
+    {
+        double sum = 0.0;
+        for (end = begin; end < gathered && strcmp(events[end].name, events[begin].name) == 0; end++)
+        {
+            sum += (events[end].end - events[end].begin) / 1e6;
+        }
+
+        const ProfileEvent *group = &events[begin];
+        uint64_t count = end - begin;
+        fprintf(file, "%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", group->name, (unsigned long long)count, sum, sum / count, percentile_ms(group, count, 0.5), percentile_ms(group, count, 0.9), percentile_ms(group, count, 0.99), percentile_ms(group, count, 1.0));
+    }
+
+    free(events);
+    fclose(file);
+    return 1;
+}
+
+void free_profiler()
+{
+    ProfileRing *ring = __atomic_exchange_n(&rings, NULL, __ATOMIC_ACQUIRE);
+    while (ring)
+    {
+        ProfileRing *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    ring_count = 0;
+    thread_ring = NULL;
+}
\ No newline at end of file
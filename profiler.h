@@ -0,0 +1,86 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+// Timed spans, recorded only when built with -DPROFILER. Without it every
+// PROFILE_ macro below expands to nothing and the hot paths are untouched.
+//
+// Each thread appends to its own ring of PROFILER_RING_EVENTS events, no
+// locks and no shared cache lines while recording. A ring that wraps keeps
+// the newest events. Rings stay around after their thread exits so that
+// short-lived workers still show up in the export.
+#define PROFILER_RING_EVENTS 32768
+
+// Names must be string literals, only the pointer is kept
+typedef struct
+{
+    const char *name;
+    uint64_t begin; // Nanoseconds, monotonic
+    uint64_t end;
+} ProfileEvent;
+
+uint64_t profiler_now();
+
+void profiler_record(const char *name, uint64_t begin, uint64_t end);
+
+// Every recorded span as Chrome trace JSON, for chrome://tracing or
+// Perfetto. Returns 0 if the file can't be written.
+int write_chrome_trace(const char *filename);
+
+// Per span name: count, total, mean, median, p90, p99 and max in
+// milliseconds, one CSV row each. Render loop phases are recorded once a
+// frame, so these are their frame time percentiles. Returns 0 if the file
+// can't be written.
+int write_profile_percentiles(const char *filename);
+
+// Only once no thread records anymore
+void free_profiler();
+
+typedef struct
+{
+    const char *name;
+    uint64_t begin;
+} ProfileScope;
+
+static inline void end_profile_scope(ProfileScope *scope)
+{
+    profiler_record(scope->name, scope->begin, profiler_now());
+}
+
+// Consecutive steps of one kind merged into a single span, for loops too
+// hot to time step by step. A new name closes the running span, NULL
+// closes it for good.
+static inline void profile_run_step(ProfileScope *run, const char *name)
+{
+    if (run->name != name)
+    {
+        uint64_t now = profiler_now();
+        if (run->name)
+        {
+            profiler_record(run->name, run->begin, now);
+        }
+        run->name = name;
+        run->begin = now;
+    }
+}
+
+#ifdef PROFILER
+// Times the rest of the enclosing block
+#define PROFILE_SCOPE(name) ProfileScope profile_scope_##name __attribute__((cleanup(end_profile_scope))) = {#name, profiler_now()}
+// Times from PROFILE_BEGIN to the matching PROFILE_END in the same block
+#define PROFILE_BEGIN(name) uint64_t profile_begin_##name = profiler_now()
+#define PROFILE_END(name) profiler_record(#name, profile_begin_##name, profiler_now())
+#define PROFILE_RUN(run) ProfileScope run = {NULL, 0}
+#define PROFILE_RUN_STEP(run, name) profile_run_step(&run, #name)
+#define PROFILE_RUN_END(run) profile_run_step(&run, NULL)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(name)
+#define PROFILE_RUN(run)
+#define PROFILE_RUN_STEP(run, name)
+#define PROFILE_RUN_END(run)
+#endif
+
+#endif // PROFILER_H
\ No newline at end of file
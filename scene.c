@@ -0,0 +1,247 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scene.h"
+#include "meshCache.h"
+#include "meshNormals.h"
+#include "meshOptimize.h"
+#include "threads.h"
+#include "utils.h"
+#include "vertexPack.h"
+
+// Per model results, filled on whichever thread loaded it
+typedef struct
+{
+    Scene *scene;
+    uint32_t cache_flags;
+    MeshCache *caches; // Mapped when the model came from its cache
+    GpuMesh *meshes;   // Built otherwise
+    Material **materials;
+} SceneLoad;
+
+static void load_scene_model_task(void *context, int index)
+{
+    SceneLoad *load = (SceneLoad *)context;
+    SceneModel *model = &load->scene->models[index];
+    double start = getTimeSeconds();
+
+    char objFilename[1024], mtlFilename[1024];
+    snprintf(objFilename, sizeof(objFilename), "%s.obj", model->name);
+    snprintf(mtlFilename, sizeof(mtlFilename), "%s.mtl", model->name);
+
+    // Everything below interns into this thread's material table, which is
+    // what keeps the models' material names apart
+    free_materials();
+
+    if (load_mesh_cache(objFilename, mtlFilename, load->cache_flags, &load->caches[index]))
+    {
+        load_material_table(load->caches[index].materials, load->caches[index].material_count);
+        model->vertex_count = load->caches[index].vertex_count;
+        model->index_count = load->caches[index].index_count;
+        model->from_cache = 1;
+    }
+    else
+    {
+        Vertex *vertices = NULL;
+        TexCoord *texCoords = NULL;
+        Normal *normals = NULL;
+        Face *faces = NULL;
+        int vertex_count = 0, vertex_capacity = 0;
+        int texCoord_count = 0, texCoord_capacity = 0;
+        int normal_count = 0, normal_capacity = 0;
+        int face_count = 0, face_capacity = 0;
+
+        read_mtl_file(mtlFilename);
+        read_obj_file(objFilename, &vertices, &vertex_count, &vertex_capacity, &texCoords, &texCoord_count, &texCoord_capacity, &normals, &normal_count, &normal_capacity, &faces, &face_count, &face_capacity);
+        // Models already load in parallel, one thread each is enough
+        repair_mesh_normals(vertices, vertex_count, texCoords, texCoord_count, faces, face_count, 1, &normals, &normal_count, &normal_capacity);
+
+        // Sorted like a single model load, so the cache serves both
+        MaterialRange *ranges = NULL;
+        int range_count = sort_faces_by_material(faces, face_count, &ranges);
+        GpuMesh *mesh = &load->meshes[index];
+        build_gpu_mesh(vertices, vertex_count, normals, normal_count, faces, face_count, mesh);
+        free(vertices);
+        free(texCoords);
+        free(normals);
+        free(faces);
+
+        if (load->cache_flags & MESH_CACHE_OPTIMIZED)
+        {
+            optimize_gpu_mesh(mesh, ranges, range_count, NULL);
+        }
+        write_mesh_cache(objFilename, mtlFilename, load->cache_flags | MESH_CACHE_MATERIAL_RANGES, mesh, materials, material_count, ranges, range_count);
+        free(ranges);
+
+        model->vertex_count = mesh->vertex_count;
+        model->index_count = mesh->index_count;
+    }
+
+    // The next task on this thread starts the table over, keep a copy
+    model->material_count = material_count;
+    load->materials[index] = malloc(((size_t)material_count + 1) * sizeof(Material));
+    if (!load->materials[index])
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(load->materials[index], materials, (size_t)material_count * sizeof(Material));
+    free_materials();
+
+    model->milliseconds = (getTimeSeconds() - start) * 1000.0;
+}
+
+static int split_model_names(const char *names, Scene *scene)
+{
+    int capacity = 1;
+    for (const char *c = names; *c; c++)
+    {
+        capacity += *c == ',';
+    }
+
+    scene->models = calloc((size_t)capacity, sizeof(SceneModel));
+    if (!scene->models)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *begin = names;
+    while (*begin)
+    {
+        const char *end = strchr(begin, ',');
+        size_t length = end ? (size_t)(end - begin) : strlen(begin);
+        if (length > 0 && length < sizeof(scene->models[0].name))
+        {
+            memcpy(scene->models[scene->model_count++].name, begin, length);
+        }
+        begin += length + (end ? 1 : 0);
+    }
+
+    return scene->model_count;
+}
+
+// Copies one model's vertices into its grid cell, scaled to fit
+static void place_model(const float *source, int vertex_count, int cell, int columns, float *out)
+{
+    float min[3], max[3];
+    compute_position_bounds(source, vertex_count, GPU_VERTEX_FLOATS, min, max);
+
+    float extent = fmaxf(max[0] - min[0], fmaxf(max[1] - min[1], max[2] - min[2]));
+    float cell_size = 2.0f * SCENE_HALF_EXTENT / columns;
+    float scale = extent > 0.0f ? cell_size * SCENE_CELL_FILL / extent : 1.0f;
+
+    float target[3] = {
+        -SCENE_HALF_EXTENT + cell_size * (cell % columns + 0.5f),
+        SCENE_HALF_EXTENT - cell_size * (cell / columns + 0.5f),
+        0.0f};
+
+    for (int v = 0; v < vertex_count; v++)
+    {
+        const float *in = &source[(size_t)v * GPU_VERTEX_FLOATS];
+        float *vertex = &out[(size_t)v * GPU_VERTEX_FLOATS];
+
+        // A uniform scale leaves the normals as they are
+        memcpy(vertex, in, GPU_VERTEX_FLOATS * sizeof(float));
+        for (int i = 0; i < 3; i++)
+        {
+            vertex[i] = (in[i] - (min[i] + max[i]) * 0.5f) * scale + target[i];
+        }
+    }
+}
+
+int load_scene(const char *names, int thread_count, uint32_t cache_flags, Scene *scene)
+{
+    memset(scene, 0, sizeof(Scene));
+    int model_count = split_model_names(names, scene);
+
+    SceneLoad load;
+    load.scene = scene;
+    // Caches written with material ranges, LODs or by any other path
+    // satisfy this too, see mesh_cache_flags_satisfy
+    load.cache_flags = cache_flags & MESH_CACHE_OPTIMIZED;
+    load.caches = calloc((size_t)model_count + 1, sizeof(MeshCache));
+    load.meshes = calloc((size_t)model_count + 1, sizeof(GpuMesh));
+    load.materials = calloc((size_t)model_count + 1, sizeof(Material *));
+    if (!load.caches || !load.meshes || !load.materials)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    runParallel(model_count, thread_count > 0 ? thread_count : getCpuCount(), load_scene_model_task, &load);
+
+    // Models follow each other in the merged buffers, in list order
+    size_t vertex_total = 0, index_total = 0, material_total = 0;
+    for (int m = 0; m < model_count; m++)
+    {
+        SceneModel *model = &scene->models[m];
+        model->base_vertex = (int)vertex_total;
+        model->first_index = (int)index_total;
+        model->first_material = (int)material_total;
+        vertex_total += (size_t)model->vertex_count;
+        index_total += (size_t)model->index_count;
+        material_total += (size_t)model->material_count;
+    }
+
+    GpuMesh *mesh = &scene->mesh;
+    mesh->vertex_count = (int)vertex_total;
+    mesh->index_count = (int)index_total;
+    mesh->vertices = malloc((vertex_total + 1) * GPU_VERTEX_FLOATS * sizeof(float));
+    mesh->indices = malloc((index_total + 1) * sizeof(unsigned int));
+    scene->materials = malloc((material_total + 1) * sizeof(Material));
+    scene->material_count = (int)material_total;
+    if (!mesh->vertices || !mesh->indices || !scene->materials)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    int columns = 1;
+    while (columns * columns < model_count)
+    {
+        columns++;
+    }
+
+    for (int m = 0; m < model_count; m++)
+    {
+        SceneModel *model = &scene->models[m];
+        const float *vertices = model->from_cache ? load.caches[m].vertices : load.meshes[m].vertices;
+        const unsigned int *indices = model->from_cache ? load.caches[m].indices : load.meshes[m].indices;
+
+        place_model(vertices, model->vertex_count, m, columns, &mesh->vertices[(size_t)model->base_vertex * GPU_VERTEX_FLOATS]);
+        memcpy(&mesh->indices[model->first_index], indices, (size_t)model->index_count * sizeof(unsigned int));
+        memcpy(&scene->materials[model->first_material], load.materials[m], (size_t)model->material_count * sizeof(Material));
+
+        if (model->from_cache)
+        {
+            close_mesh_cache(&load.caches[m]);
+        }
+        free_gpu_mesh(&load.meshes[m]);
+        free(load.materials[m]);
+    }
+
+    free(load.caches);
+    free(load.meshes);
+    free(load.materials);
+    return model_count;
+}
+
+void scene_draws(const Scene *scene, size_t index_size, int *counts, const void **offsets, int *base_vertices)
+{
+    for (int m = 0; m < scene->model_count; m++)
+    {
+        counts[m] = scene->models[m].index_count;
+        offsets[m] = (const void *)((size_t)scene->models[m].first_index * index_size);
+        base_vertices[m] = scene->models[m].base_vertex;
+    }
+}
+
+void free_scene(Scene *scene)
+{
+    free(scene->models);
+    free_gpu_mesh(&scene->mesh);
+    free(scene->materials);
+    memset(scene, 0, sizeof(Scene));
+}
\ No newline at end of file
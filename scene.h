@@ -0,0 +1,58 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+#include "loader.h"
+#include "mesh.h"
+
+// Models are scaled and moved into the cells of a square grid spanning
+// this far either side of the origin, about what vertexShader.glsl shows
+// with w = 10
+#define SCENE_HALF_EXTENT 9.0f
+
+// Fraction of its cell a model fills
+#define SCENE_CELL_FILL 0.9f
+
+typedef struct
+{
+    char name[256];
+
+    // Where the model sits in the merged buffers. Indices are the model's
+    // own, drawn with base_vertex added by glMultiDrawElementsBaseVertex.
+    int base_vertex;
+    int vertex_count;
+    int first_index;
+    int index_count;
+
+    // The model's own materials, a namespace of their own in Scene.materials
+    int first_material;
+    int material_count;
+
+    int from_cache;
+    double milliseconds; // Loading and building on its thread
+} SceneModel;
+
+typedef struct
+{
+    SceneModel *models;
+    int model_count;
+    GpuMesh mesh; // Every model in one vertex and one index buffer
+    Material *materials;
+    int material_count;
+} Scene;
+
+// Loads a comma separated list of model names, NAME.obj and NAME.mtl each,
+// one model per task on thread_count threads (0 = one per core). Every
+// model goes through its own mesh cache with cache_flags, only
+// MESH_CACHE_OPTIMIZED is applied. Uses and then clears the material table
+// of every thread it runs on, the calling one included. Returns the number
+// of models.
+int load_scene(const char *names, int thread_count, uint32_t cache_flags, Scene *scene);
+
+// Draw arguments for glMultiDrawElementsBaseVertex, one draw per model.
+// The arrays need room for model_count entries.
+void scene_draws(const Scene *scene, size_t index_size, int *counts, const void **offsets, int *base_vertices);
+
+void free_scene(Scene *scene);
+
+#endif // SCENE_H
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+#include "shaderManager.h"
+#include "shaders.h"
+#include "utils.h"
+
+#define SHADER_CACHE_MAGIC "SHPC"
+
+static void permutation_defines(unsigned int permutation, char *defines, size_t size)
+{
+    snprintf(defines, size, "%s%s%s",
+             permutation & SHADER_PACKED_VERTICES ? "#define PACKED_VERTICES\n" : "",
+             permutation & SHADER_LUT_GRADING ? "#define LUT_GRADING\n" : "",
+             permutation & SHADER_INSTANCED ? "#define INSTANCED\n" : "");
+}
+
+static void shader_cache_path(unsigned int permutation, char *path, size_t size)
+{
+    snprintf(path, size, "shader_%u.programcache", permutation);
+}
+
+static uint64_t hash_string(const GLubyte *string, uint64_t hash)
+{
+    const char *text = string ? (const char *)string : "";
+    return hashBytes(text, strlen(text) + 1, hash);
+}
+
+void initShaderManager(ShaderManager *manager)
+{
+    memset(manager, 0, sizeof(ShaderManager));
+
+    uint64_t hash = HASH_SEED;
+    hash = hash_string(glGetString(GL_VENDOR), hash);
+    hash = hash_string(glGetString(GL_RENDERER), hash);
+    hash = hash_string(glGetString(GL_VERSION), hash);
+    hash = hash_string(glGetString(GL_SHADING_LANGUAGE_VERSION), hash);
+    manager->driverHash = hash;
+
+    // Some drivers have the entry points but no format to save in
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1)
+    {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    manager->binaryCache = formats > 0;
+
+    // As many compiler threads as the driver likes
+    manager->parallelCompile = GLEW_KHR_parallel_shader_compile;
+    if (manager->parallelCompile)
+    {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    }
+}
+
+static uint64_t program_key(const ShaderManager *manager, const char *vertexSource, const char *fragmentSource, const char *defines)
+{
+    uint64_t key = hashBytes(vertexSource, strlen(vertexSource) + 1, manager->driverHash);
+    key = hashBytes(fragmentSource, strlen(fragmentSource) + 1, key);
+    return hashBytes(defines, strlen(defines) + 1, key);
+}
+
+// NULL if the file can't be opened
+static void *read_cache_file(const char *path, ShaderCacheHeader *header)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    void *binary = NULL;
+    if (fread(header, sizeof(ShaderCacheHeader), 1, file) == 1 &&
+        memcmp(header->magic, SHADER_CACHE_MAGIC, 4) == 0 &&
+        header->version == SHADER_CACHE_VERSION &&
+        header->length > 0)
+    {
+        binary = malloc(header->length);
+        if (!binary)
+        {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        if (fread(binary, 1, header->length, file) != header->length)
+        {
+            free(binary);
+            binary = NULL;
+        }
+    }
+
+    fclose(file);
+    return binary;
+}
+
+static GLuint load_cached_program(const char *path, uint64_t key)
+{
+    PROFILE_SCOPE(load_program_binary);
+
+    ShaderCacheHeader header;
+    void *binary = read_cache_file(path, &header);
+    if (!binary)
+    {
+        return 0;
+    }
+    if (header.key != key)
+    {
+        free(binary);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, (GLenum)header.format, binary, (GLsizei)header.length);
+    free(binary);
+
+    // A driver can still refuse a binary it wrote, then it is rebuilt
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void store_cached_program(const char *path, GLuint program, uint64_t key)
+{
+    PROFILE_SCOPE(store_program_binary);
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    void *binary = malloc((size_t)length);
+    if (!binary)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary);
+
+    ShaderCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHADER_CACHE_MAGIC, 4);
+    header.version = SHADER_CACHE_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = (uint32_t)written;
+
+    // Written under a temporary name and renamed into place, so a crash or
+    // a full disk never leaves a truncated binary behind
+    char tempPath[1040];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    FILE *file = fopen(tempPath, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Failed to write shader cache %s\n", tempPath);
+        free(binary);
+        return;
+    }
+
+    int ok = written > 0 &&
+             fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(binary, 1, (size_t)written, file) == (size_t)written;
+    if (fclose(file) != 0 || !ok || rename(tempPath, path) != 0)
+    {
+        fprintf(stderr, "Failed to write shader cache %s\n", path);
+        remove(tempPath);
+    }
+    free(binary);
+}
+
+static GLuint build_program(const char *vertexSource, const char *fragmentSource, const char *defines)
+{
+    GLuint shaders[2];
+    shaders[0] = genShaderSource(vertexSource, defines, GL_VERTEX_SHADER);
+    shaders[1] = genShaderSource(fragmentSource, defines, GL_FRAGMENT_SHADER);
+
+    GLuint program = shaders[0] && shaders[1] ? genShaderProgram(shaders, 2) : 0;
+
+    // The program keeps what it needs, the shaders can go right away
+    for (int i = 0; i < 2; i++)
+    {
+        if (shaders[i])
+        {
+            glDeleteShader(shaders[i]);
+        }
+    }
+    return program;
+}
+
+GLuint getShaderProgram(ShaderManager *manager, unsigned int permutation)
+{
+    if (permutation >= SHADER_PERMUTATION_COUNT)
+    {
+        fprintf(stderr, "Unknown shader permutation %u\n", permutation);
+        return 0;
+    }
+    if (manager->programs[permutation])
+    {
+        return manager->programs[permutation];
+    }
+
+    char *vertexSource = readShaderSource(SHADER_VERTEX_SOURCE);
+    char *fragmentSource = readShaderSource(SHADER_FRAGMENT_SOURCE);
+    if (!vertexSource || !fragmentSource)
+    {
+        free(vertexSource);
+        free(fragmentSource);
+        return 0;
+    }
+
+    char defines[128];
+    permutation_defines(permutation, defines, sizeof(defines));
+
+    uint64_t key = program_key(manager, vertexSource, fragmentSource, defines);
+
+    char path[1024];
+    shader_cache_path(permutation, path, sizeof(path));
+
+    GLuint program = manager->binaryCache ? load_cached_program(path, key) : 0;
+    if (program)
+    {
+        manager->cacheHits++;
+    }
+    else
+    {
+        manager->cacheMisses++;
+        program = build_program(vertexSource, fragmentSource, defines);
+        if (program && manager->binaryCache)
+        {
+            store_cached_program(path, program, key);
+        }
+    }
+
+    free(vertexSource);
+    free(fragmentSource);
+
+    manager->programs[permutation] = program;
+    return program;
+}
+
+int precompileShaderPermutations(ShaderManager *manager)
+{
+    int ok = 1;
+    for (unsigned int permutation = 0; permutation < SHADER_PERMUTATION_COUNT; permutation++)
+    {
+        ok = getShaderProgram(manager, permutation) != 0 && ok;
+    }
+    return ok;
+}
+
+int startShaderRebuild(ShaderManager *manager, unsigned int permutation, const char *vertexSource, const char *fragmentSource, ShaderRebuild *rebuild)
+{
+    memset(rebuild, 0, sizeof(ShaderRebuild));
+    if (permutation >= SHADER_PERMUTATION_COUNT)
+    {
+        fprintf(stderr, "Unknown shader permutation %u\n", permutation);
+        return 0;
+    }
+
+    char defines[128];
+    permutation_defines(permutation, defines, sizeof(defines));
+
+    rebuild->permutation = permutation;
+    rebuild->key = program_key(manager, vertexSource, fragmentSource, defines);
+    rebuild->shaders[0] = startShaderCompile(vertexSource, defines, GL_VERTEX_SHADER);
+    rebuild->shaders[1] = startShaderCompile(fragmentSource, defines, GL_FRAGMENT_SHADER);
+    rebuild->program = startProgramLink(rebuild->shaders, 2);
+    return 1;
+}
+
+int finishShaderRebuild(ShaderManager *manager, ShaderRebuild *rebuild, GLuint *program)
+{
+    if (manager->parallelCompile)
+    {
+        GLint done = 0;
+        glGetProgramiv(rebuild->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done)
+        {
+            return 0;
+        }
+    }
+
+    // A failed link is explained by the compile logs first
+    int compiled = checkShaderCompile(rebuild->shaders[0]);
+    compiled = checkShaderCompile(rebuild->shaders[1]) && compiled;
+    int linked = compiled && checkProgramLink(rebuild->program);
+    for (int i = 0; i < 2; i++)
+    {
+        glDetachShader(rebuild->program, rebuild->shaders[i]);
+        glDeleteShader(rebuild->shaders[i]);
+    }
+
+    if (!linked)
+    {
+        glDeleteProgram(rebuild->program);
+        memset(rebuild, 0, sizeof(ShaderRebuild));
+        *program = 0;
+        return 1;
+    }
+
+    if (manager->binaryCache)
+    {
+        char path[1024];
+        shader_cache_path(rebuild->permutation, path, sizeof(path));
+        store_cached_program(path, rebuild->program, rebuild->key);
+    }
+
+    GLuint *slot = &manager->programs[rebuild->permutation];
+    if (*slot)
+    {
+        glDeleteProgram(*slot);
+    }
+    *slot = rebuild->program;
+    *program = rebuild->program;
+    memset(rebuild, 0, sizeof(ShaderRebuild));
+    return 1;
+}
+
+void clearShaderCache()
+{
+    for (unsigned int permutation = 0; permutation < SHADER_PERMUTATION_COUNT; permutation++)
+    {
+        char path[1024];
+        shader_cache_path(permutation, path, sizeof(path));
+        remove(path);
+    }
+}
+
+void benchmarkShaderStartup()
+{
+    ShaderManager manager;
+    initShaderManager(&manager);
+    if (!manager.binaryCache)
+    {
+        printf("The driver has no program binary formats, every start compiles\n");
+    }
+
+    // Cold still benefits from a driver's own shader cache if it has one,
+    // so it is the most an application cache can save, not always the
+    // first start on a machine
+    clearShaderCache();
+    double start = getTimeSeconds();
+    int ok = precompileShaderPermutations(&manager);
+    glFinish();
+    double cold = (getTimeSeconds() - start) * 1000.0;
+    freeShaderManager(&manager);
+
+    initShaderManager(&manager);
+    start = getTimeSeconds();
+    ok = precompileShaderPermutations(&manager) && ok;
+    glFinish();
+    double warm = (getTimeSeconds() - start) * 1000.0;
+
+    printf("Shader startup, %d permutations%s\n", SHADER_PERMUTATION_COUNT, ok ? "" : " (some failed)");
+    printf("  cold: %8.2f ms, compiled and linked\n", cold);
+    printf("  warm: %8.2f ms, %d from the program cache\n", warm, manager.cacheHits);
+    freeShaderManager(&manager);
+}
+
+void freeShaderManager(ShaderManager *manager)
+{
+    for (int i = 0; i < SHADER_PERMUTATION_COUNT; i++)
+    {
+        if (manager->programs[i])
+        {
+            glDeleteProgram(manager->programs[i]);
+        }
+    }
+    memset(manager, 0, sizeof(ShaderManager));
+}
\ No newline at end of file
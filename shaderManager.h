@@ -0,0 +1,85 @@
+#ifndef SHADER_MANAGER_H
+#define SHADER_MANAGER_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#define SHADER_VERTEX_SOURCE "vertexShader.glsl"
+#define SHADER_FRAGMENT_SOURCE "fragmentShader.glsl"
+
+// Permutation bits, each one a #define ahead of both sources
+#define SHADER_PACKED_VERTICES 1 // PACKED_VERTICES, vertexPack.h input
+#define SHADER_LUT_GRADING 2     // LUT_GRADING, colorGrade.h lookups
+#define SHADER_INSTANCED 4       // INSTANCED, instanceBuffer.h attributes
+#define SHADER_PERMUTATION_COUNT 8
+
+// Bump whenever the header changes so old cache files are rebuilt instead
+// of misread
+#define SHADER_CACHE_VERSION 1
+
+// Linked programs are kept as shader_<permutation>.programcache. A file
+// is only used if its key, a hash of both sources, the permutation's
+// defines and the driver, matches, so edited shaders and driver updates
+// recompile.
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format; // From glGetProgramBinary
+    uint32_t length;
+} ShaderCacheHeader;
+
+// Every permutation linked so far, made from the cache where possible
+typedef struct
+{
+    GLuint programs[SHADER_PERMUTATION_COUNT];
+    uint64_t driverHash; // Vendor, renderer, version and GLSL version
+    int binaryCache;     // 0 if the driver has no program binary formats
+    int cacheHits;
+    int cacheMisses;
+    int parallelCompile; // KHR_parallel_shader_compile, rebuilds never wait
+} ShaderManager;
+
+// A permutation rebuilt from new sources while its old program keeps
+// drawing
+typedef struct
+{
+    unsigned int permutation;
+    uint64_t key;
+    GLuint shaders[2];
+    GLuint program;
+} ShaderRebuild;
+
+// Needs a current context
+void initShaderManager(ShaderManager *manager);
+
+// The linked program of a permutation: the one already made, the cached
+// binary, or compiled and linked from the sources and then cached. 0 if
+// it doesn't compile or link.
+GLuint getShaderProgram(ShaderManager *manager, unsigned int permutation);
+
+// Makes every permutation, for instance to fill the cache ahead of use.
+// Returns 0 if any of them fails.
+int precompileShaderPermutations(ShaderManager *manager);
+
+// Starts compiling and linking a permutation from the given sources.
+// Returns 0 if the permutation is unknown.
+int startShaderRebuild(ShaderManager *manager, unsigned int permutation, const char *vertexSource, const char *fragmentSource, ShaderRebuild *rebuild);
+
+// 0 while the driver is still at it, poll again next frame. Otherwise
+// *program is the new program, which replaces and deletes the old one and
+// goes into the cache, or 0 if the sources didn't build and the old one
+// stays. Only waits for the driver without KHR_parallel_shader_compile.
+int finishShaderRebuild(ShaderManager *manager, ShaderRebuild *rebuild, GLuint *program);
+
+// Removes every permutation's cache file
+void clearShaderCache();
+
+// Times making every permutation cold, with the cache cleared, against
+// warm, from the files the cold run wrote. Prints milliseconds for each.
+void benchmarkShaderStartup();
+
+void freeShaderManager(ShaderManager *manager);
+
+#endif // SHADER_MANAGER_H
\ No newline at end of file
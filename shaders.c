@@ -1,5 +1,9 @@
 #include <GL/glew.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+#include "shaders.h"
 #include "utils.h"
 
 GLuint genShader(const char *fileName, GLenum shaderType)
@@ -11,11 +15,46 @@ GLuint genShader(const char *fileName, GLenum shaderType)
         return 0;
     }
 
+    GLuint shader = genShaderSource(shaderSource, "", shaderType);
+    free(shaderSource);
+    return shader;
+}
+
+GLuint genShaderSource(const char *source, const char *defines, GLenum shaderType)
+{
+    PROFILE_SCOPE(compile_shader);
+
+    GLuint shader = startShaderCompile(source, defines, shaderType);
+    if (!checkShaderCompile(shader))
+    {
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+GLuint startShaderCompile(const char *source, const char *defines, GLenum shaderType)
+{
+    // #version has to come first, the defines go right after its line
+    const char *body = source;
+    if (strncmp(source, "#version", 8) == 0)
+    {
+        const char *newline = strchr(source, '\n');
+        body = newline ? newline + 1 : source + strlen(source);
+    }
+    const char *parts[3] = {source, defines, body};
+    GLint lengths[3] = {(GLint)(body - source), -1, -1};
+
     // Compile the shader
     GLuint shader = glCreateShader(shaderType);
-    glShaderSource(shader, 1, &shaderSource, NULL);
+    glShaderSource(shader, 3, parts, lengths);
     glCompileShader(shader);
+    return shader;
+}
 
+int checkShaderCompile(GLuint shader)
+{
     // Check for shader compilation errors
     int success;
     char infoLog[512];
@@ -26,30 +65,50 @@ GLuint genShader(const char *fileName, GLenum shaderType)
         fprintf(stderr, "ERROR::SHADER::COMPILATION_FAILED\n%s\n", infoLog);
         return 0;
     }
-
-    return shader;
+    return 1;
 }
 
 GLuint genShaderProgram(GLuint *shaders, int numShaders)
+{
+    PROFILE_SCOPE(link_program);
+
+    GLuint shaderProgram = startProgramLink(shaders, numShaders);
+    if (!checkProgramLink(shaderProgram))
+    {
+        return 0;
+    }
+
+    return shaderProgram;
+}
+
+GLuint startProgramLink(GLuint *shaders, int numShaders)
 {
     // Link the shaders into a shader program
     GLuint shaderProgram = glCreateProgram();
+    if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1)
+    {
+        // Lets shaderManager.c read the linked binary back for its cache
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     for (int i = 0; i < numShaders; i++)
     {
         glAttachShader(shaderProgram, shaders[i]);
     }
     glLinkProgram(shaderProgram);
+    return shaderProgram;
+}
 
+int checkProgramLink(GLuint program)
+{
     // Check for linking errors
     int success;
     char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success)
     {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
         fprintf(stderr, "ERROR::SHADER::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
         return 0;
     }
-
-    return shaderProgram;
+    return 1;
 }
\ No newline at end of file
@@ -6,6 +6,20 @@
 
 GLuint genShader(const char *fileName, GLenum shaderType);
 
+// Compiles source with defines, lines of #define, inserted after its
+// #version line
+GLuint genShaderSource(const char *source, const char *defines, GLenum shaderType);
+
 GLuint genShaderProgram(GLuint *shaders, int numShaders);
 
+// The two halves of genShaderSource and genShaderProgram. With
+// KHR_parallel_shader_compile the driver works on its own threads between
+// them, checking is what waits for it.
+GLuint startShaderCompile(const char *source, const char *defines, GLenum shaderType);
+GLuint startProgramLink(GLuint *shaders, int numShaders);
+
+// 1 on success, the log goes to stderr otherwise
+int checkShaderCompile(GLuint shader);
+int checkProgramLink(GLuint program);
+
 #endif // SHADERS_H
\ No newline at end of file
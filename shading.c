@@ -0,0 +1,48 @@
+#include <string.h>
+#include "shading.h"
+
+void default_global_parameters(GlobalParameters *parameters)
+{
+    memset(parameters, 0, sizeof(GlobalParameters));
+
+    // This works for esposito.obj
+    parameters->hueAdjust = 0.05f;              // 1
+    parameters->saturationAdjust = 3.459998f;   // 2
+    parameters->brightnessAdjust = 0.2f;        // 3
+    parameters->hHueAdjust = 0.05f;             // 4
+    parameters->hSaturationAdjust = 0.880001f;  // 5
+    parameters->hBrightnessAdjust = 0.2f;       // 6
+    parameters->gamma = 2.2f;                   // 7
+    parameters->ambientStrength = -0.109999f;   // 8
+    parameters->specularStrength = 0.8f;        // 9
+    parameters->specularExponent = 32.0f;       // 0
+}
+
+void material_parameters(const Material *material, MaterialParameters *parameters)
+{
+    MaterialParameters filled = {
+        {material->Kd[0], material->Kd[1], material->Kd[2], material->d},
+        {material->Ks[0], material->Ks[1], material->Ks[2], material->Ns},
+        {0.0f, 0.0f, 0.0f, 0.0f}};
+    *parameters = filled;
+}
+
+void vertex_color_parameters(MaterialParameters *parameters)
+{
+    MaterialParameters filled = {
+        {1.0f, 1.0f, 1.0f, 1.0f},
+        {1.0f, 1.0f, 1.0f, 0.0f},
+        {1.0f, 0.0f, 0.0f, 0.0f}};
+    *parameters = filled;
+}
+
+void shader_transforms(float time, float aspect, ShaderTransforms *transforms)
+{
+    transforms->eye = vec3(0.0f, 0.0f, -SHADER_CAMERA_DISTANCE);
+    transforms->model = mat4_rotation(vec3(0.0f, 1.0f, 0.0f), time);
+    transforms->view = mat4_look_at(transforms->eye, vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+    transforms->projection = mat4_perspective(SHADER_FIELD_OF_VIEW, aspect > 0.0f ? aspect : 1.0f, SHADER_NEAR_PLANE, SHADER_FAR_PLANE);
+    transforms->view_projection = mat4_multiply(&transforms->projection, &transforms->view);
+    transforms->model_view_projection = mat4_multiply(&transforms->view_projection, &transforms->model);
+    mat4_normal_matrix(&transforms->model, transforms->normal_matrix);
+}
\ No newline at end of file
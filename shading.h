@@ -0,0 +1,69 @@
+#ifndef SHADING_H
+#define SHADING_H
+
+#include "loader.h"
+#include "vecMath.h"
+
+// What fragmentShader.glsl shades with, independent of who draws: the GL
+// uniform blocks and the software rasterizer both take these
+
+// The GlobalParameters block, std140: scalars packed, the block padded to
+// a whole vec4
+typedef struct
+{
+    float hueAdjust;
+    float saturationAdjust;
+    float brightnessAdjust;
+    float hHueAdjust;
+    float hSaturationAdjust;
+    float hBrightnessAdjust;
+    float gamma;
+    float ambientStrength;
+    float specularStrength;
+    float specularExponent;
+    float padding[2];
+} GlobalParameters;
+
+// The MaterialParameters block, std140, three vec4s
+typedef struct
+{
+    float diffuse[4];  // Kd, d
+    float specular[4]; // Ks, Ns
+    float options[4];  // x: 1 takes the diffuse color from the vertex instead
+} MaterialParameters;
+
+// The camera every renderer draws from: on -z looking at the origin, far
+// enough back that the -10..10 square the shaders used to divide down to
+// (w = 10, no projection) still fills the screen's height
+#define SHADER_CAMERA_DISTANCE 24.0f
+#define SHADER_FIELD_OF_VIEW 0.7853982f // Vertical, 45 degrees
+#define SHADER_NEAR_PLANE 1.0f
+#define SHADER_FAR_PLANE 100.0f
+
+// What vertexShader.glsl gets as uniforms, made once per frame instead of
+// per vertex
+typedef struct
+{
+    Mat4 model; // Rotated about Y by time
+    Mat4 view;
+    Mat4 projection;
+    Mat4 view_projection;
+    Mat4 model_view_projection;
+    float normal_matrix[9]; // Column major
+    Vec3 eye;               // Camera position, world space
+} ShaderTransforms;
+
+// aspect is width over height
+void shader_transforms(float time, float aspect, ShaderTransforms *transforms);
+
+// The adjustments the keys start from
+void default_global_parameters(GlobalParameters *parameters);
+
+void material_parameters(const Material *material, MaterialParameters *parameters);
+
+// For draws that aren't sorted by material: the vertex color, white
+// specular and no exponent of its own, shading as it did before materials
+// had blocks
+void vertex_color_parameters(MaterialParameters *parameters);
+
+#endif // SHADING_H
\ No newline at end of file
@@ -0,0 +1,556 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "softRaster.h"
+#include "threads.h"
+#include "utils.h"
+
+// Floats per vertex in SoftRasterizer.screen
+#define SOFT_SCREEN_FLOATS 10
+
+// Vertices transformed per task
+#define SOFT_VERTEX_CHUNK 16384
+
+// Interpolated per pixel: depth, 1 / w, then vertex color, normal and
+// world position divided by w, for perspective correct values
+#define SOFT_ATTRIBUTES 11
+
+// fragmentShader.glsl defaults, the render loop never changes them
+static const float light_position[3] = {1.2f, 1.0f, -2.0f};
+
+// Everything the three stages of one frame share
+typedef struct
+{
+    SoftRasterizer *rasterizer;
+    const SoftMesh *mesh;
+    const GlobalParameters *parameters;
+    MaterialParameters vertex_color;
+    ShaderTransforms transforms;
+    int triangle_count;
+    int chunk_count;
+} SoftFrame;
+
+static void *grow_or_die(void *memory, size_t size)
+{
+    memory = realloc(memory, size ? size : 1);
+    if (!memory)
+    {
+        perror("Failed to reallocate memory");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+void init_soft_rasterizer(SoftRasterizer *rasterizer, int width, int height, int thread_count)
+{
+    memset(rasterizer, 0, sizeof(SoftRasterizer));
+    rasterizer->width = width;
+    rasterizer->height = height;
+    rasterizer->thread_count = thread_count > 0 ? thread_count : getCpuCount();
+    rasterizer->tiles_x = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    rasterizer->tiles_y = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    rasterizer->pixels = grow_or_die(NULL, (size_t)width * height * 3);
+    init_color_grade_lut(&rasterizer->color_grade, COLOR_GRADE_LUT_SIZE);
+}
+
+// vertexShader.glsl up to the viewport, y flipped so rows go top down like
+// the image. There is no near plane clipping: vertices behind the camera
+// get NaN positions, which drops their triangles.
+static void transform_vertices_task(void *context, int chunk)
+{
+    const SoftFrame *frame = (const SoftFrame *)context;
+    const SoftMesh *mesh = frame->mesh;
+    SoftRasterizer *rasterizer = frame->rasterizer;
+    const ShaderTransforms *transforms = &frame->transforms;
+    const float *normal_matrix = transforms->normal_matrix;
+
+    int first = chunk * SOFT_VERTEX_CHUNK;
+    int last = first + SOFT_VERTEX_CHUNK < mesh->vertex_count ? first + SOFT_VERTEX_CHUNK : mesh->vertex_count;
+
+    for (int v = first; v < last; v++)
+    {
+        const float *in = &mesh->vertices[(size_t)v * GPU_VERTEX_FLOATS];
+        float *out = &rasterizer->screen[(size_t)v * SOFT_SCREEN_FLOATS];
+
+        Vec4 world = mat4_transform(&transforms->model, vec4(in[0], in[1], in[2], 1.0f));
+        Vec4 clip = mat4_transform(&transforms->view_projection, world);
+        float inverse_w = clip[3] > 0.0f ? 1.0f / clip[3] : NAN;
+
+        out[0] = (clip[0] * inverse_w * 0.5f + 0.5f) * rasterizer->width;
+        out[1] = (0.5f - clip[1] * inverse_w * 0.5f) * rasterizer->height;
+        out[2] = clip[2] * inverse_w * 0.5f + 0.5f;
+        out[3] = inverse_w;
+        out[4] = world[0];
+        out[5] = world[1];
+        out[6] = world[2];
+        for (int i = 0; i < 3; i++)
+        {
+            out[7 + i] = normal_matrix[i] * in[6] + normal_matrix[3 + i] * in[7] + normal_matrix[6 + i] * in[8];
+        }
+    }
+}
+
+// Pixels whose centers the triangle may cover, as tiles. Returns 0 for
+// triangles that can't produce a pixel: degenerate, off screen, outside the
+// depth range or with indices past the vertices.
+static int triangle_tiles(const SoftRasterizer *rasterizer, const SoftMesh *mesh, int triangle, int tiles[4])
+{
+    const unsigned int *corner = &mesh->indices[(size_t)triangle * 3];
+    if (corner[0] >= (unsigned int)mesh->vertex_count || corner[1] >= (unsigned int)mesh->vertex_count || corner[2] >= (unsigned int)mesh->vertex_count)
+    {
+        return 0;
+    }
+
+    const float *a = &rasterizer->screen[(size_t)corner[0] * SOFT_SCREEN_FLOATS];
+    const float *b = &rasterizer->screen[(size_t)corner[1] * SOFT_SCREEN_FLOATS];
+    const float *c = &rasterizer->screen[(size_t)corner[2] * SOFT_SCREEN_FLOATS];
+
+    // Also rejects NaN positions
+    float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    if (!(area > 0.0f || area < 0.0f))
+    {
+        return 0;
+    }
+    if ((a[2] < 0.0f && b[2] < 0.0f && c[2] < 0.0f) || (a[2] > 1.0f && b[2] > 1.0f && c[2] > 1.0f))
+    {
+        return 0;
+    }
+
+    float min_x = fminf(a[0], fminf(b[0], c[0]));
+    float max_x = fmaxf(a[0], fmaxf(b[0], c[0]));
+    float min_y = fminf(a[1], fminf(b[1], c[1]));
+    float max_y = fmaxf(a[1], fmaxf(b[1], c[1]));
+
+    float x0 = fmaxf(ceilf(min_x - 0.5f), 0.0f);
+    float x1 = fminf(floorf(max_x - 0.5f), (float)(rasterizer->width - 1));
+    float y0 = fmaxf(ceilf(min_y - 0.5f), 0.0f);
+    float y1 = fminf(floorf(max_y - 0.5f), (float)(rasterizer->height - 1));
+    if (x0 > x1 || y0 > y1)
+    {
+        return 0;
+    }
+
+    tiles[0] = (int)x0 / SOFT_TILE_SIZE;
+    tiles[1] = (int)y0 / SOFT_TILE_SIZE;
+    tiles[2] = (int)x1 / SOFT_TILE_SIZE;
+    tiles[3] = (int)y1 / SOFT_TILE_SIZE;
+    return 1;
+}
+
+// Each chunk fills its own bins, so binning takes no locks
+static void bin_triangles_task(void *context, int chunk)
+{
+    const SoftFrame *frame = (const SoftFrame *)context;
+    const SoftRasterizer *rasterizer = frame->rasterizer;
+    SoftBin *bin = &rasterizer->bins[chunk];
+    int tile_count = rasterizer->tiles_x * rasterizer->tiles_y;
+
+    int first = chunk * SOFT_BIN_CHUNK;
+    int last = first + SOFT_BIN_CHUNK < frame->triangle_count ? first + SOFT_BIN_CHUNK : frame->triangle_count;
+
+    // Counted first, so every tile's list is contiguous
+    memset(bin->offsets, 0, ((size_t)tile_count + 1) * sizeof(int));
+    for (int t = first; t < last; t++)
+    {
+        int tiles[4];
+        if (triangle_tiles(rasterizer, frame->mesh, t, tiles))
+        {
+            for (int y = tiles[1]; y <= tiles[3]; y++)
+            {
+                for (int x = tiles[0]; x <= tiles[2]; x++)
+                {
+                    bin->offsets[y * rasterizer->tiles_x + x + 1]++;
+                }
+            }
+        }
+    }
+    for (int i = 0; i < tile_count; i++)
+    {
+        bin->offsets[i + 1] += bin->offsets[i];
+    }
+
+    if (bin->offsets[tile_count] > bin->capacity)
+    {
+        bin->capacity = bin->offsets[tile_count];
+        bin->triangles = grow_or_die(bin->triangles, (size_t)bin->capacity * sizeof(int));
+    }
+
+    // Filled through the offsets, which then point one tile ahead
+    for (int t = first; t < last; t++)
+    {
+        int tiles[4];
+        if (triangle_tiles(rasterizer, frame->mesh, t, tiles))
+        {
+            for (int y = tiles[1]; y <= tiles[3]; y++)
+            {
+                for (int x = tiles[0]; x <= tiles[2]; x++)
+                {
+                    bin->triangles[bin->offsets[y * rasterizer->tiles_x + x]++] = t;
+                }
+            }
+        }
+    }
+    for (int i = tile_count; i > 0; i--)
+    {
+        bin->offsets[i] = bin->offsets[i - 1];
+    }
+    bin->offsets[0] = 0;
+}
+
+static void normalize3(float v[3])
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f)
+    {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+// fragmentShader.glsl for one pixel, line by line
+static void shade_fragment(const GlobalParameters *g, const ColorGradeLut *color_grade, const MaterialParameters *material, const float vertex_color[3], const float interpolated_normal[3], const float position[3], const float eye[3], float out[3])
+{
+    float ambient = g->ambientStrength;
+
+    float norm[3] = {interpolated_normal[0], interpolated_normal[1], interpolated_normal[2]};
+    normalize3(norm);
+    float light_direction[3] = {light_position[0] - position[0], light_position[1] - position[1], light_position[2] - position[2]};
+    normalize3(light_direction);
+    float diffuse = fmaxf(norm[0] * light_direction[0] + norm[1] * light_direction[1] + norm[2] * light_direction[2], 0.0f);
+
+    float view_direction[3] = {eye[0] - position[0], eye[1] - position[1], eye[2] - position[2]};
+    normalize3(view_direction);
+    float incident_dot = -(norm[0] * light_direction[0] + norm[1] * light_direction[1] + norm[2] * light_direction[2]);
+    float reflect_direction[3];
+    for (int i = 0; i < 3; i++)
+    {
+        reflect_direction[i] = -light_direction[i] - 2.0f * incident_dot * norm[i];
+    }
+    float exponent = material->specular[3] > 0.0f ? material->specular[3] : g->specularExponent;
+    float spec = powf(fmaxf(view_direction[0] * reflect_direction[0] + view_direction[1] * reflect_direction[1] + view_direction[2] * reflect_direction[2], 0.0f), exponent);
+
+    float kd[3], kd_corrected[3], graded[3];
+    for (int i = 0; i < 3; i++)
+    {
+        kd[i] = material->diffuse[i] + (vertex_color[i] - material->diffuse[i]) * material->options[0];
+    }
+    sample_color_grade_lut(color_grade, kd, kd_corrected, graded);
+
+    for (int i = 0; i < 3; i++)
+    {
+        float specular = g->specularStrength * spec * material->specular[i];
+        out[i] = (ambient + diffuse + specular) * kd_corrected[i] + graded[i];
+    }
+}
+
+// Pixel centers inside every edge, or exactly on an edge that is a top or
+// left one, so pixels on a shared edge belong to one of the triangles
+static SoftInt4 inside_edge(SoftFloat4 edge, SoftInt4 include_zero)
+{
+    return (edge > 0.0f) | ((edge == 0.0f) & include_zero);
+}
+
+static void raster_triangle(const SoftFrame *frame, int triangle, const MaterialParameters *material, int tile_x, int tile_y, int width, int height, float *color, float *depth)
+{
+    const SoftMesh *mesh = frame->mesh;
+    const SoftRasterizer *rasterizer = frame->rasterizer;
+    const unsigned int *corner = &mesh->indices[(size_t)triangle * 3];
+
+    const float *screen[3];
+    const float *vertex[3];
+    for (int i = 0; i < 3; i++)
+    {
+        screen[i] = &rasterizer->screen[(size_t)corner[i] * SOFT_SCREEN_FLOATS];
+        vertex[i] = &mesh->vertices[(size_t)corner[i] * GPU_VERTEX_FLOATS];
+    }
+
+    // Relative to the tile in double, so the edge constants keep their
+    // precision far from the origin
+    double x[3], y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = (double)screen[i][0] - tile_x;
+        y[i] = (double)screen[i][1] - tile_y;
+    }
+
+    double area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area < 0.0)
+    {
+        // Both windings are drawn, like the GL path without --meshlets
+        const float *swap_screen = screen[1];
+        const float *swap_vertex = vertex[1];
+        double swap_x = x[1], swap_y = y[1];
+        screen[1] = screen[2], vertex[1] = vertex[2], x[1] = x[2], y[1] = y[2];
+        screen[2] = swap_screen, vertex[2] = swap_vertex, x[2] = swap_x, y[2] = swap_y;
+        area = -area;
+    }
+
+    // Edge i faces vertex i, positive inside: e = a x + b y + c
+    double a[3], b[3], c[3];
+    SoftInt4 include_zero[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        a[i] = y[j] - y[k];
+        b[i] = x[k] - x[j];
+        c[i] = x[j] * y[k] - x[k] * y[j];
+        int top_left = a[i] > 0.0 || (a[i] == 0.0 && b[i] > 0.0);
+        include_zero[i] = (SoftInt4){0, 0, 0, 0} - top_left;
+    }
+
+    // Every attribute as a plane over the tile
+    float values[SOFT_ATTRIBUTES][3];
+    for (int i = 0; i < 3; i++)
+    {
+        float inverse_w = screen[i][3];
+        values[0][i] = screen[i][2];
+        values[1][i] = inverse_w;
+        for (int n = 0; n < 3; n++)
+        {
+            values[2 + n][i] = vertex[i][3 + n] * inverse_w;
+            values[5 + n][i] = screen[i][7 + n] * inverse_w;
+            values[8 + n][i] = screen[i][4 + n] * inverse_w;
+        }
+    }
+    float plane_x[SOFT_ATTRIBUTES], plane_y[SOFT_ATTRIBUTES], plane_c[SOFT_ATTRIBUTES];
+    for (int n = 0; n < SOFT_ATTRIBUTES; n++)
+    {
+        plane_x[n] = (float)((a[0] * values[n][0] + a[1] * values[n][1] + a[2] * values[n][2]) / area);
+        plane_y[n] = (float)((b[0] * values[n][0] + b[1] * values[n][1] + b[2] * values[n][2]) / area);
+        plane_c[n] = (float)((c[0] * values[n][0] + c[1] * values[n][1] + c[2] * values[n][2]) / area);
+    }
+
+    int x0 = (int)fmax(ceil(fmin(x[0], fmin(x[1], x[2])) - 0.5), 0.0);
+    int x1 = (int)fmin(floor(fmax(x[0], fmax(x[1], x[2])) - 0.5), width - 1.0);
+    int y0 = (int)fmax(ceil(fmin(y[0], fmin(y[1], y[2])) - 0.5), 0.0);
+    int y1 = (int)fmin(floor(fmax(y[0], fmax(y[1], y[2])) - 0.5), height - 1.0);
+
+    const SoftFloat4 lane_offsets = {0.5f, 1.5f, 2.5f, 3.5f};
+    const SoftInt4 lane_index = {0, 1, 2, 3};
+    float alpha = material->diffuse[3];
+    const float eye[3] = {frame->transforms.eye[0], frame->transforms.eye[1], frame->transforms.eye[2]};
+
+    for (int py = y0; py <= y1; py++)
+    {
+        float center_y = py + 0.5f;
+        SoftFloat4 row_edge[3];
+        for (int i = 0; i < 3; i++)
+        {
+            row_edge[i] = (SoftFloat4){0.0f, 0.0f, 0.0f, 0.0f} + (float)(b[i] * center_y + c[i]);
+        }
+
+        for (int px = x0 & ~3; px <= x1; px += 4)
+        {
+            SoftFloat4 center_x = (float)px + lane_offsets;
+            SoftInt4 lane = px + lane_index;
+
+            SoftInt4 covered = (lane >= x0) & (lane <= x1);
+            for (int i = 0; i < 3; i++)
+            {
+                covered &= inside_edge((float)a[i] * center_x + row_edge[i], include_zero[i]);
+            }
+
+            // Depth clipped to [0, 1] like the GL near and far planes
+            SoftFloat4 z = plane_x[0] * center_x + (plane_y[0] * center_y + plane_c[0]);
+            SoftFloat4 stored;
+            memcpy(&stored, &depth[py * SOFT_TILE_SIZE + px], sizeof(SoftFloat4));
+            covered &= (z >= 0.0f) & (z <= 1.0f) & (z < stored);
+
+            if (!(covered[0] | covered[1] | covered[2] | covered[3]))
+            {
+                continue;
+            }
+
+            SoftFloat4 attribute[SOFT_ATTRIBUTES];
+            for (int n = 1; n < SOFT_ATTRIBUTES; n++)
+            {
+                attribute[n] = plane_x[n] * center_x + (plane_y[n] * center_y + plane_c[n]);
+            }
+
+            for (int l = 0; l < 4; l++)
+            {
+                if (!covered[l])
+                {
+                    continue;
+                }
+
+                int pixel = py * SOFT_TILE_SIZE + px + l;
+                depth[pixel] = z[l];
+
+                float w = 1.0f / attribute[1][l];
+                float vertex_color[3] = {attribute[2][l] * w, attribute[3][l] * w, attribute[4][l] * w};
+                float normal[3] = {attribute[5][l] * w, attribute[6][l] * w, attribute[7][l] * w};
+                float position[3] = {attribute[8][l] * w, attribute[9][l] * w, attribute[10][l] * w};
+
+                float shaded[3];
+                shade_fragment(frame->parameters, &frame->rasterizer->color_grade, material, vertex_color, normal, position, eye, shaded);
+                for (int i = 0; i < 3; i++)
+                {
+                    float source = fminf(fmaxf(shaded[i], 0.0f), 1.0f);
+                    color[pixel * 3 + i] = alpha < 1.0f ? source * alpha + color[pixel * 3 + i] * (1.0f - alpha) : source;
+                }
+            }
+        }
+    }
+}
+
+static void raster_tile_task(void *context, int tile)
+{
+    const SoftFrame *frame = (const SoftFrame *)context;
+    const SoftMesh *mesh = frame->mesh;
+    SoftRasterizer *rasterizer = frame->rasterizer;
+
+    int tile_x = tile % rasterizer->tiles_x * SOFT_TILE_SIZE;
+    int tile_y = tile / rasterizer->tiles_x * SOFT_TILE_SIZE;
+    int width = rasterizer->width - tile_x < SOFT_TILE_SIZE ? rasterizer->width - tile_x : SOFT_TILE_SIZE;
+    int height = rasterizer->height - tile_y < SOFT_TILE_SIZE ? rasterizer->height - tile_y : SOFT_TILE_SIZE;
+
+    // Rows are a whole tile wide, so the four lanes of a row never run off
+    // the buffer even in partial tiles
+    float color[SOFT_TILE_SIZE * SOFT_TILE_SIZE * 3];
+    float depth[SOFT_TILE_SIZE * SOFT_TILE_SIZE];
+    for (int i = 0; i < SOFT_TILE_SIZE * SOFT_TILE_SIZE; i++)
+    {
+        color[i * 3 + 0] = SOFT_CLEAR_R;
+        color[i * 3 + 1] = SOFT_CLEAR_G;
+        color[i * 3 + 2] = SOFT_CLEAR_B;
+        depth[i] = 1.0f;
+    }
+
+    // Triangles arrive in index order, so the material range only moves on
+    int range = 0;
+    for (int chunk = 0; chunk < frame->chunk_count; chunk++)
+    {
+        const SoftBin *bin = &rasterizer->bins[chunk];
+        for (int i = bin->offsets[tile]; i < bin->offsets[tile + 1]; i++)
+        {
+            int triangle = bin->triangles[i];
+            const MaterialParameters *material = &frame->vertex_color;
+
+            while (range < mesh->range_count && triangle * 3 >= mesh->ranges[range].first_index + mesh->ranges[range].index_count)
+            {
+                range++;
+            }
+            if (range < mesh->range_count && triangle * 3 >= mesh->ranges[range].first_index)
+            {
+                int id = mesh->ranges[range].material;
+                material = id >= 0 && id < mesh->material_count ? &mesh->materials[id] : material;
+            }
+
+            raster_triangle(frame, triangle, material, tile_x, tile_y, width, height, color, depth);
+        }
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t *row = &rasterizer->pixels[((size_t)(tile_y + y) * rasterizer->width + tile_x) * 3];
+        for (int x = 0; x < width * 3; x++)
+        {
+            row[x] = (uint8_t)(color[y * SOFT_TILE_SIZE * 3 + x] * 255.0f + 0.5f);
+        }
+    }
+}
+
+void soft_draw(SoftRasterizer *rasterizer, const SoftMesh *mesh, const GlobalParameters *parameters, float time)
+{
+    SoftFrame frame;
+    frame.rasterizer = rasterizer;
+    frame.mesh = mesh;
+    frame.parameters = parameters;
+    vertex_color_parameters(&frame.vertex_color);
+    shader_transforms(time, (float)rasterizer->width / rasterizer->height, &frame.transforms);
+    frame.triangle_count = mesh->index_count / 3;
+    frame.chunk_count = (frame.triangle_count + SOFT_BIN_CHUNK - 1) / SOFT_BIN_CHUNK;
+
+    if (color_grade_lut_stale(&rasterizer->color_grade, parameters))
+    {
+        build_color_grade_lut(&rasterizer->color_grade, parameters, rasterizer->thread_count);
+    }
+
+    if (mesh->vertex_count > rasterizer->screen_capacity)
+    {
+        rasterizer->screen_capacity = mesh->vertex_count;
+        rasterizer->screen = grow_or_die(rasterizer->screen, (size_t)mesh->vertex_count * SOFT_SCREEN_FLOATS * sizeof(float));
+    }
+
+    int tile_count = rasterizer->tiles_x * rasterizer->tiles_y;
+    if (frame.chunk_count > rasterizer->bin_capacity)
+    {
+        rasterizer->bins = grow_or_die(rasterizer->bins, (size_t)frame.chunk_count * sizeof(SoftBin));
+        for (int i = rasterizer->bin_capacity; i < frame.chunk_count; i++)
+        {
+            rasterizer->bins[i].offsets = grow_or_die(NULL, ((size_t)tile_count + 1) * sizeof(int));
+            rasterizer->bins[i].triangles = NULL;
+            rasterizer->bins[i].capacity = 0;
+        }
+        rasterizer->bin_capacity = frame.chunk_count;
+    }
+
+    int vertex_chunks = (mesh->vertex_count + SOFT_VERTEX_CHUNK - 1) / SOFT_VERTEX_CHUNK;
+    runParallel(vertex_chunks, rasterizer->thread_count, transform_vertices_task, &frame);
+    runParallel(frame.chunk_count, rasterizer->thread_count, bin_triangles_task, &frame);
+    runParallel(tile_count, rasterizer->thread_count, raster_tile_task, &frame);
+}
+
+int write_soft_framebuffer(const SoftRasterizer *rasterizer, const char *filename)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        perror("Failed to open file");
+        return 0;
+    }
+
+    size_t size = (size_t)rasterizer->width * rasterizer->height * 3;
+    int ok = fprintf(file, "P6\n%d %d\n255\n", rasterizer->width, rasterizer->height) > 0 && fwrite(rasterizer->pixels, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+void benchmark_soft_raster(const SoftMesh *mesh, const GlobalParameters *parameters, int width, int height, int frame_count)
+{
+    int cpu_count = getCpuCount();
+    int triangle_count = mesh->index_count / 3;
+    printf("Software rasterizer, %d triangles at %dx%d, %d frames per run\n", triangle_count, width, height, frame_count);
+
+    for (int threads = 1;; threads = threads * 2 < cpu_count ? threads * 2 : cpu_count)
+    {
+        SoftRasterizer rasterizer;
+        init_soft_rasterizer(&rasterizer, width, height, threads);
+
+        // The first frame grows the buffers, it isn't timed
+        soft_draw(&rasterizer, mesh, parameters, 0.0f);
+
+        double start = getTimeSeconds();
+        for (int f = 0; f < frame_count; f++)
+        {
+            soft_draw(&rasterizer, mesh, parameters, f / 60.0f);
+        }
+        double seconds = getTimeSeconds() - start;
+        seconds = seconds > 0.0 ? seconds : 1e-9;
+
+        printf("%3d threads: %8.2f ms per frame, %7.1f frames/s, %7.2f Mtri/s\n", threads, seconds * 1000.0 / frame_count, frame_count / seconds, (double)triangle_count * frame_count / seconds / 1e6);
+        free_soft_rasterizer(&rasterizer);
+
+        if (threads >= cpu_count)
+        {
+            break;
+        }
+    }
+}
+
+void free_soft_rasterizer(SoftRasterizer *rasterizer)
+{
+    for (int i = 0; i < rasterizer->bin_capacity; i++)
+    {
+        free(rasterizer->bins[i].offsets);
+        free(rasterizer->bins[i].triangles);
+    }
+    free(rasterizer->bins);
+    free(rasterizer->screen);
+    free(rasterizer->pixels);
+    free_color_grade_lut(&rasterizer->color_grade);
+    memset(rasterizer, 0, sizeof(SoftRasterizer));
+}
\ No newline at end of file
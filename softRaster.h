@@ -0,0 +1,87 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <stdint.h>
+#include "colorGrade.h"
+#include "mesh.h"
+#include "shading.h"
+
+// The screen is cut into square tiles, each rasterized by one task with
+// its color and depth in a local buffer
+#define SOFT_TILE_SIZE 64
+
+// Triangles binned per task. Bins of earlier chunks are drawn first, so
+// triangles keep the index buffer order within every tile like on a GPU.
+#define SOFT_BIN_CHUNK 16384
+
+// Same clear color as the render loop
+#define SOFT_CLEAR_R 0.2f
+#define SOFT_CLEAR_G 0.3f
+#define SOFT_CLEAR_B 0.3f
+
+// Four lanes, one per pixel of a row, with the GCC and Clang vector
+// extension so the same code becomes SSE on x86 and NEON on ARM
+typedef float SoftFloat4 __attribute__((vector_size(16)));
+typedef int SoftInt4 __attribute__((vector_size(16)));
+
+// What a frame draws: interleaved GPU_VERTEX_FLOATS vertices and
+// triangles, as uploaded to the GPU. With ranges, each range is shaded
+// with materials[range.material], triangles outside of them and meshes
+// without ranges with vertex_color_parameters.
+typedef struct
+{
+    const float *vertices;
+    int vertex_count;
+    const unsigned int *indices;
+    int index_count;
+    const MaterialRange *ranges;
+    int range_count;
+    const MaterialParameters *materials;
+    int material_count;
+} SoftMesh;
+
+// Per chunk of triangles, the triangles touching each tile
+typedef struct
+{
+    int *offsets; // tile_count + 1 entries into triangles
+    int *triangles;
+    int capacity;
+} SoftBin;
+
+typedef struct
+{
+    int width;
+    int height;
+    int thread_count;
+    uint8_t *pixels; // RGB, top row first
+
+    int tiles_x;
+    int tiles_y;
+
+    // Reused from frame to frame, grown as meshes need
+    float *screen; // Per vertex x, y in pixels, depth, rotated normal
+    int screen_capacity;
+    SoftBin *bins;
+    int bin_capacity;
+    ColorGradeLut color_grade; // Rebuilt when the grading parameters change
+} SoftRasterizer;
+
+// thread_count 0 uses one thread per core
+void init_soft_rasterizer(SoftRasterizer *rasterizer, int width, int height, int thread_count);
+
+// Clears and draws one frame the way vertexShader.glsl and
+// fragmentShader.glsl do: with shader_transforms at time, depth tested with
+// GL_LESS and blended by the material's d
+void soft_draw(SoftRasterizer *rasterizer, const SoftMesh *mesh, const GlobalParameters *parameters, float time);
+
+// Binary PPM. Returns 0 if the file can't be written.
+int write_soft_framebuffer(const SoftRasterizer *rasterizer, const char *filename);
+
+// Draws frame_count frames at width x height with 1, 2, 4... threads up to
+// one per core and prints milliseconds per frame, frames and millions of
+// triangles per second for each
+void benchmark_soft_raster(const SoftMesh *mesh, const GlobalParameters *parameters, int width, int height, int frame_count);
+
+void free_soft_rasterizer(SoftRasterizer *rasterizer);
+
+#endif // SOFT_RASTER_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "threads.h"
+
+typedef struct
+{
+    ParallelTask task;
+    void *context;
+    int taskCount;
+    int nextTask;
+} ParallelJob;
+
+int getCpuCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+static void *parallelWorker(void *argument)
+{
+    ParallelJob *job = (ParallelJob *)argument;
+
+    for (;;)
+    {
+        int taskIndex = __atomic_fetch_add(&job->nextTask, 1, __ATOMIC_RELAXED);
+        if (taskIndex >= job->taskCount)
+        {
+            break;
+        }
+        job->task(job->context, taskIndex);
+    }
+
+    return NULL;
+}
+
+void runParallel(int taskCount, int threadCount, ParallelTask task, void *context)
+{
+    ParallelJob job = {task, context, taskCount, 0};
+
+    if (threadCount > taskCount)
+    {
+        threadCount = taskCount;
+    }
+    if (threadCount <= 1)
+    {
+        parallelWorker(&job);
+        return;
+    }
+
+    pthread_t *threads = malloc((threadCount - 1) * sizeof(pthread_t));
+    int started = 0;
+    if (threads)
+    {
+        for (; started < threadCount - 1; started++)
+        {
+            if (pthread_create(&threads[started], NULL, parallelWorker, &job) != 0)
+            {
+                // Whatever threads did start, plus this one, still drain the job
+                fprintf(stderr, "Failed to create worker thread, continuing with %d\n", started + 1);
+                break;
+            }
+        }
+    }
+
+    parallelWorker(&job);
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
\ No newline at end of file
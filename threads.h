@@ -0,0 +1,14 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+typedef void (*ParallelTask)(void *context, int taskIndex);
+
+// Number of online cores, at least 1
+int getCpuCount();
+
+// Runs task(context, i) for every i in [0, taskCount) on up to threadCount
+// threads and returns when all of them finished. Tasks are handed out
+// dynamically so uneven tasks still balance. The calling thread takes part.
+void runParallel(int taskCount, int threadCount, ParallelTask task, void *context);
+
+#endif // THREADS_H
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uniformBuffers.h"
+
+void bindUniformBlocks(GLuint program)
+{
+    // GLSL 3.30 has no binding layout qualifier, so it is set from here
+    GLuint globalIndex = glGetUniformBlockIndex(program, "GlobalParameters");
+    GLuint materialIndex = glGetUniformBlockIndex(program, "MaterialParameters");
+
+    if (globalIndex != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(program, globalIndex, GLOBAL_UNIFORM_BINDING);
+    }
+    if (materialIndex != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(program, materialIndex, MATERIAL_UNIFORM_BINDING);
+    }
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "correctedLut"), COLOR_GRADE_CORRECTED_UNIT);
+    glUniform1i(glGetUniformLocation(program, "gradedLut"), COLOR_GRADE_GRADED_UNIT);
+}
+
+void initGlobalUniforms(GlobalUniforms *uniforms)
+{
+    memset(uniforms, 0, sizeof(GlobalUniforms));
+    uniforms->dirty = 1;
+
+    glGenBuffers(1, &uniforms->buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, uniforms->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GlobalParameters), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, GLOBAL_UNIFORM_BINDING, uniforms->buffer);
+}
+
+void updateGlobalUniforms(GlobalUniforms *uniforms, const GlobalParameters *parameters)
+{
+    if (!uniforms->dirty && memcmp(&uniforms->uploaded, parameters, sizeof(GlobalParameters)) == 0)
+    {
+        return;
+    }
+
+    uniforms->uploaded = *parameters;
+    uniforms->dirty = 0;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, uniforms->buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GlobalParameters), parameters);
+}
+
+void initMaterialUniforms(MaterialUniforms *uniforms)
+{
+    memset(uniforms, 0, sizeof(MaterialUniforms));
+
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment = alignment > 0 ? alignment : 256;
+    uniforms->stride = ((GLsizeiptr)sizeof(MaterialParameters) + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &uniforms->buffer);
+    setMaterialUniforms(uniforms, NULL, 0);
+}
+
+void setMaterialUniforms(MaterialUniforms *uniforms, const Material *materials, int materialCount)
+{
+    unsigned char *blocks = realloc(uniforms->blocks, ((size_t)materialCount + 1) * (size_t)uniforms->stride);
+    if (!blocks)
+    {
+        perror("Failed to reallocate memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(blocks, 0, ((size_t)materialCount + 1) * (size_t)uniforms->stride);
+
+    for (int i = 0; i < materialCount; i++)
+    {
+        MaterialParameters parameters;
+        material_parameters(&materials[i], &parameters);
+        memcpy(&blocks[(size_t)i * (size_t)uniforms->stride], &parameters, sizeof(MaterialParameters));
+    }
+
+    MaterialParameters vertexColor;
+    vertex_color_parameters(&vertexColor);
+    memcpy(&blocks[(size_t)materialCount * (size_t)uniforms->stride], &vertexColor, sizeof(MaterialParameters));
+
+    uniforms->blocks = blocks;
+    uniforms->materialCount = materialCount;
+    uniforms->dirty = 1;
+}
+
+void updateMaterialUniforms(MaterialUniforms *uniforms)
+{
+    if (!uniforms->dirty)
+    {
+        return;
+    }
+    uniforms->dirty = 0;
+
+    // The table only changes with the materials, so it is replaced whole
+    glBindBuffer(GL_UNIFORM_BUFFER, uniforms->buffer);
+    glBufferData(GL_UNIFORM_BUFFER, ((GLsizeiptr)uniforms->materialCount + 1) * uniforms->stride, uniforms->blocks, GL_STATIC_DRAW);
+}
+
+void bindMaterialUniforms(const MaterialUniforms *uniforms, int material)
+{
+    int entry = material >= 0 && material < uniforms->materialCount ? material : uniforms->materialCount;
+    glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_UNIFORM_BINDING, uniforms->buffer, (GLintptr)entry * uniforms->stride, sizeof(MaterialParameters));
+}
+
+void initColorGradeTextures(ColorGradeTextures *textures)
+{
+    memset(textures, 0, sizeof(ColorGradeTextures));
+    init_color_grade_lut(&textures->lut, COLOR_GRADE_LUT_SIZE);
+
+    glGenTextures(2, textures->textures);
+    for (int i = 0; i < 2; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + (i == 0 ? COLOR_GRADE_CORRECTED_UNIT : COLOR_GRADE_GRADED_UNIT));
+        glBindTexture(GL_TEXTURE_3D, textures->textures[i]);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+double updateColorGradeTextures(ColorGradeTextures *textures, const GlobalParameters *parameters)
+{
+    if (!color_grade_lut_stale(&textures->lut, parameters))
+    {
+        return 0.0;
+    }
+
+    double milliseconds = build_color_grade_lut(&textures->lut, parameters, 0);
+
+    // Both stay bound to their units, nothing else uses 3D textures
+    int size = textures->lut.size;
+    const float *tables[2] = {textures->lut.corrected, textures->lut.graded};
+    for (int i = 0; i < 2; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + (i == 0 ? COLOR_GRADE_CORRECTED_UNIT : COLOR_GRADE_GRADED_UNIT));
+        glBindTexture(GL_TEXTURE_3D, textures->textures[i]);
+        if (textures->allocated)
+        {
+            glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, size, size, size, GL_RGB, GL_FLOAT, tables[i]);
+        }
+        else
+        {
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, size, size, size, 0, GL_RGB, GL_FLOAT, tables[i]);
+        }
+    }
+    glActiveTexture(GL_TEXTURE0);
+    textures->allocated = 1;
+
+    return milliseconds;
+}
+
+void freeGlobalUniforms(GlobalUniforms *uniforms)
+{
+    glDeleteBuffers(1, &uniforms->buffer);
+    memset(uniforms, 0, sizeof(GlobalUniforms));
+}
+
+void freeMaterialUniforms(MaterialUniforms *uniforms)
+{
+    glDeleteBuffers(1, &uniforms->buffer);
+    free(uniforms->blocks);
+    memset(uniforms, 0, sizeof(MaterialUniforms));
+}
+
+void freeColorGradeTextures(ColorGradeTextures *textures)
+{
+    glDeleteTextures(2, textures->textures);
+    free_color_grade_lut(&textures->lut);
+    memset(textures, 0, sizeof(ColorGradeTextures));
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef UNIFORM_BUFFERS_H
+#define UNIFORM_BUFFERS_H
+
+#include <GL/glew.h>
+#include "colorGrade.h"
+#include "loader.h"
+#include "shading.h"
+
+// Binding points of the blocks in fragmentShader.glsl
+#define GLOBAL_UNIFORM_BINDING 0
+#define MATERIAL_UNIFORM_BINDING 1
+
+// Texture units of the color grading lookups in fragmentShader.glsl
+#define COLOR_GRADE_CORRECTED_UNIT 0
+#define COLOR_GRADE_GRADED_UNIT 1
+
+// The global block with the values last uploaded, so an unchanged frame
+// costs a compare and no GL call
+typedef struct
+{
+    GLuint buffer;
+    GlobalParameters uploaded;
+    int dirty;
+} GlobalUniforms;
+
+// Every material's block in one buffer, each at a multiple of stride so it
+// can be bound with glBindBufferRange. The entry after the materials is
+// the vertex color material, for draws that aren't sorted by material.
+typedef struct
+{
+    GLuint buffer;
+    GLsizeiptr stride;
+    int materialCount;
+    unsigned char *blocks;
+    int dirty;
+} MaterialUniforms;
+
+// The color grading baked into two RGB16F 3D textures, rebuilt on the CPU
+// only when a grading parameter changes
+typedef struct
+{
+    GLuint textures[2]; // Corrected, graded
+    ColorGradeLut lut;
+    int allocated;
+} ColorGradeTextures;
+
+// Points the program's blocks at the binding points and its lookup
+// samplers at their units, once after linking. Leaves the program in use.
+void bindUniformBlocks(GLuint program);
+
+void initGlobalUniforms(GlobalUniforms *uniforms);
+
+// Uploads parameters if they differ from what the buffer holds
+void updateGlobalUniforms(GlobalUniforms *uniforms, const GlobalParameters *parameters);
+
+void initMaterialUniforms(MaterialUniforms *uniforms);
+
+// Fills the blocks from a material table; uploaded by the next update
+void setMaterialUniforms(MaterialUniforms *uniforms, const Material *materials, int materialCount);
+
+// Uploads the blocks if setMaterialUniforms changed them
+void updateMaterialUniforms(MaterialUniforms *uniforms);
+
+// Binds a material's block for the next draws, the vertex color material
+// for -1
+void bindMaterialUniforms(const MaterialUniforms *uniforms, int material);
+
+void initColorGradeTextures(ColorGradeTextures *textures);
+
+// Rebuilds and uploads the lookups if a parameter they bake changed.
+// Returns the milliseconds the rebuild took, 0 if there was none.
+double updateColorGradeTextures(ColorGradeTextures *textures, const GlobalParameters *parameters);
+
+void freeGlobalUniforms(GlobalUniforms *uniforms);
+void freeMaterialUniforms(MaterialUniforms *uniforms);
+void freeColorGradeTextures(ColorGradeTextures *textures);
+
+#endif // UNIFORM_BUFFERS_H
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include <GL/glew.h>
+#include <stddef.h>
+#include "upload.h"
+
+static void beginGpuUpload(void *context, int vertexCount, int indexCount)
+{
+    GpuUpload *upload = (GpuUpload *)context;
+    upload->vertexCount = vertexCount;
+    upload->indexCount = indexCount;
+
+    // Storage only, the data follows block by block
+    glBindBuffer(GL_ARRAY_BUFFER, upload->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCount * GPU_VERTEX_FLOATS * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCount * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+}
+
+static void uploadVertices(void *context, const float *vertices, int first, int count)
+{
+    GpuUpload *upload = (GpuUpload *)context;
+    glBindBuffer(GL_ARRAY_BUFFER, upload->vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)first * GPU_VERTEX_FLOATS * sizeof(GLfloat), (GLsizeiptr)count * GPU_VERTEX_FLOATS * sizeof(GLfloat), vertices);
+}
+
+static void uploadIndices(void *context, const unsigned int *indices, int first, int count)
+{
+    GpuUpload *upload = (GpuUpload *)context;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload->indexBuffer);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)first * sizeof(GLuint), (GLsizeiptr)count * sizeof(GLuint), indices);
+}
+
+MeshSink gpuUploadSink(GpuUpload *upload)
+{
+    MeshSink sink = {beginGpuUpload, uploadVertices, uploadIndices, upload};
+    return sink;
+}
+
+// GL is only ever driven from one thread, so the packing blocks are shared
+static PackedVertex packedVertexBlock[STAGING_BLOCK_VERTICES];
+static uint16_t packedIndexBlock[STAGING_BLOCK_INDICES];
+
+static void beginGpuPackedUpload(void *context, int vertexCount, int indexCount)
+{
+    GpuPackedUpload *upload = (GpuPackedUpload *)context;
+    upload->vertexCount = vertexCount;
+    upload->indexCount = indexCount;
+    upload->indexType = vertexCount <= PACKED_MAX_SHORT_INDEX_VERTICES ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    size_t indexSize = upload->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    glBindBuffer(GL_ARRAY_BUFFER, upload->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCount * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCount * indexSize, NULL, GL_STATIC_DRAW);
+}
+
+static void uploadPackedVertices(void *context, const float *vertices, int first, int count)
+{
+    GpuPackedUpload *upload = (GpuPackedUpload *)context;
+    pack_vertices(upload->packer, vertices, count, packedVertexBlock);
+
+    glBindBuffer(GL_ARRAY_BUFFER, upload->vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)first * sizeof(PackedVertex), (GLsizeiptr)count * sizeof(PackedVertex), packedVertexBlock);
+}
+
+static void uploadPackedIndices(void *context, const unsigned int *indices, int first, int count)
+{
+    GpuPackedUpload *upload = (GpuPackedUpload *)context;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload->indexBuffer);
+
+    if (upload->indexType == GL_UNSIGNED_SHORT)
+    {
+        pack_short_indices(indices, count, packedIndexBlock);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)first * sizeof(GLushort), (GLsizeiptr)count * sizeof(GLushort), packedIndexBlock);
+    }
+    else
+    {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)first * sizeof(GLuint), (GLsizeiptr)count * sizeof(GLuint), indices);
+    }
+}
+
+MeshSink gpuPackedUploadSink(GpuPackedUpload *upload)
+{
+    MeshSink sink = {beginGpuPackedUpload, uploadPackedVertices, uploadPackedIndices, upload};
+    return sink;
+}
+
+void setVertexAttributes()
+{
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, GPU_VERTEX_FLOATS * sizeof(GLfloat), (GLvoid *)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, GPU_VERTEX_FLOATS * sizeof(GLfloat), (GLvoid *)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, GPU_VERTEX_FLOATS * sizeof(GLfloat), (GLvoid *)(6 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(2);
+}
+
+void setPackedVertexAttributes()
+{
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid *)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+
+    // Integer attribute, the shader indexes the palette with it
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, sizeof(PackedVertex), (GLvoid *)offsetof(PackedVertex, color));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid *)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(2);
+}
+
+void setPackedVertexUniforms(GLuint program, const VertexPacker *packer)
+{
+    // Decode constants never change, set them once per program
+    glUseProgram(program);
+    glUniform3fv(glGetUniformLocation(program, "positionOffset"), 1, packer->position_offset);
+    glUniform3fv(glGetUniformLocation(program, "positionScale"), 1, packer->position_scale);
+    glUniform3fv(glGetUniformLocation(program, "palette"), packer->palette_count, &packer->palette[0][0]);
+}
\ No newline at end of file
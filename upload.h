@@ -0,0 +1,48 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <GL/glew.h>
+#include "mesh.h"
+#include "vertexPack.h"
+
+// Streams a mesh into a vertex and an index buffer. The buffers' storage
+// is allocated once at the final size with GL_STATIC_DRAW and filled a
+// staging block at a time, so no full copy of the mesh is ever held on
+// the CPU side. The VAO the index buffer belongs to must be bound.
+typedef struct
+{
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    int vertexCount;
+    int indexCount;
+} GpuUpload;
+
+MeshSink gpuUploadSink(GpuUpload *upload);
+
+// Same streaming upload, packing each staging block on the way. Indices go
+// up as GL_UNSIGNED_SHORT when the vertex count allows; indexType says
+// which after begin. packer must be initialized and outlive the upload.
+typedef struct
+{
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    int vertexCount;
+    int indexCount;
+    GLenum indexType;
+    VertexPacker *packer;
+} GpuPackedUpload;
+
+MeshSink gpuPackedUploadSink(GpuPackedUpload *upload);
+
+// Attribute pointers for the bound VAO and its array buffer, locations as
+// in vertexShader.glsl
+void setVertexAttributes();
+
+// Same for the packed layout and vertexShader.glsl with PACKED_VERTICES
+void setPackedVertexAttributes();
+
+// The packer's decode constants and palette for a program built with
+// PACKED_VERTICES. Leaves the program in use.
+void setPackedVertexUniforms(GLuint program, const VertexPacker *packer);
+
+#endif // UPLOAD_H
\ No newline at end of file
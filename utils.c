@@ -1,5 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 char *readShaderSource(const char *filename)
 {
@@ -23,4 +29,95 @@ char *readShaderSource(const char *filename)
     buffer[length] = '\0';
     fclose(file);
     return buffer;
+}
+
+const char *mapFile(const char *filename, size_t *size)
+{
+    static const char empty[1] = "";
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    *size = (size_t)info.st_size;
+    if (*size == 0)
+    {
+        // mmap refuses zero-length mappings, an empty file is still valid input
+        close(fd);
+        return empty;
+    }
+
+    void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // The loaders scan front to back exactly once
+    madvise(data, *size, MADV_SEQUENTIAL);
+    return (const char *)data;
+}
+
+void unmapFile(const char *data, size_t size)
+{
+    if (data && size > 0)
+    {
+        munmap((void *)data, size);
+    }
+}
+
+double getTimeSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+int getFileInfo(const char *filename, long long *size, long long *mtime)
+{
+    struct stat info;
+    if (stat(filename, &info) != 0)
+    {
+        return 0;
+    }
+    *size = (long long)info.st_size;
+    *mtime = (long long)info.st_mtime;
+    return 1;
+}
+
+unsigned long long hashBytes(const void *data, size_t size, unsigned long long hash)
+{
+    // FNV-1a, 64 bit
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+long getPeakMemoryKb()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    // Bytes on macOS, kilobytes everywhere else
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
 }
\ No newline at end of file
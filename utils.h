@@ -1,6 +1,28 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+
 char *readShaderSource(const char *filename);
 
+// Maps a whole file read-only. Returns NULL if it can't be opened, the
+// mapping is not NUL terminated so always scan up to data + size.
+const char *mapFile(const char *filename, size_t *size);
+
+void unmapFile(const char *data, size_t size);
+
+// Monotonic wall clock, for timing load and build stages
+double getTimeSeconds();
+
+// Size in bytes and modification time in seconds, 0 if the file is missing
+int getFileInfo(const char *filename, long long *size, long long *mtime);
+
+// Start with HASH_SEED, feed the previous result back in to hash several
+// buffers as one stream
+#define HASH_SEED 14695981039346656037ull
+unsigned long long hashBytes(const void *data, size_t size, unsigned long long hash);
+
+// Peak resident set size of the process so far
+long getPeakMemoryKb();
+
 #endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "vecMath.h"
+
+Vec3 vec3_normalize(Vec3 v)
+{
+    float length = sqrtf(vec3_dot(v, v));
+    return length > 0.0f ? v / length : v;
+}
+
+Mat4 mat4_identity()
+{
+    Mat4 m = {{{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}}};
+    return m;
+}
+
+// Column c of a times the lanes of v, one broadcast multiply add per column
+Vec4 mat4_transform(const Mat4 *m, Vec4 v)
+{
+    return m->columns[0] * v[0] + m->columns[1] * v[1] + m->columns[2] * v[2] + m->columns[3] * v[3];
+}
+
+Mat4 mat4_multiply(const Mat4 *a, const Mat4 *b)
+{
+    Mat4 result;
+    for (int c = 0; c < 4; c++)
+    {
+        result.columns[c] = mat4_transform(a, b->columns[c]);
+    }
+    return result;
+}
+
+Mat4 mat4_transpose(const Mat4 *m)
+{
+    Mat4 result;
+    for (int c = 0; c < 4; c++)
+    {
+        result.columns[c] = (VecFloat4){m->columns[0][c], m->columns[1][c], m->columns[2][c], m->columns[3][c]};
+    }
+    return result;
+}
+
+Mat4 mat4_inverse(const Mat4 *m)
+{
+    float a[16], inverse[16];
+    memcpy(a, m->columns, sizeof(a));
+
+    // Cofactors of every element, the transposed cofactor matrix over the
+    // determinant is the inverse
+    inverse[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+    inverse[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+    inverse[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+    inverse[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+    inverse[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+    inverse[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+    inverse[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+    inverse[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+    inverse[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+    inverse[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+    inverse[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+    inverse[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+    inverse[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+    inverse[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+    inverse[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+    inverse[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+    float determinant = a[0] * inverse[0] + a[1] * inverse[4] + a[2] * inverse[8] + a[3] * inverse[12];
+    if (determinant == 0.0f || !isfinite(determinant))
+    {
+        return mat4_identity();
+    }
+
+    Mat4 result;
+    memcpy(result.columns, inverse, sizeof(inverse));
+    for (int c = 0; c < 4; c++)
+    {
+        result.columns[c] /= determinant;
+    }
+    return result;
+}
+
+Mat4 mat4_translation(Vec3 offset)
+{
+    Mat4 m = mat4_identity();
+    m.columns[3] = (VecFloat4){offset[0], offset[1], offset[2], 1.0f};
+    return m;
+}
+
+Mat4 mat4_scale(Vec3 scale)
+{
+    Mat4 m = mat4_identity();
+    for (int c = 0; c < 3; c++)
+    {
+        m.columns[c][c] = scale[c];
+    }
+    return m;
+}
+
+Mat4 mat4_rotation(Vec3 axis, float angle)
+{
+    return mat4_from_quat(quat_from_axis_angle(axis, angle));
+}
+
+Mat4 mat4_look_at(Vec3 eye, Vec3 center, Vec3 up)
+{
+    Vec3 forward = vec3_normalize(center - eye);
+    Vec3 side = vec3_normalize(vec3_cross(forward, up));
+    Vec3 upward = vec3_cross(side, forward);
+
+    Mat4 m = {{{side[0], upward[0], -forward[0], 0.0f},
+               {side[1], upward[1], -forward[1], 0.0f},
+               {side[2], upward[2], -forward[2], 0.0f},
+               {-vec3_dot(side, eye), -vec3_dot(upward, eye), vec3_dot(forward, eye), 1.0f}}};
+    return m;
+}
+
+Mat4 mat4_perspective(float field_of_view, float aspect, float near, float far)
+{
+    float f = 1.0f / tanf(field_of_view * 0.5f);
+    Mat4 m = {{{f / aspect, 0.0f, 0.0f, 0.0f},
+               {0.0f, f, 0.0f, 0.0f},
+               {0.0f, 0.0f, (far + near) / (near - far), -1.0f},
+               {0.0f, 0.0f, 2.0f * far * near / (near - far), 0.0f}}};
+    return m;
+}
+
+Mat4 mat4_orthographic(float left, float right, float bottom, float top, float near, float far)
+{
+    Mat4 m = {{{2.0f / (right - left), 0.0f, 0.0f, 0.0f},
+               {0.0f, 2.0f / (top - bottom), 0.0f, 0.0f},
+               {0.0f, 0.0f, -2.0f / (far - near), 0.0f},
+               {-(right + left) / (right - left), -(top + bottom) / (top - bottom), -(far + near) / (far - near), 1.0f}}};
+    return m;
+}
+
+void mat4_normal_matrix(const Mat4 *m, float out[9])
+{
+    // With columns a, b, c the inverse transpose is (b x c, c x a, a x b)
+    // over the determinant a . (b x c), three SIMD cross products
+    Vec3 a = m->columns[0], b = m->columns[1], c = m->columns[2];
+    Vec3 bc = vec3_cross(b, c);
+    Vec3 ca = vec3_cross(c, a);
+    Vec3 ab = vec3_cross(a, b);
+
+    float determinant = vec3_dot(a, bc);
+    float scale = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+    bc *= scale;
+    ca *= scale;
+    ab *= scale;
+
+    for (int r = 0; r < 3; r++)
+    {
+        out[r] = bc[r];
+        out[3 + r] = ca[r];
+        out[6 + r] = ab[r];
+    }
+}
+
+Quat quat_from_axis_angle(Vec3 axis, float angle)
+{
+    float s = sinf(angle * 0.5f);
+    return (Quat){axis[0] * s, axis[1] * s, axis[2] * s, cosf(angle * 0.5f)};
+}
+
+Quat quat_multiply(Quat a, Quat b)
+{
+    // xyz: a.w b + b.w a + a x b, w: a.w b.w - a . b
+    Quat result = VEC_SHUFFLE(a, 3, 3, 3, 3) * b + VEC_SHUFFLE(b, 3, 3, 3, 3) * a + vec3_cross(a, b);
+    result[3] = a[3] * b[3] - vec3_dot(a, b);
+    return result;
+}
+
+Quat quat_normalize(Quat q)
+{
+    float length = sqrtf(vec4_dot(q, q));
+    return length > 0.0f ? q / length : (Quat){0.0f, 0.0f, 0.0f, 1.0f};
+}
+
+Vec3 quat_rotate(Quat q, Vec3 v)
+{
+    // v + 2 w (q x v) + 2 q x (q x v)
+    Vec3 t = vec3_cross(q, v) * 2.0f;
+    Vec3 result = v + VEC_SHUFFLE(q, 3, 3, 3, 3) * t + vec3_cross(q, t);
+    result[3] = v[3];
+    return result;
+}
+
+Mat4 mat4_from_quat(Quat q)
+{
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    Mat4 m = {{{1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f},
+               {2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f},
+               {2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f},
+               {0.0f, 0.0f, 0.0f, 1.0f}}};
+    return m;
+}
+
+// The plain loops the benchmark measures against, column major float[16]
+static void multiply_scalar(const float *a, const float *b, float *out)
+{
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+            {
+                sum += a[k * 4 + r] * b[c * 4 + k];
+            }
+            out[c * 4 + r] = sum;
+        }
+    }
+}
+
+static void transform_scalar(const float *m, const float *v, float *out)
+{
+    for (int r = 0; r < 4; r++)
+    {
+        out[r] = m[r] * v[0] + m[4 + r] * v[1] + m[8 + r] * v[2] + m[12 + r] * v[3];
+    }
+}
+
+static void normal_matrix_scalar(const float *m, float *out)
+{
+    // Inverse of the upper 3x3 by its adjugate, written out transposed
+    float a = m[0], b = m[4], c = m[8];
+    float d = m[1], e = m[5], f = m[9];
+    float g = m[2], h = m[6], i = m[10];
+    float determinant = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+    float scale = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+    out[0] = (e * i - f * h) * scale;
+    out[1] = -(b * i - c * h) * scale;
+    out[2] = (b * f - c * e) * scale;
+    out[3] = -(d * i - f * g) * scale;
+    out[4] = (a * i - c * g) * scale;
+    out[5] = -(a * f - c * d) * scale;
+    out[6] = (d * h - e * g) * scale;
+    out[7] = -(a * h - b * g) * scale;
+    out[8] = (a * e - b * d) * scale;
+}
+
+// Matrices and vectors the benchmark cycles through, so that no product
+// can be hoisted out of its loop
+#define MATH_BENCHMARK_INPUTS 256
+
+static volatile float benchmark_sink;
+
+static double nanoseconds_per(double start, int count)
+{
+    return (getTimeSeconds() - start) * 1e9 / (count > 0 ? count : 1);
+}
+
+static float lane_sum(VecFloat4 v)
+{
+    return v[0] + v[1] + v[2] + v[3];
+}
+
+void benchmark_vec_math(int iterations, int vertex_count)
+{
+    Mat4 *matrices = malloc(MATH_BENCHMARK_INPUTS * sizeof(Mat4));
+    Vec4 *vectors = malloc(MATH_BENCHMARK_INPUTS * sizeof(Vec4));
+    float *positions = malloc(((size_t)vertex_count + 1) * 3 * sizeof(float));
+    if (!matrices || !vectors || !positions)
+    {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+
+    Mat4 projection = mat4_perspective(0.8f, 1.5f, 0.5f, 100.0f);
+    for (int i = 0; i < MATH_BENCHMARK_INPUTS; i++)
+    {
+        Mat4 view = mat4_look_at(vec3((float)i, 2.0f, -24.0f), vec3(0.0f, 0.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+        Mat4 rotation = mat4_rotation(vec3_normalize(vec3(1.0f, (float)i, 2.0f)), 0.1f * i);
+        Mat4 viewProjection = mat4_multiply(&projection, &view);
+        matrices[i] = mat4_multiply(&viewProjection, &rotation);
+        vectors[i] = vec4((float)i, 1.0f, -2.0f, 1.0f);
+    }
+    const float(*scalarMatrices)[16] = (const float(*)[16])matrices;
+    const float(*scalarVectors)[4] = (const float(*)[4])vectors;
+    int mask = MATH_BENCHMARK_INPUTS - 1;
+
+    printf("Math over %d iterations, ns per call:\n", iterations);
+
+    VecFloat4 sum = {0.0f, 0.0f, 0.0f, 0.0f};
+    double start = getTimeSeconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        Mat4 product = mat4_multiply(&matrices[i & mask], &matrices[(i + 1) & mask]);
+        sum += product.columns[0] + product.columns[1] + product.columns[2] + product.columns[3];
+    }
+    double simd = nanoseconds_per(start, iterations);
+    float scalarSum = 0.0f;
+    start = getTimeSeconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        float product[16];
+        multiply_scalar(scalarMatrices[i & mask], scalarMatrices[(i + 1) & mask], product);
+        for (int k = 0; k < 16; k++)
+        {
+            scalarSum += product[k];
+        }
+    }
+    double scalar = nanoseconds_per(start, iterations);
+    printf("  mat4 multiply   SIMD %6.2f  scalar %6.2f  %.2fx\n", simd, scalar, scalar / simd);
+
+    start = getTimeSeconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        sum += mat4_transform(&matrices[i & mask], vectors[(i + 7) & mask]);
+    }
+    simd = nanoseconds_per(start, iterations);
+    start = getTimeSeconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        float transformed[4];
+        transform_scalar(scalarMatrices[i & mask], scalarVectors[(i + 7) & mask], transformed);
+        scalarSum += transformed[0] + transformed[1] + transformed[2] + transformed[3];
+    }
+    scalar = nanoseconds_per(start, iterations);
+    printf("  mat4 transform  SIMD %6.2f  scalar %6.2f  %.2fx\n", simd, scalar, scalar / simd);
+
+    float normal[9];
+    start = getTimeSeconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        mat4_normal_matrix(&matrices[i & mask], normal);
+        scalarSum += normal[0] + normal[4] + normal[8];
+    }
+    simd = nanoseconds_per(start, iterations);
+    start = getTimeSeconds();
+    for (int i = 0; i < iterations; i++)
+    {
+        normal_matrix_scalar(scalarMatrices[i & mask], normal);
+        scalarSum += normal[0] + normal[4] + normal[8];
+    }
+    scalar = nanoseconds_per(start, iterations);
+    printf("  normal matrix   SIMD %6.2f  scalar %6.2f  %.2fx\n", simd, scalar, scalar / simd);
+
+    // The vertex stage, before: vertexShader.glsl built the rotation, the
+    // model matrix product and inverse(model * rotation) for every vertex
+    for (int v = 0; v < vertex_count * 3; v++)
+    {
+        positions[v] = (float)(v % 19) - 9.0f;
+    }
+
+    float time = 0.7f;
+    start = getTimeSeconds();
+    for (int v = 0; v < vertex_count; v++)
+    {
+        const float *p = &positions[v * 3];
+        Mat4 rotation = mat4_rotation(vec3_normalize(vec3(0.0f, 1.0f, 0.0f)), time);
+        Mat4 model = mat4_identity();
+        Mat4 modelRotation = mat4_multiply(&model, &rotation);
+        Mat4 inverse = mat4_inverse(&modelRotation);
+        Mat4 inverseTranspose = mat4_transpose(&inverse);
+        sum += mat4_transform(&modelRotation, vec4(p[0], p[1], p[2], 10.0f));
+        sum += mat4_transform(&inverseTranspose, vec4(p[2], p[1], p[0], 0.0f));
+    }
+    double before = nanoseconds_per(start, vertex_count);
+
+    // After: matrices made once per frame, then only the transforms per
+    // vertex, as vertexShader.glsl does now
+    start = getTimeSeconds();
+    Mat4 model = mat4_rotation(vec3(0.0f, 1.0f, 0.0f), time);
+    Mat4 modelViewProjection = mat4_multiply(&matrices[0], &model);
+    mat4_normal_matrix(&model, normal);
+    Mat4 normalMatrix = {{{normal[0], normal[1], normal[2], 0.0f}, {normal[3], normal[4], normal[5], 0.0f}, {normal[6], normal[7], normal[8], 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}}};
+    for (int v = 0; v < vertex_count; v++)
+    {
+        const float *p = &positions[v * 3];
+        Vec4 position = vec4(p[0], p[1], p[2], 1.0f);
+        sum += mat4_transform(&model, position);
+        sum += mat4_transform(&modelViewProjection, position);
+        sum += mat4_transform(&normalMatrix, vec4(p[2], p[1], p[0], 0.0f));
+    }
+    double after = nanoseconds_per(start, vertex_count);
+    printf("  vertex stage    per vertex matrices %6.2f  per frame matrices %6.2f  %.2fx, over %d vertices\n", before, after, before / after, vertex_count);
+
+    benchmark_sink = lane_sum(sum) + scalarSum;
+    free(matrices);
+    free(vectors);
+    free(positions);
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#ifndef VEC_MATH_H
+#define VEC_MATH_H
+
+// Four float lanes with the GCC and Clang vector extension, SSE on x86 and
+// NEON on ARM. Every type below is built from them.
+typedef float VecFloat4 __attribute__((vector_size(16)));
+typedef int VecInt4 __attribute__((vector_size(16)));
+
+#if defined(__clang__)
+#define VEC_SHUFFLE(v, a, b, c, d) __builtin_shufflevector((v), (v), a, b, c, d)
+#else
+#define VEC_SHUFFLE(v, a, b, c, d) __builtin_shuffle((v), (VecInt4){a, b, c, d})
+#endif
+
+// w is carried along and ignored, so a Vec3 costs the same as a Vec4
+typedef VecFloat4 Vec3;
+typedef VecFloat4 Vec4;
+
+// x, y, z imaginary, w real
+typedef VecFloat4 Quat;
+
+// Column major like GL, columns[c][r]. Upload with transpose GL_FALSE.
+typedef struct
+{
+    VecFloat4 columns[4];
+} Mat4;
+
+static inline Vec3 vec3(float x, float y, float z)
+{
+    return (Vec3){x, y, z, 0.0f};
+}
+
+static inline Vec4 vec4(float x, float y, float z, float w)
+{
+    return (Vec4){x, y, z, w};
+}
+
+static inline float vec3_dot(Vec3 a, Vec3 b)
+{
+    Vec3 product = a * b;
+    return product[0] + product[1] + product[2];
+}
+
+static inline float vec4_dot(Vec4 a, Vec4 b)
+{
+    Vec4 product = a * b;
+    return product[0] + product[1] + product[2] + product[3];
+}
+
+// w comes out 0
+static inline Vec3 vec3_cross(Vec3 a, Vec3 b)
+{
+    Vec3 yzx = VEC_SHUFFLE(a, 1, 2, 0, 3) * VEC_SHUFFLE(b, 2, 0, 1, 3);
+    Vec3 zxy = VEC_SHUFFLE(a, 2, 0, 1, 3) * VEC_SHUFFLE(b, 1, 2, 0, 3);
+    return yzx - zxy;
+}
+
+// Zero stays zero
+Vec3 vec3_normalize(Vec3 v);
+
+Mat4 mat4_identity();
+
+Mat4 mat4_multiply(const Mat4 *a, const Mat4 *b);
+
+Vec4 mat4_transform(const Mat4 *m, Vec4 v);
+
+Mat4 mat4_transpose(const Mat4 *m);
+
+// General inverse by cofactors. A singular matrix comes back as identity.
+Mat4 mat4_inverse(const Mat4 *m);
+
+Mat4 mat4_translation(Vec3 offset);
+
+Mat4 mat4_scale(Vec3 scale);
+
+// Right handed, counterclockwise looking down the axis. The axis must be
+// unit length.
+Mat4 mat4_rotation(Vec3 axis, float angle);
+
+// Right handed camera at eye looking at center, like gluLookAt
+Mat4 mat4_look_at(Vec3 eye, Vec3 center, Vec3 up);
+
+// Vertical field of view in radians, depth mapped to -1..1 like
+// gluPerspective
+Mat4 mat4_perspective(float field_of_view, float aspect, float near, float far);
+
+Mat4 mat4_orthographic(float left, float right, float bottom, float top, float near, float far);
+
+// Inverse transpose of the upper 3x3, column major for glUniformMatrix3fv.
+// Keeps normals perpendicular under non uniform scale.
+void mat4_normal_matrix(const Mat4 *m, float out[9]);
+
+// The axis must be unit length
+Quat quat_from_axis_angle(Vec3 axis, float angle);
+
+// a after b
+Quat quat_multiply(Quat a, Quat b);
+
+Quat quat_normalize(Quat q);
+
+Vec3 quat_rotate(Quat q, Vec3 v);
+
+// The rotation of a unit quaternion
+Mat4 mat4_from_quat(Quat q);
+
+// Times the SIMD matrix code against plain scalar loops, and the per
+// vertex work of the old vertex shader (rotation matrix, inverse and
+// transpose per vertex) against transforming with matrices made once per
+// frame, over vertex_count vertices. Prints nanoseconds per call.
+void benchmark_vec_math(int iterations, int vertex_count);
+
+#endif // VEC_MATH_H
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "vertexPack.h"
+
+void compute_position_bounds(const float *positions, int count, int stride, float min[3], float max[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = count > 0 ? FLT_MAX : 0.0f;
+        max[i] = count > 0 ? -FLT_MAX : 0.0f;
+    }
+
+    for (int v = 0; v < count; v++)
+    {
+        const float *position = &positions[(size_t)v * stride];
+        for (int i = 0; i < 3; i++)
+        {
+            min[i] = position[i] < min[i] ? position[i] : min[i];
+            max[i] = position[i] > max[i] ? position[i] : max[i];
+        }
+    }
+}
+
+static int find_palette_color(const VertexPacker *packer, const float color[3])
+{
+    for (int i = 0; i < packer->palette_count; i++)
+    {
+        if (memcmp(packer->palette[i], color, 3 * sizeof(float)) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int add_palette_color(VertexPacker *packer, const float color[3])
+{
+    int index = find_palette_color(packer, color);
+    if (index < 0 && packer->palette_count < PACKED_MAX_COLORS)
+    {
+        index = packer->palette_count++;
+        memcpy(packer->palette[index], color, 3 * sizeof(float));
+    }
+    return index;
+}
+
+int init_vertex_packer(VertexPacker *packer, const float min[3], const float max[3], const Material *materials, int material_count)
+{
+    memset(packer, 0, sizeof(VertexPacker));
+
+    for (int i = 0; i < 3; i++)
+    {
+        packer->position_offset[i] = min[i];
+        packer->position_scale[i] = max[i] - min[i];
+    }
+
+    // Faces before any usemtl get a zeroed color, give it the first slot
+    const float black[3] = {0.0f, 0.0f, 0.0f};
+    add_palette_color(packer, black);
+
+    for (int m = 0; m < material_count; m++)
+    {
+        if (add_palette_color(packer, materials[m].Kd) < 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static float clamp_unit(float value, float low)
+{
+    return value < low ? low : (value > 1.0f ? 1.0f : value);
+}
+
+static void encode_octahedral(const float normal[3], int16_t encoded[2])
+{
+    // Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower
+    // half over the diagonals of the upper one
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (length == 0.0f)
+    {
+        encoded[0] = 0;
+        encoded[1] = 0;
+        return;
+    }
+
+    float u = normal[0] / length;
+    float v = normal[1] / length;
+    if (normal[2] < 0.0f)
+    {
+        float folded_u = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float folded_v = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = folded_u;
+        v = folded_v;
+    }
+
+    encoded[0] = (int16_t)lrintf(clamp_unit(u, -1.0f) * 32767.0f);
+    encoded[1] = (int16_t)lrintf(clamp_unit(v, -1.0f) * 32767.0f);
+}
+
+void decode_octahedral(const int16_t encoded[2], float normal[3])
+{
+    // Signed normalized fetch as GL does it, then unfold
+    float x = encoded[0] / 32767.0f < -1.0f ? -1.0f : encoded[0] / 32767.0f;
+    float y = encoded[1] / 32767.0f < -1.0f ? -1.0f : encoded[1] / 32767.0f;
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = z < 0.0f ? -z : 0.0f;
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+
+    float length = sqrtf(x * x + y * y + z * z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+void pack_vertices(VertexPacker *packer, const float *vertices, int count, PackedVertex *out)
+{
+    for (int v = 0; v < count; v++)
+    {
+        const float *in = &vertices[(size_t)v * GPU_VERTEX_FLOATS];
+        PackedVertex *packed = &out[v];
+
+        double position_error = 0.0;
+        for (int i = 0; i < 3; i++)
+        {
+            float scale = packer->position_scale[i];
+            float unit = scale > 0.0f ? (in[i] - packer->position_offset[i]) / scale : 0.0f;
+            packed->position[i] = (uint16_t)lrintf(clamp_unit(unit, 0.0f) * 65535.0f);
+
+            double decoded = packer->position_offset[i] + packed->position[i] / 65535.0 * scale;
+            position_error += (decoded - in[i]) * (decoded - in[i]);
+        }
+        position_error = sqrt(position_error);
+
+        const float *color = &in[3];
+        if (packer->last_color >= packer->palette_count || memcmp(packer->palette[packer->last_color], color, 3 * sizeof(float)) != 0)
+        {
+            int index = add_palette_color(packer, color);
+            if (index < 0)
+            {
+                packer->palette_overflows++;
+                index = 0;
+            }
+            packer->last_color = index;
+        }
+        packed->color = (uint16_t)packer->last_color;
+
+        const float *normal = &in[6];
+        encode_octahedral(normal, packed->normal);
+
+        // Vertices without a normal have nothing to compare against
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length > 0.0f)
+        {
+            float decoded[3];
+            decode_octahedral(packed->normal, decoded);
+
+            double cosine = (decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2]) / length;
+            double angle = acos(cosine > 1.0 ? 1.0 : (cosine < -1.0 ? -1.0 : cosine)) * 180.0 / M_PI;
+
+            packer->normal_error_max = angle > packer->normal_error_max ? angle : packer->normal_error_max;
+            packer->normal_error_sum += angle;
+            packer->normal_samples++;
+        }
+
+        packer->position_error_max = position_error > packer->position_error_max ? position_error : packer->position_error_max;
+        packer->position_error_sum += position_error;
+        packer->position_samples++;
+    }
+}
+
+void pack_short_indices(const unsigned int *indices, int count, uint16_t *out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = (uint16_t)indices[i];
+    }
+}
+
+void print_packing_error(const VertexPacker *packer)
+{
+    double position_samples = packer->position_samples > 0 ? (double)packer->position_samples : 1.0;
+    double normal_samples = packer->normal_samples > 0 ? (double)packer->normal_samples : 1.0;
+    double diagonal = sqrt(packer->position_scale[0] * packer->position_scale[0] + packer->position_scale[1] * packer->position_scale[1] + packer->position_scale[2] * packer->position_scale[2]);
+
+    printf("Position error max %.3g mean %.3g (%.2g of the bounds diagonal)\n", packer->position_error_max, packer->position_error_sum / position_samples, diagonal > 0.0 ? packer->position_error_max / diagonal : 0.0);
+    printf("Normal error max %.4f mean %.4f degrees\n", packer->normal_error_max, packer->normal_error_sum / normal_samples);
+    printf("Color palette %d entries", packer->palette_count);
+    if (packer->palette_overflows > 0)
+    {
+        printf(", %d vertices over the limit", packer->palette_overflows);
+    }
+    printf("\n");
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef VERTEX_PACK_H
+#define VERTEX_PACK_H
+
+#include <stdint.h>
+#include "loader.h"
+#include "mesh.h"
+
+// Distinct diffuse colors a packed mesh can index. The palette is a uniform
+// array in vertexShader.glsl with PACKED_VERTICES, keep the two in sync.
+#define PACKED_MAX_COLORS 128
+
+// Indices fit in 16 bits up to this many vertices
+#define PACKED_MAX_SHORT_INDEX_VERTICES 65536
+
+// 12 bytes against the 36 of the float layout
+typedef struct
+{
+    uint16_t position[3]; // Unsigned normalized against the mesh bounds
+    uint16_t color;       // Index into the diffuse color palette
+    int16_t normal[2];    // Octahedral, signed normalized
+} PackedVertex;
+
+// Everything needed to pack vertices and to decode them again in the
+// shader, plus the error the packing introduced so far
+typedef struct
+{
+    float position_offset[3]; // Bounds minimum
+    float position_scale[3];  // Bounds extent, 0 on flat axes
+
+    float palette[PACKED_MAX_COLORS][3];
+    int palette_count;
+    int palette_overflows; // Vertices whose color didn't fit, drawn with entry 0
+    int last_color;        // Vertices arrive in runs of one material
+
+    double position_error_max; // Model units
+    double position_error_sum;
+    double normal_error_max; // Degrees
+    double normal_error_sum;
+    long long position_samples;
+    long long normal_samples;
+} VertexPacker;
+
+// Bounds of count positions spaced stride floats apart, so both the OBJ
+// positions and the interleaved GPU vertices can be measured
+void compute_position_bounds(const float *positions, int count, int stride, float min[3], float max[3]);
+
+// Sets up quantization for the given bounds and seeds the palette with the
+// distinct Kd colors of the material table. Returns 0 when the materials
+// need more than PACKED_MAX_COLORS entries and the mesh should stay in the
+// float layout.
+int init_vertex_packer(VertexPacker *packer, const float min[3], const float max[3], const Material *materials, int material_count);
+
+// Converts count interleaved GPU_VERTEX_FLOATS vertices and accumulates the
+// round trip error
+void pack_vertices(VertexPacker *packer, const float *vertices, int count, PackedVertex *out);
+
+void pack_short_indices(const unsigned int *indices, int count, uint16_t *out);
+
+// Same decode the shader does, used for the error report
+void decode_octahedral(const int16_t encoded[2], float normal[3]);
+
+void print_packing_error(const VertexPacker *packer);
+
+#endif // VERTEX_PACK_H
\ No newline at end of file
@@ -1,35 +1,74 @@
 #version 330 core
 
+// Permutations from shaderManager.h, defined ahead of this source:
+// PACKED_VERTICES reads PackedVertex from vertexPack.h instead of floats
+// INSTANCED places each instance with instances.h's per instance rows
+
+#ifdef PACKED_VERTICES
+layout(location = 0) in vec3 quantizedPosition; // 16 bit, 0..1 across the mesh bounds
+layout(location = 1) in uint colorIndex;
+layout(location = 2) in vec2 octahedralNormal; // 16 bit, -1..1
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec3 palette[128]; // PACKED_MAX_COLORS
+#else
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 vertexColor;
 layout(location = 2) in vec3 normal;
+#endif
+
+#ifdef INSTANCED
+// The first three rows of the instance's affine transform, then its tint
+layout(location = 3) in vec4 instanceRow0;
+layout(location = 4) in vec4 instanceRow1;
+layout(location = 5) in vec4 instanceRow2;
+layout(location = 6) in vec4 instanceTint;
+
+out vec4 tint;
+#endif
 
 out vec3 color;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform float time;
+// ShaderTransforms in shading.h, made once per frame on the CPU
+uniform mat4 model;
+uniform mat4 viewProjection;
+uniform mat3 normalMatrix;
 
-mat4 model = mat4(1.0);
-
-mat4 rotationMatrix(vec3 axis, float angle) {
-    axis = normalize(axis);
-    float s = sin(angle);
-    float c = cos(angle);
-    float oc = 1.0 - c;
-
-    return mat4(oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
-                oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
-                oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
-                0.0,                                0.0,                                0.0,                                1.0);
+#ifdef PACKED_VERTICES
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
 }
+#endif
 
 void main() {
-    mat4 rotation = rotationMatrix(vec3(0.0, 1.0, 0.0), time);
-    vec4 worldPosition = model * rotation * vec4(position, 10.0);
-    gl_Position = worldPosition;
+#ifdef PACKED_VERTICES
+    vec3 position = positionOffset + quantizedPosition * positionScale;
+    vec3 normal = decodeOctahedral(octahedralNormal);
+    vec3 vertexColor = palette[colorIndex];
+#endif
+
+#ifdef INSTANCED
+    // Rotation and uniform scale, so the rows also carry the normal
+    vec4 local = vec4(position, 1.0);
+    vec3 placed = vec3(dot(instanceRow0, local), dot(instanceRow1, local), dot(instanceRow2, local));
+    vec3 placedNormal = vec3(dot(instanceRow0.xyz, normal), dot(instanceRow1.xyz, normal), dot(instanceRow2.xyz, normal));
+    tint = instanceTint;
+#else
+    vec3 placed = position;
+    vec3 placedNormal = normal;
+#endif
+
+    vec4 worldPosition = model * vec4(placed, 1.0);
+    gl_Position = viewProjection * worldPosition;
 
     color = vertexColor;
-    Normal = mat3(transpose(inverse(model * rotation))) * normal; // Transforming normal
+    Normal = normalMatrix * placedNormal; // Transforming normal
     FragPos = vec3(worldPosition); // World space position
 }